@@ -0,0 +1,960 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Batch.cpp - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "Internet.h"
+#include "XmlParser.h"
+#include "CsvParser.h"
+#include "Tmx.h"
+#include "Dedimania.h"
+#include "Batch.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Constants
+
+#define BATCH_MAX_LISTSIZE  67108864 // Largest accepted UID list
+#define BATCH_MAX_DATASIZE  524288   // Largest response (MX replay list)
+#define BATCH_MAX_THREADS   8        // Number of maps that are looked up at the same time
+#define BATCH_MAX_RETRIES   3        // Retries of a failed request after 1, 2 and 4 seconds
+#define BATCH_MAX_HOSTS     16
+#define BATCH_HOST_INTERVAL 250      // Minimum time between two requests to an exchange site in ms
+#define BATCH_DEDI_INTERVAL 1000     // Minimum time between two requests to Dedimania in ms
+#define BATCH_TMX_MAXAGE    86400    // Exchange data is cached for one day
+#define BATCH_DEDI_MAXAGE   3600     // Records are cached for one hour
+#define BATCH_PROGRESS_TIME 500      // Update interval of the progress display in ms
+
+#ifndef HTTP_STATUS_TOO_MANY_REQUESTS
+#define HTTP_STATUS_TOO_MANY_REQUESTS 429
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// Map read from the UID list
+typedef struct _BATCH_MAP
+{
+	char	szUid[UID_LENGTH];
+	char	szEnvi[ENVI_LENGTH];
+	BOOL	bDone;			// Set if the map is already listed in the result file
+} BATCH_MAP, *PBATCH_MAP;
+
+// Information collected for a map
+typedef struct _BATCH_RESULT
+{
+	int		nGame;			// Game of the exchange site that knows the map, 0 if none
+	int		nTrackId;		// Track ID on the exchange site
+	int		nAwards;		// Number of awards on the exchange site
+	int		nReplays;		// Number of replays on the exchange site
+	int		nReplayTime;	// Time of the best replay
+	int		nDediRecords;	// Number of Dedimania records
+	int		nDediTime;		// Time of the best Dedimania record
+} BATCH_RESULT, *PBATCH_RESULT;
+
+// Request schedule of a host
+typedef struct _HOST_SLOT
+{
+	TCHAR	szHost[64];
+	DWORD	dwNextTick;		// Earliest time of the next request
+} HOST_SLOT, *PHOST_SLOT;
+
+// State shared by the worker threads of a batch run
+typedef struct _BATCH_JOB
+{
+	PBATCH_MAP		pMaps;		// Maps sorted by UID
+	LONG			lCount;		// Number of maps
+	volatile LONG	lNext;		// Index of the next map to be processed
+	volatile LONG	lActive;	// Number of running worker threads
+	volatile LONG	lDone;		// Number of processed maps, including those of previous runs
+	volatile LONG	lFound;		// Number of maps known by an exchange site
+	volatile LONG	lFailed;	// Number of maps whose requests failed
+	HANDLE			hFinished;	// Signaled when the last worker thread has finished
+	HANDLE			hOutput;	// Result file, which is also the checkpoint of the run
+	CRITICAL_SECTION cs;		// Synchronizes writing to the result file
+	HOST_SLOT		aHostSlots[BATCH_MAX_HOSTS]; // Request schedules of the hosts
+	int				nHostSlots;	// Number of hosts requested so far
+	CRITICAL_SECTION csHostSlots; // Synchronizes the access to the request schedules
+	HWND			hwndEdit;	// Output window that shows the progress line
+	int				nProgress;	// Start of the progress line in the output window
+} BATCH_JOB, *PBATCH_JOB;
+
+// Replay list of an MX map that is counted while it is being received
+typedef struct _REPLAY_COUNTER
+{
+	XML_PARSER	parser;
+	int			nReplays;		// Number of Replay elements
+	int			nReplayTime;	// Time of the first replay
+	BOOL		bInReplayTime;	// Set within the ReplayTime element of the first replay
+} REPLAY_COUNTER, *PREPLAY_COUNTER;
+
+// Dedimania record list that is counted while it is being received
+typedef struct _DEDI_COUNTER
+{
+	CSV_PARSER	parser;
+	BOOL		bTrackFound;	// Set if the track info line has several fields
+	int			nRecords;		// Number of records
+	int			nBestTime;		// Time of the first record
+} DEDI_COUNTER, *PDEDI_COUNTER;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward declarations of functions included in this code module
+
+// Reads the map UIDs and environments of a list, sorted by UID and without duplicates
+static BOOL ReadUidList(LPCTSTR lpszFileName, PBATCH_MAP* ppMaps, PLONG plCount);
+// Opens the result file and marks the maps that it already contains as done
+static HANDLE OpenResultFile(LPCTSTR lpszFileName, PBATCH_MAP pMaps, LONG lCount);
+// Compares the UIDs of two maps for qsort and bsearch
+static int __cdecl CompareMaps(const void* pElem1, const void* pElem2);
+// Thread function that looks up maps until the list is processed or the run is cancelled
+static unsigned __stdcall BatchThreadProc(LPVOID lpParameter);
+// Replaces the progress line of a batch run while waiting for the worker threads
+static void CALLBACK OutputBatchProgress(LPVOID lpParam);
+// Collects the exchange and Dedimania data of a map
+static BOOL LookupMap(PBATCH_JOB pJob, const PBATCH_MAP pMap, PBATCH_RESULT pResult, LPSTR lpszData, DWORD dwSize);
+// Requests data and retries temporary failures. Optionally, the data is passed to a receive function.
+static BOOL BatchRequest(PBATCH_JOB pJob, LPCTSTR lpszUrl, DWORD dwMaxAge, LPSTR lpszData, DWORD dwSize,
+	LPFNINTERNETRECEIVE lpfnReceive = NULL, LPVOID lpParam = NULL);
+// Receives a chunk of an MX replay list and counts the replays
+static BOOL CALLBACK CountReplays(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+// Receives a chunk of a Dedimania record list and counts the records
+static BOOL CALLBACK CountDediRecords(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+// Counts the records passed to the tokenizer so far
+static void CountDediLines(PDEDI_COUNTER pCounter);
+// HTTP transport of the batch requests that keeps the request rate of each host below its limit
+static BOOL CALLBACK ThrottledTransport(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszHeaders, LPINTERNET_RESPONSE lpResponse);
+// Reserves the next request slot of the host of a URL and returns the time to wait for it
+static DWORD ReserveHostSlot(PBATCH_JOB pJob, LPCTSTR lpszUrl);
+// Appends the result of a map to the result file
+static void WriteResult(PBATCH_JOB pJob, const PBATCH_MAP pMap, const PBATCH_RESULT pResult);
+// Returns the numeric value of a field in the first line of delimited text
+static int GetFieldInt(LPCSTR lpszText, char chDelimiter, int nField);
+// Returns the numeric value of the first occurrence of an XML element
+static int GetXmlInt(LPCSTR lpszXml, LPCSTR lpszElement);
+// Counts the occurrences of a string
+static int CountStrings(LPCSTR lpszText, LPCSTR lpszFind);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+
+static HANDLE g_hCancel = NULL; // Signaled to stop a running batch
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// String Constants
+
+const char g_szResultHeader[] = "UID\tEnvironment\tSite\tTrackID\tAwards\tReplays\tReplayTime\tDedimania\tDediTime\r\n";
+
+const TCHAR g_szBatch[]       = TEXT("Batch Lookup:\r\n");
+const TCHAR g_szBatchStart[]  = TEXT("Maps:\t\t%ld (%ld done in previous runs)\r\nResults:\t%s\r\nPress Esc to stop the run, it can be resumed later.\r\n");
+const TCHAR g_szBatchState[]  = TEXT("Processed:\t%ld/%ld, %ld found, %ld failed");
+const TCHAR g_szBatchStop[]   = TEXT("Stopped. Start the lookup again to continue the run.\r\n");
+const TCHAR g_szBatchFail[]   = TEXT("The requests for %ld maps failed. Start the lookup again to retry them.\r\n");
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL GetBatchFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen)
+{
+	if (lpszFileName == NULL || cchStringLen == 0)
+		return FALSE;
+
+	// Filter string
+	TCHAR szFilter[256] = {0};
+	LoadString(g_hInstance, g_bGerUI ? IDS_GER_FILTER_UID : IDS_ENG_FILTER_UID, szFilter, _countof(szFilter));
+	TCHAR* psz = szFilter;
+	while ((psz = _tcschr(psz, TEXT('|'))))
+		*psz++ = TEXT('\0');
+
+	TCHAR szFile[MY_OFN_MAX_PATH] = {0};
+	MyStrNCpy(szFile, lpszFileName, _countof(szFile));
+
+	OPENFILENAME of    = {0};
+	of.lStructSize     = sizeof(OPENFILENAME);
+	of.hwndOwner       = hDlg;
+	of.Flags           = OFN_HIDEREADONLY | OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+	of.lpstrFile       = szFile;
+	of.nMaxFile        = _countof(szFile);
+	of.lpstrFilter     = szFilter;
+	of.nFilterIndex    = 1;
+	of.lpstrDefExt     = TEXT("txt");
+
+	BOOL bRet = FALSE;
+
+	__try
+	{
+		bRet = GetOpenFileName(&of);
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
+
+	if (bRet)
+		MyStrNCpy(lpszFileName, szFile, (int)cchStringLen);
+
+	return bRet;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL BatchLookup(HWND hwndEdit, LPCTSTR lpszUidFile)
+{
+	// Only one run at a time
+	if (hwndEdit == NULL || lpszUidFile == NULL || g_hCancel != NULL)
+		return FALSE;
+
+	TCHAR szOutput[OUTPUT_LEN];
+	OutputText(hwndEdit, g_szBatch);
+	OutputText(hwndEdit, g_szSep1);
+
+	BATCH_JOB job;
+	ZeroMemory(&job, sizeof(BATCH_JOB));
+
+	if (!ReadUidList(lpszUidFile, &job.pMaps, &job.lCount))
+	{
+		OutputErrorMessage(hwndEdit, GetLastError());
+		return FALSE;
+	}
+
+	// The results are written next to the list
+	TCHAR szResultFile[MY_OFN_MAX_PATH];
+	_sntprintf(szResultFile, _countof(szResultFile), TEXT("%s.tsv"), lpszUidFile);
+	szResultFile[_countof(szResultFile)-1] = TEXT('\0');
+
+	job.hOutput = OpenResultFile(szResultFile, job.pMaps, job.lCount);
+	if (job.hOutput == INVALID_HANDLE_VALUE)
+	{
+		OutputErrorMessage(hwndEdit, GetLastError());
+		MyGlobalFreePtr((LPVOID)job.pMaps);
+		return FALSE;
+	}
+
+	for (LONG i = 0; i < job.lCount; i++)
+		if (job.pMaps[i].bDone)
+			job.lDone++;
+
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szBatchStart, job.lCount, job.lDone, szResultFile);
+
+	g_hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+	job.hFinished = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (g_hCancel == NULL || job.hFinished == NULL)
+	{
+		OutputErrorMessage(hwndEdit, GetLastError());
+		if (g_hCancel != NULL)
+			CloseHandle(g_hCancel);
+		if (job.hFinished != NULL)
+			CloseHandle(job.hFinished);
+		g_hCancel = NULL;
+		CloseHandle(job.hOutput);
+		MyGlobalFreePtr((LPVOID)job.pMaps);
+		return FALSE;
+	}
+
+	InitializeCriticalSection(&job.cs);
+	InitializeCriticalSection(&job.csHostSlots);
+
+	// Start the pool of worker threads
+	HANDLE ahThreads[BATCH_MAX_THREADS];
+	int nThreads = 0;
+
+	job.lActive = BATCH_MAX_THREADS;
+	for (int i = 0; i < BATCH_MAX_THREADS; i++)
+	{
+		HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, BatchThreadProc, &job, 0, NULL);
+		if (hThread != NULL)
+			ahThreads[nThreads++] = hThread;
+		else
+			InterlockedDecrement(&job.lActive);
+	}
+
+	if (nThreads == 0)
+	{ // Process the list in this thread instead
+		job.lActive = 1;
+		BatchThreadProc(&job);
+	}
+
+	// Keep the dialog box painted while waiting for the worker threads. User input is
+	// discarded, except for the Esc key, which stops the run.
+	job.hwndEdit = hwndEdit;
+	job.nProgress = Edit_GetTextLength(hwndEdit);
+	WaitForWorkerThreads(job.hFinished, g_hCancel, ahThreads, nThreads, BATCH_PROGRESS_TIME, OutputBatchProgress, &job);
+
+	OutputText(hwndEdit, TEXT("\r\n"));
+	if (WaitForSingleObject(g_hCancel, 0) == WAIT_OBJECT_0)
+		OutputText(hwndEdit, g_szBatchStop);
+	else if (job.lFailed > 0)
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szBatchFail, job.lFailed);
+	OutputText(hwndEdit, g_szSep2);
+
+	DeleteCriticalSection(&job.csHostSlots);
+	DeleteCriticalSection(&job.cs);
+	CloseHandle(job.hFinished);
+	CloseHandle(g_hCancel);
+	g_hCancel = NULL;
+	CloseHandle(job.hOutput);
+	MyGlobalFreePtr((LPVOID)job.pMaps);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL ReadUidList(LPCTSTR lpszFileName, PBATCH_MAP* ppMaps, PLONG plCount)
+{
+	if (lpszFileName == NULL || ppMaps == NULL || plCount == NULL)
+		return FALSE;
+
+	*ppMaps = NULL;
+	*plCount = 0;
+
+	HANDLE hFile = CreateFile(lpszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	DWORD dwSize = GetFileSize(hFile, NULL);
+	if (dwSize == INVALID_FILE_SIZE || dwSize > BATCH_MAX_LISTSIZE)
+	{
+		CloseHandle(hFile);
+		SetLastError(ERROR_FILE_TOO_LARGE);
+		return FALSE;
+	}
+
+	LPSTR lpszList = (LPSTR)MyGlobalAllocPtr(GHND, dwSize + 1);
+	if (lpszList == NULL)
+	{
+		CloseHandle(hFile);
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return FALSE;
+	}
+
+	DWORD dwRead = 0;
+	if (!ReadFile(hFile, lpszList, dwSize, &dwRead, NULL) || dwRead != dwSize)
+	{
+		DWORD dwError = GetLastError();
+		MyGlobalFreePtr((LPVOID)lpszList);
+		CloseHandle(hFile);
+		SetLastError(dwError != ERROR_SUCCESS ? dwError : ERROR_HANDLE_EOF);
+		return FALSE;
+	}
+
+	CloseHandle(hFile);
+
+	// Every line can hold a map
+	LONG lLines = 1;
+	for (LPCSTR lpsz = lpszList; *lpsz != '\0'; lpsz++)
+		if (*lpsz == '\n')
+			lLines++;
+
+	PBATCH_MAP pMaps = (PBATCH_MAP)MyGlobalAllocPtr(GHND, lLines * sizeof(BATCH_MAP));
+	if (pMaps == NULL)
+	{
+		MyGlobalFreePtr((LPVOID)lpszList);
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return FALSE;
+	}
+
+	// UID and optional environment, separated by tabs, commas, semicolons or spaces.
+	// Empty lines, comments (#) and the header of a result file are skipped.
+	const char szDelimiters[] = "\t,; \r";
+	LONG lCount = 0;
+	LPSTR lpsz = lpszList;
+	while (*lpsz != '\0')
+	{
+		LPSTR lpszLine = lpsz;
+		LPSTR lpszNewLine = strchr(lpsz, '\n');
+		if (lpszNewLine != NULL)
+		{
+			*lpszNewLine = '\0';
+			lpsz = lpszNewLine + 1;
+		}
+		else
+			lpsz += strlen(lpsz);
+
+		lpszLine += strspn(lpszLine, szDelimiters);
+		SIZE_T cchUid = strcspn(lpszLine, szDelimiters);
+		if (cchUid == 0 || cchUid >= UID_LENGTH || *lpszLine == '#')
+			continue;
+
+		LPSTR lpszEnvi = lpszLine + cchUid;
+		lpszEnvi += strspn(lpszEnvi, szDelimiters);
+		SIZE_T cchEnvi = strcspn(lpszEnvi, szDelimiters);
+
+		PBATCH_MAP pMap = &pMaps[lCount];
+		CopyMemory(pMap->szUid, lpszLine, cchUid);
+		pMap->szUid[cchUid] = '\0';
+		if (strcmp(pMap->szUid, "UID") == 0)
+			continue;
+
+		// Without environment, the map is looked up like a Stadium map on all sites
+		if (cchEnvi == 0 || cchEnvi >= ENVI_LENGTH)
+			strcpy(pMap->szEnvi, "Stadium");
+		else
+		{
+			CopyMemory(pMap->szEnvi, lpszEnvi, cchEnvi);
+			pMap->szEnvi[cchEnvi] = '\0';
+		}
+
+		lCount++;
+	}
+
+	MyGlobalFreePtr((LPVOID)lpszList);
+
+	// Sort the maps to find them quickly in the result file and remove duplicates
+	qsort(pMaps, lCount, sizeof(BATCH_MAP), CompareMaps);
+
+	LONG lUnique = 0;
+	for (LONG i = 0; i < lCount; i++)
+		if (lUnique == 0 || strcmp(pMaps[lUnique-1].szUid, pMaps[i].szUid) != 0)
+			pMaps[lUnique++] = pMaps[i];
+
+	*ppMaps = pMaps;
+	*plCount = lUnique;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static HANDLE OpenResultFile(LPCTSTR lpszFileName, PBATCH_MAP pMaps, LONG lCount)
+{
+	if (lpszFileName == NULL || (pMaps == NULL && lCount > 0))
+		return INVALID_HANDLE_VALUE;
+
+	HANDLE hFile = CreateFile(lpszFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return INVALID_HANDLE_VALUE;
+
+	DWORD dwSize = GetFileSize(hFile, NULL);
+	if (dwSize == INVALID_FILE_SIZE || dwSize > BATCH_MAX_LISTSIZE)
+	{
+		CloseHandle(hFile);
+		SetLastError(ERROR_FILE_TOO_LARGE);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	DWORD dwValid = 0;
+	if (dwSize > 0)
+	{
+		LPSTR lpszResults = (LPSTR)MyGlobalAllocPtr(GHND, dwSize + 1);
+		if (lpszResults == NULL)
+		{
+			CloseHandle(hFile);
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return INVALID_HANDLE_VALUE;
+		}
+
+		DWORD dwRead = 0;
+		if (!ReadFile(hFile, lpszResults, dwSize, &dwRead, NULL) || dwRead != dwSize)
+		{
+			DWORD dwError = GetLastError();
+			MyGlobalFreePtr((LPVOID)lpszResults);
+			CloseHandle(hFile);
+			SetLastError(dwError != ERROR_SUCCESS ? dwError : ERROR_HANDLE_EOF);
+			return INVALID_HANDLE_VALUE;
+		}
+
+		// An incomplete last line of an interrupted run is discarded
+		dwValid = dwSize;
+		while (dwValid > 0 && lpszResults[dwValid-1] != '\n')
+			dwValid--;
+		lpszResults[dwValid] = '\0';
+
+		// The first column of every line holds the UID of a processed map
+		BATCH_MAP key;
+		LPSTR lpsz = lpszResults;
+		while (*lpsz != '\0')
+		{
+			SIZE_T cchUid = strcspn(lpsz, "\t\r\n");
+			if (cchUid > 0 && cchUid < UID_LENGTH)
+			{
+				CopyMemory(key.szUid, lpsz, cchUid);
+				key.szUid[cchUid] = '\0';
+
+				PBATCH_MAP pMap = (PBATCH_MAP)bsearch(&key, pMaps, lCount, sizeof(BATCH_MAP), CompareMaps);
+				if (pMap != NULL)
+					pMap->bDone = TRUE;
+			}
+
+			LPSTR lpszNewLine = strchr(lpsz, '\n');
+			if (lpszNewLine == NULL)
+				break;
+			lpsz = lpszNewLine + 1;
+		}
+
+		MyGlobalFreePtr((LPVOID)lpszResults);
+	}
+
+	// Continue behind the last complete line
+	DWORD dwWritten = 0;
+	if (!FileSeekBegin(hFile, dwValid) || !SetEndOfFile(hFile) ||
+		(dwValid == 0 && !WriteFile(hFile, g_szResultHeader, sizeof(g_szResultHeader) - 1, &dwWritten, NULL)))
+	{
+		DWORD dwError = GetLastError();
+		CloseHandle(hFile);
+		SetLastError(dwError);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return hFile;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int __cdecl CompareMaps(const void* pElem1, const void* pElem2)
+{
+	return strcmp(((const BATCH_MAP*)pElem1)->szUid, ((const BATCH_MAP*)pElem2)->szUid);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static unsigned __stdcall BatchThreadProc(LPVOID lpParameter)
+{
+	PBATCH_JOB pJob = (PBATCH_JOB)lpParameter;
+	if (pJob == NULL)
+		return 1;
+
+	LPSTR lpszData = (LPSTR)MyGlobalAllocPtr(GHND, BATCH_MAX_DATASIZE);
+	if (lpszData != NULL)
+	{
+		LONG lIndex = 0;
+		while (WaitForSingleObject(g_hCancel, 0) == WAIT_TIMEOUT &&
+			(lIndex = InterlockedIncrement(&pJob->lNext) - 1) < pJob->lCount)
+		{
+			PBATCH_MAP pMap = &pJob->pMaps[lIndex];
+			if (pMap->bDone)
+				continue;
+
+			// Maps whose requests failed are not written, so that the next run retries them
+			BATCH_RESULT result;
+			if (LookupMap(pJob, pMap, &result, lpszData, BATCH_MAX_DATASIZE))
+			{
+				WriteResult(pJob, pMap, &result);
+				if (result.nGame != 0)
+					InterlockedIncrement(&pJob->lFound);
+			}
+			else if (WaitForSingleObject(g_hCancel, 0) == WAIT_TIMEOUT)
+				InterlockedIncrement(&pJob->lFailed);
+			else
+				break;
+
+			InterlockedIncrement(&pJob->lDone);
+		}
+
+		MyGlobalFreePtr((LPVOID)lpszData);
+	}
+
+	if (InterlockedDecrement(&pJob->lActive) == 0)
+		SetEvent(pJob->hFinished);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void CALLBACK OutputBatchProgress(LPVOID lpParam)
+{
+	PBATCH_JOB pJob = (PBATCH_JOB)lpParam;
+	TCHAR szOutput[OUTPUT_LEN];
+
+	// Replace the progress line
+	Edit_SetSel(pJob->hwndEdit, pJob->nProgress, Edit_GetTextLength(pJob->hwndEdit));
+	OutputTextFmt(pJob->hwndEdit, szOutput, _countof(szOutput), g_szBatchState,
+		pJob->lDone, pJob->lCount, pJob->lFound, pJob->lFailed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL LookupMap(PBATCH_JOB pJob, const PBATCH_MAP pMap, PBATCH_RESULT pResult, LPSTR lpszData, DWORD dwSize)
+{
+	if (pJob == NULL || pMap == NULL || pResult == NULL || lpszData == NULL)
+		return FALSE;
+
+	ZeroMemory(pResult, sizeof(BATCH_RESULT));
+
+	TCHAR szUrl[512];
+	char szTrackId[16];
+
+	// Query the exchange sites in the order of priority until one of them knows the map
+	int anGames[8];
+	int nGames = GetExchangeGames(pMap->szEnvi, anGames, _countof(anGames));
+	for (int i = 0; i < nGames && pResult->nGame == 0; i++)
+	{
+		int nGame = anGames[i];
+		LPCTSTR lpszSubDomain = GetSubDomain(nGame);
+		if (!GetLookupUrl(nGame, pMap->szUid, szUrl, _countof(szUrl)))
+			continue;
+		if (!BatchRequest(pJob, szUrl, BATCH_TMX_MAXAGE, lpszData, dwSize))
+			return FALSE;
+
+		if (IS_MX_GAME(nGame))
+		{
+			int nTrackId = GetMxTrackId(lpszData);
+			if (nTrackId == 0)
+				continue;
+
+			pResult->nGame = nGame;
+			pResult->nTrackId = nTrackId;
+			pResult->nAwards = GetXmlInt(lpszData, "AwardCount");
+
+			// Replay data is only available for TrackMania 2 and Trackmania 2020
+			if (nGame != GAME_TM2020 && nGame != GAME_TM2)
+				continue;
+
+			_sntprintf(szUrl, _countof(szUrl), nGame == GAME_TM2020 ? g_szUrlMxRepl : g_szUrlMpRepl,
+				g_szHttps, lpszSubDomain, nTrackId);
+			szUrl[_countof(szUrl)-1] = TEXT('\0');
+			// Replay lists can be larger than the buffer and are therefore parsed while being received
+			REPLAY_COUNTER counter;
+			ZeroMemory(&counter, sizeof(REPLAY_COUNTER));
+			XmlInitParser(&counter.parser);
+			BOOL bSuccess = BatchRequest(pJob, szUrl, BATCH_TMX_MAXAGE, lpszData, dwSize, CountReplays, &counter);
+			XmlFreeParser(&counter.parser);
+			if (!bSuccess)
+				return FALSE;
+
+			pResult->nReplays = counter.nReplays;
+			pResult->nReplayTime = counter.nReplayTime;
+		}
+		else
+		{
+			if (strchr(lpszData, '\t') == NULL || (pResult->nTrackId = GetFieldInt(lpszData, '\t', 1)) == 0)
+				continue;
+
+			pResult->nGame = nGame;
+			_snprintf(szTrackId, _countof(szTrackId), "%d", pResult->nTrackId);
+			szTrackId[_countof(szTrackId)-1] = '\0';
+
+			// The awards are part of the search result
+			_sntprintf(szUrl, _countof(szUrl), g_szUrlTmx, g_szHttp, lpszSubDomain, g_szParamSearch, szTrackId);
+			szUrl[_countof(szUrl)-1] = TEXT('\0');
+			if (!BatchRequest(pJob, szUrl, BATCH_TMX_MAXAGE, lpszData, dwSize))
+				return FALSE;
+
+			if (strchr(lpszData, '\t') != NULL)
+				pResult->nAwards = GetFieldInt(lpszData, '\t', 13);
+
+			// One line per replay, the best one first
+			_sntprintf(szUrl, _countof(szUrl), g_szUrlTmx, g_szHttp, lpszSubDomain, g_szParamRecord, szTrackId);
+			szUrl[_countof(szUrl)-1] = TEXT('\0');
+			if (!BatchRequest(pJob, szUrl, BATCH_TMX_MAXAGE, lpszData, dwSize))
+				return FALSE;
+
+			if (strchr(lpszData, '\t') != NULL)
+			{
+				pResult->nReplays = CountStrings(lpszData, "\r\n");
+				pResult->nReplayTime = GetFieldInt(lpszData, '\t', 4);
+			}
+		}
+	}
+
+	// Stadium maps can have records in both Dedimania systems
+	BOOL bIsTwice = FALSE;
+	BOOL bIsManiaPlanet = TRUE;
+	GetDediSystems(pMap->szEnvi, &bIsManiaPlanet, &bIsTwice);
+
+	for (int i = 0; i < (bIsTwice ? 2 : 1); i++, bIsManiaPlanet = !bIsManiaPlanet)
+	{
+		if (!GetDediUrl(pMap->szUid, bIsManiaPlanet, szUrl, _countof(szUrl)))
+			return FALSE;
+
+		DEDI_COUNTER counter;
+		ZeroMemory(&counter, sizeof(DEDI_COUNTER));
+		CsvInitParser(&counter.parser);
+		BOOL bSuccess = BatchRequest(pJob, szUrl, BATCH_DEDI_MAXAGE, lpszData, dwSize, CountDediRecords, &counter);
+		if (bSuccess)
+		{ // Count the last record, which may lack the line break
+			CsvFeed(&counter.parser, NULL, 0);
+			CountDediLines(&counter);
+		}
+		CsvFreeParser(&counter.parser);
+		if (!bSuccess)
+			return FALSE;
+
+		if (!counter.bTrackFound)
+			continue;
+
+		pResult->nDediRecords = counter.nRecords;
+		pResult->nDediTime = counter.nBestTime;
+		break;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL BatchRequest(PBATCH_JOB pJob, LPCTSTR lpszUrl, DWORD dwMaxAge, LPSTR lpszData, DWORD dwSize,
+	LPFNINTERNETRECEIVE lpfnReceive, LPVOID lpParam)
+{
+	if (pJob == NULL || lpszUrl == NULL || lpszData == NULL || dwSize == 0)
+		return FALSE;
+
+	for (int nRetry = 0; ; nRetry++)
+	{
+		INTERNET_REQUEST request;
+		if (!InitInternetRequest(&request, lpszUrl, lpszData, dwSize, dwMaxAge))
+			return FALSE;
+
+		if (lpfnReceive != NULL)
+		{
+			request.lpfnReceive = lpfnReceive;
+			request.lpParam = lpParam;
+		}
+
+		// Only requests that actually reach a server are throttled, cached responses are not.
+		// Requests outside the batch run keep using the global transport without delay.
+		request.lpfnTransport = ThrottledTransport;
+		request.lpTransportParam = pJob;
+
+		BOOL bSuccess = ExecuteInternetRequest(&request);
+		DWORD dwStatusCode = request.dwStatusCode;
+		DeleteInternetRequest(&request);
+
+		// Server errors and exceeded rate limits are temporary
+		if (bSuccess && dwStatusCode != HTTP_STATUS_TOO_MANY_REQUESTS && dwStatusCode < HTTP_STATUS_SERVER_ERROR)
+			return TRUE;
+
+		if (nRetry == BATCH_MAX_RETRIES || WaitForSingleObject(g_hCancel, 1000 << nRetry) != WAIT_TIMEOUT)
+			return FALSE;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK CountReplays(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PREPLAY_COUNTER pCounter = (PREPLAY_COUNTER)lpParam;
+	if (pCounter == NULL)
+		return FALSE;
+
+	if (lpData == NULL)
+	{ // The request is restarted
+		XmlFreeParser(&pCounter->parser);
+		ZeroMemory(pCounter, sizeof(REPLAY_COUNTER));
+		XmlInitParser(&pCounter->parser);
+		return TRUE;
+	}
+
+	XML_NODE node;
+	int nNodeType = XML_NODE_NONE;
+	XmlFeed(&pCounter->parser, lpData, cbData);
+	while ((nNodeType = XmlRead(&pCounter->parser, &node)) != XML_NODE_NONE)
+	{
+		if (nNodeType == XML_NODE_ERROR)
+			return FALSE;
+
+		if (nNodeType == XML_NODE_ELEMENT)
+		{
+			if (XmlIsName(node.lpszName, node.cchName, "Replay"))
+				pCounter->nReplays++;
+			else if (XmlIsName(node.lpszName, node.cchName, "ReplayTime"))
+				pCounter->bInReplayTime = (pCounter->nReplays == 1 && !node.bEmpty);
+		}
+		else if (nNodeType == XML_NODE_TEXT && pCounter->bInReplayTime)
+			pCounter->nReplayTime = XmlToInt(node.lpszValue, node.cchValue);
+		else if (nNodeType == XML_NODE_ENDELEMENT)
+			pCounter->bInReplayTime = FALSE;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK CountDediRecords(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PDEDI_COUNTER pCounter = (PDEDI_COUNTER)lpParam;
+	if (pCounter == NULL)
+		return FALSE;
+
+	if (lpData == NULL)
+	{ // The request is restarted
+		CsvFreeParser(&pCounter->parser);
+		ZeroMemory(pCounter, sizeof(DEDI_COUNTER));
+		CsvInitParser(&pCounter->parser);
+		return TRUE;
+	}
+
+	CsvFeed(&pCounter->parser, lpData, cbData);
+	CountDediLines(pCounter);
+
+	return !pCounter->parser.bError;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void CountDediLines(PDEDI_COUNTER pCounter)
+{
+	// The track info line is followed by one line per record, the best one first
+	CSV_RECORD record;
+	while (CsvRead(&pCounter->parser, &record))
+	{
+		if (record.uRecord == 1)
+			pCounter->bTrackFound = (record.uFields > 1);
+		else if (pCounter->bTrackFound && ++pCounter->nRecords == 1)
+			pCounter->nBestTime = CsvGetFieldInt(&record, 0);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ThrottledTransport(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszHeaders, LPINTERNET_RESPONSE lpResponse)
+{
+	PBATCH_JOB pJob = (lpRequest != NULL) ? (PBATCH_JOB)lpRequest->lpTransportParam : NULL;
+	if (pJob == NULL)
+		return FALSE;
+
+	DWORD dwDelay = ReserveHostSlot(pJob, lpRequest->lpszUrl);
+	if (dwDelay > 0 && WaitForSingleObject(g_hCancel, dwDelay) != WAIT_TIMEOUT)
+	{
+		lpRequest->dwError = ERROR_INTERNET_OPERATION_CANCELLED;
+		return FALSE;
+	}
+
+	return GetInternetTransport()(lpRequest, lpszHeaders, lpResponse);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static DWORD ReserveHostSlot(PBATCH_JOB pJob, LPCTSTR lpszUrl)
+{
+	if (pJob == NULL || lpszUrl == NULL)
+		return 0;
+
+	// The host name lies between the scheme and the port or path
+	TCHAR szHost[64];
+	LPCTSTR lpszHost = _tcsstr(lpszUrl, TEXT("://"));
+	lpszHost = (lpszHost != NULL) ? lpszHost + 3 : lpszUrl;
+	SIZE_T cchHost = _tcscspn(lpszHost, TEXT(":/?"));
+	if (cchHost >= _countof(szHost))
+		cchHost = _countof(szHost) - 1;
+	_tcsncpy(szHost, lpszHost, cchHost);
+	szHost[cchHost] = TEXT('\0');
+
+	DWORD dwInterval = (_tcsstr(szHost, TEXT("dedimania")) != NULL) ? BATCH_DEDI_INTERVAL : BATCH_HOST_INTERVAL;
+	DWORD dwDelay = 0;
+
+	EnterCriticalSection(&pJob->csHostSlots);
+
+	int i = 0;
+	while (i < pJob->nHostSlots && _tcsicmp(pJob->aHostSlots[i].szHost, szHost) != 0)
+		i++;
+
+	DWORD dwNow = GetTickCount();
+	if (i == pJob->nHostSlots && i < BATCH_MAX_HOSTS)
+	{
+		_tcscpy(pJob->aHostSlots[i].szHost, szHost);
+		pJob->aHostSlots[i].dwNextTick = dwNow;
+		pJob->nHostSlots++;
+	}
+
+	if (i < pJob->nHostSlots)
+	{ // The tick count wraps around after 49.7 days
+		if ((LONG)(pJob->aHostSlots[i].dwNextTick - dwNow) > 0)
+			dwDelay = pJob->aHostSlots[i].dwNextTick - dwNow;
+		pJob->aHostSlots[i].dwNextTick = dwNow + dwDelay + dwInterval;
+	}
+
+	LeaveCriticalSection(&pJob->csHostSlots);
+
+	return dwDelay;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void WriteResult(PBATCH_JOB pJob, const PBATCH_MAP pMap, const PBATCH_RESULT pResult)
+{
+	if (pJob == NULL || pMap == NULL || pResult == NULL)
+		return;
+
+	LPCTSTR lpszSite = (pResult->nGame != 0) ? GetSubDomain(pResult->nGame) : TEXT("");
+	if (lpszSite == NULL)
+		lpszSite = TEXT("");
+
+	TCHAR szLine[256];
+	_sntprintf(szLine, _countof(szLine), TEXT("%hs\t%hs\t%s\t%d\t%d\t%d\t%d\t%d\t%d\r\n"),
+		pMap->szUid, pMap->szEnvi, lpszSite, pResult->nTrackId, pResult->nAwards,
+		pResult->nReplays, pResult->nReplayTime, pResult->nDediRecords, pResult->nDediTime);
+	szLine[_countof(szLine)-1] = TEXT('\0');
+
+	// All fields consist of ASCII characters
+	char szLineA[256];
+#ifdef UNICODE
+	WideCharToMultiByte(CP_ACP, 0, szLine, -1, szLineA, sizeof(szLineA), NULL, NULL);
+	szLineA[sizeof(szLineA)-1] = '\0';
+#else
+	MyStrNCpyA(szLineA, szLine, sizeof(szLineA));
+#endif
+
+	// Every line is written at once, so that an interruption can only truncate the last line
+	DWORD dwWritten = 0;
+	EnterCriticalSection(&pJob->cs);
+	WriteFile(pJob->hOutput, szLineA, (DWORD)strlen(szLineA), &dwWritten, NULL);
+	LeaveCriticalSection(&pJob->cs);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int GetFieldInt(LPCSTR lpszText, char chDelimiter, int nField)
+{
+	if (lpszText == NULL || nField < 1)
+		return 0;
+
+	LPCSTR lpsz = lpszText;
+	for (int i = 1; i < nField; i++)
+	{
+		while (*lpsz != chDelimiter && *lpsz != '\0' && *lpsz != '\r' && *lpsz != '\n')
+			lpsz++;
+		if (*lpsz != chDelimiter)
+			return 0;
+		lpsz++;
+	}
+
+	return atoi(lpsz);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int GetXmlInt(LPCSTR lpszXml, LPCSTR lpszElement)
+{
+	if (lpszXml == NULL || lpszElement == NULL)
+		return 0;
+
+	char szTag[64];
+	_snprintf(szTag, _countof(szTag), "<%s>", lpszElement);
+	szTag[_countof(szTag)-1] = '\0';
+
+	LPCSTR lpsz = strstr(lpszXml, szTag);
+	return (lpsz != NULL) ? atoi(lpsz + strlen(szTag)) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CountStrings(LPCSTR lpszText, LPCSTR lpszFind)
+{
+	if (lpszText == NULL || lpszFind == NULL || *lpszFind == '\0')
+		return 0;
+
+	int nCount = 0;
+	SIZE_T cchFind = strlen(lpszFind);
+	while ((lpszText = strstr(lpszText, lpszFind)) != NULL)
+	{
+		nCount++;
+		lpszText += cchFind;
+	}
+
+	return nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
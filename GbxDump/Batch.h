@@ -0,0 +1,27 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Batch.h - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Shows the Open dialog box to select a list of map UIDs
+BOOL GetBatchFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen);
+
+// Resolves the exchange track IDs, awards and records of all maps in a list of map UIDs.
+// Each line contains a UID, optionally followed by the environment of the map. The results
+// are appended to the file <list>.tsv, which also allows an interrupted run to be resumed.
+BOOL BatchLookup(HWND hwndEdit, LPCTSTR lpszUidFile);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,1195 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// ContactSheet.cpp - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include <shlobj.h>
+#include "ImgFmt.h"
+#include "DumpGbx.h"
+#include "ContactSheet.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Constants
+
+#define SHEET_COLUMNS       8        // Tiles per row of a sheet
+#define SHEET_ROWS          8        // Rows of tiles per sheet
+#define SHEET_TILES         (SHEET_COLUMNS * SHEET_ROWS)
+#define SHEET_TILE_SIZE     256      // Largest width and height of an image
+#define SHEET_PADDING       8        // Space around the tiles in pixels
+#define SHEET_FONT_HEIGHT   15       // Character height of the captions in pixels
+#define SHEET_CAPTION_LINES 3        // Name, author and environment
+#define SHEET_MAX_FILES     65536    // Largest number of files per run
+#define SHEET_MAX_THREADS   16       // Largest number of worker threads
+#define SHEET_BATCH_SIZE    64       // Number of files that are prepared at the same time
+#define SHEET_PROGRESS_TIME 250      // Update interval of the progress display in ms
+#define SHEET_JSON_BUFFER   16384    // Size of the write buffer of the manifest
+#define WEBP_EXPORT_EXT     TEXT(".webp") // Replace the .Gbx extension of the exported images
+#define JPEG_EXPORT_EXT     TEXT(".jpg")
+
+#define SHEET_BACKGROUND    RGB(32, 32, 32)
+#define SHEET_PLACEHOLDER   RGB(64, 64, 64)
+#define SHEET_TEXT          RGB(240, 240, 240)
+#define SHEET_TEXT_DIM      RGB(160, 160, 160)
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// File found in the folder
+typedef struct _SHEET_FILE
+{
+	TCHAR	szPath[MAX_PATH];	// Path relative to the folder
+} SHEET_FILE, *PSHEET_FILE;
+
+// File prepared by a worker thread
+typedef struct _SHEET_ENTRY
+{
+	LONG		lFile;			// Index of the file
+	BOOL		bIsValid;		// Set if the file is a map or an item
+	GBX_PREVIEW	preview;		// The DIB is freed after it has been scaled
+	LPBYTE		lpTile;			// Scaled image blended over the background (top-down BGR), or NULL
+	int			nWidth;			// Width of the scaled image
+	int			nHeight;		// Height of the scaled image
+} SHEET_ENTRY, *PSHEET_ENTRY;
+
+// Tile placed on the current sheet
+typedef struct _SHEET_TILE
+{
+	LONG	lFile;				// Index of the file
+	BOOL	bIsMap;				// Map or item
+	BOOL	bHasImage;			// Image or placeholder
+	RECT	rcImage;			// Position of the image or the placeholder
+	TCHAR	szName[PREVIEW_TEXT_LEN];
+	TCHAR	szAuthor[PREVIEW_TEXT_LEN];
+	TCHAR	szEnvi[PREVIEW_TEXT_LEN];
+} SHEET_TILE, *PSHEET_TILE;
+
+// Sheet that is being filled
+typedef struct _SHEET_PAGE
+{
+	HDC		hdc;				// Memory DC with the DIB section and the caption font
+	HBITMAP	hbmp;				// 24-bit top-down DIB section of a full sheet
+	HGDIOBJ	hbmpOld;
+	HFONT	hFont;
+	HGDIOBJ	hFontOld;
+	LPBYTE	lpBits;				// Pixels of the DIB section
+	int		nWidth;				// Size of a full sheet
+	int		nHeight;
+	int		nStride;			// Bytes per row of the DIB section
+	int		nLineHeight;		// Height of a caption line
+	int		nCellHeight;		// Height of a tile including its caption
+	int		nTiles;				// Number of tiles on the current sheet
+	int		nSheets;			// Number of saved sheets
+	UINT	uFormat;			// File format of the sheets (SF_* value)
+	LONG	lTiles;				// Number of tiles on all saved sheets
+	SHEET_TILE aTiles[SHEET_TILES];
+} SHEET_PAGE, *PSHEET_PAGE;
+
+// Buffered UTF-8 output of the manifest
+typedef struct _JSON_WRITER
+{
+	HANDLE	hFile;
+	DWORD	cbUsed;				// Number of bytes in the buffer
+	BOOL	bFailed;			// Set if a write operation failed
+	char	achBuffer[SHEET_JSON_BUFFER];
+} JSON_WRITER, *PJSON_WRITER;
+
+// State shared by the worker threads of a batch of files
+typedef struct _SHEET_JOB
+{
+	LPCTSTR			lpszFolder;	// Folder without trailing backslash
+	PSHEET_FILE		pFiles;		// Files sorted by path
+	LONG			lFiles;		// Number of files
+	PSHEET_ENTRY	pEntries;	// Entries of the current batch
+	LONG			lCount;		// Number of entries of the current batch
+	volatile LONG	lNext;		// Index of the next entry to be prepared
+	volatile LONG	lActive;	// Number of running worker threads
+	volatile LONG	lDone;		// Number of prepared files of all batches
+	HANDLE			hFinished;	// Signaled when the last worker thread has finished
+	UINT			uExport;	// Export the images (TE_* value) instead of preparing tiles
+	int				nQuality;	// Quality of the exported WebP images (0 to 100)
+	UINT			uOptions;	// Options of the WebP encoder (WEO_* flags)
+	BOOL			bFlipImage;	// Flip the exported JPEG images
+	volatile LONG	lSaved;		// Number of exported images
+	HWND			hwndEdit;	// Output window that shows the progress line
+	int				nProgress;	// Start of the progress line in the output window
+	int				nSheets;	// Number of sheets saved so far
+} SHEET_JOB, *PSHEET_JOB;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward declarations of functions included in this code module
+
+// Preselects the last folder in the Browse For Folder dialog box
+static int CALLBACK BrowseCallbackProc(HWND hwnd, UINT uMsg, LPARAM lParam, LPARAM lpData);
+// Adds the GBX files of a folder and its subfolders to the file list
+static BOOL FindGbxFiles(LPCTSTR lpszFolder, LPCTSTR lpszSubFolder, PSHEET_FILE* ppFiles, PLONG plCount, PLONG plCapacity);
+// Compares the paths of two files for qsort
+static int __cdecl CompareFiles(const void* pElem1, const void* pElem2);
+// Prepares the entries of a batch in the worker threads and keeps the dialog box painted
+static BOOL RunSheetBatch(HWND hwndEdit, PSHEET_JOB pJob, int nProgress, int nSheets);
+// Replaces the progress line of a run while waiting for the worker threads
+static void CALLBACK OutputSheetProgress(LPVOID lpParam);
+// Exports the thumbnails of all files in a folder as described by the job
+static BOOL ExportThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, PSHEET_JOB pJob);
+// Thread function that prepares entries until the batch is processed or the run is cancelled
+static unsigned __stdcall SheetThreadProc(LPVOID lpParameter);
+// Reads the preview of a file and scales its image to the tile size
+static void PrepareEntry(PSHEET_JOB pJob, PSHEET_ENTRY pEntry);
+// Reads the preview of a file and saves its image as a WebP file next to the file
+static void ExportEntry(PSHEET_JOB pJob, PSHEET_ENTRY pEntry);
+// Scales a DIB to fit into a tile and blends it over the background of the sheets
+static LPBYTE CreateTileImage(HANDLE hDib, int* pnWidth, int* pnHeight);
+// Creates the memory DC, the caption font and the DIB section of the sheets
+static BOOL InitSheetPage(PSHEET_PAGE pPage);
+// Releases the GDI objects of the sheets
+static void FreeSheetPage(PSHEET_PAGE pPage);
+// Places the image and the captions of an entry on the current sheet
+static void AddSheetTile(PSHEET_PAGE pPage, const PSHEET_ENTRY pEntry);
+// Draws the captions, saves the current sheet and adds its tiles to the manifest
+static BOOL SaveSheetPage(PSHEET_PAGE pPage, LPCTSTR lpszFolder, const PSHEET_FILE pFiles, PJSON_WRITER pWriter);
+// Fills a rectangle of the DIB section with a color
+static void FillSheetRect(PSHEET_PAGE pPage, int x, int y, int nWidth, int nHeight, COLORREF crColor);
+// Converts a Gbx string to Unicode and removes the formatting characters
+static void ConvertCaption(LPCSTR lpszGbxString, LPTSTR lpszCaption, SIZE_T cchCaption);
+// Appends formatted text to the manifest
+static void JsonWriteFmt(PJSON_WRITER pWriter, LPCSTR lpszFormat, ...);
+// Appends a string in quotation marks to the manifest
+static void JsonWriteString(PJSON_WRITER pWriter, LPCTSTR lpszText);
+// Writes the buffered text of the manifest to the file
+static BOOL JsonFlush(PJSON_WRITER pWriter);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+
+static HANDLE g_hCancel = NULL; // Signaled to stop the creation of the sheets
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// String Constants
+
+const TCHAR g_szSheet[]       = TEXT("Contact Sheets:\r\n");
+const TCHAR g_szSheetStart[]  = TEXT("Files:\t\t%ld\r\nFolder:\t\t%s\r\nPress Esc to stop the run.\r\n");
+const TCHAR g_szSheetState[]  = TEXT("Processed:\t%ld/%ld files, %d sheets saved");
+const TCHAR g_szSheetDone[]   = TEXT("Sheets:\t\t%d (%ld maps and items)\r\nManifest:\t%s\r\n");
+const TCHAR g_szSheetStop[]   = TEXT("Stopped. The manifest lists the sheets saved so far.\r\n");
+const TCHAR g_szSheetNone[]   = TEXT("No GBX files found.\r\n");
+const TCHAR g_szSheetFile[]   = TEXT("ContactSheet%d.png");
+const TCHAR g_szSheetWebp[]   = TEXT("ContactSheet%d.webp");
+const TCHAR g_szSheetJson[]   = TEXT("ContactSheet.json");
+const TCHAR g_szExport[]      = TEXT("WebP Thumbnails:\r\n");
+const TCHAR g_szExportState[] = TEXT("Processed:\t%ld/%ld files, %ld images saved");
+const TCHAR g_szExportDone[]  = TEXT("Images:\t\t%ld WebP files saved next to the maps and items\r\n");
+const TCHAR g_szExportStop[]  = TEXT("Stopped. The images saved so far are kept.\r\n");
+const TCHAR g_szJpegExport[]  = TEXT("JPEG Thumbnails:\r\n");
+const TCHAR g_szJpegExportDone[] = TEXT("Images:\t\t%ld JPEG files saved next to the maps\r\n");
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL GetContactSheetFolder(HWND hDlg, LPTSTR lpszFolder, SIZE_T cchStringLen, UINT uExport)
+{
+	if (lpszFolder == NULL || cchStringLen == 0)
+		return FALSE;
+
+	TCHAR szTitle[256] = {0};
+	UINT uID = g_bGerUI ? IDS_GER_SHEET_FOLDER : IDS_ENG_SHEET_FOLDER;
+	if (uExport == TE_WEBP)
+		uID = g_bGerUI ? IDS_GER_WEBP_FOLDER : IDS_ENG_WEBP_FOLDER;
+	else if (uExport == TE_JPEG)
+		uID = g_bGerUI ? IDS_GER_JPEG_FOLDER : IDS_ENG_JPEG_FOLDER;
+	LoadString(g_hInstance, uID, szTitle, _countof(szTitle));
+
+	TCHAR szFolder[MAX_PATH] = {0};
+
+	// The dialog box with the new user interface requires OLE
+	HRESULT hr = OleInitialize(NULL);
+
+	BROWSEINFO bi     = {0};
+	bi.hwndOwner      = hDlg;
+	bi.pszDisplayName = szFolder;
+	bi.lpszTitle      = szTitle;
+	bi.ulFlags        = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
+	bi.lpfn           = BrowseCallbackProc;
+	bi.lParam         = (LPARAM)lpszFolder;
+
+	BOOL bRet = FALSE;
+
+	__try
+	{
+		LPITEMIDLIST pidl = SHBrowseForFolder(&bi);
+		if (pidl != NULL)
+		{
+			bRet = SHGetPathFromIDList(pidl, szFolder);
+			CoTaskMemFree(pidl);
+		}
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) { bRet = FALSE; }
+
+	if (SUCCEEDED(hr))
+		OleUninitialize();
+
+	if (bRet)
+		MyStrNCpy(lpszFolder, szFolder, (int)cchStringLen);
+
+	return bRet;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL CreateContactSheets(HWND hwndEdit, LPCTSTR lpszFolder, UINT uFormat)
+{
+	// Only one run at a time
+	if (hwndEdit == NULL || lpszFolder == NULL || lpszFolder[0] == TEXT('\0') || g_hCancel != NULL)
+		return FALSE;
+
+	TCHAR szOutput[OUTPUT_LEN];
+	OutputText(hwndEdit, g_szSheet);
+	OutputText(hwndEdit, g_szSep1);
+
+	// The paths are assembled without a trailing backslash
+	TCHAR szFolder[MAX_PATH];
+	MyStrNCpy(szFolder, lpszFolder, _countof(szFolder));
+	SIZE_T cchFolder = _tcslen(szFolder);
+	if (cchFolder > 0 && szFolder[cchFolder-1] == TEXT('\\'))
+		szFolder[cchFolder-1] = TEXT('\0');
+
+	SHEET_JOB job;
+	ZeroMemory(&job, sizeof(SHEET_JOB));
+	job.lpszFolder = szFolder;
+
+	LONG lCapacity = 0;
+	if (!FindGbxFiles(szFolder, NULL, &job.pFiles, &job.lFiles, &lCapacity))
+	{
+		OutputErrorMessage(hwndEdit, GetLastError());
+		if (job.pFiles != NULL)
+			MyGlobalFreePtr((LPVOID)job.pFiles);
+		return FALSE;
+	}
+
+	if (job.lFiles == 0)
+	{
+		OutputText(hwndEdit, g_szSheetNone);
+		OutputText(hwndEdit, g_szSep2);
+		if (job.pFiles != NULL)
+			MyGlobalFreePtr((LPVOID)job.pFiles);
+		return TRUE;
+	}
+
+	// Sort the files so that the sheets are reproducible
+	qsort(job.pFiles, job.lFiles, sizeof(SHEET_FILE), CompareFiles);
+
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szSheetStart, job.lFiles, szFolder);
+
+	// The manifest is written next to the sheets
+	TCHAR szManifest[MY_OFN_MAX_PATH];
+	_sntprintf(szManifest, _countof(szManifest), TEXT("%s\\%s"), szFolder, g_szSheetJson);
+	szManifest[_countof(szManifest)-1] = TEXT('\0');
+
+	PJSON_WRITER pWriter = (PJSON_WRITER)MyGlobalAllocPtr(GHND, sizeof(JSON_WRITER));
+	PSHEET_PAGE pPage = (PSHEET_PAGE)MyGlobalAllocPtr(GHND, sizeof(SHEET_PAGE));
+	job.pEntries = (PSHEET_ENTRY)MyGlobalAllocPtr(GHND, SHEET_BATCH_SIZE * sizeof(SHEET_ENTRY));
+	g_hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+	job.hFinished = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	BOOL bSuccess = (pWriter != NULL && pPage != NULL && job.pEntries != NULL && g_hCancel != NULL && job.hFinished != NULL);
+	DWORD dwError = bSuccess ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY;
+
+	if (bSuccess)
+	{
+		pWriter->hFile = CreateFile(szManifest, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (pWriter->hFile == INVALID_HANDLE_VALUE)
+		{
+			dwError = GetLastError();
+			bSuccess = FALSE;
+		}
+	}
+
+	if (bSuccess && !InitSheetPage(pPage))
+	{
+		dwError = GetLastError();
+		bSuccess = FALSE;
+	}
+
+	if (bSuccess)
+	{
+		pPage->uFormat = uFormat;
+		JsonWriteFmt(pWriter, "{\r\n  \"tileSize\": %d,\r\n  \"sheets\": [", SHEET_TILE_SIZE);
+
+		int nProgress = Edit_GetTextLength(hwndEdit);
+		for (LONG lFirst = 0; lFirst < job.lFiles; lFirst += SHEET_BATCH_SIZE)
+		{
+			job.lCount = min(SHEET_BATCH_SIZE, job.lFiles - lFirst);
+			ZeroMemory(job.pEntries, SHEET_BATCH_SIZE * sizeof(SHEET_ENTRY));
+			for (LONG i = 0; i < job.lCount; i++)
+				job.pEntries[i].lFile = lFirst + i;
+
+			BOOL bCompleted = RunSheetBatch(hwndEdit, &job, nProgress, pPage->nSheets);
+
+			// The tiles keep the order of the files, files that are no maps or items are skipped
+			for (LONG i = 0; i < job.lCount; i++)
+			{
+				PSHEET_ENTRY pEntry = &job.pEntries[i];
+				if (bCompleted && bSuccess && pEntry->bIsValid)
+				{
+					AddSheetTile(pPage, pEntry);
+					if (pPage->nTiles == SHEET_TILES && !SaveSheetPage(pPage, szFolder, job.pFiles, pWriter))
+					{
+						dwError = GetLastError();
+						bSuccess = FALSE;
+					}
+				}
+
+				if (pEntry->lpTile != NULL)
+					MyGlobalFreePtr((LPVOID)pEntry->lpTile);
+			}
+
+			if (!bCompleted || !bSuccess)
+				break;
+		}
+
+		// Save the last sheet, unless the run has been stopped
+		if (bSuccess && pPage->nTiles > 0 && WaitForSingleObject(g_hCancel, 0) == WAIT_TIMEOUT &&
+			!SaveSheetPage(pPage, szFolder, job.pFiles, pWriter))
+		{
+			dwError = GetLastError();
+			bSuccess = FALSE;
+		}
+
+		JsonWriteFmt(pWriter, "\r\n  ]\r\n}\r\n");
+		if (!JsonFlush(pWriter) && bSuccess)
+		{
+			dwError = GetLastError();
+			bSuccess = FALSE;
+		}
+
+		// Replace the progress line
+		Edit_SetSel(hwndEdit, nProgress, Edit_GetTextLength(hwndEdit));
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szSheetState, job.lDone, job.lFiles, pPage->nSheets);
+		OutputText(hwndEdit, TEXT("\r\n"));
+	}
+
+	if (!bSuccess)
+		OutputErrorMessage(hwndEdit, dwError);
+	else if (WaitForSingleObject(g_hCancel, 0) == WAIT_OBJECT_0)
+		OutputText(hwndEdit, g_szSheetStop);
+	else
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szSheetDone, pPage->nSheets, pPage->lTiles, szManifest);
+	OutputText(hwndEdit, g_szSep2);
+
+	if (pPage != NULL)
+	{
+		FreeSheetPage(pPage);
+		MyGlobalFreePtr((LPVOID)pPage);
+	}
+
+	if (pWriter != NULL)
+	{
+		if (pWriter->hFile != NULL && pWriter->hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(pWriter->hFile);
+		MyGlobalFreePtr((LPVOID)pWriter);
+	}
+
+	if (job.hFinished != NULL)
+		CloseHandle(job.hFinished);
+	if (g_hCancel != NULL)
+		CloseHandle(g_hCancel);
+	g_hCancel = NULL;
+
+	if (job.pEntries != NULL)
+		MyGlobalFreePtr((LPVOID)job.pEntries);
+	MyGlobalFreePtr((LPVOID)job.pFiles);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ExportWebpThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, int nQuality, UINT uOptions)
+{
+	SHEET_JOB job;
+	ZeroMemory(&job, sizeof(SHEET_JOB));
+	job.uExport = TE_WEBP;
+	job.nQuality = nQuality;
+	// The files are already processed in parallel, so each image is encoded in one thread
+	job.uOptions = uOptions & ~WEO_USE_THREADS;
+
+	return ExportThumbnails(hwndEdit, lpszFolder, &job);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ExportJpegThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, BOOL bFlipImage)
+{
+	SHEET_JOB job;
+	ZeroMemory(&job, sizeof(SHEET_JOB));
+	job.uExport = TE_JPEG;
+	job.bFlipImage = bFlipImage;
+
+	return ExportThumbnails(hwndEdit, lpszFolder, &job);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL ExportThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, PSHEET_JOB pJob)
+{
+	// Only one run at a time
+	if (hwndEdit == NULL || lpszFolder == NULL || lpszFolder[0] == TEXT('\0') || g_hCancel != NULL)
+		return FALSE;
+
+	TCHAR szOutput[OUTPUT_LEN];
+	OutputText(hwndEdit, pJob->uExport == TE_JPEG ? g_szJpegExport : g_szExport);
+	OutputText(hwndEdit, g_szSep1);
+
+	// The paths are assembled without a trailing backslash
+	TCHAR szFolder[MAX_PATH];
+	MyStrNCpy(szFolder, lpszFolder, _countof(szFolder));
+	SIZE_T cchFolder = _tcslen(szFolder);
+	if (cchFolder > 0 && szFolder[cchFolder-1] == TEXT('\\'))
+		szFolder[cchFolder-1] = TEXT('\0');
+
+	pJob->lpszFolder = szFolder;
+
+	LONG lCapacity = 0;
+	if (!FindGbxFiles(szFolder, NULL, &pJob->pFiles, &pJob->lFiles, &lCapacity))
+	{
+		OutputErrorMessage(hwndEdit, GetLastError());
+		if (pJob->pFiles != NULL)
+			MyGlobalFreePtr((LPVOID)pJob->pFiles);
+		return FALSE;
+	}
+
+	if (pJob->lFiles == 0)
+	{
+		OutputText(hwndEdit, g_szSheetNone);
+		OutputText(hwndEdit, g_szSep2);
+		if (pJob->pFiles != NULL)
+			MyGlobalFreePtr((LPVOID)pJob->pFiles);
+		return TRUE;
+	}
+
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szSheetStart, pJob->lFiles, szFolder);
+
+	pJob->pEntries = (PSHEET_ENTRY)MyGlobalAllocPtr(GHND, SHEET_BATCH_SIZE * sizeof(SHEET_ENTRY));
+	g_hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+	pJob->hFinished = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	BOOL bSuccess = (pJob->pEntries != NULL && g_hCancel != NULL && pJob->hFinished != NULL);
+
+	if (bSuccess)
+	{
+		int nProgress = Edit_GetTextLength(hwndEdit);
+		for (LONG lFirst = 0; lFirst < pJob->lFiles; lFirst += SHEET_BATCH_SIZE)
+		{
+			pJob->lCount = min(SHEET_BATCH_SIZE, pJob->lFiles - lFirst);
+			ZeroMemory(pJob->pEntries, SHEET_BATCH_SIZE * sizeof(SHEET_ENTRY));
+			for (LONG i = 0; i < pJob->lCount; i++)
+				pJob->pEntries[i].lFile = lFirst + i;
+
+			if (!RunSheetBatch(hwndEdit, pJob, nProgress, 0))
+				break;
+		}
+
+		// Replace the progress line
+		Edit_SetSel(hwndEdit, nProgress, Edit_GetTextLength(hwndEdit));
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), g_szExportState, pJob->lDone, pJob->lFiles, pJob->lSaved);
+		OutputText(hwndEdit, TEXT("\r\n"));
+	}
+
+	if (!bSuccess)
+		OutputErrorMessage(hwndEdit, ERROR_NOT_ENOUGH_MEMORY);
+	else if (WaitForSingleObject(g_hCancel, 0) == WAIT_OBJECT_0)
+		OutputText(hwndEdit, g_szExportStop);
+	else
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput),
+			pJob->uExport == TE_JPEG ? g_szJpegExportDone : g_szExportDone, pJob->lSaved);
+	OutputText(hwndEdit, g_szSep2);
+
+	if (pJob->hFinished != NULL)
+		CloseHandle(pJob->hFinished);
+	if (g_hCancel != NULL)
+		CloseHandle(g_hCancel);
+	g_hCancel = NULL;
+
+	if (pJob->pEntries != NULL)
+		MyGlobalFreePtr((LPVOID)pJob->pEntries);
+	MyGlobalFreePtr((LPVOID)pJob->pFiles);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CALLBACK BrowseCallbackProc(HWND hwnd, UINT uMsg, LPARAM lParam, LPARAM lpData)
+{
+	UNREFERENCED_PARAMETER(lParam);
+
+	if (uMsg == BFFM_INITIALIZED && lpData != 0 && *(LPCTSTR)lpData != TEXT('\0'))
+		SendMessage(hwnd, BFFM_SETSELECTION, TRUE, lpData);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL FindGbxFiles(LPCTSTR lpszFolder, LPCTSTR lpszSubFolder, PSHEET_FILE* ppFiles, PLONG plCount, PLONG plCapacity)
+{
+	if (lpszFolder == NULL || ppFiles == NULL || plCount == NULL || plCapacity == NULL)
+		return FALSE;
+
+	TCHAR szPattern[MY_OFN_MAX_PATH];
+	if (lpszSubFolder == NULL)
+		_sntprintf(szPattern, _countof(szPattern), TEXT("%s\\*"), lpszFolder);
+	else
+		_sntprintf(szPattern, _countof(szPattern), TEXT("%s\\%s\\*"), lpszFolder, lpszSubFolder);
+	szPattern[_countof(szPattern)-1] = TEXT('\0');
+
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFile(szPattern, &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{ // An empty or inaccessible subfolder is skipped
+		return (lpszSubFolder != NULL || GetLastError() == ERROR_FILE_NOT_FOUND);
+	}
+
+	BOOL bRet = TRUE;
+
+	do
+	{
+		if (_tcscmp(fd.cFileName, TEXT(".")) == 0 || _tcscmp(fd.cFileName, TEXT("..")) == 0)
+			continue;
+
+		// Paths that are too long are skipped
+		TCHAR szPath[MAX_PATH];
+		int nLen = (lpszSubFolder == NULL) ?
+			_sntprintf(szPath, _countof(szPath), TEXT("%s"), fd.cFileName) :
+			_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), lpszSubFolder, fd.cFileName);
+		if (nLen < 0 || nLen >= (int)_countof(szPath))
+			continue;
+
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{ // Junctions and symbolic links are not followed to avoid cycles
+			if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+				bRet = FindGbxFiles(lpszFolder, szPath, ppFiles, plCount, plCapacity);
+			continue;
+		}
+
+		SIZE_T cchName = _tcslen(fd.cFileName);
+		if (cchName < 4 || _tcsicmp(fd.cFileName + cchName - 4, TEXT(".gbx")) != 0)
+			continue;
+
+		if (*plCount >= SHEET_MAX_FILES)
+			break;
+
+		// Enlarge the list
+		if (*plCount >= *plCapacity)
+		{
+			LONG lCapacity = (*plCapacity > 0) ? min(*plCapacity * 2, SHEET_MAX_FILES) : 256;
+			PSHEET_FILE pFiles = (PSHEET_FILE)MyGlobalAllocPtr(GHND, lCapacity * sizeof(SHEET_FILE));
+			if (pFiles == NULL)
+			{
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+				bRet = FALSE;
+				break;
+			}
+
+			if (*ppFiles != NULL)
+			{
+				CopyMemory(pFiles, *ppFiles, *plCount * sizeof(SHEET_FILE));
+				MyGlobalFreePtr((LPVOID)*ppFiles);
+			}
+
+			*ppFiles = pFiles;
+			*plCapacity = lCapacity;
+		}
+
+		MyStrNCpy((*ppFiles)[*plCount].szPath, szPath, MAX_PATH);
+		(*plCount)++;
+	}
+	while (bRet && FindNextFile(hFind, &fd));
+
+	FindClose(hFind);
+
+	return bRet;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int __cdecl CompareFiles(const void* pElem1, const void* pElem2)
+{
+	return _tcsicmp(((const SHEET_FILE*)pElem1)->szPath, ((const SHEET_FILE*)pElem2)->szPath);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL RunSheetBatch(HWND hwndEdit, PSHEET_JOB pJob, int nProgress, int nSheets)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nMaxThreads = (int)min(min(si.dwNumberOfProcessors, SHEET_MAX_THREADS), (DWORD)pJob->lCount);
+
+	pJob->lNext = 0;
+	ResetEvent(pJob->hFinished);
+
+	// Start the worker threads
+	HANDLE ahThreads[SHEET_MAX_THREADS];
+	int nThreads = 0;
+
+	pJob->lActive = nMaxThreads;
+	for (int i = 0; i < nMaxThreads; i++)
+	{
+		HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, SheetThreadProc, pJob, 0, NULL);
+		if (hThread != NULL)
+			ahThreads[nThreads++] = hThread;
+		else
+			InterlockedDecrement(&pJob->lActive);
+	}
+
+	if (nThreads == 0)
+	{ // Prepare the batch in this thread instead
+		pJob->lActive = 1;
+		SheetThreadProc(pJob);
+	}
+
+	// Keep the dialog box painted while waiting for the worker threads. User input is
+	// discarded, except for the Esc key, which stops the run.
+	pJob->hwndEdit = hwndEdit;
+	pJob->nProgress = nProgress;
+	pJob->nSheets = nSheets;
+	WaitForWorkerThreads(pJob->hFinished, g_hCancel, ahThreads, nThreads, SHEET_PROGRESS_TIME, OutputSheetProgress, pJob);
+
+	return (WaitForSingleObject(g_hCancel, 0) == WAIT_TIMEOUT);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void CALLBACK OutputSheetProgress(LPVOID lpParam)
+{
+	PSHEET_JOB pJob = (PSHEET_JOB)lpParam;
+	TCHAR szOutput[OUTPUT_LEN];
+
+	// Replace the progress line
+	Edit_SetSel(pJob->hwndEdit, pJob->nProgress, Edit_GetTextLength(pJob->hwndEdit));
+	if (pJob->uExport != TE_NONE)
+		OutputTextFmt(pJob->hwndEdit, szOutput, _countof(szOutput), g_szExportState, pJob->lDone, pJob->lFiles, pJob->lSaved);
+	else
+		OutputTextFmt(pJob->hwndEdit, szOutput, _countof(szOutput), g_szSheetState, pJob->lDone, pJob->lFiles, pJob->nSheets);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static unsigned __stdcall SheetThreadProc(LPVOID lpParameter)
+{
+	PSHEET_JOB pJob = (PSHEET_JOB)lpParameter;
+	if (pJob == NULL)
+		return 1;
+
+	LONG lIndex = 0;
+	while (WaitForSingleObject(g_hCancel, 0) == WAIT_TIMEOUT &&
+		(lIndex = InterlockedIncrement(&pJob->lNext) - 1) < pJob->lCount)
+	{
+		if (pJob->uExport != TE_NONE)
+			ExportEntry(pJob, &pJob->pEntries[lIndex]);
+		else
+			PrepareEntry(pJob, &pJob->pEntries[lIndex]);
+		InterlockedIncrement(&pJob->lDone);
+	}
+
+	if (InterlockedDecrement(&pJob->lActive) == 0)
+		SetEvent(pJob->hFinished);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void PrepareEntry(PSHEET_JOB pJob, PSHEET_ENTRY pEntry)
+{
+	TCHAR szPath[MY_OFN_MAX_PATH];
+	_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), pJob->lpszFolder, pJob->pFiles[pEntry->lFile].szPath);
+	szPath[_countof(szPath)-1] = TEXT('\0');
+
+	HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	// JPEG thumbnails are already scaled down while they are decoded
+	pEntry->bIsValid = ReadGbxPreview(hFile, &pEntry->preview, SHEET_TILE_SIZE);
+	CloseHandle(hFile);
+
+	if (pEntry->preview.hDib != NULL)
+	{
+		pEntry->lpTile = CreateTileImage(pEntry->preview.hDib, &pEntry->nWidth, &pEntry->nHeight);
+		pEntry->preview.hDib = FreeDib(pEntry->preview.hDib);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void ExportEntry(PSHEET_JOB pJob, PSHEET_ENTRY pEntry)
+{
+	TCHAR szPath[MY_OFN_MAX_PATH];
+	_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), pJob->lpszFolder, pJob->pFiles[pEntry->lFile].szPath);
+	szPath[_countof(szPath)-1] = TEXT('\0');
+
+	HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	// The images are exported in their original size. JPEG thumbnails are not decoded at all.
+	BOOL bJpeg = (pJob->uExport == TE_JPEG);
+	pEntry->bIsValid = ReadGbxPreview(hFile, &pEntry->preview, 0, bJpeg);
+	CloseHandle(hFile);
+
+	if (bJpeg)
+	{
+		if (pEntry->preview.lpJpegData == NULL)
+			return;
+
+		// The thumbnails are stored upside down and are flipped without recompression
+		SIZE_T cchPath = _tcslen(szPath);
+		if (cchPath >= 4 && cchPath - 4 + _countof(JPEG_EXPORT_EXT) <= _countof(szPath))
+		{
+			_tcscpy(szPath + cchPath - 4, JPEG_EXPORT_EXT);
+			if (SaveJpegFile(szPath, pEntry->preview.lpJpegData, pEntry->preview.dwJpegSize, pJob->bFlipImage))
+				InterlockedIncrement(&pJob->lSaved);
+		}
+
+		MyGlobalFreePtr(pEntry->preview.lpJpegData);
+		pEntry->preview.lpJpegData = NULL;
+		return;
+	}
+
+	if (pEntry->preview.hDib == NULL)
+		return;
+
+	// Replace the .Gbx extension, so that "A01.Map.Gbx" is exported as "A01.Map.webp"
+	SIZE_T cchPath = _tcslen(szPath);
+	if (cchPath >= 4 && cchPath - 4 + _countof(WEBP_EXPORT_EXT) <= _countof(szPath))
+	{
+		_tcscpy(szPath + cchPath - 4, WEBP_EXPORT_EXT);
+
+		// Map thumbnails are screenshots of the track, item icons are small rendered images
+		if (SaveWebpFile(szPath, pEntry->preview.hDib, pEntry->preview.bIsMap ? WEP_PHOTO : WEP_ICON,
+			pJob->nQuality, pJob->uOptions))
+			InterlockedIncrement(&pJob->lSaved);
+	}
+
+	pEntry->preview.hDib = FreeDib(pEntry->preview.hDib);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static LPBYTE CreateTileImage(HANDLE hDib, int* pnWidth, int* pnHeight)
+{
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+		return NULL;
+
+	LONG lWidth  = IS_OS2PM_DIB(lpbi) ? ((LPBITMAPCOREHEADER)lpbi)->bcWidth : lpbi->biWidth;
+	LONG lHeight = IS_OS2PM_DIB(lpbi) ? ((LPBITMAPCOREHEADER)lpbi)->bcHeight : abs(lpbi->biHeight);
+	GlobalUnlock(hDib);
+
+	if (lWidth <= 0 || lHeight <= 0)
+		return NULL;
+
+	// Fit the image into the tile and keep its aspect ratio
+	int nWidth  = SHEET_TILE_SIZE;
+	int nHeight = SHEET_TILE_SIZE;
+	if (lWidth > lHeight)
+		nHeight = max(1, MulDiv(SHEET_TILE_SIZE, lHeight, lWidth));
+	else if (lHeight > lWidth)
+		nWidth = max(1, MulDiv(SHEET_TILE_SIZE, lWidth, lHeight));
+
+	// The files are already processed in parallel, so each image is resampled in this thread
+	HANDLE hTileDib = ResampleDib(hDib, nWidth, nHeight, FALSE);
+	if (hTileDib == NULL)
+		return NULL;
+
+	LPBYTE lpTile = NULL;
+	LPBYTE lpTileDib = (LPBYTE)GlobalLock(hTileDib);
+	if (lpTileDib != NULL)
+	{
+		lpTile = (LPBYTE)MyGlobalAllocPtr(GHND, (SIZE_T)nWidth * nHeight * 3);
+		if (lpTile != NULL)
+		{
+			UINT uBlue  = GetBValue(SHEET_BACKGROUND);
+			UINT uGreen = GetGValue(SHEET_BACKGROUND);
+			UINT uRed   = GetRValue(SHEET_BACKGROUND);
+
+			// The resampled DIB is a bottom-up 32-bit DIB. Opaque images have an alpha value of 255.
+			LPBYTE lpBits = lpTileDib + sizeof(BITMAPINFOHEADER);
+			for (int y = 0; y < nHeight; y++)
+			{
+				LPBYTE lpSrc = lpBits + (SIZE_T)(nHeight - 1 - y) * nWidth * 4;
+				LPBYTE lpDest = lpTile + (SIZE_T)y * nWidth * 3;
+				for (int x = 0; x < nWidth; x++)
+				{
+					UINT uAlpha = lpSrc[3];
+					UINT uInvAlpha = 255 - uAlpha;
+					lpDest[0] = (BYTE)((lpSrc[0] * uAlpha + uBlue * uInvAlpha + 127) / 255);
+					lpDest[1] = (BYTE)((lpSrc[1] * uAlpha + uGreen * uInvAlpha + 127) / 255);
+					lpDest[2] = (BYTE)((lpSrc[2] * uAlpha + uRed * uInvAlpha + 127) / 255);
+					lpSrc += 4;
+					lpDest += 3;
+				}
+			}
+
+			*pnWidth = nWidth;
+			*pnHeight = nHeight;
+		}
+
+		GlobalUnlock(hTileDib);
+	}
+
+	FreeDib(hTileDib);
+
+	return lpTile;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL InitSheetPage(PSHEET_PAGE pPage)
+{
+	pPage->hdc = CreateCompatibleDC(NULL);
+	if (pPage->hdc == NULL)
+		return FALSE;
+
+	// Grayscale antialiasing avoids color fringes in the saved images
+	pPage->hFont = CreateFont(-SHEET_FONT_HEIGHT, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+		OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH | FF_SWISS, TEXT("Segoe UI"));
+	if (pPage->hFont != NULL)
+		pPage->hFontOld = SelectObject(pPage->hdc, pPage->hFont);
+
+	TEXTMETRIC tm;
+	if (GetTextMetrics(pPage->hdc, &tm))
+		pPage->nLineHeight = tm.tmHeight + tm.tmExternalLeading;
+	else
+		pPage->nLineHeight = SHEET_FONT_HEIGHT + 4;
+
+	pPage->nCellHeight = SHEET_TILE_SIZE + SHEET_PADDING / 2 + SHEET_CAPTION_LINES * pPage->nLineHeight + SHEET_PADDING;
+	pPage->nWidth  = SHEET_PADDING + SHEET_COLUMNS * (SHEET_TILE_SIZE + SHEET_PADDING);
+	pPage->nHeight = SHEET_PADDING + SHEET_ROWS * pPage->nCellHeight;
+	pPage->nStride = WIDTHBYTES(pPage->nWidth * 24);
+
+	BITMAPINFO bmi;
+	ZeroMemory(&bmi, sizeof(BITMAPINFO));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = pPage->nWidth;
+	bmi.bmiHeader.biHeight = -pPage->nHeight;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 24;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	pPage->hbmp = CreateDIBSection(pPage->hdc, &bmi, DIB_RGB_COLORS, (LPVOID*)&pPage->lpBits, NULL, 0);
+	if (pPage->hbmp == NULL || pPage->lpBits == NULL)
+		return FALSE;
+
+	pPage->hbmpOld = SelectObject(pPage->hdc, pPage->hbmp);
+
+	SetBkMode(pPage->hdc, TRANSPARENT);
+	FillSheetRect(pPage, 0, 0, pPage->nWidth, pPage->nHeight, SHEET_BACKGROUND);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void FreeSheetPage(PSHEET_PAGE pPage)
+{
+	if (pPage->hdc != NULL)
+	{
+		if (pPage->hbmpOld != NULL)
+			SelectObject(pPage->hdc, pPage->hbmpOld);
+		if (pPage->hFontOld != NULL)
+			SelectObject(pPage->hdc, pPage->hFontOld);
+		DeleteDC(pPage->hdc);
+	}
+
+	if (pPage->hbmp != NULL)
+		DeleteObject(pPage->hbmp);
+	if (pPage->hFont != NULL)
+		DeleteObject(pPage->hFont);
+
+	pPage->hdc = NULL;
+	pPage->hbmp = NULL;
+	pPage->hFont = NULL;
+	pPage->lpBits = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void AddSheetTile(PSHEET_PAGE pPage, const PSHEET_ENTRY pEntry)
+{
+	PSHEET_TILE pTile = &pPage->aTiles[pPage->nTiles];
+
+	int x = SHEET_PADDING + (pPage->nTiles % SHEET_COLUMNS) * (SHEET_TILE_SIZE + SHEET_PADDING);
+	int y = SHEET_PADDING + (pPage->nTiles / SHEET_COLUMNS) * pPage->nCellHeight;
+
+	pTile->lFile = pEntry->lFile;
+	pTile->bIsMap = pEntry->preview.bIsMap;
+	ConvertCaption(pEntry->preview.szName, pTile->szName, _countof(pTile->szName));
+	ConvertCaption(pEntry->preview.szAuthor, pTile->szAuthor, _countof(pTile->szAuthor));
+	ConvertCaption(pEntry->preview.szEnvi, pTile->szEnvi, _countof(pTile->szEnvi));
+
+	if (pEntry->lpTile != NULL)
+	{ // Center the image in the tile
+		int nLeft = x + (SHEET_TILE_SIZE - pEntry->nWidth) / 2;
+		int nTop = y + (SHEET_TILE_SIZE - pEntry->nHeight) / 2;
+		SetRect(&pTile->rcImage, nLeft, nTop, nLeft + pEntry->nWidth, nTop + pEntry->nHeight);
+		pTile->bHasImage = TRUE;
+
+		for (int i = 0; i < pEntry->nHeight; i++)
+			CopyMemory(pPage->lpBits + (SIZE_T)(nTop + i) * pPage->nStride + nLeft * 3,
+				pEntry->lpTile + (SIZE_T)i * pEntry->nWidth * 3, pEntry->nWidth * 3);
+	}
+	else
+	{ // Files without a thumbnail or with an undecodable image get a placeholder
+		SetRect(&pTile->rcImage, x, y, x + SHEET_TILE_SIZE, y + SHEET_TILE_SIZE);
+		pTile->bHasImage = FALSE;
+		FillSheetRect(pPage, x, y, SHEET_TILE_SIZE, SHEET_TILE_SIZE, SHEET_PLACEHOLDER);
+	}
+
+	pPage->nTiles++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL SaveSheetPage(PSHEET_PAGE pPage, LPCTSTR lpszFolder, const PSHEET_FILE pFiles, PJSON_WRITER pWriter)
+{
+	// Draw the captions below the tiles
+	for (int i = 0; i < pPage->nTiles; i++)
+	{
+		PSHEET_TILE pTile = &pPage->aTiles[i];
+		int x = SHEET_PADDING + (i % SHEET_COLUMNS) * (SHEET_TILE_SIZE + SHEET_PADDING);
+		int y = SHEET_PADDING + (i / SHEET_COLUMNS) * pPage->nCellHeight + SHEET_TILE_SIZE + SHEET_PADDING / 2;
+
+		LPCTSTR alpszLines[SHEET_CAPTION_LINES] = { pTile->szName, pTile->szAuthor, pTile->szEnvi };
+		for (int j = 0; j < SHEET_CAPTION_LINES; j++)
+		{
+			RECT rc = { x, y + j * pPage->nLineHeight, x + SHEET_TILE_SIZE, y + (j + 1) * pPage->nLineHeight };
+			SetTextColor(pPage->hdc, j == 0 ? SHEET_TEXT : SHEET_TEXT_DIM);
+			DrawText(pPage->hdc, alpszLines[j], -1, &rc, DT_CENTER | DT_SINGLELINE | DT_NOPREFIX | DT_END_ELLIPSIS);
+		}
+	}
+
+	// The pixels are accessed directly after drawing
+	GdiFlush();
+
+	// Crop an incomplete sheet
+	int nColumns = min(pPage->nTiles, SHEET_COLUMNS);
+	int nRows = (pPage->nTiles + SHEET_COLUMNS - 1) / SHEET_COLUMNS;
+	int nWidth = SHEET_PADDING + nColumns * (SHEET_TILE_SIZE + SHEET_PADDING);
+	int nHeight = SHEET_PADDING + nRows * pPage->nCellHeight;
+	DWORD dwStride = WIDTHBYTES(nWidth * 24);
+
+	// Copy the sheet into a bottom-up packed DIB
+	HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + (SIZE_T)dwStride * nHeight);
+	if (hDib == NULL)
+	{
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return FALSE;
+	}
+
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+	{
+		GlobalFree(hDib);
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return FALSE;
+	}
+
+	lpbi->biSize = sizeof(BITMAPINFOHEADER);
+	lpbi->biWidth = nWidth;
+	lpbi->biHeight = nHeight;
+	lpbi->biPlanes = 1;
+	lpbi->biBitCount = 24;
+	lpbi->biCompression = BI_RGB;
+	lpbi->biSizeImage = dwStride * nHeight;
+
+	LPBYTE lpBits = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+	for (int y = 0; y < nHeight; y++)
+		CopyMemory(lpBits + (SIZE_T)(nHeight - 1 - y) * dwStride, pPage->lpBits + (SIZE_T)y * pPage->nStride, nWidth * 3);
+
+	GlobalUnlock(hDib);
+
+	TCHAR szFileName[MAX_PATH];
+	_sntprintf(szFileName, _countof(szFileName), pPage->uFormat == SF_WEBP ? g_szSheetWebp : g_szSheetFile, pPage->nSheets + 1);
+	szFileName[_countof(szFileName)-1] = TEXT('\0');
+
+	TCHAR szPath[MY_OFN_MAX_PATH];
+	_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), lpszFolder, szFileName);
+	szPath[_countof(szPath)-1] = TEXT('\0');
+
+	// The sheets are saved in the calling thread, so the WebP encoder may use its worker threads
+	BOOL bSaved = pPage->uFormat == SF_WEBP ?
+		SaveWebpFile(szPath, hDib, WEP_PICTURE, 90, WEO_DEFAULT) : SavePngFile(szPath, hDib);
+	DWORD dwError = GetLastError();
+	FreeDib(hDib);
+
+	if (!bSaved)
+	{
+		SetLastError(dwError != ERROR_SUCCESS ? dwError : ERROR_WRITE_FAULT);
+		return FALSE;
+	}
+
+	// List the sheet and its tiles in the manifest
+	JsonWriteFmt(pWriter, "%s\r\n    {\r\n      \"file\": ", pPage->nSheets > 0 ? "," : "");
+	JsonWriteString(pWriter, szFileName);
+	JsonWriteFmt(pWriter, ",\r\n      \"width\": %d,\r\n      \"height\": %d,\r\n      \"tiles\": [", nWidth, nHeight);
+
+	for (int i = 0; i < pPage->nTiles; i++)
+	{
+		PSHEET_TILE pTile = &pPage->aTiles[i];
+
+		// The paths use forward slashes
+		TCHAR szFile[MAX_PATH];
+		MyStrNCpy(szFile, pFiles[pTile->lFile].szPath, _countof(szFile));
+		for (LPTSTR lpsz = szFile; *lpsz != TEXT('\0'); lpsz++)
+			if (*lpsz == TEXT('\\'))
+				*lpsz = TEXT('/');
+
+		JsonWriteFmt(pWriter, "%s\r\n        { \"file\": ", i > 0 ? "," : "");
+		JsonWriteString(pWriter, szFile);
+		JsonWriteFmt(pWriter, ", \"type\": \"%s\", \"name\": ", pTile->bIsMap ? "map" : "item");
+		JsonWriteString(pWriter, pTile->szName);
+		JsonWriteFmt(pWriter, ", \"author\": ");
+		JsonWriteString(pWriter, pTile->szAuthor);
+		JsonWriteFmt(pWriter, ", \"environment\": ");
+		JsonWriteString(pWriter, pTile->szEnvi);
+		JsonWriteFmt(pWriter, ", \"x\": %d, \"y\": %d, \"width\": %d, \"height\": %d, \"image\": %s }",
+			pTile->rcImage.left, pTile->rcImage.top, pTile->rcImage.right - pTile->rcImage.left,
+			pTile->rcImage.bottom - pTile->rcImage.top, pTile->bHasImage ? "true" : "false");
+	}
+
+	JsonWriteFmt(pWriter, "\r\n      ]\r\n    }");
+
+	pPage->lTiles += pPage->nTiles;
+	pPage->nSheets++;
+	pPage->nTiles = 0;
+
+	// Clear the sheet for the next tiles
+	FillSheetRect(pPage, 0, 0, pPage->nWidth, pPage->nHeight, SHEET_BACKGROUND);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void FillSheetRect(PSHEET_PAGE pPage, int x, int y, int nWidth, int nHeight, COLORREF crColor)
+{
+	if (pPage->lpBits == NULL || nWidth <= 0 || nHeight <= 0)
+		return;
+
+	// Fill the first row and copy it to the other rows
+	LPBYTE lpFirst = pPage->lpBits + (SIZE_T)y * pPage->nStride + x * 3;
+	LPBYTE lpDest = lpFirst;
+	for (int i = 0; i < nWidth; i++)
+	{
+		*lpDest++ = GetBValue(crColor);
+		*lpDest++ = GetGValue(crColor);
+		*lpDest++ = GetRValue(crColor);
+	}
+
+	for (int i = 1; i < nHeight; i++)
+		CopyMemory(lpFirst + (SIZE_T)i * pPage->nStride, lpFirst, nWidth * 3);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void ConvertCaption(LPCSTR lpszGbxString, LPTSTR lpszCaption, SIZE_T cchCaption)
+{
+	// ConvertGbxString appends a line break, which is removed again
+	TCHAR szText[PREVIEW_TEXT_LEN + 3];
+	szText[0] = TEXT('\0');
+	ConvertGbxString((LPVOID)lpszGbxString, strlen(lpszGbxString), szText, _countof(szText));
+
+	SIZE_T cchLen = _tcslen(szText);
+	if (cchLen >= 2 && szText[cchLen-2] == TEXT('\r'))
+		szText[cchLen-2] = TEXT('\0');
+
+	if (!CleanupString(szText, lpszCaption, cchCaption))
+		MyStrNCpy(lpszCaption, szText, (int)cchCaption);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void JsonWriteFmt(PJSON_WRITER pWriter, LPCSTR lpszFormat, ...)
+{
+	char szText[256];
+
+	va_list arglist;
+	va_start(arglist, lpszFormat);
+	int nLen = _vsnprintf(szText, _countof(szText) - 1, lpszFormat, arglist);
+	va_end(arglist);
+
+	if (nLen < 0)
+		nLen = _countof(szText) - 1;
+	szText[nLen] = '\0';
+
+	if (pWriter->cbUsed + nLen > sizeof(pWriter->achBuffer))
+		JsonFlush(pWriter);
+
+	CopyMemory(pWriter->achBuffer + pWriter->cbUsed, szText, nLen);
+	pWriter->cbUsed += nLen;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void JsonWriteString(PJSON_WRITER pWriter, LPCTSTR lpszText)
+{
+	char szUtf8[MAX_PATH * 3];
+	if (WideCharToMultiByte(CP_UTF8, 0, lpszText, -1, szUtf8, sizeof(szUtf8), NULL, NULL) == 0)
+		szUtf8[0] = '\0';
+
+	// Each byte takes up to six bytes when escaped
+	if (pWriter->cbUsed + strlen(szUtf8) * 6 + 2 > sizeof(pWriter->achBuffer))
+		JsonFlush(pWriter);
+
+	LPSTR lpDest = pWriter->achBuffer + pWriter->cbUsed;
+	*lpDest++ = '"';
+	for (LPCSTR lpsz = szUtf8; *lpsz != '\0'; lpsz++)
+	{
+		BYTE ch = (BYTE)*lpsz;
+		if (ch == '"' || ch == '\\')
+		{
+			*lpDest++ = '\\';
+			*lpDest++ = (char)ch;
+		}
+		else if (ch < 0x20)
+			lpDest += sprintf(lpDest, "\\u%04X", ch);
+		else
+			*lpDest++ = (char)ch;
+	}
+	*lpDest++ = '"';
+
+	pWriter->cbUsed = (DWORD)(lpDest - pWriter->achBuffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL JsonFlush(PJSON_WRITER pWriter)
+{
+	if (pWriter->cbUsed > 0 && !pWriter->bFailed)
+	{
+		DWORD dwWritten = 0;
+		if (!WriteFile(pWriter->hFile, pWriter->achBuffer, pWriter->cbUsed, &dwWritten, NULL) ||
+			dwWritten != pWriter->cbUsed)
+			pWriter->bFailed = TRUE;
+	}
+
+	pWriter->cbUsed = 0;
+
+	return !pWriter->bFailed;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// ContactSheet.h - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Purposes of the folder selection and of a run
+#define TE_NONE     0       // Contact sheets
+#define TE_WEBP     1       // Export of WebP thumbnails and icons
+#define TE_JPEG     2       // Export of the original JPEG thumbnails
+
+// Shows the Browse For Folder dialog box to select a folder with maps and items for the
+// contact sheets or for the export of thumbnails (TE_* value)
+BOOL GetContactSheetFolder(HWND hDlg, LPTSTR lpszFolder, SIZE_T cchStringLen, UINT uExport = TE_NONE);
+
+// File formats of the contact sheets
+#define SF_PNG      0       // ContactSheet<n>.png
+#define SF_WEBP     1       // ContactSheet<n>.webp
+
+// Creates contact sheets of all maps and items in a folder and its subfolders. The thumbnails
+// and icons are decoded and scaled in parallel and arranged in a grid with the name, author and
+// environment of each file. The sheets are saved as ContactSheet<n>.png or .webp (SF_* value)
+// in the folder, together with ContactSheet.json, which lists the file name of each sheet and
+// the position of each image in the sheets.
+BOOL CreateContactSheets(HWND hwndEdit, LPCTSTR lpszFolder, UINT uFormat = SF_PNG);
+
+// Re-encodes the thumbnails and icons of all maps and items in a folder and its subfolders as
+// WebP images, which are saved next to the files with the .Gbx extension replaced by .webp.
+// The files are processed in parallel. Maps use the photo preset, items the icon preset.
+BOOL ExportWebpThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, int nQuality = 80, UINT uOptions = 0);
+
+// Saves the JPEG thumbnails of all maps in a folder and its subfolders as they are stored in the
+// files, next to the maps with the .Gbx extension replaced by .jpg. Items are skipped. The images
+// are not decoded. Since the thumbnails are stored upside down, bFlipImage flips them losslessly.
+BOOL ExportJpegThumbnails(HWND hwndEdit, LPCTSTR lpszFolder, BOOL bFlipImage = TRUE);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,359 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// CsvParser.cpp- Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "CsvParser.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
+
+#define CSV_MIN_CARRYSIZE 4096
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward declarations of functions included in this code module
+
+// Parses the record at the beginning of the data. Returns FALSE if the record is incomplete.
+static BOOL ParseRecord(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData, LPCSV_RECORD lpRecord, LPDWORD lpcbUsed);
+// Finds the next field delimiter or line feed
+static LPCSTR FindFieldEnd(LPCSV_PARSER lpParser, LPCSTR lpData, LPCSTR lpEnd);
+// Appends data to the carry buffer and removes the bytes already parsed
+static BOOL AppendCarry(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CsvInitParser(LPCSV_PARSER lpParser, char chDelimiter)
+{
+	if (lpParser == NULL)
+		return;
+
+	ZeroMemory(lpParser, sizeof(CSV_PARSER));
+	lpParser->chDelimiter = chDelimiter;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	lpParser->bUseSse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CsvFreeParser(LPCSV_PARSER lpParser)
+{
+	if (lpParser == NULL)
+		return;
+
+	if (lpParser->lpCarry != NULL)
+		MyGlobalFreePtr((LPVOID)lpParser->lpCarry);
+
+	lpParser->lpCarry = NULL;
+	lpParser->cbCarry = lpParser->dwCarryPos = lpParser->cbAlloc = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CsvFeed(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData)
+{
+	if (lpParser == NULL || lpParser->bError)
+		return;
+
+	// Keep the rest of a chunk that has not been parsed completely
+	if (lpParser->dwChunkPos < lpParser->cbChunk &&
+		!AppendCarry(lpParser, lpParser->lpChunk + lpParser->dwChunkPos, lpParser->cbChunk - lpParser->dwChunkPos))
+		lpParser->bError = TRUE;
+
+	lpParser->lpChunk = lpData;
+	lpParser->cbChunk = (lpData != NULL) ? cbData : 0;
+	lpParser->dwChunkPos = 0;
+
+	if (lpData == NULL)
+		lpParser->bFinal = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL CsvRead(LPCSV_PARSER lpParser, LPCSV_RECORD lpRecord)
+{
+	if (lpParser == NULL || lpRecord == NULL)
+		return FALSE;
+
+	while (!lpParser->bError)
+	{
+		DWORD cbUsed = 0;
+		LPCSTR lpRest = lpParser->lpChunk + lpParser->dwChunkPos;
+		DWORD cbRest = lpParser->cbChunk - lpParser->dwChunkPos;
+
+		if (lpParser->dwCarryPos < lpParser->cbCarry)
+		{ // Parse the record of the carry buffer first
+			if (ParseRecord(lpParser, lpParser->lpCarry + lpParser->dwCarryPos,
+				lpParser->cbCarry - lpParser->dwCarryPos, lpRecord, &cbUsed))
+			{
+				lpParser->dwCarryPos += cbUsed;
+				if (lpRecord->uFields > 0)
+					return TRUE;
+				continue;
+			}
+
+			if (cbRest == 0)
+				return FALSE;
+
+			// Complete the record with the next line of the chunk
+			LPCSTR lpEnd = (LPCSTR)memchr(lpRest, '\n', cbRest);
+			DWORD cbAppend = (lpEnd != NULL) ? (DWORD)(lpEnd - lpRest) + 1 : cbRest;
+			if (!AppendCarry(lpParser, lpRest, cbAppend))
+				lpParser->bError = TRUE;
+			lpParser->dwChunkPos += cbAppend;
+			continue;
+		}
+
+		lpParser->cbCarry = 0;
+		lpParser->dwCarryPos = 0;
+
+		if (cbRest == 0)
+			return FALSE;
+
+		// Parse the chunk in place
+		if (ParseRecord(lpParser, lpRest, cbRest, lpRecord, &cbUsed))
+		{
+			lpParser->dwChunkPos += cbUsed;
+			if (lpRecord->uFields > 0)
+				return TRUE;
+			continue;
+		}
+
+		// Carry the incomplete record over to the next chunk
+		if (!AppendCarry(lpParser, lpRest, cbRest))
+			lpParser->bError = TRUE;
+		lpParser->dwChunkPos = lpParser->cbChunk;
+		return FALSE;
+	}
+
+	return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD CsvGetField(const LPCSV_RECORD lpRecord, UINT uField, LPSTR lpszText, DWORD cchText)
+{
+	if (lpszText == NULL || cchText == 0)
+		return 0;
+
+	DWORD cchOut = 0;
+	if (lpRecord != NULL && uField < lpRecord->uFields && uField < CSV_MAX_FIELDS)
+	{
+		const CSV_FIELD* pField = &lpRecord->aFields[uField];
+		for (DWORD i = 0; i < pField->cchValue && cchOut < cchText - 1; i++)
+		{
+			lpszText[cchOut++] = pField->lpszValue[i];
+			if (pField->bQuoted && pField->lpszValue[i] == '"')
+				i++; // Doubled quote
+		}
+	}
+
+	lpszText[cchOut] = '\0';
+
+	return cchOut;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int CsvGetFieldInt(const LPCSV_RECORD lpRecord, UINT uField)
+{
+	if (lpRecord == NULL || uField >= lpRecord->uFields || uField >= CSV_MAX_FIELDS)
+		return 0;
+
+	LPCSTR lpsz = lpRecord->aFields[uField].lpszValue;
+	LPCSTR lpszEnd = lpsz + lpRecord->aFields[uField].cchValue;
+	while (lpsz < lpszEnd && (*lpsz == ' ' || *lpsz == '\t'))
+		lpsz++;
+
+	BOOL bNegative = FALSE;
+	if (lpsz < lpszEnd && (*lpsz == '-' || *lpsz == '+'))
+		bNegative = (*lpsz++ == '-');
+
+	int nValue = 0;
+	while (lpsz < lpszEnd && *lpsz >= '0' && *lpsz <= '9')
+		nValue = nValue * 10 + (*lpsz++ - '0');
+
+	return bNegative ? -nValue : nValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL ParseRecord(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData, LPCSV_RECORD lpRecord, LPDWORD lpcbUsed)
+{
+	const char chDelimiter = lpParser->chDelimiter;
+	LPCSTR lpsz = lpData;
+	LPCSTR lpEnd = lpData + cbData;
+	UINT uFields = 0;
+
+	*lpcbUsed = 0;
+	lpRecord->uFields = 0;
+
+	for (;;)
+	{
+		LPCSTR lpszValue = lpsz;
+		DWORD cchValue = 0;
+		BOOL bQuoted = (lpsz < lpEnd && *lpsz == '"');
+
+		if (bQuoted)
+		{ // The value ends at a quote that is not doubled
+			LPCSTR lpszQuote = ++lpszValue;
+			for (;;)
+			{
+				lpszQuote = (LPCSTR)memchr(lpszQuote, '"', lpEnd - lpszQuote);
+				if (lpszQuote == NULL || (lpszQuote + 1 == lpEnd && !lpParser->bFinal))
+				{
+					if (!lpParser->bFinal)
+						return FALSE;
+					lpszQuote = lpEnd; // Unterminated value at the end of the data
+					break;
+				}
+				if (lpszQuote + 1 < lpEnd && lpszQuote[1] == '"')
+					lpszQuote += 2;
+				else
+					break;
+			}
+
+			cchValue = (DWORD)(lpszQuote - lpszValue);
+			lpsz = (lpszQuote < lpEnd) ? lpszQuote + 1 : lpEnd;
+
+			// Skip anything between the closing quote and the end of the field
+			while (lpsz < lpEnd && *lpsz != chDelimiter && *lpsz != '\n')
+				lpsz++;
+		}
+		else
+		{
+			lpsz = FindFieldEnd(lpParser, lpsz, lpEnd);
+			cchValue = (DWORD)(lpsz - lpszValue);
+			if (cchValue > 0 && lpszValue[cchValue-1] == '\r' && (lpsz == lpEnd || *lpsz == '\n'))
+				cchValue--;
+		}
+
+		// The end of the record is unknown until the line feed has been received
+		if (lpsz == lpEnd && !lpParser->bFinal)
+			return FALSE;
+
+		if (uFields < CSV_MAX_FIELDS)
+		{
+			lpRecord->aFields[uFields].lpszValue = lpszValue;
+			lpRecord->aFields[uFields].cchValue = cchValue;
+			lpRecord->aFields[uFields].bQuoted = bQuoted;
+		}
+		uFields++;
+
+		if (lpsz < lpEnd && *lpsz == chDelimiter)
+		{
+			lpsz++;
+			continue;
+		}
+
+		if (lpsz < lpEnd)
+			lpsz++; // Line feed
+		break;
+	}
+
+	*lpcbUsed = (DWORD)(lpsz - lpData);
+
+	// Empty lines are skipped
+	if (uFields == 1 && lpRecord->aFields[0].cchValue == 0 && !lpRecord->aFields[0].bQuoted)
+		return TRUE;
+
+	lpRecord->uFields = uFields;
+	lpRecord->uRecord = ++lpParser->uRecords;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static LPCSTR FindFieldEnd(LPCSV_PARSER lpParser, LPCSTR lpData, LPCSTR lpEnd)
+{
+	const char chDelimiter = lpParser->chDelimiter;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	if (lpParser->bUseSse2)
+	{ // Compare 16 characters at once
+		__m128i delimiter = _mm_set1_epi8(chDelimiter);
+		__m128i linefeed = _mm_set1_epi8('\n');
+		while (lpEnd - lpData >= 16)
+		{
+			__m128i chars = _mm_loadu_si128((const __m128i*)lpData);
+			int nMask = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(chars, delimiter), _mm_cmpeq_epi8(chars, linefeed)));
+			if (nMask != 0)
+			{
+				unsigned long ulIndex;
+				_BitScanForward(&ulIndex, (unsigned long)nMask);
+				return lpData + ulIndex;
+			}
+			lpData += 16;
+		}
+	}
+#endif
+
+	while (lpData < lpEnd && *lpData != chDelimiter && *lpData != '\n')
+		lpData++;
+
+	return lpData;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL AppendCarry(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData)
+{
+	// Remove the parsed bytes, which are no longer referenced
+	if (lpParser->dwCarryPos > 0)
+	{
+		MoveMemory(lpParser->lpCarry, lpParser->lpCarry + lpParser->dwCarryPos,
+			lpParser->cbCarry - lpParser->dwCarryPos);
+		lpParser->cbCarry -= lpParser->dwCarryPos;
+		lpParser->dwCarryPos = 0;
+	}
+
+	if (cbData > CSV_MAX_RECORDSIZE - lpParser->cbCarry)
+		return FALSE;
+
+	DWORD cbNeeded = lpParser->cbCarry + cbData;
+	if (cbNeeded > lpParser->cbAlloc)
+	{
+		DWORD cbAlloc = max(lpParser->cbAlloc, CSV_MIN_CARRYSIZE);
+		while (cbAlloc < cbNeeded)
+			cbAlloc *= 2;
+
+		LPSTR lpCarry = (LPSTR)MyGlobalAllocPtr(GHND, cbAlloc);
+		if (lpCarry == NULL)
+			return FALSE;
+
+		if (lpParser->lpCarry != NULL)
+		{
+			CopyMemory(lpCarry, lpParser->lpCarry, lpParser->cbCarry);
+			MyGlobalFreePtr((LPVOID)lpParser->lpCarry);
+		}
+
+		lpParser->lpCarry = lpCarry;
+		lpParser->cbAlloc = cbAlloc;
+	}
+
+	CopyMemory(lpParser->lpCarry + lpParser->cbCarry, lpData, cbData);
+	lpParser->cbCarry += cbData;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
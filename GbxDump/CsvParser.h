@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// CsvParser.h - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Number of fields of a record that are returned, further fields are ignored
+#define CSV_MAX_FIELDS      16
+
+// Upper limit for a single record that is split across several chunks
+#define CSV_MAX_RECORDSIZE  1048576
+
+// Field of a record. The value points into the parsed data, is not null-terminated and
+// remains valid until the next call of CsvRead or CsvFeed.
+typedef struct _CSV_FIELD
+{
+    LPCSTR lpszValue;   // Value without the enclosing quotes
+    DWORD  cchValue;    // Number of characters of the value
+    BOOL   bQuoted;     // Quoted value, which can contain doubled quotes
+} CSV_FIELD, FAR* LPCSV_FIELD, *PCSV_FIELD;
+
+// Record returned by CsvRead
+typedef struct _CSV_RECORD
+{
+    UINT   uRecord;     // One-based index of the record, empty lines are not counted
+    UINT   uFields;     // Number of fields of the record
+    CSV_FIELD aFields[CSV_MAX_FIELDS];
+} CSV_RECORD, FAR* LPCSV_RECORD, *PCSV_RECORD;
+
+// State of the tokenizer. Chunks of data are parsed in place; only a record that is
+// split across two chunks is copied to the carry buffer until it is complete.
+typedef struct _CSV_PARSER
+{
+    LPCSTR lpChunk;     // Data passed with the last call of CsvFeed
+    DWORD  cbChunk;     // Size of the chunk in bytes
+    DWORD  dwChunkPos;  // Offset of the first unparsed byte of the chunk
+    LPSTR  lpCarry;     // Incomplete record carried over from previous chunks
+    DWORD  cbCarry;     // Number of bytes in the carry buffer
+    DWORD  dwCarryPos;  // Offset of the first unparsed byte of the carry buffer
+    DWORD  cbAlloc;     // Allocated size of the carry buffer
+    UINT   uRecords;    // Number of records returned so far
+    char   chDelimiter; // Field delimiter
+    BOOL   bUseSse2;    // Set if the delimiters are searched 16 bytes at a time
+    BOOL   bFinal;      // Set when the end of the data has been reached
+    BOOL   bError;      // Set if a record exceeds CSV_MAX_RECORDSIZE or memory is low
+} CSV_PARSER, FAR* LPCSV_PARSER, *PCSV_PARSER;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Initializes the state of a tokenizer
+void CsvInitParser(LPCSV_PARSER lpParser, char chDelimiter = ',');
+
+// Frees the carry buffer of a tokenizer
+void CsvFreeParser(LPCSV_PARSER lpParser);
+
+// Passes the next chunk of data to the tokenizer. A NULL pointer marks the end of the data.
+// The chunk must remain valid until CsvRead returns FALSE.
+void CsvFeed(LPCSV_PARSER lpParser, LPCSTR lpData, DWORD cbData);
+
+// Returns the next complete record of the data passed so far. FALSE requests the next
+// chunk; at the end of the data or on errors (bError), it is returned permanently.
+BOOL CsvRead(LPCSV_PARSER lpParser, LPCSV_RECORD lpRecord);
+
+// Copies the value of a field into a null-terminated string and removes the quoting.
+// Returns the length of the string; longer values are truncated.
+DWORD CsvGetField(const LPCSV_RECORD lpRecord, UINT uField, LPSTR lpszText, DWORD cchText);
+
+// Converts the leading digits of a field into an integer. Missing fields are 0.
+int CsvGetFieldInt(const LPCSV_RECORD lpRecord, UINT uField);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
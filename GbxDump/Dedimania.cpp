@@ -18,15 +18,31 @@
 
 #include "stdafx.h"
 #include "Internet.h"
+#include "CsvParser.h"
 #include "Dedimania.h"
 
-#define DEDI_MAX_DATASIZE 8192
+#define DEDI_CACHE_MAXAGE 3600 // Records are cached for one hour
+
+// State of the output of a Dedimania response that is parsed while it is being received
+typedef struct _DEDI_OUTPUT
+{
+	HWND	hwndEdit;		// Output window
+	BOOL	bIsManiaPlanet;	// Records of the ManiaPlanet or the TrackMania 1 system
+	int		nOutputStart;	// Length of the text of the output window before the response
+	BOOL	bTrackFound;	// Set if the response contains the track info line
+	UINT	uRecords;		// Number of records output so far
+	CSV_PARSER parser;
+} DEDI_OUTPUT, *PDEDI_OUTPUT;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Forward declarations of functions included in this code module
 
 // Request, parse and output data from Dedimania
 BOOL RequestAndOutputDediData(HWND hwndEdit, LPCSTR lpszUid, BOOL bIsManiaPlanet, LPBOOL lpbTrackFound);
+// Receives a chunk of a Dedimania response and outputs the records that are complete
+static BOOL CALLBACK ReceiveDediData(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+// Outputs the records passed to the tokenizer so far
+static void OutputDediRecords(PDEDI_OUTPUT pOutput);
 // Converts a UTF-8 string to Unicode and removes the Nadeo formatting characters
 BOOL ConvertDediString(LPVOID lpData, SIZE_T cbLenData, LPTSTR lpszOutput, SIZE_T cchLenOutput);
 
@@ -41,42 +57,6 @@ const TCHAR g_szErrOom[]    = TEXT("Out of memory.\r\n");
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-// strtok replacement that also supports empty tokens
-static char *estrtok(char *str, const char *delim)
-{
-	static char *last = NULL;
-	char *ret;
-
-	if (str)
-		last = str;
-	else
-	{
-		if (!last)
-			return NULL;
-		last++;
-	}
-
-	ret = last;
-
-	for (;;)
-	{
-		if (*last == 0)
-		{
-			last = NULL;
-			return ret;
-		}
-
-		if (strchr(delim, *last))
-		{
-			*last = 0;
-			return ret;
-		}
-		last++;
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////
-
 BOOL DumpDedimania(HWND hwndEdit, LPCSTR lpszUid, LPCSTR lpszEnvi)
 {
 	if (hwndEdit == NULL || lpszUid == NULL || lpszEnvi == NULL)
@@ -91,10 +71,7 @@ BOOL DumpDedimania(HWND hwndEdit, LPCSTR lpszUid, LPCSTR lpszEnvi)
 	// Does the environment belong to TrackMania 1 or ManiaPlanet?
 	BOOL bIsTwice = FALSE;
 	BOOL bIsManiaPlanet = TRUE;
-	if (strcmp("Stadium", lpszEnvi) == 0)
-		bIsTwice = TRUE;
-	else if (strstr(g_szTm1Envis, lpszEnvi) != NULL)
-		bIsManiaPlanet = FALSE;
+	GetDediSystems(lpszEnvi, &bIsManiaPlanet, &bIsTwice);
 
 	// Retrieve and display the data
 	BOOL bSuccess = RequestAndOutputDediData(hwndEdit, lpszUid, bIsManiaPlanet, &bTrackFound);
@@ -119,166 +96,205 @@ BOOL RequestAndOutputDediData(HWND hwndEdit, LPCSTR lpszUid, BOOL bIsManiaPlanet
 	if (hwndEdit == NULL || lpszUid == NULL || lpbTrackFound == NULL)
 		return FALSE;
 
-	TCHAR szOutput[OUTPUT_LEN];
 	*lpbTrackFound = FALSE;
 
-	// Allocate memory for the Dedimania data
-	LPSTR lpszData = (LPSTR)MyGlobalAllocPtr(GHND, DEDI_MAX_DATASIZE);
-	if (lpszData == NULL)
+	PDEDI_OUTPUT pOutput = (PDEDI_OUTPUT)MyGlobalAllocPtr(GHND, sizeof(DEDI_OUTPUT));
+	if (pOutput == NULL)
 	{
 		OutputText(hwndEdit, g_szSep1);
 		OutputText(hwndEdit, g_szErrOom);
 		return FALSE;
 	}
 
-	// Build the URL for querying the data
+	pOutput->hwndEdit = hwndEdit;
+	pOutput->bIsManiaPlanet = bIsManiaPlanet;
+	CsvInitParser(&pOutput->parser);
+
+	// Build the URL for querying the data. The records are output while they are
+	// being downloaded, so the length of the record list is not limited.
 	TCHAR szDediUrl[512];
-	_sntprintf(szDediUrl, _countof(szDediUrl), g_szUrlDedi, TEXT("http"),
-		bIsManiaPlanet ? 8080 : 8000, bIsManiaPlanet ? TEXT("MX") : TEXT("TMX"), lpszUid);
-	if (!ReadInternetFile(hwndEdit, szDediUrl, lpszData, DEDI_MAX_DATASIZE))
-	{
-		MyGlobalFreePtr((LPVOID)lpszData);
-		return FALSE;
-	}
+	GetDediUrl(lpszUid, bIsManiaPlanet, szDediUrl, _countof(szDediUrl));
+	BOOL bSuccess = ReadInternetStream(hwndEdit, szDediUrl, ReceiveDediData, pOutput, DEDI_CACHE_MAXAGE);
+	if (bSuccess)
+	{ // Output the last record, which may lack the line break
+		CsvFeed(&pOutput->parser, NULL, 0);
+		OutputDediRecords(pOutput);
+
+		// Check for existing records
+		if (pOutput->bTrackFound && pOutput->uRecords == 0)
+		{
+			TCHAR szText[OUTPUT_LEN];
+			if (LoadString(g_hInstance, g_bGerUI ? IDP_GER_ERR_RECORDS : IDP_ENG_ERR_RECORDS, szText, _countof(szText)) > 0)
+				OutputText(hwndEdit, szText);
+		}
 
-	// Have user data been found?
-	if (lpszData[0] == '\0' || strchr(lpszData, ',') == NULL)
-	{
-		MyGlobalFreePtr((LPVOID)lpszData);
-		return TRUE;
+		*lpbTrackFound = pOutput->bTrackFound;
 	}
 
-	*lpbTrackFound = TRUE;
+	CsvFreeParser(&pOutput->parser);
+	MyGlobalFreePtr((LPVOID)pOutput);
 
-	// Place the cursor at the end of the line
-	int nLen = Edit_GetTextLength(hwndEdit);
-	Edit_SetSel(hwndEdit, (WPARAM)nLen, (LPARAM)nLen);
-	OutputText(hwndEdit, g_szSep1);
+	return bSuccess;
+}
 
-	// Skip first line (track info)
-	LPSTR lpsz = lpszData;
-	LPSTR lpszNewLine = strstr(lpsz, "\r\n");
-	if (lpszNewLine != NULL)
-	{
-		*lpszNewLine = '\0';
-		lpsz = lpszNewLine + 2;
-	}
-	else
-	{
-		MyGlobalFreePtr((LPVOID)lpszData);
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ReceiveDediData(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PDEDI_OUTPUT pOutput = (PDEDI_OUTPUT)lpParam;
+	if (pOutput == NULL)
+		return FALSE;
+
+	if (lpData == NULL)
+	{ // The request is restarted: remove the output of the data received so far
+		if (pOutput->bTrackFound)
+		{
+			Edit_SetSel(pOutput->hwndEdit, pOutput->nOutputStart, Edit_GetTextLength(pOutput->hwndEdit));
+			Edit_ReplaceSel(pOutput->hwndEdit, TEXT(""));
+		}
+
+		pOutput->bTrackFound = FALSE;
+		pOutput->uRecords = 0;
+		CsvFreeParser(&pOutput->parser);
+		CsvInitParser(&pOutput->parser);
 		return TRUE;
 	}
 
-	// Check for existing records
-	if (*lpsz == '\0')
-	{
-		TCHAR szText[OUTPUT_LEN];
-		if (LoadString(g_hInstance, g_bGerUI ? IDP_GER_ERR_RECORDS : IDP_ENG_ERR_RECORDS, szText, _countof(szText)) > 0)
-			OutputText(hwndEdit, szText);
-	}
+	CsvFeed(&pOutput->parser, lpData, cbData);
+	OutputDediRecords(pOutput);
+
+	return !pOutput->parser.bError;
+}
 
-	UINT uRecords = 0;
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void OutputDediRecords(PDEDI_OUTPUT pOutput)
+{
+	if (pOutput == NULL)
+		return;
+
+	HWND hwndEdit = pOutput->hwndEdit;
+	TCHAR szOutput[OUTPUT_LEN];
+	char szField[OUTPUT_LEN];
+	CSV_RECORD record;
 
-	// Parse and output list of records
-	while (lpsz != NULL)
+	while (CsvRead(&pOutput->parser, &record))
 	{
-		uRecords++;
+		// The first line holds the track info, which has several fields if user data have been found
+		if (record.uRecord == 1)
+		{
+			if (record.uFields > 1)
+			{
+				pOutput->bTrackFound = TRUE;
+
+				// Place the cursor at the end of the line
+				pOutput->nOutputStart = Edit_GetTextLength(hwndEdit);
+				Edit_SetSel(hwndEdit, (WPARAM)pOutput->nOutputStart, (LPARAM)pOutput->nOutputStart);
+				OutputText(hwndEdit, g_szSep1);
+			}
+			continue;
+		}
 
-		// Set pointer to next line. Ignore last (empty) row.
-		lpszNewLine = strstr(lpsz, "\r\n");
-		if (lpszNewLine != NULL)
+		if (!pOutput->bTrackFound)
+			continue;
+
+		// Time (ms)
+		OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("%02u. "), ++pOutput->uRecords);
+		int nTime = CsvGetFieldInt(&record, 0);
+		if (nTime < 3600000)
 		{
-			*lpszNewLine = '\0';
-			lpszNewLine += 2;
+			int nMinute   = (nTime / 60000);
+			int nSecond   = (nTime % 60000 / 1000);
+			int nMilliSec = (nTime % 60000 % 1000);
+
+			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput),
+				TEXT("%d:%02d.%003d, "), nMinute, nSecond, nMilliSec);
 		}
 		else
-			break;
+		{
+			int nHour     = (nTime / 3600000);
+			int nMinute   = (nTime % 3600000 / 60000);
+			int nSecond   = (nTime % 3600000 % 60000 / 1000);
+			int nMilliSec = (nTime % 3600000 % 60000 % 1000);
+
+			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput),
+				TEXT("%d:%02d:%02d.%003d, "), nHour, nMinute, nSecond, nMilliSec);
+		}
 
-		int i = 0;
-		LPSTR token = estrtok(lpsz, ",");
-		while (token != NULL)
+		// Game mode
+		int nGamemode = CsvGetFieldInt(&record, 1);
+		if (pOutput->bIsManiaPlanet)
 		{
-			i++;
-			switch (i)
+			switch (nGamemode)
 			{
-				case 1: // Time (ms)
-					{
-						OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("%02u. "), uRecords);
-						int nTime = atoi(token);
-						if (nTime < 3600000)
-						{
-							int nMinute   = (nTime / 60000);
-							int nSecond   = (nTime % 60000 / 1000);
-							int nMilliSec = (nTime % 60000 % 1000);
-
-							OutputTextFmt(hwndEdit, szOutput, _countof(szOutput),
-								TEXT("%d:%02d.%003d, "), nMinute, nSecond, nMilliSec);
-						}
-						else
-						{
-							int nHour     = (nTime / 3600000);
-							int nMinute   = (nTime % 3600000 / 60000);
-							int nSecond   = (nTime % 3600000 % 60000 / 1000);
-							int nMilliSec = (nTime % 3600000 % 60000 % 1000);
-
-							OutputTextFmt(hwndEdit, szOutput, _countof(szOutput),
-								TEXT("%d:%02d:%02d.%003d, "), nHour, nMinute, nSecond, nMilliSec);
-						}
-					}
-					break;
-				case 2:
-					{
-						int nGamemode = atoi(token);
-						if (bIsManiaPlanet)
-						{
-							switch (nGamemode)
-							{
-								case 2: OutputText(hwndEdit, TEXT("TA,  ")); break;
-								case 1: OutputText(hwndEdit, TEXT("Rnd, ")); break;
-								case 4: OutputText(hwndEdit, TEXT("Laps, ")); break;
-								case 3: OutputText(hwndEdit, TEXT("Team, ")); break;
-								case 5: OutputText(hwndEdit, TEXT("Cup, ")); break;
-								case 0: OutputText(hwndEdit, TEXT("Script, ")); break;
-								case 6: OutputText(hwndEdit, TEXT("Stunts, ")); break;
-								default: OutputText(hwndEdit, TEXT("?, "));
-							}
-						}
-						else
-						{
-							if (nGamemode == 1)
-								OutputText(hwndEdit, TEXT("TA,  "));
-							else if (nGamemode == 0)
-								OutputText(hwndEdit, TEXT("Rnd, "));
-							else
-								OutputText(hwndEdit, TEXT("?,   "));
-						}
-					}
-					break;
-				/*
-				case 4: // Login
-					ConvertDediString(token, strlen(token), szOutput, _countof(szOutput));
-					OutputText(hwndEdit, szOutput);
-					OutputText(hwndEdit, TEXT(", "));
-					break;
-				*/
-				case 6: // Nick name
-					ConvertDediString(token, strlen(token), szOutput, _countof(szOutput));
-					OutputText(hwndEdit, szOutput);
-					OutputText(hwndEdit, TEXT(", "));
-					break;
-				case 7: // Server name
-					ConvertDediString(token, strlen(token), szOutput, _countof(szOutput));
-					OutputText(hwndEdit, szOutput);
-					OutputText(hwndEdit, TEXT("\r\n"));
-					break;
+				case 2: OutputText(hwndEdit, TEXT("TA,  ")); break;
+				case 1: OutputText(hwndEdit, TEXT("Rnd, ")); break;
+				case 4: OutputText(hwndEdit, TEXT("Laps, ")); break;
+				case 3: OutputText(hwndEdit, TEXT("Team, ")); break;
+				case 5: OutputText(hwndEdit, TEXT("Cup, ")); break;
+				case 0: OutputText(hwndEdit, TEXT("Script, ")); break;
+				case 6: OutputText(hwndEdit, TEXT("Stunts, ")); break;
+				default: OutputText(hwndEdit, TEXT("?, "));
 			}
-			token = estrtok(NULL, ",");
 		}
-		lpsz = lpszNewLine;
+		else
+		{
+			if (nGamemode == 1)
+				OutputText(hwndEdit, TEXT("TA,  "));
+			else if (nGamemode == 0)
+				OutputText(hwndEdit, TEXT("Rnd, "));
+			else
+				OutputText(hwndEdit, TEXT("?,   "));
+		}
+
+		/*
+		// Login
+		SIZE_T cchField = CsvGetField(&record, 3, szField, _countof(szField));
+		ConvertDediString(szField, cchField, szOutput, _countof(szOutput));
+		OutputText(hwndEdit, szOutput);
+		OutputText(hwndEdit, TEXT(", "));
+		*/
+
+		// Nick name
+		SIZE_T cchField = CsvGetField(&record, 5, szField, _countof(szField));
+		ConvertDediString(szField, cchField, szOutput, _countof(szOutput));
+		OutputText(hwndEdit, szOutput);
+		OutputText(hwndEdit, TEXT(", "));
+
+		// Server name
+		cchField = CsvGetField(&record, 6, szField, _countof(szField));
+		ConvertDediString(szField, cchField, szOutput, _countof(szOutput));
+		OutputText(hwndEdit, szOutput);
+		OutputText(hwndEdit, TEXT("\r\n"));
 	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void GetDediSystems(LPCSTR lpszEnvi, PBOOL pbIsManiaPlanet, PBOOL pbIsTwice)
+{
+	if (lpszEnvi == NULL || pbIsManiaPlanet == NULL || pbIsTwice == NULL)
+		return;
+
+	*pbIsTwice = FALSE;
+	*pbIsManiaPlanet = TRUE;
+	if (strcmp("Stadium", lpszEnvi) == 0)
+		*pbIsTwice = TRUE;
+	else if (strstr(g_szTm1Envis, lpszEnvi) != NULL)
+		*pbIsManiaPlanet = FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL GetDediUrl(LPCSTR lpszUid, BOOL bIsManiaPlanet, LPTSTR lpszUrl, SIZE_T cchUrl)
+{
+	if (lpszUid == NULL || lpszUrl == NULL || cchUrl == 0)
+		return FALSE;
+
+	_sntprintf(lpszUrl, cchUrl, g_szUrlDedi, TEXT("http"),
+		bIsManiaPlanet ? 8080 : 8000, bIsManiaPlanet ? TEXT("MX") : TEXT("TMX"), lpszUid);
+	lpszUrl[cchUrl - 1] = TEXT('\0');
 
-	// Release memory
-	MyGlobalFreePtr((LPVOID)lpszData);
 	return TRUE;
 }
 
@@ -16,7 +16,19 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+// URL template of the Dedimania records
+extern const TCHAR g_szUrlDedi[];
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 // Retrieves and prints Dedimania information for a specific map
 BOOL DumpDedimania(HWND hwndEdit, LPCSTR lpszUid, LPCSTR lpszEnvi);
 
+// Determines whether the Dedimania records of an environment are kept by the ManiaPlanet
+// system, by the TrackMania system or by both of them (Stadium)
+void GetDediSystems(LPCSTR lpszEnvi, PBOOL pbIsManiaPlanet, PBOOL pbIsTwice);
+
+// Creates the URL to request the Dedimania records by map UID
+BOOL GetDediUrl(LPCSTR lpszUid, BOOL bIsManiaPlanet, LPTSTR lpszUrl, SIZE_T cchUrl);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -118,6 +118,10 @@ BOOL GameSkinChunk(HWND hwndEdit, HANDLE hFile, PCHUNK chunkGameSkin);
 BOOL ProfileChunk(HWND hwndEdit, HANDLE hFile, PCHUNK chunkProfile);
 BOOL FolderDepChunk(HWND hwndEdit, HANDLE hFile, PCHUNK chunkFolder);
 
+BOOL ReadPreviewText(HANDLE hFile, PCHUNK pckDesc, PGBX_PREVIEW pPreview);
+BOOL ReadPreviewImage(HANDLE hFile, PCHUNK pckImage, PGBX_PREVIEW pPreview, UINT uTargetSize, BOOL bRawJpeg);
+HANDLE IconDataToDib(LPVOID lpData, WORD wWidth, WORD wHeight);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // String Constants
 
@@ -317,6 +321,237 @@ BOOL DumpGbx(HWND hwndEdit, HANDLE hFile, LPSTR lpszUid, LPSTR lpszEnvi)
 	return bRet;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+// ReadGbxPreview is called by the worker threads of CreateContactSheets from ContactSheet.cpp
+
+BOOL ReadGbxPreview(HANDLE hFile, PGBX_PREVIEW pPreview, UINT uTargetSize, BOOL bRawJpeg)
+{
+	if (hFile == NULL || pPreview == NULL)
+		return FALSE;
+
+	ZeroMemory(pPreview, sizeof(GBX_PREVIEW));
+
+	// File signature
+	CHAR achSignature[3] = {0};
+	if (!FileSeekBegin(hFile, 0) || !ReadData(hFile, (LPVOID)achSignature, 3) ||
+		memcmp(achSignature, "GBX", 3) != 0)
+		return FALSE;
+
+	// The header chunks are only available in binary files of version 6
+	WORD wVersion = 0;
+	if (!ReadNat16(hFile, &wVersion) || wVersion != 6)
+		return FALSE;
+
+	BYTE achStorageSettings[4] = {'X', 'X', 'X', 'X'};
+	if (!ReadData(hFile, (LPVOID)&achStorageSettings, 4) || !IS_GBX_BINARY(achStorageSettings))
+		return FALSE;
+
+	DWORD dwClassId = 0;
+	if (!ReadMask(hFile, &dwClassId))
+		return FALSE;
+
+	BASECLASS eBaseClass = GetBaseClass(NULL, dwClassId);
+	if (eBaseClass != eChallenge && eBaseClass != eCollector)
+		return FALSE;
+
+	pPreview->bIsMap = (eBaseClass == eChallenge);
+
+	// Number of chunks, which follows the size of the Header User Data
+	DWORD dwNumHeaderChunks = 0;
+	if (!FileSeekBegin(hFile, POS_NUMBER_CHUNKS))
+		return FALSE;
+	if (!ReadNat32(hFile, &dwNumHeaderChunks) || dwNumHeaderChunks == 0 || dwNumHeaderChunks > 0xFF)
+		return FALSE;
+
+	// Determine the positions of the description and the image
+	CHUNK chunkDesc = {0};
+	CHUNK chunkImage = {0};
+	DWORD dwChunkId, dwChunkSize;
+	DWORD dwChunkOffset = GET_CHUNK_OFFSET(dwNumHeaderChunks);
+
+	for (DWORD dwCouter = 1; dwCouter <= dwNumHeaderChunks; dwCouter++)
+	{
+		if (!ReadNat32(hFile, &dwChunkId))
+			return FALSE;
+		if (!ReadNat32(hFile, &dwChunkSize))
+			return FALSE;
+
+		dwChunkSize &= 0x7FFFFFFF;
+
+		PCHUNK pChunk = NULL;
+		if (pPreview->bIsMap)
+		{
+			if (dwChunkId == 0x03043003 || dwChunkId == 0x24003003)
+				pChunk = &chunkDesc;
+			else if (dwChunkId == 0x03043007 || dwChunkId == 0x24003007)
+				pChunk = &chunkImage;
+		}
+		else
+		{
+			if (dwChunkId == 0x0301A003 || dwChunkId == 0x2400A003 || dwChunkId == 0x2E001003)
+				pChunk = &chunkDesc;
+			else if (dwChunkId == 0x0301A004 || dwChunkId == 0x2400A004 || dwChunkId == 0x2E001004)
+				pChunk = &chunkImage;
+		}
+
+		if (pChunk != NULL)
+		{
+			pChunk->dwId = dwChunkId;
+			pChunk->dwSize = dwChunkSize;
+			pChunk->dwOffset = dwChunkOffset;
+		}
+
+		dwChunkOffset += dwChunkSize;
+	}
+
+	// A file with an unreadable description is still listed
+	if (chunkDesc.dwSize > 0)
+		ReadPreviewText(hFile, &chunkDesc, pPreview);
+
+	// Item icons are not JPEG images and are not needed as raw data
+	if (chunkImage.dwSize > 0 && (!bRawJpeg || pPreview->bIsMap))
+		ReadPreviewImage(hFile, &chunkImage, pPreview, uTargetSize, bRawJpeg);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ReadPreviewText(HANDLE hFile, PCHUNK pckDesc, PGBX_PREVIEW pPreview)
+{
+	CHAR szRead[ID_LEN];
+	IDENTIFIER id;
+	ResetIdentifier(&id);
+
+	if (!FileSeekBegin(hFile, pckDesc->dwOffset))
+		return FALSE;
+
+	if (pPreview->bIsMap)
+	{ // Common chunk: version, map UID, environment, author and map name
+		BYTE cVersion = 0;
+		if (!ReadNat8(hFile, &cVersion))
+			return FALSE;
+
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szEnvi, szRead, _countof(pPreview->szEnvi));
+
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szAuthor, szRead, _countof(pPreview->szAuthor));
+
+		if (ReadString(hFile, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szName, szRead, _countof(pPreview->szName));
+	}
+	else
+	{ // Desc chunk: name, collection and author
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szName, szRead, _countof(pPreview->szName));
+
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szEnvi, szRead, _countof(pPreview->szEnvi));
+
+		if (ReadIdentifier(hFile, &id, szRead, _countof(szRead)) < 0)
+			return FALSE;
+		MyStrNCpyA(pPreview->szAuthor, szRead, _countof(pPreview->szAuthor));
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ReadPreviewImage(HANDLE hFile, PCHUNK pckImage, PGBX_PREVIEW pPreview, UINT uTargetSize, BOOL bRawJpeg)
+{
+	DWORD dwImageSize = 0;
+	WORD wWidth  = 0;
+	WORD wHeight = 0;
+	BOOL bIsJpeg = pPreview->bIsMap;
+
+	if (!FileSeekBegin(hFile, pckImage->dwOffset))
+		return FALSE;
+
+	if (pPreview->bIsMap)
+	{ // Thumbnail chunk: version, size and the JPEG image enclosed in <Thumbnail.jpg>
+		DWORD dwVersion = 0;
+		if (!ReadNat32(hFile, &dwVersion) || dwVersion == 0)
+			return FALSE;
+
+		if (!ReadNat32(hFile, &dwImageSize) || dwImageSize >= 0xA00000)
+			return FALSE;
+
+		if (!FileSeekCurrent(hFile, sizeof "<Thumbnail.jpg>" - 1))
+			return FALSE;
+	}
+	else
+	{ // Icon chunk: size and either RGBA data or a WebP image
+		if (!ReadNat16(hFile, &wWidth))
+			return FALSE;
+		if (!ReadNat16(hFile, &wHeight))
+			return FALSE;
+
+		if ((SHORT)wWidth >= 0 && (SHORT)wHeight >= 0)
+		{
+			dwImageSize = wWidth * wHeight * 4;
+			if (dwImageSize != (pckImage->dwSize - 4))
+				return FALSE;
+		}
+		else
+		{
+			WORD wVersion = 0;
+			if (!ReadNat16(hFile, &wVersion))
+				return FALSE;
+			if (!ReadNat32(hFile, &dwImageSize) || dwImageSize >= 0xA00000)
+				return FALSE;
+
+			wWidth = wHeight = 0;
+		}
+	}
+
+	if (dwImageSize == 0)
+		return FALSE;
+
+	LPVOID lpData = MyGlobalAllocPtr(GHND, dwImageSize);
+	if (lpData == NULL)
+		return FALSE;
+
+	if (!ReadData(hFile, lpData, dwImageSize))
+	{
+		MyGlobalFreePtr(lpData);
+		return FALSE;
+	}
+
+	// The caller takes over the undecoded JPEG data
+	if (bIsJpeg && bRawJpeg)
+	{
+		pPreview->lpJpegData = lpData;
+		pPreview->dwJpegSize = dwImageSize;
+		return TRUE;
+	}
+
+	// Decode the image without displaying messages
+	__try
+	{
+		if (bIsJpeg)
+			pPreview->hDib = JpegToDib(lpData, dwImageSize, TRUE, -1, uTargetSize);
+		else if (wWidth > 0 && wHeight > 0)
+			pPreview->hDib = IconDataToDib(lpData, wWidth, wHeight);
+		else
+			pPreview->hDib = WebpToDib(lpData, dwImageSize, TRUE);
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) { pPreview->hDib = NULL; }
+
+	MyGlobalFreePtr(lpData);
+
+	return (pPreview->hDib != NULL);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
 BASECLASS GetBaseClass(HWND hwndEdit, DWORD dwClassId)
@@ -3745,42 +3980,13 @@ BOOL CollectorIconChunk(HWND hwndEdit, HANDLE hFile, PCHUNK pckIcon)
 		}
 
 		// Create a 32-bit DIB
-		HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + dwSizeImage);
+		HANDLE hDib = IconDataToDib(lpData, wWidth, wHeight);
 		if (hDib != NULL)
 		{
 			g_hBitmapThumb = FreeBitmap(g_hBitmapThumb);
-			g_hDibThumb = FreeDib(g_hDibThumb);
-
-			LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
-			if (lpbi != NULL)
-			{
-				lpbi->biSize = sizeof(BITMAPINFOHEADER);
-				lpbi->biWidth = wWidth;
-				lpbi->biHeight = wHeight;
-				lpbi->biPlanes = 1;
-				lpbi->biBitCount = 32;
-				lpbi->biCompression = BI_RGB;
-				lpbi->biSizeImage = dwSizeImage;
-				lpbi->biXPelsPerMeter = 0;
-				lpbi->biYPelsPerMeter = 0;
-				lpbi->biClrUsed = 0;
-				lpbi->biClrImportant = 0;
-
-				LPBYTE lpSrc = (LPBYTE)lpData;
-				LPBYTE lpDest = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
-
-				__try
-				{
-					while (dwSizeImage--)
-						*lpDest++ = *lpSrc++;
-				}
-				__except (EXCEPTION_EXECUTE_HANDLER) { dwSizeImage = 0; }
-
-				GlobalUnlock(hDib);
-
-				g_hDibThumb = hDib;
-				g_hBitmapThumb = CreatePremultipliedBitmap(hDib);
-			}
+			FreeDib(g_hDibThumb);
+			g_hDibThumb = hDib;
+			g_hBitmapThumb = CreatePremultipliedBitmap(hDib);
 
 			// View the thumbnail immediately
 			HWND hwndThumb = GetDlgItem(hDlg, IDC_THUMB);
@@ -3819,22 +4025,12 @@ BOOL CollectorIconChunk(HWND hwndEdit, HANDLE hFile, PCHUNK pckIcon)
 	if (dwImageSize == 0)
 		return TRUE;
 
-	// Read and display the WebP image
-	LPVOID lpData = MyGlobalAllocPtr(GHND, dwImageSize);
-	if (lpData == NULL)
-		return FALSE;
-
-	if (!ReadData(hFile, lpData, dwImageSize))
-	{
-		MyGlobalFreePtr(lpData);
-		return FALSE;
-	}
-
-	// Decode the thumbnail image
+	// Decode and display the WebP image while reading it
 	HANDLE hDib = NULL;
+	BOOL bReadError = FALSE;
 	HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
 
-	__try { hDib = WebpToDib(lpData, dwImageSize, TRUE); }
+	__try { hDib = WebpFileToDib(hFile, dwImageSize, TRUE, FALSE, PreviewThumbnail, hDlg, &bReadError); }
 	__except (EXCEPTION_EXECUTE_HANDLER) { hDib = NULL; }
 
 	SetCursor(hOldCursor);
@@ -3844,9 +4040,54 @@ BOOL CollectorIconChunk(HWND hwndEdit, HANDLE hFile, PCHUNK pckIcon)
 	else
 		MarkAsUnsupported(hDlg);
 
-	MyGlobalFreePtr(lpData);
+	return !bReadError;
+}
 
-	return TRUE;
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Creates a bottom-up 32-bit DIB from the uncompressed BGRA data of an icon
+
+HANDLE IconDataToDib(LPVOID lpData, WORD wWidth, WORD wHeight)
+{
+	DWORD dwSizeImage = wWidth * wHeight * 4;
+	if (lpData == NULL || dwSizeImage == 0)
+		return NULL;
+
+	HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + dwSizeImage);
+	if (hDib == NULL)
+		return NULL;
+
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+	{
+		GlobalFree(hDib);
+		return NULL;
+	}
+
+	lpbi->biSize = sizeof(BITMAPINFOHEADER);
+	lpbi->biWidth = wWidth;
+	lpbi->biHeight = wHeight;
+	lpbi->biPlanes = 1;
+	lpbi->biBitCount = 32;
+	lpbi->biCompression = BI_RGB;
+	lpbi->biSizeImage = dwSizeImage;
+	lpbi->biXPelsPerMeter = 0;
+	lpbi->biYPelsPerMeter = 0;
+	lpbi->biClrUsed = 0;
+	lpbi->biClrImportant = 0;
+
+	LPBYTE lpSrc = (LPBYTE)lpData;
+	LPBYTE lpDest = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+
+	__try
+	{
+		while (dwSizeImage--)
+			*lpDest++ = *lpSrc++;
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) { dwSizeImage = 0; }
+
+	GlobalUnlock(hDib);
+
+	return hDib;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
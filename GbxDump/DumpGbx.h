@@ -19,4 +19,26 @@
 // Displays file header information of a GameBox file
 BOOL DumpGbx(HWND hwndEdit, HANDLE hFile, LPSTR lpszUid, LPSTR lpszEnvi);
 
+#define PREVIEW_TEXT_LEN 256
+
+// Name, author and preview image of a map or an item
+typedef struct _GBX_PREVIEW
+{
+	BOOL	bIsMap;							// Map or item
+	CHAR	szName[PREVIEW_TEXT_LEN];		// UTF-8, including formatting characters
+	CHAR	szAuthor[PREVIEW_TEXT_LEN];		// Login of the author
+	CHAR	szEnvi[PREVIEW_TEXT_LEN];		// Environment of a map, collection of an item
+	HANDLE	hDib;							// Thumbnail of a map or icon of an item, or NULL
+	LPVOID	lpJpegData;						// Undecoded JPEG thumbnail of a map, or NULL
+	DWORD	dwJpegSize;						// Size of the JPEG thumbnail in bytes
+} GBX_PREVIEW, *PGBX_PREVIEW;
+
+// Reads the name, author and thumbnail or icon of a binary map or item file without any output,
+// so that several files can be read in parallel. If a target size is specified, JPEG thumbnails
+// are scaled down while they are decoded. If bRawJpeg is set, the JPEG thumbnail of a map is
+// returned as it is stored in the file (upside down) instead of a DIB, and item icons are skipped.
+// Returns FALSE for other files. The DIB must be freed using FreeDib, the JPEG data using
+// MyGlobalFreePtr.
+BOOL ReadGbxPreview(HANDLE hFile, PGBX_PREVIEW pPreview, UINT uTargetSize = 0, BOOL bRawJpeg = FALSE);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -25,6 +25,10 @@
 #include "DumpDds.h"
 #include "DumpPak.h"
 #include "DumpGbx.h"
+#include "NadeoFmt.h"
+#include "Internet.h"
+#include "Batch.h"
+#include "ContactSheet.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Data Types
@@ -161,6 +165,10 @@ int APIENTRY _tWinMain(__in HINSTANCE hInstance, __in_opt HINSTANCE hPrevInstanc
 	g_bUseDarkMode = IsAppThemed() && ShouldAppsUseDarkMode() && !IsHighContrast();
 	// Load the default thumbnail from the resources
 	g_hDibDefault = MyLoadBitmap(hInstance, MAKEINTRESOURCE(IDB_THUMB), LR_CREATEDIBSECTION);
+	// Reuse the worker threads of the WebP decoder across images
+	InitWebpWorkerPool();
+	// Create the color tables of the thumbnail resampler once for all threads
+	InitResampler();
 
 	LPTSTR lpszFilename = NULL;
 	LPCTSTR lpszCommandLine = AllocGetCmdLine(lpCmdLine, &lpszFilename);
@@ -179,6 +187,18 @@ int APIENTRY _tWinMain(__in HINSTANCE hInstance, __in_opt HINSTANCE hPrevInstanc
 	g_hDibThumb = FreeDib(g_hDibThumb);
 	g_hDibDefault = FreeDib(g_hDibDefault);
 
+	// Free the cached span lists of formatted strings
+	FreeNadeoTextCache();
+
+	// Terminate the idle worker threads of the WebP decoder
+	FreeWebpWorkerPool();
+
+	// Free the color tables and the cached filter weights of the resampler
+	FreeResampler();
+
+	// Close the kept-alive connections to the exchange sites
+	CloseInternetSession();
+
 	if (hLibDwmapi != NULL)
 		FreeLibrary(hLibDwmapi);
 
@@ -276,6 +296,8 @@ INT_PTR CALLBACK GbxDumpDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM l
 	static char     s_szUid[UID_LENGTH];
 	static char     s_szEnvi[ENVI_LENGTH];
 	static TCHAR    s_szFileName[MY_OFN_MAX_PATH];
+	static TCHAR    s_szBatchFileName[MY_OFN_MAX_PATH];
+	static TCHAR    s_szSheetFolder[MAX_PATH];
 
 	switch (message)
 	{
@@ -661,6 +683,73 @@ INT_PTR CALLBACK GbxDumpDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM l
 					}
 					return FALSE;
 
+				case IDC_BATCH:
+					{ // Look up the exchange data of the maps of a UID list
+						if (GetBatchFileName(hDlg, s_szBatchFileName, _countof(s_szBatchFileName)))
+						{
+							HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+							HWND hwndEdit = GetDlgItem(hDlg, IDC_OUTPUT);
+
+							ClearOutputWindow(hwndEdit);
+							BatchLookup(hwndEdit, s_szBatchFileName);
+
+							SetCursor(hOldCursor);
+						}
+					}
+					return FALSE;
+
+				case IDC_CONTACT_SHEET:
+				case IDC_CONTACT_SHEET_WEBP:
+					{ // Create contact sheets of the maps and items of a folder
+						if (GetContactSheetFolder(hDlg, s_szSheetFolder, _countof(s_szSheetFolder)))
+						{
+							HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+							HWND hwndEdit = GetDlgItem(hDlg, IDC_OUTPUT);
+
+							ClearOutputWindow(hwndEdit);
+							CreateContactSheets(hwndEdit, s_szSheetFolder,
+								LOWORD(wParam) == IDC_CONTACT_SHEET_WEBP ? SF_WEBP : SF_PNG);
+
+							SetCursor(hOldCursor);
+						}
+					}
+					return FALSE;
+
+				case IDC_WEBP_EXPORT:
+				case IDC_WEBP_EXPORT_LOSSLESS:
+					{ // Save the thumbnails and icons of the maps and items of a folder as WebP files
+						if (GetContactSheetFolder(hDlg, s_szSheetFolder, _countof(s_szSheetFolder), TE_WEBP))
+						{
+							HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+							HWND hwndEdit = GetDlgItem(hDlg, IDC_OUTPUT);
+
+							ClearOutputWindow(hwndEdit);
+							// Same settings as the lossy and lossless WebP formats of the Save As dialog box
+							if (LOWORD(wParam) == IDC_WEBP_EXPORT_LOSSLESS)
+								ExportWebpThumbnails(hwndEdit, s_szSheetFolder, 75, WEO_LOSSLESS);
+							else
+								ExportWebpThumbnails(hwndEdit, s_szSheetFolder);
+
+							SetCursor(hOldCursor);
+						}
+					}
+					return FALSE;
+
+				case IDC_JPEG_EXPORT:
+					{ // Save the JPEG thumbnails of the maps of a folder without decoding them
+						if (GetContactSheetFolder(hDlg, s_szSheetFolder, _countof(s_szSheetFolder), TE_JPEG))
+						{
+							HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+							HWND hwndEdit = GetDlgItem(hDlg, IDC_OUTPUT);
+
+							ClearOutputWindow(hwndEdit);
+							ExportJpegThumbnails(hwndEdit, s_szSheetFolder);
+
+							SetCursor(hOldCursor);
+						}
+					}
+					return FALSE;
+
 				case IDC_WORDWRAP:
 					{
 						HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
@@ -743,7 +832,7 @@ INT_PTR CALLBACK GbxDumpDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM l
 					return FALSE;
 
 				case IDC_THUMB_SAVE:
-					{ // Save the current thumbnail as a PNG or BMP file
+					{ // Save the current thumbnail as a PNG, BMP or WebP file
 						TCHAR szFileName[MY_OFN_MAX_PATH];
 						MyStrNCpy(szFileName, s_szFileName, _countof(szFileName));
 
@@ -753,6 +842,11 @@ INT_PTR CALLBACK GbxDumpDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM l
 							HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
 							if (s_dwSaveFilterIndex == 1)
 								bSuccess = SavePngFile(szFileName, g_hDibThumb ? g_hDibThumb : g_hDibDefault);
+							else if (s_dwSaveFilterIndex == 3)
+								bSuccess = SaveWebpFile(szFileName, g_hDibThumb ? g_hDibThumb : g_hDibDefault);
+							else if (s_dwSaveFilterIndex == 4)
+								bSuccess = SaveWebpFile(szFileName, g_hDibThumb ? g_hDibThumb : g_hDibDefault,
+									WEP_DEFAULT, 75, WEO_DEFAULT | WEO_LOSSLESS);
 							else
 								bSuccess = SaveBmpFile(szFileName, g_hDibThumb ? g_hDibThumb : g_hDibDefault);
 							SetCursor(hOldCursor);
@@ -1408,24 +1502,14 @@ BOOL DumpWebP(HWND hwndEdit, HANDLE hFile, DWORD dwFileSize)
 	if (!FileSeekBegin(hFile, 0))
 		return FALSE;
 
-	LPVOID lpData = MyGlobalAllocPtr(GHND, dwFileSize);
-	if (lpData == NULL)
-		return FALSE;
-
-	// Read the file
-	if (!ReadData(hFile, lpData, dwFileSize))
-	{
-		MyGlobalFreePtr(lpData);
-		return FALSE;
-	}
-
 	OutputText(hwndEdit, g_szSep1);
 
 	HANDLE hDib = NULL;
+	BOOL bReadError = FALSE;
 	HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
 
-	// Decode the WebP image
-	__try { hDib = WebpToDib(lpData, dwFileSize, FALSE, TRUE); }
+	// Decode the WebP image while reading the file
+	__try { hDib = WebpFileToDib(hFile, dwFileSize, FALSE, TRUE, PreviewThumbnail, hDlg, &bReadError); }
 	__except (EXCEPTION_EXECUTE_HANDLER) { hDib = NULL; }
 
 	SetCursor(hOldCursor);
@@ -1435,9 +1519,7 @@ BOOL DumpWebP(HWND hwndEdit, HANDLE hFile, DWORD dwFileSize)
 	else
 		MarkAsUnsupported(hDlg);
 
-	MyGlobalFreePtr(lpData);
-
-	return TRUE;
+	return !bReadError;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2247,3 +2329,32 @@ void ReplaceThumbnail(HWND hDlg, HANDLE hDib)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
+// The rows that have not been decoded yet are still black. Transparency is ignored
+// until the complete image replaces the current thumbnail.
+
+void CALLBACK PreviewThumbnail(LPVOID lpParam, HANDLE hDib, int nRows)
+{
+	UNREFERENCED_PARAMETER(nRows);
+
+	HWND hwndThumb = GetDlgItem((HWND)lpParam, IDC_THUMB);
+	if (hwndThumb == NULL || hDib == NULL)
+		return;
+
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+		return;
+
+	HDC hdc = GetDC(hwndThumb);
+	if (hdc != NULL)
+	{
+		RECT rc;
+		GetClientRect(hwndThumb, &rc);
+		DrawDib(hdc, lpbi, rc.left, rc.top, rc.right-rc.left, rc.bottom-rc.top,
+			0, 0, abs(lpbi->biWidth), abs(lpbi->biHeight));
+		ReleaseDC(hwndThumb, hdc);
+	}
+
+	GlobalUnlock(hDib);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
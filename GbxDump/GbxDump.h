@@ -74,4 +74,7 @@ void MarkAsUnsupported(HWND hDlg);
 // Replaces the current thumbnail with the given DIB
 void ReplaceThumbnail(HWND hDlg, HANDLE hDib);
 
+// Draws a partially decoded DIB over the current thumbnail (lpParam is the dialog box handle)
+void CALLBACK PreviewThumbnail(LPVOID lpParam, HANDLE hDib, int nRows);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -25,12 +25,34 @@
 #include "stdafx.h"
 #include "ImgFmt.h"
 #include "DumpBmp.h"
+#include "Archive.h"
 #include "..\libjpeg\jpeglib.h"
 #include "..\libjpeg\iccprofile.h"
+extern "C" {
+#include "..\libjpeg\transupp.h"  // Has no C++ linkage specification
+}
 #include "..\libwebp\src\webp\decode.h"
+#include "..\libwebp\src\webp\encode.h"
+#include "..\libwebp\src\utils\thread_utils.h"
 #include "..\crunch\inc\crnlib.h"
 #include "..\crunch\crnlib\crn_miniz.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// Color masks of a 16- or 32-bpp DIB, which are analyzed once per image
+typedef struct _DIB_BITFIELDS
+{
+	DWORD           adwMask[4];     // Blue, green, red and alpha mask
+	int             anShift[4];     // Left shifts that move the most significant bits of the masks to bit 31
+	WORD            wBitCount;      // Bits per pixel (16 or 32)
+	BOOL            bUseSse2;       // Expand the pixels using SSE2 instructions
+} DIB_BITFIELDS, *LPDIB_BITFIELDS;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Forward declarations of functions included in this code module
 
@@ -39,6 +61,25 @@
 int Mul8Bit(int a, int b);
 // Determines the value of a color component using a color mask
 BYTE GetColorValue(DWORD dwPixel, DWORD dwMask);
+// Analyzes the color masks of a 16- or 32-bpp DIB
+void InitDibBitfields(LPDIB_BITFIELDS lpBitfields, WORD wBitCount, DWORD dwRedMask, DWORD dwGreenMask, DWORD dwBlueMask, DWORD dwAlphaMask);
+// Determines the value of a color component using the analyzed color masks (0 = blue ... 3 = alpha).
+// The result is the same as that of GetColorValue.
+BYTE GetBitfieldValue(DWORD dwPixel, LPDIB_BITFIELDS lpBitfields, int nIndex);
+// Expands a row of 16- or 32-bpp pixels into BGRA with pre-multiplied alpha. The alpha values
+// are accumulated in lpcAlphaOr and lpcAlphaAnd to detect visible and transparent pixels.
+void PremultiplyBitfieldsRow(LPDIB_BITFIELDS lpBitfields, LPBYTE lpSrc, LPBYTE lpDest, LONG lWidth, LPBYTE lpcAlphaOr, LPBYTE lpcAlphaAnd);
+#if defined(_M_IX86) || defined(_M_X64)
+// Expands four 32-bit pixels into BGRA with pre-multiplied alpha
+__m128i PremultiplyBitfieldsSse2(__m128i px, const __m128i* aMask, const __m128i* aShift);
+#endif
+// Expands any DIB into top-down BGRA pixels. lpbHasAlpha receives TRUE if the image is translucent.
+// Rows that cannot be read due to an access violation remain black.
+LPBYTE ConvertDibToBgra(HANDLE hDib, LPLONG lplWidth, LPLONG lplHeight, LPBOOL lpbHasAlpha);
+// Outputs the features of a WebP bitstream
+void OutputWebpFeatures(const WebPBitstreamFeatures* pFeatures);
+// Returns the file name extension of an image file type of the Save As dialog box
+LPCTSTR GetSaveExtension(DWORD dwFilterIndex);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -87,8 +128,8 @@ BOOL GetFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen, LPDWORD lp
 			_tcscpy(szFile, TEXT("*"));
 		if ((psz = _tcsrchr(szFile, TEXT('.'))) != NULL)
 			szFile[psz - szFile] = TEXT('\0');
-		_tcsncat(szFile, *lpdwFilterIndex == 1 ? TEXT(".png") : TEXT(".bmp"),
-			_countof(szFile) - _tcslen(szFile) - 1);
+		_tcsncat(szFile, TEXT("."), _countof(szFile) - _tcslen(szFile) - 1);
+		_tcsncat(szFile, GetSaveExtension(*lpdwFilterIndex), _countof(szFile) - _tcslen(szFile) - 1);
 	}
 
 	OPENFILENAME of    = {0};
@@ -99,7 +140,7 @@ BOOL GetFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen, LPDWORD lp
 	of.nMaxFile        = _countof(szFile);
 	of.lpstrFilter     = szFilter;
 	of.nFilterIndex    = *lpdwFilterIndex;
-	of.lpstrDefExt     = bSave ? (*lpdwFilterIndex == 1 ? TEXT("png") : TEXT("bmp")) : TEXT("gbx");
+	of.lpstrDefExt     = bSave ? GetSaveExtension(*lpdwFilterIndex) : TEXT("gbx");
 	of.lpstrInitialDir = pszInitialDir;
 
 	BOOL bRet = FALSE;
@@ -136,6 +177,23 @@ BOOL GetFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen, LPDWORD lp
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+LPCTSTR GetSaveExtension(DWORD dwFilterIndex)
+{
+	// PNG, BMP, lossy WebP and lossless WebP (see IDS_*_FILTER_PNG)
+	switch (dwFilterIndex)
+	{
+		case 1:
+			return TEXT("png");
+		case 3:
+		case 4:
+			return TEXT("webp");
+		default:
+			return TEXT("bmp");
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL SaveBmpFile(LPCTSTR lpszFileName, HANDLE hDib)
 {
 	if (hDib == NULL || lpszFileName == NULL)
@@ -194,6 +252,96 @@ BOOL SaveBmpFile(LPCTSTR lpszFileName, HANDLE hDib)
 	return TRUE;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+// PNG encoder using the deflate compressor of miniz
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// Approximate number of filtered bytes of a strip that is deflated on its own
+#define PNG_STRIP_SIZE          0x40000
+// Maximum number of worker threads that deflate strips in parallel
+#define PNG_MAX_THREADS         16
+// Number of strip buffers per worker thread
+#define PNG_STRIPS_PER_THREAD   2
+// Number of zero bytes in front of a converted image row (left neighbors of the first pixel)
+#define PNG_ROW_PADDING         16
+// Distance between the converted image rows in the scratch buffer of a strip
+#define PNG_ROW_STRIDE(bytes)   (PNG_ROW_PADDING + (((bytes) + PNG_ROW_PADDING - 1) & ~(PNG_ROW_PADDING - 1)))
+
+// Source image data and PNG pixel format
+typedef struct _PNG_SOURCE
+{
+	LPBYTE          lpDIB;          // Pointer to the image data of the DIB
+	DWORD           dwIncrement;    // Bytes per DIB row
+	LONG            lWidth;         // Width of the image in pixels
+	LONG            lHeight;        // Height of the image in pixels
+	WORD            wBitCount;      // Bits per DIB pixel
+	BOOL            bFlipImage;     // DIB rows are stored top-down
+	BOOL            bIsCMYK;        // DIB uses the CMYK color model
+	DWORD           dwRedMask;      // Color masks of 16- and 32-bpp DIBs
+	DWORD           dwGreenMask;
+	DWORD           dwBlueMask;
+	DWORD           dwAlphaMask;
+	RGBQUAD         aPalette[256];  // Color table of 1- to 8-bpp DIBs
+	int             nNumChannels;   // Channels per PNG pixel
+	DWORD           dwRowBytes;     // Bytes per PNG row without the filter type byte
+	BOOL            bUseSse2;       // Filter the rows using SSE2 instructions
+} PNG_SOURCE, *LPPNG_SOURCE;
+
+// A strip of whole image rows, filtered and deflated independently of the other strips
+typedef struct _PNG_STRIP
+{
+	UINT            uStrip;         // Index of the strip in the image
+	LPBYTE          lpData;         // Data of the IDAT chunk of the strip
+	DWORD           cbData;         // Size of the chunk data in bytes
+	DWORD           cbAlloc;        // Size of the data buffer in bytes
+	DWORD           dwAdler;        // Adler-32 checksum of the filtered rows
+	BOOL            bSuccess;       // The strip has been deflated
+	HANDLE          hDone;          // Event that is signaled when the strip is done
+} PNG_STRIP, *LPPNG_STRIP;
+
+// Shared state of the threads that deflate the strips of an image
+typedef struct _PNG_ENCODER
+{
+	LPPNG_SOURCE    lpSource;       // Source image data
+	LPPNG_STRIP     lpSlots;        // Buffers of the strips that are deflated or waiting to be written
+	UINT            uNumSlots;      // Number of strip buffers
+	UINT            uNumStrips;     // Number of strips of the image
+	LONG            lRowsPerStrip;  // Image rows per strip, except for the last one
+	volatile LONG   lNextStrip;     // Index of the next strip to be deflated
+	HANDLE          hFreeSlots;     // Semaphore that counts the strip buffers that can be reused
+} PNG_ENCODER, *LPPNG_ENCODER;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions
+
+// Gets the size of the scratch buffer that holds the rows of a strip while it is filtered
+DWORD png_rows_size(LPPNG_SOURCE lpSource);
+// Converts an image row (counted from the top) of the DIB into a PNG row
+void convert_png_row(LPPNG_SOURCE lpSource, LONG lRow, LPBYTE lpDest);
+// Applies a PNG filter to an image row and returns the sum of the absolute values of the
+// filtered bytes (taken as signed). Both rows must be preceded by PNG_ROW_PADDING zeros.
+DWORD filter_png_row(LPPNG_SOURCE lpSource, BYTE cFilter, LPBYTE lpRow, LPBYTE lpPrior, LPBYTE lpDest);
+#if defined(_M_IX86) || defined(_M_X64)
+// Computes the Paeth predictors of eight 16-bit values
+__m128i paeth_predictor_sse2(__m128i a, __m128i b, __m128i c);
+#endif
+// Filters and deflates the rows of a strip into the data of its IDAT chunk
+BOOL deflate_png_strip(LPPNG_ENCODER lpEncoder, LPPNG_STRIP lpStrip, tdefl_compressor* pComp, LPBYTE lpRows);
+// Combines the Adler-32 checksums of two consecutive blocks, cbData2 is the size of the second block
+DWORD adler32_combine(DWORD dwAdler1, DWORD dwAdler2, ULONGLONG cbData2);
+// Writes a PNG chunk with its length, type and CRC to a file
+BOOL write_png_chunk(HANDLE hFile, LPCSTR lpszType, LPCVOID lpData, DWORD cbData);
+// Thread function that deflates strips until all strips of the image have been taken
+static unsigned __stdcall png_strip_thread(LPVOID lpParameter);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback functions
+
+// Appends deflated data to the data of a strip (tdefl_put_buf_func_ptr)
+static mz_bool png_put_buf(const void* pBuf, int len, void* pUser);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
 BOOL SavePngFile(LPCTSTR lpszFileName, HANDLE hDib)
@@ -220,10 +368,14 @@ BOOL SavePngFile(LPCTSTR lpszFileName, HANDLE hDib)
 	WORD wBitCount = bIsCore ? lpbc->bcBitCount : lpbi->biBitCount;
 	BOOL bIsCMYK   = DibIsCMYK((LPCSTR)lpbi);
 
-	if (wBitCount < 16)
+	// Palette DIBs are expanded row by row, except for RLE compressed DIBs
+	BOOL bIsPalette = (wBitCount == 1 || wBitCount == 2 || wBitCount == 4 || wBitCount == 8) &&
+		(bIsCore || lpbi->biCompression == BI_RGB);
+
+	if (wBitCount < 16 && !bIsPalette)
 	{
 		GlobalUnlock(hDib);
-		// Convert a 1-, 4-, or 8-bpp DIB to a 24-bpp DIB
+		// Convert the DIB to a 24-bpp DIB
 		HANDLE hNewDib = ChangeDibBitDepth(hDib, 24);
 		if (hNewDib == NULL)
 			return FALSE;
@@ -245,253 +397,785 @@ BOOL SavePngFile(LPCTSTR lpszFileName, HANDLE hDib)
 		bFlipImage = TRUE;
 	}
 
-	int nNumChannels = max(wBitCount >> 3, 1);
-	// 16-bit bitmaps are saved with 3 channels (or 4, if there is an alpha channel)
-	LONG lSizeImage = lHeight * lWidth * (wBitCount == 16 ? 4 : nNumChannels);
-	if (lSizeImage == 0)
+	PNG_SOURCE Source;
+	ZeroMemory(&Source, sizeof(Source));
+	Source.lpDIB        = FindDibBits((LPCSTR)lpbi);
+	Source.dwIncrement  = WIDTHBYTES(lWidth * wBitCount);
+	Source.lWidth       = lWidth;
+	Source.lHeight      = lHeight;
+	Source.wBitCount    = wBitCount;
+	Source.bFlipImage   = bFlipImage;
+	Source.bIsCMYK      = bIsCMYK && wBitCount == 32;
+	Source.nNumChannels = max(wBitCount >> 3, 1);
+#if defined(_M_IX86) || defined(_M_X64)
+	Source.bUseSse2     = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+	if (bIsPalette)
 	{
-		GlobalUnlock(hDib);
-		return FALSE;
+		// Indices without a color table entry are black
+		UINT uNumColors = min(DibNumColors((LPCSTR)lpbi), 1U << wBitCount);
+		LPBYTE lpPalette = FindDibPalette((LPCSTR)lpbi);
+		BOOL bIsGray = TRUE;
+		for (UINT i = 0; i < uNumColors; i++)
+		{
+			LPRGBQUAD lprgb = &Source.aPalette[i];
+			if (bIsCore)
+			{
+				lprgb->rgbBlue  = ((LPRGBTRIPLE)lpPalette)[i].rgbtBlue;
+				lprgb->rgbGreen = ((LPRGBTRIPLE)lpPalette)[i].rgbtGreen;
+				lprgb->rgbRed   = ((LPRGBTRIPLE)lpPalette)[i].rgbtRed;
+			}
+			else
+			{
+				lprgb->rgbBlue  = ((LPRGBQUAD)lpPalette)[i].rgbBlue;
+				lprgb->rgbGreen = ((LPRGBQUAD)lpPalette)[i].rgbGreen;
+				lprgb->rgbRed   = ((LPRGBQUAD)lpPalette)[i].rgbRed;
+			}
+
+			if (lprgb->rgbRed != lprgb->rgbGreen || lprgb->rgbRed != lprgb->rgbBlue)
+				bIsGray = FALSE;
+		}
+
+		// A DIB with a gray color table is saved as a grayscale image
+		Source.nNumChannels = bIsGray ? 1 : 3;
+	}
+	else if (Source.bIsCMYK)  // 32-bpp CMYK DIB --> 24-bpp RGB PNG
+		Source.nNumChannels = 3;
+	else if (wBitCount == 16 || wBitCount == 32)
+	{
+		if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
+		{
+			LPDWORD lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
+			Source.dwRedMask   = lpdwColorMasks[0];
+			Source.dwGreenMask = lpdwColorMasks[1];
+			Source.dwBlueMask  = lpdwColorMasks[2];
+			Source.dwAlphaMask = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
+		}
+		else if (wBitCount == 16)
+		{
+			Source.dwRedMask   = 0x00007C00;
+			Source.dwGreenMask = 0x000003E0;
+			Source.dwBlueMask  = 0x0000001F;
+			Source.dwAlphaMask = 0x00008000; // TODO: Add test for visible pixels
+		}
+		else
+		{
+			Source.dwRedMask   = 0x00FF0000;
+			Source.dwGreenMask = 0x0000FF00;
+			Source.dwBlueMask  = 0x000000FF;
+			Source.dwAlphaMask = 0xFF000000; // TODO: Add test for visible pixels
+		}
+
+		// 16-bit bitmaps are saved with 3 channels (or 4, if there is an alpha channel)
+		if (wBitCount == 16)
+			Source.nNumChannels = Source.dwAlphaMask ? 4 : 3;
 	}
 
-	LPBYTE lpDIB = FindDibBits((LPCSTR)lpbi);
-	LPBYTE lpRGBA = (LPBYTE)MyGlobalAllocPtr(GHND, lSizeImage);
-	if (lpRGBA == NULL)
+	Source.dwRowBytes = (DWORD)lWidth * Source.nNumChannels;
+	if (Source.dwRowBytes == 0 || lHeight == 0)
 	{
 		GlobalUnlock(hDib);
 		return FALSE;
 	}
 
-	LONG h, w;
-	LPBYTE lpSrc, lpDest;
-	LPDWORD lpdwColorMasks;
-	DWORD dwColor, dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask;
-	DWORD dwIncrement = WIDTHBYTES(lWidth * wBitCount);
+	// Split the image into strips of whole rows. Each strip is deflated as a separate block
+	// sequence, which ends with a sync flush on a byte boundary, so that the deflated strips
+	// can be concatenated into one zlib stream. The strips are written as they are finished.
+	PNG_ENCODER Encoder;
+	ZeroMemory(&Encoder, sizeof(Encoder));
+	Encoder.lpSource = &Source;
+	Encoder.lRowsPerStrip = max((LONG)((PNG_STRIP_SIZE + Source.dwRowBytes) / (Source.dwRowBytes + 1)), 1);
+	Encoder.uNumStrips = (UINT)((lHeight + Encoder.lRowsPerStrip - 1) / Encoder.lRowsPerStrip);
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	UINT uMaxThreads = min(min(si.dwNumberOfProcessors, PNG_MAX_THREADS), Encoder.uNumStrips);
+	if (uMaxThreads < 2)
+		uMaxThreads = 0;
+	Encoder.uNumSlots = uMaxThreads > 0 ? min(uMaxThreads * PNG_STRIPS_PER_THREAD, Encoder.uNumStrips) : 1;
+
+	// Bound of the deflated data of a strip, plus zlib header and sync flush
+	DWORD cbStrip = (DWORD)mz_compressBound((mz_ulong)Encoder.lRowsPerStrip * (Source.dwRowBytes + 1)) + 16;
+
+	BOOL bSuccess = TRUE;
+	Encoder.lpSlots = (LPPNG_STRIP)MyGlobalAllocPtr(GHND, Encoder.uNumSlots * sizeof(PNG_STRIP));
+	if (Encoder.lpSlots == NULL)
+		bSuccess = FALSE;
+
+	for (UINT i = 0; i < Encoder.uNumSlots && bSuccess; i++)
+	{
+		LPPNG_STRIP lpSlot = &Encoder.lpSlots[i];
+		lpSlot->lpData = (LPBYTE)MyGlobalAllocPtr(GHND, cbStrip + 4);  // Room for the Adler-32 checksum
+		lpSlot->cbAlloc = cbStrip;
+		if (uMaxThreads > 0)
+			lpSlot->hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (lpSlot->lpData == NULL || (uMaxThreads > 0 && lpSlot->hDone == NULL))
+			bSuccess = FALSE;
+	}
+
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	if (bSuccess)
+	{
+		hFile = CreateFile(lpszFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		bSuccess = (hFile != INVALID_HANDLE_VALUE);
+	}
+
+	// PNG signature and header chunk
+	if (bSuccess)
+	{
+		static const BYTE abSignature[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+		BYTE abHeader[13] = {0};
+		*(LPDWORD)&abHeader[0] = _byteswap_ulong((DWORD)lWidth);
+		*(LPDWORD)&abHeader[4] = _byteswap_ulong((DWORD)lHeight);
+		abHeader[8] = 8;  // Bit depth
+		abHeader[9] = Source.nNumChannels == 1 ? 0 : (Source.nNumChannels == 3 ? 2 : 6);  // Color type
+
+		DWORD dwWrite;
+		bSuccess = WriteFile(hFile, abSignature, sizeof(abSignature), &dwWrite, NULL) &&
+			dwWrite == sizeof(abSignature) && write_png_chunk(hFile, "IHDR", abHeader, sizeof(abHeader));
+	}
+
+	// Start the worker threads, which take the strips in order
+	HANDLE ahThreads[PNG_MAX_THREADS];
+	DWORD dwThreads = 0;
+	if (bSuccess && uMaxThreads > 0)
+	{
+		Encoder.hFreeSlots = CreateSemaphore(NULL, Encoder.uNumSlots, LONG_MAX, NULL);
+		for (UINT i = 0; i < uMaxThreads && Encoder.hFreeSlots != NULL; i++)
+		{
+			HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, png_strip_thread, &Encoder, 0, NULL);
+			if (hThread == NULL)
+				break;
+			ahThreads[dwThreads++] = hThread;
+		}
+	}
+
+	// Without worker threads, the strips are deflated in this thread
+	tdefl_compressor* pComp = NULL;
+	LPBYTE lpRows = NULL;
+	if (bSuccess && dwThreads == 0)
+	{
+		pComp = (tdefl_compressor*)MyGlobalAllocPtr(GHND, sizeof(tdefl_compressor));
+		lpRows = (LPBYTE)MyGlobalAllocPtr(GHND, png_rows_size(&Source));
+		bSuccess = (pComp != NULL && lpRows != NULL);
+	}
+
+	// Write an IDAT chunk for each strip
+	DWORD dwAdler = MZ_ADLER32_INIT;
+	for (UINT s = 0; s < Encoder.uNumStrips && bSuccess; s++)
+	{
+		LPPNG_STRIP lpStrip = &Encoder.lpSlots[s % Encoder.uNumSlots];
+		if (dwThreads > 0)
+			WaitForSingleObject(lpStrip->hDone, INFINITE);
+		else
+		{
+			lpStrip->uStrip = s;
+			lpStrip->bSuccess = deflate_png_strip(&Encoder, lpStrip, pComp, lpRows);
+		}
+
+		bSuccess = lpStrip->bSuccess;
+		if (bSuccess)
+		{
+			LONG lNumRows = min(Encoder.lRowsPerStrip, lHeight - (LONG)s * Encoder.lRowsPerStrip);
+			dwAdler = s > 0 ? adler32_combine(dwAdler, lpStrip->dwAdler,
+				(ULONGLONG)lNumRows * (Source.dwRowBytes + 1)) : lpStrip->dwAdler;
+
+			// The Adler-32 checksum of the filtered rows ends the zlib stream
+			if (s + 1 == Encoder.uNumStrips)
+			{
+				DWORD dwChecksum = _byteswap_ulong(dwAdler);
+				CopyMemory(lpStrip->lpData + lpStrip->cbData, &dwChecksum, sizeof(dwChecksum));
+				lpStrip->cbData += sizeof(dwChecksum);
+			}
+
+			bSuccess = write_png_chunk(hFile, "IDAT", lpStrip->lpData, lpStrip->cbData);
+		}
+
+		if (dwThreads > 0)
+		{
+			if (!bSuccess)  // Let the worker threads run out of strips
+				InterlockedExchange(&Encoder.lNextStrip, (LONG)Encoder.uNumStrips);
+			ReleaseSemaphore(Encoder.hFreeSlots, 1, NULL);
+		}
+	}
+
+	if (bSuccess)
+		bSuccess = write_png_chunk(hFile, "IEND", NULL, 0);
+
+	if (dwThreads > 0)
+	{
+		WaitForMultipleObjects(dwThreads, ahThreads, TRUE, INFINITE);
+		for (DWORD i = 0; i < dwThreads; i++)
+			CloseHandle(ahThreads[i]);
+	}
+
+	if (Encoder.hFreeSlots != NULL)
+		CloseHandle(Encoder.hFreeSlots);
+
+	if (Encoder.lpSlots != NULL)
+	{
+		for (UINT i = 0; i < Encoder.uNumSlots; i++)
+		{
+			if (Encoder.lpSlots[i].lpData != NULL)
+				MyGlobalFreePtr((LPVOID)Encoder.lpSlots[i].lpData);
+			if (Encoder.lpSlots[i].hDone != NULL)
+				CloseHandle(Encoder.lpSlots[i].hDone);
+		}
+		MyGlobalFreePtr((LPVOID)Encoder.lpSlots);
+	}
+
+	if (pComp != NULL)
+		MyGlobalFreePtr((LPVOID)pComp);
+	if (lpRows != NULL)
+		MyGlobalFreePtr((LPVOID)lpRows);
+
+	GlobalUnlock(hDib);
+
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hFile);
+		if (!bSuccess)
+			DeleteFile(lpszFileName);
+	}
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD png_rows_size(LPPNG_SOURCE lpSource)
+{
+	// Two converted rows (prior and current) and one filtered row per filter type
+	return 2 * PNG_ROW_STRIDE(lpSource->dwRowBytes) + 5 * (lpSource->dwRowBytes + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void convert_png_row(LPPNG_SOURCE lpSource, LONG lRow, LPBYTE lpDest)
+{
+	LONG w, lWidth = lpSource->lWidth;
+	LPBYTE lpSrc = lpSource->lpDIB + (ULONG_PTR)(lpSource->bFlipImage ? lRow :
+		lpSource->lHeight-1 - lRow) * lpSource->dwIncrement;
+	DWORD dwColor;
 
 	__try
 	{
-		switch (nNumChannels)
+		switch (lpSource->wBitCount)
 		{
-			case 1: // 1-, 4-, or 8-bpp DIB --> 8-bpp grayscale PNG; requires a sorted color table
-				if (wBitCount == 8)
-				{
-					for (h = 0; h < lHeight; h++)
-					{
-						lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-						lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-						for (w = 0; w < lWidth; w++)
-							*lpDest++ = *lpSrc++;
-					}
-				}
-				else if (wBitCount == 4)
-				{
-					for (h = 0; h < lHeight; h++)
-					{
-						lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-						lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-						for (w = 0; w < lWidth; w += 2)
-						{
-							*lpDest++ = ((*lpSrc >> 4) & 0x0F) * 0x11;
-							*lpDest++ = (*lpSrc++ & 0x0F) * 0x11;
-						}
-					}
-				}
-				else if (wBitCount == 1)
+			case 1: // 1-, 2-, 4-, or 8-bpp DIB --> 8-bpp grayscale or 24-bpp RGB PNG
+			case 2:
+			case 4:
+			case 8:
 				{
-					for (h = 0; h < lHeight; h++)
+					UINT uBitCount = lpSource->wBitCount;
+					BYTE cMask = (BYTE)((1U << uBitCount) - 1);
+					for (w = 0; w < lWidth; w++)
 					{
-						lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-						lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-						for (w = 0; w < lWidth; w += 8)
+						// The leftmost pixel is stored in the most significant bits of a byte
+						UINT uBit = (UINT)w * uBitCount;
+						BYTE cIndex = (lpSrc[uBit >> 3] >> (8 - uBitCount - (uBit & 7))) & cMask;
+						LPRGBQUAD lprgb = &lpSource->aPalette[cIndex];
+						*lpDest++ = lprgb->rgbRed;
+						if (lpSource->nNumChannels == 3)
 						{
-							for (int b = 0; b < 8; b++)
-								*lpDest++ = ((*lpSrc >> (7 - b)) & 1) ? 0xFF : 0x00;
-							lpSrc++;
+							*lpDest++ = lprgb->rgbGreen;
+							*lpDest++ = lprgb->rgbBlue;
 						}
 					}
 				}
-
 				break;
 
-			case 2: // 16-bpp DIB --> 24- or 32-bpp PNG
-				if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
-				{
-					lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
-					dwRedMask      = lpdwColorMasks[0];
-					dwGreenMask    = lpdwColorMasks[1];
-					dwBlueMask     = lpdwColorMasks[2];
-					dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
-				}
-				else
-				{
-					dwRedMask   = 0x00007C00;
-					dwGreenMask = 0x000003E0;
-					dwBlueMask  = 0x0000001F;
-					dwAlphaMask = 0x00008000; // TODO: Add test for visible pixels
-				}
-
-				nNumChannels = dwAlphaMask ? 4 : 3;
-
-				for (h = 0; h < lHeight; h++)
+			case 16: // 16-bpp DIB --> 24- or 32-bpp PNG
+				for (w = 0; w < lWidth; w++)
 				{
-					lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-					lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-					for (w = 0; w < lWidth; w++)
-					{
-						dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), 0);
-						*lpDest++ = GetColorValue(dwColor, dwRedMask);
-						*lpDest++ = GetColorValue(dwColor, dwGreenMask);
-						*lpDest++ = GetColorValue(dwColor, dwBlueMask);
-						if (nNumChannels == 4)
-							*lpDest++ = GetColorValue(dwColor, dwAlphaMask);
-						lpSrc += 2;
-					}
+					dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), 0);
+					*lpDest++ = GetColorValue(dwColor, lpSource->dwRedMask);
+					*lpDest++ = GetColorValue(dwColor, lpSource->dwGreenMask);
+					*lpDest++ = GetColorValue(dwColor, lpSource->dwBlueMask);
+					if (lpSource->nNumChannels == 4)
+						*lpDest++ = GetColorValue(dwColor, lpSource->dwAlphaMask);
+					lpSrc += 2;
 				}
-
 				break;
 
-			case 3: // 24-bpp RGB --> 24-bpp PNG
-				for (h = 0; h < lHeight; h++)
+			case 24: // 24-bpp RGB --> 24-bpp PNG
+				for (w = 0; w < lWidth; w++)
 				{
-					lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-					lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-					for (w = 0; w < lWidth; w++)
-					{
-						lpDest[2] = *lpSrc++;
-						lpDest[1] = *lpSrc++;
-						lpDest[0] = *lpSrc++;
-						lpDest += 3;
-					}
+					lpDest[2] = *lpSrc++;
+					lpDest[1] = *lpSrc++;
+					lpDest[0] = *lpSrc++;
+					lpDest += 3;
 				}
-
 				break;
 
-			case 4:
-				if (bIsCMYK)
+			case 32:
+				if (lpSource->bIsCMYK)
 				{ // 32-bpp CMYK DIB --> 24-bpp RGB PNG
-					nNumChannels = 3;
-
 					BYTE cInvKey;
-					for (h = 0; h < lHeight; h++)
+					for (w = 0; w < lWidth; w++)
 					{
-						lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-						lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-						for (w = 0; w < lWidth; w++)
-						{
-							cInvKey = 0xFF - lpSrc[3];
-							*lpDest++ = Mul8Bit(0xFF - lpSrc[2], cInvKey);
-							*lpDest++ = Mul8Bit(0xFF - lpSrc[1], cInvKey);
-							*lpDest++ = Mul8Bit(0xFF - lpSrc[0], cInvKey);
-							lpSrc += 4;
-						}
+						cInvKey = 0xFF - lpSrc[3];
+						*lpDest++ = Mul8Bit(0xFF - lpSrc[2], cInvKey);
+						*lpDest++ = Mul8Bit(0xFF - lpSrc[1], cInvKey);
+						*lpDest++ = Mul8Bit(0xFF - lpSrc[0], cInvKey);
+						lpSrc += 4;
 					}
 				}
 				else
 				{ // 32-bpp DIB --> 32-bpp PNG
-					if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
-					{
-						lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
-						dwRedMask      = lpdwColorMasks[0];
-						dwGreenMask    = lpdwColorMasks[1];
-						dwBlueMask     = lpdwColorMasks[2];
-						dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
-					}
-					else
-					{
-						dwRedMask   = 0x00FF0000;
-						dwGreenMask = 0x0000FF00;
-						dwBlueMask  = 0x000000FF;
-						dwAlphaMask = 0xFF000000; // TODO: Add test for visible pixels
-					}
-
-					for (h = 0; h < lHeight; h++)
+					for (w = 0; w < lWidth; w++)
 					{
-						lpSrc = lpDIB + (ULONG_PTR)(bFlipImage ? h : lHeight-1 - h) * dwIncrement;
-						lpDest = lpRGBA + (ULONG_PTR)h * lWidth * nNumChannels;
-						for (w = 0; w < lWidth; w++)
-						{
-							dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), MAKEWORD(lpSrc[2], lpSrc[3]));
-							*lpDest++ = GetColorValue(dwColor, dwRedMask);
-							*lpDest++ = GetColorValue(dwColor, dwGreenMask);
-							*lpDest++ = GetColorValue(dwColor, dwBlueMask);
-							*lpDest++ = dwAlphaMask ? GetColorValue(dwColor, dwAlphaMask) : 0xFF;
-							lpSrc += 4;
-						}
+						dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), MAKEWORD(lpSrc[2], lpSrc[3]));
+						*lpDest++ = GetColorValue(dwColor, lpSource->dwRedMask);
+						*lpDest++ = GetColorValue(dwColor, lpSource->dwGreenMask);
+						*lpDest++ = GetColorValue(dwColor, lpSource->dwBlueMask);
+						*lpDest++ = lpSource->dwAlphaMask ? GetColorValue(dwColor, lpSource->dwAlphaMask) : 0xFF;
+						lpSrc += 4;
 					}
 				}
-
 				break;
 		}
 	}
 	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD filter_png_row(LPPNG_SOURCE lpSource, BYTE cFilter, LPBYTE lpRow, LPBYTE lpPrior, LPBYTE lpDest)
+{
+	int nBpp = lpSource->nNumChannels;
+	int nRowBytes = (int)lpSource->dwRowBytes;
+	DWORD dwSum = 0;
+	int i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	if (lpSource->bUseSse2)
+	{ // Filter 16 bytes at once. Unlike decoding, the predictors only depend on unfiltered bytes.
+		__m128i zero = _mm_setzero_si128();
+		__m128i one = _mm_set1_epi8(1);
+		__m128i sum = zero;
+		for (; i + 16 <= nRowBytes; i += 16)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(lpRow + i));
+			__m128i a = _mm_loadu_si128((const __m128i*)(lpRow + i - nBpp));
+			__m128i b = _mm_loadu_si128((const __m128i*)(lpPrior + i));
+			__m128i c = _mm_loadu_si128((const __m128i*)(lpPrior + i - nBpp));
+
+			switch (cFilter)
+			{
+				case 1: // Sub
+					x = _mm_sub_epi8(x, a);
+					break;
+				case 2: // Up
+					x = _mm_sub_epi8(x, b);
+					break;
+				case 3: // Average; _mm_avg_epu8 rounds up
+					x = _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)));
+					break;
+				case 4: // Paeth
+					x = _mm_sub_epi8(x, _mm_packus_epi16(
+						paeth_predictor_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+						paeth_predictor_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero))));
+					break;
+			}
+
+			_mm_storeu_si128((__m128i*)(lpDest + i), x);
+			// The absolute value of a signed byte is the smaller one of the byte and its negation
+			sum = _mm_add_epi32(sum, _mm_sad_epu8(_mm_min_epu8(x, _mm_sub_epi8(zero, x)), zero));
+		}
+
+		dwSum = (DWORD)_mm_cvtsi128_si32(sum) + (DWORD)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+	}
+#endif
 
-	size_t cbSize = 0;
-	LPVOID lpPNG = tdefl_write_image_to_png_file_in_memory(lpRGBA, lWidth, lHeight, nNumChannels, &cbSize);
-	if (lpPNG == NULL)
+	for (; i < nRowBytes; i++)
 	{
-		MyGlobalFreePtr((LPVOID)lpRGBA);
-		GlobalUnlock(hDib);
-		return FALSE;
+		int a = lpRow[i - nBpp];
+		int b = lpPrior[i];
+		int c = lpPrior[i - nBpp];
+		int nPredictor = 0;
+
+		switch (cFilter)
+		{
+			case 1:
+				nPredictor = a;
+				break;
+			case 2:
+				nPredictor = b;
+				break;
+			case 3:
+				nPredictor = (a + b) >> 1;
+				break;
+			case 4:
+				{
+					int pa = abs(b - c);
+					int pb = abs(a - c);
+					int pc = abs(a + b - 2 * c);
+					nPredictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+				}
+				break;
+		}
+
+		BYTE cValue = (BYTE)(lpRow[i] - nPredictor);
+		lpDest[i] = cValue;
+		dwSum += cValue < 0x80 ? cValue : 0x100 - cValue;
 	}
 
-	HANDLE hFile = CreateFile(lpszFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
-		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-	if (hFile == INVALID_HANDLE_VALUE)
+	return dwSum;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(_M_IX86) || defined(_M_X64)
+__m128i paeth_predictor_sse2(__m128i a, __m128i b, __m128i c)
+{
+	// pa = |p - a| = |b - c|, pb = |p - b| = |a - c|, pc = |p - c| = |a + b - 2c|
+	__m128i zero = _mm_setzero_si128();
+	__m128i pa = _mm_sub_epi16(b, c);
+	__m128i pb = _mm_sub_epi16(a, c);
+	__m128i pc = _mm_add_epi16(pa, pb);
+	pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+	pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+	pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+	// (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c)
+	__m128i use_c = _mm_cmpgt_epi16(pb, pc);
+	__m128i bc = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+	__m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	return _mm_or_si128(_mm_and_si128(not_a, bc), _mm_andnot_si128(not_a, a));
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL deflate_png_strip(LPPNG_ENCODER lpEncoder, LPPNG_STRIP lpStrip, tdefl_compressor* pComp, LPBYTE lpRows)
+{
+	LPPNG_SOURCE lpSource = lpEncoder->lpSource;
+	DWORD dwRowBytes = lpSource->dwRowBytes;
+	DWORD dwRowStride = PNG_ROW_STRIDE(dwRowBytes);
+	LPBYTE lpPrior = lpRows + PNG_ROW_PADDING;
+	LPBYTE lpRow = lpPrior + dwRowStride;
+	LPBYTE lpFiltered = lpRows + 2 * dwRowStride;
+
+	LONG lFirstRow = (LONG)lpStrip->uStrip * lpEncoder->lRowsPerStrip;
+	LONG lEndRow = min(lFirstRow + lpEncoder->lRowsPerStrip, lpSource->lHeight);
+	BOOL bLastStrip = (lpStrip->uStrip + 1 == lpEncoder->uNumStrips);
+
+	// The zlib header (deflate, 32K window, default compression) precedes the first strip
+	lpStrip->cbData = 0;
+	if (lpStrip->uStrip == 0)
 	{
-		mz_free(lpPNG);
-		MyGlobalFreePtr((LPVOID)lpRGBA);
-		GlobalUnlock(hDib);
+		lpStrip->lpData[lpStrip->cbData++] = 0x78;
+		lpStrip->lpData[lpStrip->cbData++] = 0x9C;
+	}
+
+	if (tdefl_init(pComp, png_put_buf, lpStrip, TDEFL_DEFAULT_MAX_PROBES | TDEFL_COMPUTE_ADLER32) != TDEFL_STATUS_OKAY)
 		return FALSE;
+
+	// The first row of a strip is filtered against the last row of the previous strip
+	if (lFirstRow > 0)
+		convert_png_row(lpSource, lFirstRow - 1, lpPrior);
+	else
+		ZeroMemory(lpPrior, dwRowBytes);
+
+	for (LONG lRow = lFirstRow; lRow < lEndRow; lRow++)
+	{
+		convert_png_row(lpSource, lRow, lpRow);
+
+		// Select the filter type with the minimum sum of absolute differences
+		LPBYTE lpBest = NULL;
+		DWORD dwBestSum = 0;
+		for (BYTE cFilter = 0; cFilter < 5; cFilter++)
+		{
+			LPBYTE lpDest = lpFiltered + cFilter * (dwRowBytes + 1);
+			lpDest[0] = cFilter;
+			DWORD dwSum = filter_png_row(lpSource, cFilter, lpRow, lpPrior, lpDest + 1);
+			if (lpBest == NULL || dwSum < dwBestSum)
+			{
+				lpBest = lpDest;
+				dwBestSum = dwSum;
+			}
+		}
+
+		if (tdefl_compress_buffer(pComp, lpBest, dwRowBytes + 1, TDEFL_NO_FLUSH) != TDEFL_STATUS_OKAY)
+			return FALSE;
+
+		LPBYTE lpTemp = lpPrior;
+		lpPrior = lpRow;
+		lpRow = lpTemp;
 	}
 
-	DWORD dwWrite;
-	if (!WriteFile(hFile, lpPNG, (DWORD)cbSize, &dwWrite, NULL) || dwWrite != cbSize)
+	// Only the last strip ends with a final block
+	if (bLastStrip)
 	{
-		mz_free(lpPNG);
-		MyGlobalFreePtr((LPVOID)lpRGBA);
-		GlobalUnlock(hDib);
-		CloseHandle(hFile);
-		DeleteFile(lpszFileName);
-		return FALSE;
+		if (tdefl_compress_buffer(pComp, NULL, 0, TDEFL_FINISH) != TDEFL_STATUS_DONE)
+			return FALSE;
 	}
+	else if (tdefl_compress_buffer(pComp, NULL, 0, TDEFL_SYNC_FLUSH) != TDEFL_STATUS_OKAY)
+		return FALSE;
 
-	mz_free(lpPNG);
-	MyGlobalFreePtr((LPVOID)lpRGBA);
-	GlobalUnlock(hDib);
-	CloseHandle(hFile);
+	lpStrip->dwAdler = tdefl_get_adler32(pComp);
 
 	return TRUE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
-// JPEG decoder using the Independent JPEG Group's JPEG software
+// Computes the checksum of two concatenated blocks from the checksums of the blocks (as zlib)
 
-////////////////////////////////////////////////////////////////////////////////////////////////
-// Data Types
+DWORD adler32_combine(DWORD dwAdler1, DWORD dwAdler2, ULONGLONG cbData2)
+{
+	const DWORD dwBase = 65521;
+
+	DWORD dwRem = (DWORD)(cbData2 % dwBase);
+	DWORD dwSum1 = dwAdler1 & 0xFFFF;
+	DWORD dwSum2 = (DWORD)(((ULONGLONG)dwRem * dwSum1) % dwBase);
+	dwSum1 += (dwAdler2 & 0xFFFF) + dwBase - 1;
+	dwSum2 += (dwAdler1 >> 16) + (dwAdler2 >> 16) + dwBase - dwRem;
+	if (dwSum1 >= dwBase) dwSum1 -= dwBase;
+	if (dwSum1 >= dwBase) dwSum1 -= dwBase;
+	if (dwSum2 >= (dwBase << 1)) dwSum2 -= (dwBase << 1);
+	if (dwSum2 >= dwBase) dwSum2 -= dwBase;
+
+	return dwSum1 | (dwSum2 << 16);
+}
 
-typedef struct jpeg_decompress_struct j_decompress;
-typedef struct jpeg_error_mgr         j_error_mgr;
+////////////////////////////////////////////////////////////////////////////////////////////////
 
-// JPEG decompression structure (overloads jpeg_decompress_struct)
-typedef struct _JPEG_DECOMPRESS
+BOOL write_png_chunk(HANDLE hFile, LPCSTR lpszType, LPCVOID lpData, DWORD cbData)
 {
-	j_decompress    jInfo;          // Decompression structure
-	j_error_mgr     jError;         // Error manager
-	INT             nTraceLevel;    // Max. message level that will be displayed
-	BOOL            bNeedDestroy;   // jInfo must be destroyed
-	LPBYTE          lpProfileData;  // Pointer to ICC profile data
-} JPEG_DECOMPRESS, *LPJPEG_DECOMPRESS;
+	BYTE abHeader[8];
+	*(LPDWORD)&abHeader[0] = _byteswap_ulong(cbData);
+	CopyMemory(&abHeader[4], lpszType, 4);
 
-// Buffer for processor status
-static jmp_buf JmpBuffer;
+	// The CRC covers the chunk type and data
+	DWORD dwCrc = (DWORD)mz_crc32(MZ_CRC32_INIT, &abHeader[4], 4);
+	if (cbData > 0)
+		dwCrc = (DWORD)mz_crc32(dwCrc, (const mz_uint8*)lpData, cbData);
+	dwCrc = _byteswap_ulong(dwCrc);
 
-////////////////////////////////////////////////////////////////////////////////////////////////
-// Helper functions
+	DWORD dwWrite;
+	if (!WriteFile(hFile, abHeader, sizeof(abHeader), &dwWrite, NULL) || dwWrite != sizeof(abHeader))
+		return FALSE;
+	if (cbData > 0 && (!WriteFile(hFile, lpData, cbData, &dwWrite, NULL) || dwWrite != cbData))
+		return FALSE;
+	if (!WriteFile(hFile, &dwCrc, sizeof(dwCrc), &dwWrite, NULL) || dwWrite != sizeof(dwCrc))
+		return FALSE;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Takes the strips in order as long as there is a free strip buffer. A buffer becomes free
+// when its strip has been written to the file, which limits the memory of pending strips.
+
+unsigned __stdcall png_strip_thread(LPVOID lpParameter)
+{
+	LPPNG_ENCODER lpEncoder = (LPPNG_ENCODER)lpParameter;
+	if (lpEncoder == NULL)
+		return 1;
+
+	tdefl_compressor* pComp = (tdefl_compressor*)MyGlobalAllocPtr(GHND, sizeof(tdefl_compressor));
+	LPBYTE lpRows = (LPBYTE)MyGlobalAllocPtr(GHND, png_rows_size(lpEncoder->lpSource));
+
+	for (;;)
+	{
+		WaitForSingleObject(lpEncoder->hFreeSlots, INFINITE);
+
+		LONG lStrip = InterlockedIncrement(&lpEncoder->lNextStrip) - 1;
+		if ((UINT)lStrip >= lpEncoder->uNumStrips)
+		{ // Pass the wakeup on to the next thread
+			ReleaseSemaphore(lpEncoder->hFreeSlots, 1, NULL);
+			break;
+		}
+
+		LPPNG_STRIP lpStrip = &lpEncoder->lpSlots[lStrip % lpEncoder->uNumSlots];
+		lpStrip->uStrip = (UINT)lStrip;
+		lpStrip->bSuccess = (pComp != NULL && lpRows != NULL) && deflate_png_strip(lpEncoder, lpStrip, pComp, lpRows);
+		SetEvent(lpStrip->hDone);
+	}
+
+	if (pComp != NULL)
+		MyGlobalFreePtr((LPVOID)pComp);
+	if (lpRows != NULL)
+		MyGlobalFreePtr((LPVOID)lpRows);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+mz_bool png_put_buf(const void* pBuf, int len, void* pUser)
+{
+	LPPNG_STRIP lpStrip = (LPPNG_STRIP)pUser;
+	if (lpStrip == NULL || len < 0 || (DWORD)len > lpStrip->cbAlloc - lpStrip->cbData)
+		return MZ_FALSE;
+
+	CopyMemory(lpStrip->lpData + lpStrip->cbData, pBuf, len);
+	lpStrip->cbData += len;
+
+	return MZ_TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// WebP encoder using libwebpencoder
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback functions
+
+// Writes encoded data to the file passed in custom_ptr (WebPWriterFunction)
+static int WebpFileWriter(const uint8_t* data, size_t data_size, const WebPPicture* picture);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL SaveWebpFile(LPCTSTR lpszFileName, HANDLE hDib, UINT uPreset, int nQuality, UINT uOptions)
+{
+	if (hDib == NULL || lpszFileName == NULL || uPreset > WEP_TEXT)
+		return FALSE;
+
+	LONG lWidth = 0;
+	LONG lHeight = 0;
+	BOOL bHasAlpha = FALSE;
+	LPBYTE lpBGRA = ConvertDibToBgra(hDib, &lWidth, &lHeight, &bHasAlpha);
+	if (lpBGRA == NULL)
+		return FALSE;
+
+	WebPConfig config;
+	WebPPicture picture;
+	if (!WebPConfigPreset(&config, (WebPPreset)uPreset, (float)max(0, min(nQuality, 100))) ||
+		!WebPPictureInit(&picture))
+	{
+		MyGlobalFreePtr((LPVOID)lpBGRA);
+		return FALSE;
+	}
+
+	// With thread_level set, the lossy encoder analyzes the image and compresses the alpha
+	// plane in worker threads, and the lossless encoder tries its configurations in parallel.
+	// The threads are taken from the worker pool, if InitWebpWorkerPool has been called.
+	config.thread_level = (uOptions & WEO_USE_THREADS) ? 1 : 0;
+	config.lossless = (uOptions & WEO_LOSSLESS) ? 1 : 0;
+	config.exact = (uOptions & WEO_EXACT) ? 1 : 0;
+
+	// Lossless images are encoded from ARGB, lossy images from YUV
+	picture.use_argb = config.lossless;
+	picture.width = lWidth;
+	picture.height = lHeight;
+
+	BOOL bSuccess = WebPValidateConfig(&config) && (bHasAlpha ?
+		WebPPictureImportBGRA(&picture, lpBGRA, lWidth * 4) :
+		WebPPictureImportBGRX(&picture, lpBGRA, lWidth * 4));
+	MyGlobalFreePtr((LPVOID)lpBGRA);
+
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	if (bSuccess)
+	{
+		hFile = CreateFile(lpszFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		bSuccess = (hFile != INVALID_HANDLE_VALUE);
+	}
+
+	if (bSuccess)
+	{
+		// The RIFF container is passed to the writer as soon as the image is encoded
+		picture.writer = WebpFileWriter;
+		picture.custom_ptr = (void*)hFile;
+		bSuccess = WebPEncode(&config, &picture);
+	}
+
+	WebPPictureFree(&picture);
+
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hFile);
+		if (!bSuccess)
+			DeleteFile(lpszFileName);
+	}
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int WebpFileWriter(const uint8_t* data, size_t data_size, const WebPPicture* picture)
+{
+	HANDLE hFile = (HANDLE)picture->custom_ptr;
+	if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+		return 0;
+
+	DWORD dwWrite = 0;
+	if (data_size > 0 && (!WriteFile(hFile, data, (DWORD)data_size, &dwWrite, NULL) || dwWrite != data_size))
+		return 0;
+
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// JPEG decoder using the Independent JPEG Group's JPEG software
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+typedef struct jpeg_decompress_struct j_decompress;
+typedef struct jpeg_error_mgr         j_error_mgr;
+
+// Minimum number of output pixels of an image that is decoded in parallel strips
+#define JPEG_STRIP_MIN_PIXELS   0x100000
+// Maximum number of strips that are decoded in parallel
+#define JPEG_MAX_STRIPS         16
+
+// JPEG decompression structure (overloads jpeg_decompress_struct)
+typedef struct _JPEG_DECOMPRESS
+{
+	j_decompress    jInfo;          // Decompression structure
+	j_error_mgr     jError;         // Error manager
+	INT             nTraceLevel;    // Max. message level that will be displayed
+	BOOL            bNeedDestroy;   // jInfo must be destroyed
+	LPBYTE          lpProfileData;  // Pointer to ICC profile data
+	jmp_buf         JmpBuffer;      // Processor status for error handling
+} JPEG_DECOMPRESS, *LPJPEG_DECOMPRESS;
+
+// Decompression structure of a strip that is decoded in a worker thread
+typedef struct _JPEG_STRIP_DECOMPRESS
+{
+	j_decompress    jInfo;          // Decompression structure
+	j_error_mgr     jError;         // Error manager
+	jmp_buf         JmpBuffer;      // Processor status of the worker thread
+} JPEG_STRIP_DECOMPRESS, *LPJPEG_STRIP_DECOMPRESS;
+
+// A strip of whole MCU rows, stored as a JPEG image of its own
+typedef struct _JPEG_STRIP
+{
+	j_decompress_ptr pjImage;       // Decompression structure of the whole image
+	LPBYTE          lpData;         // Header, entropy-coded segments and EOI marker of the strip
+	DWORD           dwLenData;      // Size of the strip data in bytes
+	JDIMENSION      uFirstRow;      // First output row of the strip in the whole image
+	JDIMENSION      uNumRows;       // Number of output rows of the strip
+	LPBYTE          lpDIB;          // Pointer to the image data of the DIB
+	UINT            uIncrement;     // Bytes per DIB row
+	BOOL            bFlipImage;     // Image rows are stored top-down
+	BOOL            bSuccess;       // The strip has been decoded without warnings
+} JPEG_STRIP, *LPJPEG_STRIP;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions
 
 // Performs housekeeping
 void cleanup_jpeg_to_dib(LPJPEG_DECOMPRESS lpJpegDecompress, HANDLE hDib);
 // Registers the callback functions for the error manager
 void set_error_manager(j_common_ptr pjInfo, j_error_mgr *pjError);
+// Converts an image row from inverted CMYK to BGRX
+void convert_cmyk_row(LPBYTE lpBits, JDIMENSION uWidth);
+// Decodes an image with restart markers in parallel strips of MCU rows. Returns FALSE
+// if the image does not qualify or a strip fails, then the caller decodes the image.
+BOOL decode_jpeg_strips(j_decompress_ptr pjInfo, LPBYTE lpJpegData, DWORD dwLenData, DWORD dwScanStart,
+	LPBYTE lpDIB, UINT uIncrement, BOOL bFlipImage);
+// Determines the offset of the image height in the SOF marker segment
+DWORD find_jpeg_frame_height(LPBYTE lpData, DWORD dwLenData);
+// Renumbers the restart markers of the entropy-coded segments of a strip
+void renumber_jpeg_restarts(LPBYTE lpData, DWORD dwLenData, UINT uFirstInterval);
+// Worker thread that decodes a strip
+static unsigned __stdcall jpeg_strip_thread(LPVOID lpParameter);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Callback functions
@@ -502,10 +1186,14 @@ static void my_error_exit(j_common_ptr pjInfo);
 static void my_output_message(j_common_ptr pjInfo);
 // Message handling
 static void my_emit_message(j_common_ptr pjInfo, int nMessageLevel);
+// Error handling of the worker threads
+static void strip_error_exit(j_common_ptr pjInfo);
+// Message handling of the worker threads
+static void strip_emit_message(j_common_ptr pjInfo, int nMessageLevel);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTraceLevel)
+HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTraceLevel, UINT uTargetSize)
 {
 	HANDLE hDib = NULL;
 
@@ -517,7 +1205,7 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 	set_error_manager((j_common_ptr)pjInfo, &JpegDecompress.jError);
 
 	// Save processor status for error handling
-	if (setjmp(JmpBuffer))
+	if (setjmp(JpegDecompress.JmpBuffer))
 	{
 		cleanup_jpeg_to_dib(&JpegDecompress, hDib);
 		return NULL;
@@ -535,6 +1223,9 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 	// Determine image information
 	jpeg_read_header(pjInfo, TRUE);
 
+	// The entropy-coded data of the first scan follows the header
+	DWORD dwScanStart = dwLenData - (DWORD)pjInfo->src->bytes_in_buffer;
+
 	// Read an existing ICC profile
 	UINT uProfileLen = 0;
 	BOOL bHasProfile = FALSE;
@@ -558,6 +1249,27 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 		}
 	}
 
+	// Decode at a reduced size of 1/8 to 7/8 if this is sufficient for the target size.
+	// Scaling in the IDCT skips most of the work of a full-size decode.
+	if (uTargetSize > 0)
+	{
+		for (UINT uScale = 1; uScale < 8; uScale++)
+		{
+			pjInfo->scale_num = uScale;
+			pjInfo->scale_denom = 8;
+			jpeg_calc_output_dimensions(pjInfo);
+			if (max(pjInfo->output_width, pjInfo->output_height) >= uTargetSize)
+				break;
+		}
+
+		if (max(pjInfo->output_width, pjInfo->output_height) < uTargetSize)
+			pjInfo->scale_num = pjInfo->scale_denom = 1;
+
+		// The physical size of the image is unchanged
+		lXPelsPerMeter = MulDiv(lXPelsPerMeter, pjInfo->scale_num, pjInfo->scale_denom);
+		lYPelsPerMeter = MulDiv(lYPelsPerMeter, pjInfo->scale_num, pjInfo->scale_denom);
+	}
+
 	// Start decompression in the JPEG library
 	jpeg_start_decompress(pjInfo);
 
@@ -626,11 +1338,14 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 	LPBYTE lpBits = NULL;           // Pointer to a DIB image row
 	JSAMPROW lpScanlines[1] = {0};  // Pointer to a scanline
 	JDIMENSION uScanline = 0;       // Row index
-	BYTE cKey, cRed, cBlue;         // Color components
+
+	// Large images with restart markers are decoded in parallel strips
+	BOOL bDecodedStrips = decode_jpeg_strips(pjInfo, (LPBYTE)lpJpegData, dwLenData, dwScanStart,
+		lpDIB, uIncrement, bFlipImage);
 
 	// Copy image rows (scanlines). The arrangement of the color
 	// components must be changed in jmorecfg.h from RGB to BGR.
-	while (pjInfo->output_scanline < pjInfo->output_height)
+	while (!bDecodedStrips && pjInfo->output_scanline < pjInfo->output_height)
 	{
 		uScanline = bFlipImage ? pjInfo->output_scanline : pjInfo->output_height-1 - pjInfo->output_scanline;
 		lpBits = lpDIB + (UINT_PTR)uScanline * uIncrement;
@@ -638,18 +1353,7 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 		jpeg_read_scanlines(pjInfo, lpScanlines, 1);  // Decompress one line
 
 		if (pjInfo->out_color_space == JCS_CMYK)
-		{  // Convert from inverted CMYK to RGB
-			for (UINT u = 0; u < (pjInfo->output_width * 4); u += 4)
-			{
-				cKey  = lpBits[u+3];
-				cRed  = Mul8Bit(lpBits[u+0], cKey);
-				cBlue = Mul8Bit(lpBits[u+2], cKey);
-				lpBits[u+1] = Mul8Bit(lpBits[u+1], cKey);
-				lpBits[u+0] = cBlue;
-				lpBits[u+2] = cRed;
-				lpBits[u+3] = 0xFF;
-			}
-		}
+			convert_cmyk_row(lpBits, pjInfo->output_width);
 	}
 
 	// Embed an existing ICC profile into the DIB
@@ -663,9 +1367,12 @@ HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage, INT nTrace
 		CopyMemory(lpDIB + dwImageSize, JpegDecompress.lpProfileData, uProfileLen);
 	}
 
-	// Finish decompression
+	// Finish decompression. The strips have been decoded by separate JPEG objects.
 	GlobalUnlock(hDib);
-	jpeg_finish_decompress(pjInfo);
+	if (bDecodedStrips)
+		jpeg_abort_decompress(pjInfo);
+	else
+		jpeg_finish_decompress(pjInfo);
 
 	// Free all requested memory, but keep the DIB we just created
 	cleanup_jpeg_to_dib(&JpegDecompress, NULL);
@@ -720,6 +1427,324 @@ void set_error_manager(j_common_ptr pjInfo, j_error_mgr *pjError)
 	pjInfo->err = pjError;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void convert_cmyk_row(LPBYTE lpBits, JDIMENSION uWidth)
+{
+	BYTE cKey, cRed, cBlue;  // Color components
+
+	for (UINT u = 0; u < (uWidth * 4); u += 4)
+	{
+		cKey  = lpBits[u+3];
+		cRed  = Mul8Bit(lpBits[u+0], cKey);
+		cBlue = Mul8Bit(lpBits[u+2], cKey);
+		lpBits[u+1] = Mul8Bit(lpBits[u+1], cKey);
+		lpBits[u+0] = cBlue;
+		lpBits[u+2] = cRed;
+		lpBits[u+3] = 0xFF;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Each restart marker resets the DC predictions and the bit buffer of the entropy decoder,
+// so a run of restart intervals that begins and ends at MCU row boundaries can be decoded
+// on its own. decode_jpeg_strips pre-scans the entropy-coded data for the restart markers,
+// copies the header and the intervals of each strip into a separate JPEG stream with
+// an adjusted image height and decodes the streams in parallel, directly into the DIB.
+// Without context rows (block smoothing, color quantization), libjpeg produces the
+// same pixels for the strips as for the whole image.
+
+BOOL decode_jpeg_strips(j_decompress_ptr pjInfo, LPBYTE lpJpegData, DWORD dwLenData, DWORD dwScanStart,
+	LPBYTE lpDIB, UINT uIncrement, BOOL bFlipImage)
+{
+	// Only sequential Huffman-coded images with a single interleaved scan qualify
+	if (pjInfo->restart_interval == 0 || pjInfo->progressive_mode || pjInfo->arith_code ||
+		pjInfo->comps_in_scan != pjInfo->num_components || pjInfo->quantize_colors ||
+		pjInfo->block_size != DCTSIZE || dwScanStart >= dwLenData)
+		return FALSE;
+
+	if ((ULONGLONG)pjInfo->output_width * pjInfo->output_height < JPEG_STRIP_MIN_PIXELS)
+		return FALSE;
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+
+	UINT uMcusPerRow = pjInfo->MCUs_per_row;
+	UINT uMcuRows = pjInfo->MCU_rows_in_scan;
+	UINT uMcuHeight = pjInfo->comps_in_scan == 1 ? DCTSIZE : pjInfo->max_v_samp_factor * DCTSIZE;
+	UINT uRestartInterval = pjInfo->restart_interval;
+	UINT uNumIntervals = (UINT)(((ULONGLONG)uMcusPerRow * uMcuRows + uRestartInterval - 1) / uRestartInterval);
+	UINT uMaxStrips = min(min(si.dwNumberOfProcessors, JPEG_MAX_STRIPS), uMcuRows);
+	if (uMaxStrips < 2)
+		return FALSE;
+
+	// Split the image at MCU rows that begin with a restart interval
+	UINT auFirstMcuRow[JPEG_MAX_STRIPS + 1];
+	UINT uNumStrips = 0;
+	auFirstMcuRow[0] = 0;
+	for (UINT s = 1; s < uMaxStrips; s++)
+	{
+		UINT uRow = max(uMcuRows * s / uMaxStrips, auFirstMcuRow[uNumStrips] + 1);
+		while (uRow < uMcuRows && ((ULONGLONG)uRow * uMcusPerRow) % uRestartInterval != 0)
+			uRow++;
+		if (uRow >= uMcuRows)
+			break;
+		auFirstMcuRow[++uNumStrips] = uRow;
+	}
+	auFirstMcuRow[++uNumStrips] = uMcuRows;
+	if (uNumStrips < 2)
+		return FALSE;
+
+	// The image height is patched in the copied header of each strip
+	DWORD dwFrameHeight = find_jpeg_frame_height(lpJpegData, dwScanStart);
+	if (dwFrameHeight == 0)
+		return FALSE;
+
+	// Locate the entropy-coded data of the strips. Any marker other than RSTn
+	// ends the scan. Images with more than one scan or a DNL marker are rejected.
+	LPBYTE lpScan = lpJpegData + dwScanStart;
+	DWORD dwLenScan = dwLenData - dwScanStart;
+	DWORD adwStart[JPEG_MAX_STRIPS + 1];
+	LPBYTE lpMarker = NULL;
+	DWORD dwPos = 0;
+	UINT uInterval = 0;
+	UINT uStrip = 1;
+
+	adwStart[0] = 0;
+	adwStart[uNumStrips] = 0;
+	while ((lpMarker = (LPBYTE)memchr(lpScan + dwPos, 0xFF, dwLenScan - dwPos)) != NULL)
+	{
+		dwPos = (DWORD)(lpMarker - lpScan) + 1;
+		if (dwPos >= dwLenScan)
+			break;
+
+		BYTE cMarker = lpScan[dwPos];
+		if (cMarker == 0x00)
+		{  // Stuffed zero byte
+			dwPos++;
+			continue;
+		}
+
+		if (cMarker == 0xFF)  // Fill byte
+			continue;
+
+		if (cMarker < JPEG_RST0 || cMarker > JPEG_RST0 + 7)
+		{  // End of the scan
+			if (cMarker == JPEG_EOI)
+				adwStart[uNumStrips] = dwPos + 1;
+			break;
+		}
+
+		// Restart markers must be in sequence
+		if ((UINT)(cMarker - JPEG_RST0) != (uInterval & 7))
+			return FALSE;
+
+		dwPos++;
+		if (++uInterval < uNumIntervals && uStrip < uNumStrips &&
+			uInterval == (UINT)(((ULONGLONG)auFirstMcuRow[uStrip] * uMcusPerRow) / uRestartInterval))
+			adwStart[uStrip++] = dwPos;
+	}
+
+	if (adwStart[uNumStrips] == 0 || uStrip != uNumStrips || uInterval + 1 != uNumIntervals)
+		return FALSE;
+
+	// Create a JPEG image of its own for each strip
+	JPEG_STRIP aStrips[JPEG_MAX_STRIPS];
+	ZeroMemory(aStrips, sizeof(aStrips));
+
+	BOOL bSuccess = TRUE;
+	for (UINT s = 0; s < uNumStrips && bSuccess; s++)
+	{
+		// The segments of a strip end before the restart marker that starts the next strip
+		DWORD dwLenSegments = adwStart[s+1] - 2 - adwStart[s];
+		UINT uFirstInterval = (UINT)(((ULONGLONG)auFirstMcuRow[s] * uMcusPerRow) / uRestartInterval);
+		JDIMENSION uFirstLine = auFirstMcuRow[s] * uMcuHeight;
+		JDIMENSION uNextLine = min(auFirstMcuRow[s+1] * uMcuHeight, pjInfo->image_height);
+
+		LPJPEG_STRIP lpStrip = &aStrips[s];
+		lpStrip->dwLenData = dwScanStart + dwLenSegments + 2;
+		lpStrip->lpData = (LPBYTE)MyGlobalAllocPtr(GHND, lpStrip->dwLenData);
+		if (lpStrip->lpData == NULL)
+		{
+			bSuccess = FALSE;
+			break;
+		}
+
+		CopyMemory(lpStrip->lpData, lpJpegData, dwScanStart);
+		lpStrip->lpData[dwFrameHeight]   = HIBYTE(uNextLine - uFirstLine);
+		lpStrip->lpData[dwFrameHeight+1] = LOBYTE(uNextLine - uFirstLine);
+
+		CopyMemory(lpStrip->lpData + dwScanStart, lpScan + adwStart[s], dwLenSegments);
+		renumber_jpeg_restarts(lpStrip->lpData + dwScanStart, dwLenSegments, uFirstInterval);
+		lpStrip->lpData[lpStrip->dwLenData-2] = 0xFF;
+		lpStrip->lpData[lpStrip->dwLenData-1] = JPEG_EOI;
+
+		// The scaled height of a strip is exact, except for the last one
+		lpStrip->pjImage = pjInfo;
+		lpStrip->uFirstRow = uFirstLine * pjInfo->min_DCT_v_scaled_size / pjInfo->block_size;
+		lpStrip->uNumRows = (s+1 < uNumStrips ? uNextLine * pjInfo->min_DCT_v_scaled_size / pjInfo->block_size :
+			pjInfo->output_height) - lpStrip->uFirstRow;
+		lpStrip->lpDIB = lpDIB;
+		lpStrip->uIncrement = uIncrement;
+		lpStrip->bFlipImage = bFlipImage;
+	}
+
+	if (bSuccess)
+	{
+		// Start a worker thread for each strip but the first one, which is decoded in this thread
+		HANDLE ahThreads[JPEG_MAX_STRIPS];
+		DWORD dwThreads = 0;
+		for (UINT s = 1; s < uNumStrips; s++)
+		{
+			HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, jpeg_strip_thread, &aStrips[s], 0, NULL);
+			if (hThread != NULL)
+				ahThreads[dwThreads++] = hThread;
+			else
+			{  // The caller decodes the whole image instead
+				bSuccess = FALSE;
+				break;
+			}
+		}
+
+		if (bSuccess)
+			jpeg_strip_thread(&aStrips[0]);
+
+		if (dwThreads > 0)
+			WaitForMultipleObjects(dwThreads, ahThreads, TRUE, INFINITE);
+		for (DWORD i = 0; i < dwThreads; i++)
+			CloseHandle(ahThreads[i]);
+
+		for (UINT s = 0; s < uNumStrips; s++)
+			bSuccess &= aStrips[s].bSuccess;
+	}
+
+	for (UINT s = 0; s < uNumStrips; s++)
+	{
+		if (aStrips[s].lpData != NULL)
+			MyGlobalFreePtr((LPVOID)aStrips[s].lpData);
+	}
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD find_jpeg_frame_height(LPBYTE lpData, DWORD dwLenData)
+{
+	if (dwLenData < 4 || lpData[0] != 0xFF || lpData[1] != 0xD8)  // SOI
+		return 0;
+
+	// Walk the marker segments that follow the SOI marker
+	DWORD dwPos = 2;
+	while (dwPos + 4 <= dwLenData)
+	{
+		if (lpData[dwPos] != 0xFF)
+			return 0;
+
+		BYTE cMarker = lpData[dwPos+1];
+		if (cMarker == 0xFF)
+		{  // Fill byte
+			dwPos++;
+			continue;
+		}
+
+		// SOFn markers, except DHT, JPG and DAC
+		if (cMarker >= 0xC0 && cMarker <= 0xCF && cMarker != 0xC4 && cMarker != 0xC8 && cMarker != 0xCC)
+			return dwPos + 5 + 2 <= dwLenData ? dwPos + 5 : 0;
+
+		dwPos += 2 + MAKEWORD(lpData[dwPos+3], lpData[dwPos+2]);
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void renumber_jpeg_restarts(LPBYTE lpData, DWORD dwLenData, UINT uFirstInterval)
+{
+	// The restart markers of a strip must start again with RST0
+	if ((uFirstInterval & 7) == 0)
+		return;
+
+	for (DWORD dwPos = 0; dwPos + 1 < dwLenData; dwPos++)
+	{
+		if (lpData[dwPos] != 0xFF)
+			continue;
+
+		BYTE cMarker = lpData[dwPos+1];
+		if (cMarker >= JPEG_RST0 && cMarker <= JPEG_RST0 + 7)
+		{
+			lpData[dwPos+1] = (BYTE)(JPEG_RST0 + ((cMarker - JPEG_RST0 - uFirstInterval) & 7));
+			dwPos++;
+		}
+		else if (cMarker == 0x00)
+			dwPos++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Decodes a strip using a separate JPEG object with the output parameters of the whole
+// image. Errors and warnings are not displayed. The caller decodes the whole image again.
+
+unsigned __stdcall jpeg_strip_thread(LPVOID lpParameter)
+{
+	LPJPEG_STRIP lpStrip = (LPJPEG_STRIP)lpParameter;
+	if (lpStrip == NULL)
+		return 1;
+
+	j_decompress_ptr pjImage = lpStrip->pjImage;
+	JPEG_STRIP_DECOMPRESS StripDecompress;
+	ZeroMemory(&StripDecompress, sizeof(StripDecompress));
+	j_decompress_ptr pjInfo = &StripDecompress.jInfo;
+
+	jpeg_std_error(&StripDecompress.jError);
+	StripDecompress.jError.error_exit   = strip_error_exit;
+	StripDecompress.jError.emit_message = strip_emit_message;
+	pjInfo->err = &StripDecompress.jError;
+
+	// Save processor status for error handling
+	if (setjmp(StripDecompress.JmpBuffer))
+	{
+		jpeg_destroy_decompress(pjInfo);
+		return 1;
+	}
+
+	jpeg_create_decompress(pjInfo);
+	jpeg_mem_src(pjInfo, lpStrip->lpData, lpStrip->dwLenData);
+	jpeg_read_header(pjInfo, TRUE);
+
+	pjInfo->out_color_space = pjImage->out_color_space;
+	pjInfo->scale_num = pjImage->scale_num;
+	pjInfo->scale_denom = pjImage->scale_denom;
+	pjInfo->dct_method = pjImage->dct_method;
+	pjInfo->do_fancy_upsampling = pjImage->do_fancy_upsampling;
+	jpeg_start_decompress(pjInfo);
+
+	if (pjInfo->output_width == pjImage->output_width &&
+		pjInfo->output_components == pjImage->output_components &&
+		pjInfo->output_height == lpStrip->uNumRows)
+	{
+		JSAMPROW lpScanlines[1] = {0};
+		while (pjInfo->output_scanline < pjInfo->output_height)
+		{
+			JDIMENSION uRow = lpStrip->uFirstRow + pjInfo->output_scanline;
+			JDIMENSION uScanline = lpStrip->bFlipImage ? uRow : pjImage->output_height-1 - uRow;
+			lpScanlines[0] = lpStrip->lpDIB + (UINT_PTR)uScanline * lpStrip->uIncrement;
+			jpeg_read_scanlines(pjInfo, lpScanlines, 1);
+
+			if (pjInfo->out_color_space == JCS_CMYK)
+				convert_cmyk_row(lpScanlines[0], pjInfo->output_width);
+		}
+
+		jpeg_finish_decompress(pjInfo);
+		lpStrip->bSuccess = pjInfo->err->num_warnings == 0;
+	}
+
+	jpeg_destroy_decompress(pjInfo);
+
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // If an error occurs in libjpeg, my_error_exit is called. In this case, a
 // precise error message should be displayed on the screen. Then my_error_exit
@@ -734,7 +1759,7 @@ void my_error_exit(j_common_ptr pjInfo)
 	jpeg_destroy(pjInfo);
 	((LPJPEG_DECOMPRESS)pjInfo)->bNeedDestroy = FALSE;
 
-	longjmp(JmpBuffer, 1);  // Return to setjmp in JpegToDib
+	longjmp(((LPJPEG_DECOMPRESS)pjInfo)->JmpBuffer, 1);  // Return to setjmp in JpegToDib
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -745,6 +1770,10 @@ void my_output_message(j_common_ptr pjInfo)
 	char szBuffer[JMSG_LENGTH_MAX];
 	TCHAR szMessage[JMSG_LENGTH_MAX];
 
+	// A negative trace level suppresses all messages, including errors
+	if (pjInfo->err->trace_level < 0)
+		return;
+
 	// Format text
 	(*pjInfo->err->format_message)(pjInfo, szBuffer);
 
@@ -798,78 +1827,396 @@ void my_emit_message(j_common_ptr pjInfo, int nMessageLevel)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
+// The worker threads must not use the processor status of JpegToDib. Each strip returns
+// to setjmp in its own thread; the JPEG object is destroyed by jpeg_strip_thread.
 
-HANDLE WebpToDib(LPVOID lpWebpData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowFeatures)
+void strip_error_exit(j_common_ptr pjInfo)
 {
-	WebPBitstreamFeatures features;
+	longjmp(((LPJPEG_STRIP_DECOMPRESS)pjInfo)->JmpBuffer, 1);
+}
 
-	if (lpWebpData == NULL || dwLenData == 0 ||
-		WebPGetFeatures((LPBYTE)lpWebpData, dwLenData, &features) != VP8_STATUS_OK)
-		return NULL;
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Counts the warnings of a strip without displaying any messages
 
-	int nWidth = features.width;
-	int nHeight = features.height;
+void strip_emit_message(j_common_ptr pjInfo, int nMessageLevel)
+{
+	if (nMessageLevel < 0)
+		pjInfo->err->num_warnings++;
+}
 
-	if (bShowFeatures)
-	{
-		HWND hwndEdit = GetOutputWindow();
-		if (hwndEdit != NULL)
-		{
-			TCHAR szOutput[OUTPUT_LEN];
-			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Width:\t\t%d pixels\r\n"), nWidth);
-			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Height:\t\t%d pixels\r\n"), nHeight);
-			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Has Alpha:\t%s\r\n"),
-				features.has_alpha ? TEXT("True") : TEXT("False"));
-			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Has Animation:\t%s\r\n"),
-				features.has_animation ? TEXT("True") : TEXT("False"));
-			OutputText(hwndEdit, TEXT("Format:\t\t"));
-			switch (features.format)
-			{
-				case 0:
-					OutputText(hwndEdit, TEXT("Undefined/Mixed"));
-					break;
-				case 1:
-					OutputText(hwndEdit, TEXT("Lossy"));
-					break;
-				case 2:
-					OutputText(hwndEdit, TEXT("Lossless"));
-					break;
-				default:
-					OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("%d"), features.format);
-			}
-			OutputText(hwndEdit, TEXT("\r\n"));
-		}
-	}
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Lossless transformation of JPEG images using transupp of the IJG's JPEG software
 
-	LPBYTE lpBits = NULL;
-	if (features.has_alpha)
-		lpBits = WebPDecodeBGRA((LPBYTE)lpWebpData, dwLenData, &nWidth, &nHeight);
-	else
-		lpBits = WebPDecodeBGR((LPBYTE)lpWebpData, dwLenData, &nWidth, &nHeight);
-	if (lpBits == NULL)
-		return NULL;
-	
-	int nNumChannels = features.has_alpha ? 4 : 3;
-	int nIncrement = WIDTHBYTES(nWidth * nNumChannels * 8);
-	int nSizeImage = nHeight * nIncrement;
-	if (nSizeImage == 0)
-	{
-		WebPFree(lpBits);
-		return NULL;
-	}
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
 
-	HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + nSizeImage);
-	if (hDib == NULL)
-	{
-		WebPFree(lpBits);
-		return NULL;
+typedef struct jpeg_compress_struct    j_compress;
+typedef struct jpeg_destination_mgr    j_destination_mgr;
+
+// Size of the buffer that collects the transformed image before it is written to the file
+#define JPEG_OUTPUT_BUF_SIZE    0x10000
+
+// Source and destination objects of a lossless transformation
+typedef struct _JPEG_TRANSFORM
+{
+	j_decompress    jSrcInfo;       // Decompression structure of the source image
+	j_compress      jDstInfo;       // Compression structure of the transformed image
+	j_error_mgr     jSrcError;      // Error managers of both structures
+	j_error_mgr     jDstError;
+	j_destination_mgr jDest;        // Destination manager that writes to hFile
+	HANDLE          hFile;          // File that receives the transformed image
+	BOOL            bSuccess;       // The image has been transformed and written
+	jmp_buf         JmpBuffer;      // Processor status for error handling
+	JOCTET          abBuffer[JPEG_OUTPUT_BUF_SIZE];  // Output buffer
+} JPEG_TRANSFORM, *LPJPEG_TRANSFORM;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions
+
+// Flips a JPEG image vertically in the DCT domain and writes it to a file
+BOOL flip_jpeg_image(HANDLE hFile, LPVOID lpJpegData, DWORD dwLenData);
+// Writes the filled part of the output buffer to the file
+void write_transform_buffer(LPJPEG_TRANSFORM lpTransform, DWORD cbData);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback functions
+
+// Error handling without displaying messages
+static void transform_error_exit(j_common_ptr pjInfo);
+// Counts warnings and discards the messages
+static void transform_emit_message(j_common_ptr pjInfo, int nMessageLevel);
+// Destination manager
+static void transform_init_destination(j_compress_ptr pjInfo);
+static boolean transform_empty_output_buffer(j_compress_ptr pjInfo);
+static void transform_term_destination(j_compress_ptr pjInfo);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL SaveJpegFile(LPCTSTR lpszFileName, LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage)
+{
+	if (lpszFileName == NULL || lpJpegData == NULL || dwLenData == 0)
+		return FALSE;
+
+	HANDLE hFile = CreateFile(lpszFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	BOOL bSuccess = FALSE;
+	if (bFlipImage)
+		bSuccess = flip_jpeg_image(hFile, lpJpegData, dwLenData);
+	else
+	{ // The JPEG data is written as it is
+		DWORD dwWrite = 0;
+		__try { bSuccess = WriteFile(hFile, lpJpegData, dwLenData, &dwWrite, NULL) && dwWrite == dwLenData; }
+		__except (EXCEPTION_EXECUTE_HANDLER) { bSuccess = FALSE; }
 	}
 
+	CloseHandle(hFile);
+	if (!bSuccess)
+		DeleteFile(lpszFileName);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// The coefficients of the source image are read without decoding the pixels. jtransform_*
+// reverses the order of the block rows and negates the odd rows of each block, which flips
+// the image without any loss. The coefficients are then entropy-coded into the new file.
+
+BOOL flip_jpeg_image(HANDLE hFile, LPVOID lpJpegData, DWORD dwLenData)
+{
+	// The structure holds the output buffer and is allocated on the heap
+	LPJPEG_TRANSFORM lpTransform = (LPJPEG_TRANSFORM)MyGlobalAllocPtr(GHND, sizeof(JPEG_TRANSFORM));
+	if (lpTransform == NULL)
+		return FALSE;
+
+	j_decompress_ptr pjSrcInfo = &lpTransform->jSrcInfo;
+	j_compress_ptr pjDstInfo = &lpTransform->jDstInfo;
+	lpTransform->hFile = hFile;
+
+	// The error managers and the client data are kept when the JPEG objects are created
+	pjSrcInfo->err = jpeg_std_error(&lpTransform->jSrcError);
+	pjDstInfo->err = jpeg_std_error(&lpTransform->jDstError);
+	lpTransform->jSrcError.error_exit   = transform_error_exit;
+	lpTransform->jSrcError.emit_message = transform_emit_message;
+	lpTransform->jDstError.error_exit   = transform_error_exit;
+	lpTransform->jDstError.emit_message = transform_emit_message;
+	pjSrcInfo->client_data = (void*)lpTransform;
+	pjDstInfo->client_data = (void*)lpTransform;
+
+	lpTransform->jDest.init_destination    = transform_init_destination;
+	lpTransform->jDest.empty_output_buffer = transform_empty_output_buffer;
+	lpTransform->jDest.term_destination    = transform_term_destination;
+
+	if (setjmp(lpTransform->JmpBuffer) == 0)
+	{
+		jpeg_create_decompress(pjSrcInfo);
+		jpeg_create_compress(pjDstInfo);
+		jpeg_mem_src(pjSrcInfo, (LPBYTE)lpJpegData, dwLenData);
+
+		// Keep all markers, such as Exif data and ICC profiles
+		jcopy_markers_setup(pjSrcInfo, JCOPYOPT_ALL);
+		jpeg_read_header(pjSrcInfo, TRUE);
+
+		// A partial MCU row at the bottom edge cannot be flipped losslessly. If the image
+		// height is not a multiple of the MCU height, the partial row is trimmed.
+		jpeg_transform_info jTransform;
+		ZeroMemory(&jTransform, sizeof(jTransform));
+		jTransform.transform = JXFORM_FLIP_V;
+		jTransform.perfect = TRUE;
+
+		boolean bWorkspace = jtransform_request_workspace(pjSrcInfo, &jTransform);
+		if (!bWorkspace)
+		{
+			jTransform.perfect = FALSE;
+			jTransform.trim = TRUE;
+			bWorkspace = jtransform_request_workspace(pjSrcInfo, &jTransform);
+		}
+
+		if (bWorkspace)
+		{
+			jvirt_barray_ptr* pSrcCoefArrays = jpeg_read_coefficients(pjSrcInfo);
+			jpeg_copy_critical_parameters(pjSrcInfo, pjDstInfo);
+			jvirt_barray_ptr* pDstCoefArrays = jtransform_adjust_parameters(pjSrcInfo, pjDstInfo,
+				pSrcCoefArrays, &jTransform);
+
+			// Optimized Huffman tables keep the flipped image as small as the original
+			pjDstInfo->optimize_coding = TRUE;
+			pjDstInfo->dest = &lpTransform->jDest;
+
+			jpeg_write_coefficients(pjDstInfo, pDstCoefArrays);
+			jcopy_markers_execute(pjSrcInfo, pjDstInfo, JCOPYOPT_ALL);
+			jtransform_execute_transform(pjSrcInfo, pjDstInfo, pSrcCoefArrays, &jTransform);
+
+			jpeg_finish_compress(pjDstInfo);
+			jpeg_finish_decompress(pjSrcInfo);
+
+			// Corrupt source data, which libjpeg replaces with gray blocks, is a failure
+			lpTransform->bSuccess = pjSrcInfo->err->num_warnings == 0;
+		}
+	}
+
+	// Objects that have not been created are ignored
+	jpeg_destroy_compress(pjDstInfo);
+	jpeg_destroy_decompress(pjSrcInfo);
+
+	BOOL bSuccess = lpTransform->bSuccess;
+	MyGlobalFreePtr((LPVOID)lpTransform);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void write_transform_buffer(LPJPEG_TRANSFORM lpTransform, DWORD cbData)
+{
+	DWORD dwWrite = 0;
+	if (cbData > 0 && (!WriteFile(lpTransform->hFile, lpTransform->abBuffer, cbData, &dwWrite, NULL) ||
+		dwWrite != cbData))
+		longjmp(lpTransform->JmpBuffer, 1);  // Return to setjmp in flip_jpeg_image
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Errors of both JPEG objects return to flip_jpeg_image, which destroys the objects
+
+void transform_error_exit(j_common_ptr pjInfo)
+{
+	longjmp(((LPJPEG_TRANSFORM)pjInfo->client_data)->JmpBuffer, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void transform_emit_message(j_common_ptr pjInfo, int nMessageLevel)
+{
+	if (nMessageLevel < 0)
+		pjInfo->err->num_warnings++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void transform_init_destination(j_compress_ptr pjInfo)
+{
+	LPJPEG_TRANSFORM lpTransform = (LPJPEG_TRANSFORM)pjInfo->client_data;
+	lpTransform->jDest.next_output_byte = lpTransform->abBuffer;
+	lpTransform->jDest.free_in_buffer = sizeof(lpTransform->abBuffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+boolean transform_empty_output_buffer(j_compress_ptr pjInfo)
+{
+	// The whole buffer is written, regardless of next_output_byte and free_in_buffer
+	LPJPEG_TRANSFORM lpTransform = (LPJPEG_TRANSFORM)pjInfo->client_data;
+	write_transform_buffer(lpTransform, sizeof(lpTransform->abBuffer));
+
+	lpTransform->jDest.next_output_byte = lpTransform->abBuffer;
+	lpTransform->jDest.free_in_buffer = sizeof(lpTransform->abBuffer);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void transform_term_destination(j_compress_ptr pjInfo)
+{
+	LPJPEG_TRANSFORM lpTransform = (LPJPEG_TRANSFORM)pjInfo->client_data;
+	write_transform_buffer(lpTransform, (DWORD)(sizeof(lpTransform->abBuffer) - lpTransform->jDest.free_in_buffer));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// WebP decoder using libwebpdecoder
+
+// Size of the chunks passed to the incremental WebP decoder
+#define WEBP_READ_CHUNK     0x10000
+// Maximum number of idle threads kept in the worker pool
+#define WEBP_POOL_MAX_IDLE  8
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// A thread of the worker pool. While a WebPWorker owns the thread, worker->impl_ points to it.
+typedef struct _WEBP_POOL_THREAD
+{
+	struct _WEBP_POOL_THREAD* lpNext; // Next idle thread of the pool
+	HANDLE          hThread;        // Handle of the thread
+	HANDLE          hEventWork;     // Signaled to execute the hook of the worker or to terminate
+	HANDLE          hEventIdle;     // Signaled while the thread waits for work
+	WebPWorker*     pWorker;        // Worker that owns the thread, NULL to terminate the thread
+} WEBP_POOL_THREAD, *LPWEBP_POOL_THREAD;
+
+// Options of the WebP decoder (WDO_* flags)
+static volatile LONG g_lWebpDecoderOptions = WDO_DEFAULT;
+
+// Worker pool. Once installed, the worker interface and the lock are kept until the process
+// exits, because decoder threads that are still running may use them at any time.
+static CRITICAL_SECTION g_csWebpPool;
+static LPWEBP_POOL_THREAD g_lpWebpPoolIdle = NULL;
+static UINT g_uWebpPoolIdle = 0;
+static BOOL g_bWebpPool = FALSE;        // Set while idle threads are kept in the pool
+static BOOL g_bWebpPoolInstalled = FALSE;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions
+
+// Initializes the decoder configuration with the current options
+BOOL InitWebpDecoderConfig(WebPDecoderConfig* pConfig);
+// Takes an idle thread from the pool or starts a new thread
+LPWEBP_POOL_THREAD AcquireWebpPoolThread();
+// Returns a thread to the pool or terminates it if enough threads are idle
+void ReleaseWebpPoolThread(LPWEBP_POOL_THREAD lpThread);
+// Terminates a thread of the pool and frees its resources
+void TerminateWebpPoolThread(LPWEBP_POOL_THREAD lpThread);
+// Thread function of the pool threads
+static unsigned __stdcall WebpPoolThreadProc(LPVOID lpParameter);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback functions (WebPWorkerInterface)
+
+static void WebpWorkerInit(WebPWorker* const pWorker);
+static int WebpWorkerReset(WebPWorker* const pWorker);
+static int WebpWorkerSync(WebPWorker* const pWorker);
+static void WebpWorkerLaunch(WebPWorker* const pWorker);
+static void WebpWorkerExecute(WebPWorker* const pWorker);
+static void WebpWorkerEnd(WebPWorker* const pWorker);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SetWebpDecoderOptions(UINT uOptions)
+{
+	InterlockedExchange(&g_lWebpDecoderOptions, (LONG)uOptions);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+UINT GetWebpDecoderOptions()
+{
+	return (UINT)g_lWebpDecoderOptions;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// The decoder of lossy images uses a WebPWorker to run the loop filter and the output of the
+// macroblock rows in parallel to the decoding of the next rows. The default worker interface
+// starts a thread in Reset and terminates it in End, i.e. once per image. The pool interface
+// hands out idle threads instead and takes them back when the decoder is deleted.
+
+BOOL InitWebpWorkerPool()
+{
+	static const WebPWorkerInterface PoolInterface = {
+		WebpWorkerInit, WebpWorkerReset, WebpWorkerSync, WebpWorkerLaunch, WebpWorkerExecute, WebpWorkerEnd
+	};
+
+	if (!g_bWebpPoolInstalled)
+	{
+		InitializeCriticalSection(&g_csWebpPool);
+		if (!WebPSetWorkerInterface(&PoolInterface))
+		{
+			DeleteCriticalSection(&g_csWebpPool);
+			return FALSE;
+		}
+		g_bWebpPoolInstalled = TRUE;
+	}
+
+	EnterCriticalSection(&g_csWebpPool);
+	g_bWebpPool = TRUE;
+	LeaveCriticalSection(&g_csWebpPool);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void FreeWebpWorkerPool()
+{
+	if (!g_bWebpPoolInstalled)
+		return;
+
+	// Threads that are returned from now on are terminated instead of being kept
+	EnterCriticalSection(&g_csWebpPool);
+	LPWEBP_POOL_THREAD lpThread = g_lpWebpPoolIdle;
+	g_lpWebpPoolIdle = NULL;
+	g_uWebpPoolIdle = 0;
+	g_bWebpPool = FALSE;
+	LeaveCriticalSection(&g_csWebpPool);
+
+	while (lpThread != NULL)
+	{
+		LPWEBP_POOL_THREAD lpNext = lpThread->lpNext;
+		TerminateWebpPoolThread(lpThread);
+		lpThread = lpNext;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+HANDLE WebpToDib(LPVOID lpWebpData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowFeatures)
+{
+	WebPDecoderConfig config;
+
+	if (lpWebpData == NULL || dwLenData == 0 || !InitWebpDecoderConfig(&config) ||
+		WebPGetFeatures((LPBYTE)lpWebpData, dwLenData, &config.input) != VP8_STATUS_OK)
+		return NULL;
+
+	int nWidth = config.input.width;
+	int nHeight = config.input.height;
+
+	if (bShowFeatures)
+		OutputWebpFeatures(&config.input);
+
+	int nNumChannels = config.input.has_alpha ? 4 : 3;
+	int nIncrement = WIDTHBYTES(nWidth * nNumChannels * 8);
+	int nSizeImage = nHeight * nIncrement;
+	if (nSizeImage == 0)
+		return NULL;
+
+	HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + nSizeImage);
+	if (hDib == NULL)
+		return NULL;
+
 	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
 	if (lpbi == NULL)
 	{
 		GlobalFree(hDib);
-		WebPFree(lpBits);
 		return NULL;
 	}
 
@@ -880,39 +2227,469 @@ HANDLE WebpToDib(LPVOID lpWebpData, DWORD dwLenData, BOOL bFlipImage, BOOL bShow
 	lpbi->biBitCount = nNumChannels * 8;
 	lpbi->biCompression = BI_RGB;
 
-	int nSrcPtr = 0;
-	LPBYTE lpSrc = lpBits;
-	LPBYTE lpDest = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+	// Decode directly into the DIB. For a bottom-up DIB, the output starts
+	// at the last row in memory and the stride is negative.
+	LPBYTE lpBits = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+	LPBYTE lpOutput = bFlipImage ? lpBits : lpBits + (nHeight-1) * nIncrement;
+	int nStride = bFlipImage ? nIncrement : -nIncrement;
 
-	__try
+	config.output.colorspace = config.input.has_alpha ? MODE_BGRA : MODE_BGR;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = lpOutput;
+	config.output.u.RGBA.stride = nStride;
+	config.output.u.RGBA.size = nSizeImage;
+
+	VP8StatusCode status = WebPDecode((LPBYTE)lpWebpData, dwLenData, &config);
+	WebPFreeDecBuffer(&config.output);
+
+	GlobalUnlock(hDib);
+
+	if (status != VP8_STATUS_OK)
 	{
-		for (int h = 0; h < nHeight; h++)
+		GlobalFree(hDib);
+		return NULL;
+	}
+
+	return hDib;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// WebpFileToDib reads the image data in chunks and appends them to an incremental decoder,
+// so decoding starts while the rest of the image is still being read. The decoder writes
+// directly into the DIB. If the bitstream features are not known after the first chunk,
+// the whole image is read and decoded by WebpToDib.
+
+HANDLE WebpFileToDib(HANDLE hFile, DWORD dwLenData, BOOL bFlipImage, BOOL bShowFeatures,
+	LPFNDECODEPROGRESS lpfnProgress, LPVOID lpParam, LPBOOL lpbReadError)
+{
+	if (lpbReadError != NULL)
+		*lpbReadError = FALSE;
+
+	if (hFile == NULL || dwLenData == 0)
+		return NULL;
+
+	DWORD cbChunk = min(dwLenData, WEBP_READ_CHUNK);
+	LPBYTE lpChunk = (LPBYTE)MyGlobalAllocPtr(GHND, cbChunk);
+	if (lpChunk == NULL)
+		return NULL;
+
+	if (!ReadData(hFile, lpChunk, cbChunk))
+	{
+		if (lpbReadError != NULL)
+			*lpbReadError = TRUE;
+		MyGlobalFreePtr((LPVOID)lpChunk);
+		return NULL;
+	}
+
+	WebPDecoderConfig config;
+	if (!InitWebpDecoderConfig(&config))
+	{
+		MyGlobalFreePtr((LPVOID)lpChunk);
+		return NULL;
+	}
+
+	VP8StatusCode status = WebPGetFeatures(lpChunk, cbChunk, &config.input);
+	if (status == VP8_STATUS_NOT_ENOUGH_DATA && cbChunk < dwLenData)
+	{  // Large metadata chunks precede the image data
+		HANDLE hDib = NULL;
+		LPBYTE lpData = (LPBYTE)MyGlobalAllocPtr(GHND, dwLenData);
+		if (lpData != NULL)
 		{
-			nSrcPtr = (bFlipImage ? h : nHeight-1 - h) * nWidth * nNumChannels;
-			for (int w = 0; w < nIncrement; w++)
-				*lpDest++ = lpSrc[nSrcPtr++];
+			CopyMemory(lpData, lpChunk, cbChunk);
+			if (ReadData(hFile, lpData + cbChunk, dwLenData - cbChunk))
+				hDib = WebpToDib(lpData, dwLenData, bFlipImage, bShowFeatures);
+			else if (lpbReadError != NULL)
+				*lpbReadError = TRUE;
+			MyGlobalFreePtr((LPVOID)lpData);
 		}
+
+		MyGlobalFreePtr((LPVOID)lpChunk);
+		return hDib;
+	}
+
+	if (status != VP8_STATUS_OK)
+	{
+		MyGlobalFreePtr((LPVOID)lpChunk);
+		return NULL;
+	}
+
+	if (bShowFeatures)
+		OutputWebpFeatures(&config.input);
+
+	int nWidth = config.input.width;
+	int nHeight = config.input.height;
+	int nNumChannels = config.input.has_alpha ? 4 : 3;
+	int nIncrement = WIDTHBYTES(nWidth * nNumChannels * 8);
+	int nSizeImage = nHeight * nIncrement;
+
+	HANDLE hDib = nSizeImage != 0 ? GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + nSizeImage) : NULL;
+	LPBITMAPINFOHEADER lpbi = hDib != NULL ? (LPBITMAPINFOHEADER)GlobalLock(hDib) : NULL;
+	if (lpbi == NULL)
+	{
+		if (hDib != NULL)
+			GlobalFree(hDib);
+		MyGlobalFreePtr((LPVOID)lpChunk);
+		return NULL;
+	}
+
+	lpbi->biSize = sizeof(BITMAPINFOHEADER);
+	lpbi->biWidth = nWidth;
+	lpbi->biHeight = nHeight;
+	lpbi->biPlanes = 1;
+	lpbi->biBitCount = nNumChannels * 8;
+	lpbi->biCompression = BI_RGB;
+
+	// The decoder writes into the DIB. For a bottom-up DIB, the output
+	// starts at the last row in memory and the stride is negative.
+	LPBYTE lpBits = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+	LPBYTE lpOutput = bFlipImage ? lpBits : lpBits + (nHeight-1) * nIncrement;
+	int nStride = bFlipImage ? nIncrement : -nIncrement;
+
+	config.output.colorspace = config.input.has_alpha ? MODE_BGRA : MODE_BGR;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = lpOutput;
+	config.output.u.RGBA.stride = nStride;
+	config.output.u.RGBA.size = nSizeImage;
+
+	// The features are already known, so no data is passed to WebPIDecode
+	status = VP8_STATUS_OUT_OF_MEMORY;
+	WebPIDecoder* pIDec = WebPIDecode(NULL, 0, &config);
+	if (pIDec != NULL)
+	{
+		DWORD dwRemaining = dwLenData;
+		int nRowsShown = 0;
+		for (;;)
+		{
+			dwRemaining -= cbChunk;
+			status = WebPIAppend(pIDec, lpChunk, cbChunk);
+			if (status != VP8_STATUS_SUSPENDED)
+				break;
+
+			// Pass the rows decoded so far for progressive display
+			int nRows = 0;
+			if (lpfnProgress != NULL && WebPIDecGetRGB(pIDec, &nRows, NULL, NULL, NULL) != NULL && nRows > nRowsShown)
+			{
+				nRowsShown = nRows;
+				lpfnProgress(lpParam, hDib, nRows);
+			}
+
+			// Read the next chunk. The decoder has copied the data passed so far.
+			cbChunk = min(dwRemaining, WEBP_READ_CHUNK);
+			if (cbChunk == 0)
+				break;
+
+			if (!ReadData(hFile, lpChunk, cbChunk))
+			{
+				if (lpbReadError != NULL)
+					*lpbReadError = TRUE;
+				break;
+			}
+		}
+
+		WebPIDelete(pIDec);
 	}
-	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
 
 	GlobalUnlock(hDib);
-	WebPFree(lpBits);
+	MyGlobalFreePtr((LPVOID)lpChunk);
+
+	if (status != VP8_STATUS_OK)
+	{
+		GlobalFree(hDib);
+		return NULL;
+	}
 
 	return hDib;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowTextureDesc)
+BOOL InitWebpDecoderConfig(WebPDecoderConfig* pConfig)
+{
+	if (pConfig == NULL || !WebPInitDecoderConfig(pConfig))
+		return FALSE;
+
+	UINT uOptions = GetWebpDecoderOptions();
+	pConfig->options.use_threads = (uOptions & WDO_USE_THREADS) ? 1 : 0;
+	pConfig->options.no_fancy_upsampling = (uOptions & WDO_NO_FANCY_UPSAMPLING) ? 1 : 0;
+	pConfig->options.bypass_filtering = (uOptions & WDO_BYPASS_FILTERING) ? 1 : 0;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+LPWEBP_POOL_THREAD AcquireWebpPoolThread()
+{
+	LPWEBP_POOL_THREAD lpThread = NULL;
+
+	EnterCriticalSection(&g_csWebpPool);
+	if (g_lpWebpPoolIdle != NULL)
+	{
+		lpThread = g_lpWebpPoolIdle;
+		g_lpWebpPoolIdle = lpThread->lpNext;
+		g_uWebpPoolIdle--;
+	}
+	LeaveCriticalSection(&g_csWebpPool);
+
+	if (lpThread != NULL)
+	{
+		lpThread->lpNext = NULL;
+		return lpThread;
+	}
+
+	lpThread = (LPWEBP_POOL_THREAD)MyGlobalAllocPtr(GHND, sizeof(WEBP_POOL_THREAD));
+	if (lpThread == NULL)
+		return NULL;
+
+	lpThread->hEventWork = CreateEvent(NULL, FALSE, FALSE, NULL);
+	lpThread->hEventIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if (lpThread->hEventWork != NULL && lpThread->hEventIdle != NULL)
+		lpThread->hThread = (HANDLE)_beginthreadex(NULL, 0, WebpPoolThreadProc, lpThread, 0, NULL);
+
+	if (lpThread->hThread == NULL)
+	{
+		if (lpThread->hEventWork != NULL)
+			CloseHandle(lpThread->hEventWork);
+		if (lpThread->hEventIdle != NULL)
+			CloseHandle(lpThread->hEventIdle);
+		MyGlobalFreePtr((LPVOID)lpThread);
+		return NULL;
+	}
+
+	return lpThread;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ReleaseWebpPoolThread(LPWEBP_POOL_THREAD lpThread)
+{
+	if (lpThread == NULL)
+		return;
+
+	lpThread->pWorker = NULL;
+
+	EnterCriticalSection(&g_csWebpPool);
+	BOOL bKeep = g_bWebpPool && g_uWebpPoolIdle < WEBP_POOL_MAX_IDLE;
+	if (bKeep)
+	{
+		lpThread->lpNext = g_lpWebpPoolIdle;
+		g_lpWebpPoolIdle = lpThread;
+		g_uWebpPoolIdle++;
+	}
+	LeaveCriticalSection(&g_csWebpPool);
+
+	if (!bKeep)
+		TerminateWebpPoolThread(lpThread);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TerminateWebpPoolThread(LPWEBP_POOL_THREAD lpThread)
+{
+	if (lpThread == NULL)
+		return;
+
+	// Wake up the idle thread without a worker to let it exit
+	lpThread->pWorker = NULL;
+	SetEvent(lpThread->hEventWork);
+	WaitForSingleObject(lpThread->hThread, INFINITE);
+
+	CloseHandle(lpThread->hThread);
+	CloseHandle(lpThread->hEventWork);
+	CloseHandle(lpThread->hEventIdle);
+	MyGlobalFreePtr((LPVOID)lpThread);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned __stdcall WebpPoolThreadProc(LPVOID lpParameter)
+{
+	LPWEBP_POOL_THREAD lpThread = (LPWEBP_POOL_THREAD)lpParameter;
+	if (lpThread == NULL)
+		return 1;
+
+	for (;;)
+	{
+		WaitForSingleObject(lpThread->hEventWork, INFINITE);
+
+		WebPWorker* pWorker = lpThread->pWorker;
+		if (pWorker == NULL)
+			break;
+
+		WebpWorkerExecute(pWorker);
+		SetEvent(lpThread->hEventIdle);
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpWorkerInit(WebPWorker* const pWorker)
+{
+	ZeroMemory(pWorker, sizeof(WebPWorker));
+	pWorker->status_ = NOT_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int WebpWorkerReset(WebPWorker* const pWorker)
+{
+	pWorker->had_error = 0;
+
+	if (pWorker->status_ < OK)
+	{	// If no thread is available, the hooks are executed in the calling thread
+		LPWEBP_POOL_THREAD lpThread = AcquireWebpPoolThread();
+		if (lpThread != NULL)
+			lpThread->pWorker = pWorker;
+		pWorker->impl_ = lpThread;
+		pWorker->status_ = OK;
+	}
+	else if (pWorker->status_ > OK)
+		return WebpWorkerSync(pWorker);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int WebpWorkerSync(WebPWorker* const pWorker)
+{
+	LPWEBP_POOL_THREAD lpThread = (LPWEBP_POOL_THREAD)pWorker->impl_;
+	if (lpThread != NULL)
+		WaitForSingleObject(lpThread->hEventIdle, INFINITE);
+
+	if (pWorker->status_ > OK)
+		pWorker->status_ = OK;
+
+	return !pWorker->had_error;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpWorkerLaunch(WebPWorker* const pWorker)
+{
+	LPWEBP_POOL_THREAD lpThread = (LPWEBP_POOL_THREAD)pWorker->impl_;
+	if (lpThread == NULL)
+	{
+		WebpWorkerExecute(pWorker);
+		return;
+	}
+
+	// Wait for the previous job, then pass the new one to the thread
+	WaitForSingleObject(lpThread->hEventIdle, INFINITE);
+	ResetEvent(lpThread->hEventIdle);
+	pWorker->status_ = WORK;
+	SetEvent(lpThread->hEventWork);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpWorkerExecute(WebPWorker* const pWorker)
+{
+	if (pWorker->hook != NULL)
+		pWorker->had_error |= !pWorker->hook(pWorker->data1, pWorker->data2);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpWorkerEnd(WebPWorker* const pWorker)
+{
+	LPWEBP_POOL_THREAD lpThread = (LPWEBP_POOL_THREAD)pWorker->impl_;
+	if (lpThread != NULL)
+	{
+		WaitForSingleObject(lpThread->hEventIdle, INFINITE);
+		ReleaseWebpPoolThread(lpThread);
+		pWorker->impl_ = NULL;
+	}
+
+	pWorker->status_ = NOT_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void OutputWebpFeatures(const WebPBitstreamFeatures* pFeatures)
+{
+	HWND hwndEdit = GetOutputWindow();
+	if (hwndEdit == NULL || pFeatures == NULL)
+		return;
+
+	TCHAR szOutput[OUTPUT_LEN];
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Width:\t\t%d pixels\r\n"), pFeatures->width);
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Height:\t\t%d pixels\r\n"), pFeatures->height);
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Has Alpha:\t%s\r\n"),
+		pFeatures->has_alpha ? TEXT("True") : TEXT("False"));
+	OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("Has Animation:\t%s\r\n"),
+		pFeatures->has_animation ? TEXT("True") : TEXT("False"));
+	OutputText(hwndEdit, TEXT("Format:\t\t"));
+	switch (pFeatures->format)
+	{
+		case 0:
+			OutputText(hwndEdit, TEXT("Undefined/Mixed"));
+			break;
+		case 1:
+			OutputText(hwndEdit, TEXT("Lossy"));
+			break;
+		case 2:
+			OutputText(hwndEdit, TEXT("Lossless"));
+			break;
+		default:
+			OutputTextFmt(hwndEdit, szOutput, _countof(szOutput), TEXT("%d"), pFeatures->format);
+	}
+	OutputText(hwndEdit, TEXT("\r\n"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// DDS decoder using the crunch library (crnlib)
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Data Types
+
+// Destination of a DDS texture that is decompressed directly into a DIB
+typedef struct _DDS_DIB
+{
+	HANDLE          hDib;           // DIB that receives the selected mipmap level
+	BOOL            bFlipImage;     // Image rows are stored top-down
+} DDS_DIB, *LPDDS_DIB;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Callback functions
+
+// Allocates the DIB and returns the destination of the decompressed pixels
+static void* get_dds_dib_bits(const crn_texture_desc &desc, const crn_decomp_level &level, crn_int32 &pitch, void *pUserData);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowTextureDesc, UINT uTargetSize)
 {
 	if (lpDdsData == NULL || dwLenData == 0)
 		return NULL;
 
+	// crnlib decompresses the texture directly into the DIB allocated by get_dds_dib_bits
+	DDS_DIB DdsDib = {0};
+	DdsDib.bFlipImage = bFlipImage;
+
+	// Only the first face is decoded. If a target size is specified, a smaller mipmap level
+	// is selected instead of the first one, and the other levels are not read at all.
+	crn_decomp_level level = {0};
+	level.m_target_size = uTargetSize;
+
 	crn_texture_desc tex_desc;
-	crn_uint32 *pImages[cCRNMaxFaces * cCRNMaxLevels];
-	if (!crn_decompress_dds_to_images(lpDdsData, dwLenData, pImages, tex_desc))
+	BOOL bSuccess = crn_decompress_dds_to_buffer(lpDdsData, dwLenData, cCRNDecompFlagBGRA, &level,
+		get_dds_dib_bits, &DdsDib, tex_desc);
+
+	if (DdsDib.hDib == NULL)
 		return NULL;
 
+	GlobalUnlock(DdsDib.hDib);
+
+	if (!bSuccess)
+	{
+		GlobalFree(DdsDib.hDib);
+		return NULL;
+	}
+
+	// The texture description is only output for textures that could be decoded
 	if (bShowTextureDesc)
 	{
 		HWND hwndEdit = GetOutputWindow();
@@ -930,27 +2707,36 @@ HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowTe
 		}
 	}
 
-	crn_uint32 uWidth = tex_desc.m_width;
-	crn_uint32 uHeight = tex_desc.m_height;
+	return DdsDib.hDib;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocates the DIB for a DDS texture once crnlib has read the texture description and
+// returns a pointer to the top image row. A bottom-up DIB is filled using a negative pitch.
+
+void* get_dds_dib_bits(const crn_texture_desc &desc, const crn_decomp_level &level, crn_int32 &pitch, void *pUserData)
+{
+	UNREFERENCED_PARAMETER(desc);
+
+	LPDDS_DIB lpDdsDib = (LPDDS_DIB)pUserData;
+	if (lpDdsDib == NULL)
+		return NULL;
+
+	crn_uint32 uWidth = level.m_width;
+	crn_uint32 uHeight = level.m_height;
 	crn_uint32 uSizeImage = uHeight * uWidth * 4;
 	if (uSizeImage == 0)
-	{
-		crn_free_all_images(pImages, tex_desc);
 		return NULL;
-	}
 
-	HANDLE hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + uSizeImage);
-	if (hDib == NULL)
-	{
-		crn_free_all_images(pImages, tex_desc);
+	lpDdsDib->hDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + uSizeImage);
+	if (lpDdsDib->hDib == NULL)
 		return NULL;
-	}
 
-	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(lpDdsDib->hDib);
 	if (lpbi == NULL)
 	{
-		GlobalFree(hDib);
-		crn_free_all_images(pImages, tex_desc);
+		GlobalFree(lpDdsDib->hDib);
+		lpDdsDib->hDib = NULL;
 		return NULL;
 	}
 
@@ -961,32 +2747,15 @@ HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage, BOOL bShowTe
 	lpbi->biBitCount = 32;
 	lpbi->biCompression = BI_RGB;
 
-	crn_uint32 uSrcPtr = 0;
-	crn_uint32 uDestPtr = 0;
-	LPBYTE lpSrc = (LPBYTE)pImages[0];
-	LPBYTE lpDest = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
-
-	__try
+	LPBYTE lpBits = ((LPBYTE)lpbi) + sizeof(BITMAPINFOHEADER);
+	if (lpDdsDib->bFlipImage)
 	{
-		for (crn_uint32 h = 0; h < uHeight; h++)
-		{
-			uSrcPtr = (bFlipImage ? h : uHeight-1 - h) * uWidth * 4;
-			for (crn_uint32 w = 0; w < uWidth; w++)
-			{
-				lpDest[uDestPtr + 2] = lpSrc[uSrcPtr++]; // B <-- R
-				lpDest[uDestPtr + 1] = lpSrc[uSrcPtr++]; // G <-- G
-				lpDest[uDestPtr + 0] = lpSrc[uSrcPtr++]; // R <-- B
-				lpDest[uDestPtr + 3] = lpSrc[uSrcPtr++]; // A <-- A
-				uDestPtr += 4;
-			}
-		}
+		pitch = (crn_int32)(uWidth * 4);
+		return lpBits;
 	}
-	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
 
-	GlobalUnlock(hDib);
-	crn_free_all_images(pImages, tex_desc);
-
-	return hDib;
+	pitch = -(crn_int32)(uWidth * 4);
+	return lpBits + (uHeight-1) * uWidth * 4;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1047,100 +2816,54 @@ HBITMAP CreatePremultipliedBitmap(HANDLE hDib)
 		return NULL;
 	}
 
-	LONG h, w;
-	BYTE cAlpha;
-	LPBYTE lpSrc, lpDest;
-	LPDWORD lpdwColorMasks;
-	DWORD dwColor, dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask;
-	DWORD dwIncrement = WIDTHBYTES(lWidth * wBitCount);
-	BOOL bHasVisiblePixels = FALSE;
-	BOOL bHasTransparentPixels = FALSE;
+	LONG h;
+	LPDWORD lpdwColorMasks;
+	DWORD dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask;
+	DWORD dwIncrement = WIDTHBYTES(lWidth * wBitCount);
+	BYTE cAlphaOr = 0x00;
+	BYTE cAlphaAnd = 0xFF;
+
+	if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
+	{
+		lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
+		dwRedMask      = lpdwColorMasks[0];
+		dwGreenMask    = lpdwColorMasks[1];
+		dwBlueMask     = lpdwColorMasks[2];
+		dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
+	}
+	else if (wBitCount == 16)
+	{
+		dwRedMask   = 0x00007C00;
+		dwGreenMask = 0x000003E0;
+		dwBlueMask  = 0x0000001F;
+		dwAlphaMask = 0x00008000;
+	}
+	else
+	{
+		dwRedMask   = 0x00FF0000;
+		dwGreenMask = 0x0000FF00;
+		dwBlueMask  = 0x000000FF;
+		dwAlphaMask = 0xFF000000;
+	}
+
+	DIB_BITFIELDS Bitfields;
+	InitDibBitfields(&Bitfields, wBitCount, dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask);
 
 	__try
 	{
-		if (wBitCount == 16)
-		{
-			if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
-			{
-				lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
-				dwRedMask      = lpdwColorMasks[0];
-				dwGreenMask    = lpdwColorMasks[1];
-				dwBlueMask     = lpdwColorMasks[2];
-				dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
-			}
-			else
-			{
-				dwRedMask   = 0x00007C00;
-				dwGreenMask = 0x000003E0;
-				dwBlueMask  = 0x0000001F;
-				dwAlphaMask = 0x00008000;
-			}
-
-			if (dwAlphaMask)
-			{
-				for (h = 0; h < lHeight; h++)
-				{
-					lpSrc = lpDIB + (ULONG_PTR)h * dwIncrement;
-					lpDest = lpBGRA + (ULONG_PTR)h * lWidth * 4;
-					for (w = 0; w < lWidth; w++)
-					{
-						dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), 0);
-						cAlpha = dwAlphaMask ? GetColorValue(dwColor, dwAlphaMask) : 0xFF;
-						if (cAlpha != 0x00) bHasVisiblePixels = TRUE;
-						if (cAlpha != 0xFF) bHasTransparentPixels = TRUE;
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwBlueMask), cAlpha);
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwGreenMask), cAlpha);
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwRedMask), cAlpha);
-						*lpDest++ = cAlpha;
-						lpSrc += 2;
-					}
-				}
-			}
-		}
-		else if (wBitCount == 32)
+		if (dwAlphaMask)
 		{
-			if (!bIsCore && lpbi->biCompression == BI_BITFIELDS)
-			{
-				lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
-				dwRedMask      = lpdwColorMasks[0];
-				dwGreenMask    = lpdwColorMasks[1];
-				dwBlueMask     = lpdwColorMasks[2];
-				dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
-			}
-			else
-			{
-				dwRedMask   = 0x00FF0000;
-				dwGreenMask = 0x0000FF00;
-				dwBlueMask  = 0x000000FF;
-				dwAlphaMask = 0xFF000000;
-			}
-
-			if (dwAlphaMask)
-			{
-				for (h = 0; h < lHeight; h++)
-				{
-					lpSrc = lpDIB + (ULONG_PTR)h * dwIncrement;
-					lpDest = lpBGRA + (ULONG_PTR)h * lWidth * 4;
-					for (w = 0; w < lWidth; w++)
-					{
-						dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), MAKEWORD(lpSrc[2], lpSrc[3]));
-						cAlpha = dwAlphaMask ? GetColorValue(dwColor, dwAlphaMask) : 0xFF;
-						if (cAlpha != 0x00) bHasVisiblePixels = TRUE;
-						if (cAlpha != 0xFF) bHasTransparentPixels = TRUE;
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwBlueMask), cAlpha);
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwGreenMask), cAlpha);
-						*lpDest++ = Mul8Bit(GetColorValue(dwColor, dwRedMask), cAlpha);
-						*lpDest++ = cAlpha;
-						lpSrc += 4;
-					}
-				}
-			}
+			for (h = 0; h < lHeight; h++)
+				PremultiplyBitfieldsRow(&Bitfields, lpDIB + (ULONG_PTR)h * dwIncrement,
+					lpBGRA + (ULONG_PTR)h * lWidth * 4, lWidth, &cAlphaOr, &cAlphaAnd);
 		}
 	}
 	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
 
 	GlobalUnlock(hDib);
 
+	BOOL bHasVisiblePixels = (cAlphaOr != 0x00);
+	BOOL bHasTransparentPixels = (cAlphaAnd != 0xFF);
 	if (!bHasVisiblePixels || !bHasTransparentPixels)
 	{ // The image is completely transparent or completely opaque
 		DeleteBitmap(hbmpDib);
@@ -1302,6 +3025,345 @@ HANDLE ConvertBitmapToDib(HBITMAP hBitmap, HDC hdc, WORD wBitCount)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+LPBYTE ConvertDibToBgra(HANDLE hDib, LPLONG lplWidth, LPLONG lplHeight, LPBOOL lpbHasAlpha)
+{
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+		return NULL;
+
+	LPBITMAPCOREHEADER lpbc = (LPBITMAPCOREHEADER)lpbi;
+	BOOL bIsCore   = IS_OS2PM_DIB(lpbi);
+	LONG lWidth    = bIsCore ? lpbc->bcWidth : lpbi->biWidth;
+	LONG lHeight   = bIsCore ? lpbc->bcHeight : lpbi->biHeight;
+	WORD wBitCount = bIsCore ? lpbc->bcBitCount : lpbi->biBitCount;
+	DWORD dwCompression = bIsCore ? BI_RGB : lpbi->biCompression;
+
+	BOOL bIsPalette = (wBitCount == 1 || wBitCount == 2 || wBitCount == 4 || wBitCount == 8);
+	BOOL bIsSupported = (dwCompression == BI_RGB && (bIsPalette || wBitCount == 16 || wBitCount == 24 || wBitCount == 32)) ||
+		(dwCompression == BI_BITFIELDS && (wBitCount == 16 || wBitCount == 32));
+
+	if (!bIsSupported || DibIsCMYK((LPCSTR)lpbi))
+	{
+		GlobalUnlock(hDib);
+		// Convert RLE compressed and CMYK DIBs to a 24-bpp DIB
+		HANDLE hNewDib = ChangeDibBitDepth(hDib, 24);
+		if (hNewDib == NULL)
+			return NULL;
+		else
+		{
+			// Restart with the supported format
+			LPBYTE lpBGRA = ConvertDibToBgra(hNewDib, lplWidth, lplHeight, lpbHasAlpha);
+			FreeDib(hNewDib);
+			return lpBGRA;
+		}
+	}
+
+	BOOL bIsTopDown = (lHeight < 0);
+	lWidth = abs(lWidth);
+	lHeight = abs(lHeight);
+	if (lWidth == 0 || lHeight == 0)
+	{
+		GlobalUnlock(hDib);
+		return NULL;
+	}
+
+	LPDWORD lpdwColorMasks;
+	DWORD dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask;
+
+	if (dwCompression == BI_BITFIELDS)
+	{
+		lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
+		dwRedMask      = lpdwColorMasks[0];
+		dwGreenMask    = lpdwColorMasks[1];
+		dwBlueMask     = lpdwColorMasks[2];
+		dwAlphaMask    = lpbi->biSize >= 56 ? lpdwColorMasks[3] : 0;
+	}
+	else if (wBitCount == 16)
+	{
+		dwRedMask   = 0x00007C00;
+		dwGreenMask = 0x000003E0;
+		dwBlueMask  = 0x0000001F;
+		dwAlphaMask = 0x00008000;
+	}
+	else if (wBitCount == 32)
+	{
+		dwRedMask   = 0x00FF0000;
+		dwGreenMask = 0x0000FF00;
+		dwBlueMask  = 0x000000FF;
+		dwAlphaMask = 0xFF000000;
+	}
+	else
+		dwRedMask = dwGreenMask = dwBlueMask = dwAlphaMask = 0;
+
+	LPBYTE lpBGRA = (LPBYTE)MyGlobalAllocPtr(GHND, (SIZE_T)lWidth * lHeight * 4);
+	if (lpBGRA == NULL)
+	{
+		GlobalUnlock(hDib);
+		return NULL;
+	}
+
+	// Indices without a color table entry are black
+	RGBQUAD aPalette[256];
+	ZeroMemory(aPalette, sizeof(aPalette));
+	if (bIsPalette)
+	{
+		UINT uNumColors = min(DibNumColors((LPCSTR)lpbi), 1U << wBitCount);
+		LPBYTE lpPalette = FindDibPalette((LPCSTR)lpbi);
+		for (UINT i = 0; i < uNumColors; i++)
+		{
+			if (bIsCore)
+			{
+				aPalette[i].rgbBlue  = ((LPRGBTRIPLE)lpPalette)[i].rgbtBlue;
+				aPalette[i].rgbGreen = ((LPRGBTRIPLE)lpPalette)[i].rgbtGreen;
+				aPalette[i].rgbRed   = ((LPRGBTRIPLE)lpPalette)[i].rgbtRed;
+			}
+			else
+				aPalette[i] = ((LPRGBQUAD)lpPalette)[i];
+		}
+	}
+
+	DIB_BITFIELDS Bitfields;
+	InitDibBitfields(&Bitfields, wBitCount, dwRedMask, dwGreenMask, dwBlueMask, dwAlphaMask);
+
+	LPBYTE lpDIB = FindDibBits((LPCSTR)lpbi);
+	DWORD dwIncrement = WIDTHBYTES(lWidth * wBitCount);
+	BYTE cAlphaOr = 0x00;
+	BYTE cAlphaAnd = 0xFF;
+	LONG w, h;
+
+	__try
+	{
+		for (h = 0; h < lHeight; h++)
+		{
+			LPBYTE lpRow = lpDIB + (ULONG_PTR)(bIsTopDown ? h : lHeight-1 - h) * dwIncrement;
+			LPBYTE lpDest = lpBGRA + (ULONG_PTR)h * lWidth * 4;
+			DWORD dwColor;
+
+			switch (wBitCount)
+			{
+				case 1:
+				case 2:
+				case 4:
+				case 8:
+					{
+						UINT uBitCount = wBitCount;
+						BYTE cMask = (BYTE)((1U << uBitCount) - 1);
+						for (w = 0; w < lWidth; w++)
+						{
+							// The leftmost pixel is stored in the most significant bits of a byte
+							UINT uBit = (UINT)w * uBitCount;
+							BYTE cIndex = (lpRow[uBit >> 3] >> (8 - uBitCount - (uBit & 7))) & cMask;
+							*lpDest++ = aPalette[cIndex].rgbBlue;
+							*lpDest++ = aPalette[cIndex].rgbGreen;
+							*lpDest++ = aPalette[cIndex].rgbRed;
+							*lpDest++ = 0xFF;
+						}
+					}
+					break;
+
+				case 24:
+					for (w = 0; w < lWidth; w++)
+					{
+						*lpDest++ = *lpRow++;
+						*lpDest++ = *lpRow++;
+						*lpDest++ = *lpRow++;
+						*lpDest++ = 0xFF;
+					}
+					break;
+
+				case 16:
+				case 32:
+					for (w = 0; w < lWidth; w++)
+					{
+						if (wBitCount == 16)
+						{
+							dwColor = MAKELONG(MAKEWORD(lpRow[0], lpRow[1]), 0);
+							lpRow += 2;
+						}
+						else
+						{
+							dwColor = MAKELONG(MAKEWORD(lpRow[0], lpRow[1]), MAKEWORD(lpRow[2], lpRow[3]));
+							lpRow += 4;
+						}
+
+						BYTE cAlpha = dwAlphaMask ? GetBitfieldValue(dwColor, &Bitfields, 3) : 0xFF;
+						cAlphaOr |= cAlpha;
+						cAlphaAnd &= cAlpha;
+						*lpDest++ = GetBitfieldValue(dwColor, &Bitfields, 0);
+						*lpDest++ = GetBitfieldValue(dwColor, &Bitfields, 1);
+						*lpDest++ = GetBitfieldValue(dwColor, &Bitfields, 2);
+						*lpDest++ = cAlpha;
+					}
+					break;
+			}
+		}
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) { ; }
+
+	GlobalUnlock(hDib);
+
+	// Only translucent images have alpha. Completely transparent images
+	// are opaque, like in CreatePremultipliedBitmap.
+	*lplWidth = lWidth;
+	*lplHeight = lHeight;
+	*lpbHasAlpha = dwAlphaMask != 0 && cAlphaOr != 0x00 && cAlphaAnd != 0xFF;
+
+	return lpBGRA;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL InitResampler()
+{
+	return crn_init_resampler();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void FreeResampler()
+{
+	crn_free_resampler();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Largest width and height accepted by crn_resample_image
+#define RESAMPLE_MAX_SIZE  16384
+
+HANDLE ResampleDib(HANDLE hDib, UINT uWidth, UINT uHeight, BOOL bUseThreads)
+{
+	if (hDib == NULL || uWidth == 0 || uHeight == 0 || uWidth > RESAMPLE_MAX_SIZE || uHeight > RESAMPLE_MAX_SIZE)
+		return NULL;
+
+	LPBITMAPINFOHEADER lpbi = (LPBITMAPINFOHEADER)GlobalLock(hDib);
+	if (lpbi == NULL)
+		return NULL;
+
+	LONG lWidth  = 0;
+	LONG lHeight = 0;
+	BOOL bIsTranslucent = FALSE;
+	BOOL bIsBGRA = FALSE;
+
+	// 32-bpp BGRA pixels are resampled in place. The rows are read by the worker threads of crnlib,
+	// which can't catch access violations, so the bitmap bits of the DIB must be complete.
+	if (!IS_OS2PM_DIB(lpbi) && lpbi->biBitCount == 32 && !DibIsCMYK((LPCSTR)lpbi))
+	{
+		LPDWORD lpdwColorMasks = (LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]);
+		if (lpbi->biCompression == BI_RGB)
+			bIsBGRA = TRUE;
+		else if (lpbi->biCompression == BI_BITFIELDS)
+			bIsBGRA = lpdwColorMasks[0] == 0x00FF0000 && lpdwColorMasks[1] == 0x0000FF00 && lpdwColorMasks[2] == 0x000000FF &&
+				(lpbi->biSize < 56 || lpdwColorMasks[3] == 0xFF000000 || lpdwColorMasks[3] == 0);
+
+		lWidth = abs(lpbi->biWidth);
+		lHeight = abs(lpbi->biHeight);
+		bIsBGRA = bIsBGRA && lWidth != 0 && lHeight != 0 &&
+			GlobalSize(hDib) >= (SIZE_T)DibBitsOffset((LPCSTR)lpbi) + (SIZE_T)WIDTHBYTES(lWidth * 32) * lHeight;
+	}
+
+	LPBYTE lpBGRA = NULL;
+	LPBYTE lpSrc = NULL;
+	INT nSrcPitch = 0;
+
+	if (bIsBGRA)
+	{
+		if (lWidth > RESAMPLE_MAX_SIZE || lHeight > RESAMPLE_MAX_SIZE)
+		{
+			GlobalUnlock(hDib);
+			return NULL;
+		}
+
+		BOOL bHasAlpha = lpbi->biCompression == BI_RGB || (lpbi->biSize >= 56 &&
+			((LPDWORD)&(((LPBITMAPINFO)lpbi)->bmiColors[0]))[3] != 0);
+		BOOL bIsTopDown = (lpbi->biHeight < 0);
+		LPBYTE lpDIB = FindDibBits((LPCSTR)lpbi);
+		DWORD dwIncrement = WIDTHBYTES(lWidth * 32);
+		BYTE cAlphaOr = 0x00;
+		BYTE cAlphaAnd = 0xFF;
+
+		if (bHasAlpha)
+		{
+			__try
+			{
+				for (LONG h = 0; h < lHeight; h++)
+				{
+					LPBYTE lpPixel = lpDIB + (ULONG_PTR)h * dwIncrement + 3;
+					for (LONG w = 0; w < lWidth; w++, lpPixel += 4)
+					{
+						cAlphaOr |= *lpPixel;
+						cAlphaAnd &= *lpPixel;
+					}
+				}
+			}
+			__except (EXCEPTION_EXECUTE_HANDLER) { ; }
+		}
+
+		// Only translucent images are resampled with alpha. Completely transparent images
+		// are opaque, like in CreatePremultipliedBitmap.
+		bIsTranslucent = bHasAlpha && cAlphaOr != 0x00 && cAlphaAnd != 0xFF;
+
+		// A bottom-up DIB is read from the last row upwards using a negative pitch
+		lpSrc = bIsTopDown ? lpDIB : lpDIB + (ULONG_PTR)(lHeight-1) * dwIncrement;
+		nSrcPitch = bIsTopDown ? (INT)dwIncrement : -(INT)dwIncrement;
+	}
+	else
+	{
+		// All other formats are expanded into a top-down BGRA image
+		GlobalUnlock(hDib);
+
+		lpBGRA = ConvertDibToBgra(hDib, &lWidth, &lHeight, &bIsTranslucent);
+		if (lpBGRA == NULL)
+			return NULL;
+
+		if (lWidth > RESAMPLE_MAX_SIZE || lHeight > RESAMPLE_MAX_SIZE)
+		{
+			MyGlobalFreePtr(lpBGRA);
+			return NULL;
+		}
+
+		lpSrc = lpBGRA;
+		nSrcPitch = (INT)(lWidth * 4);
+	}
+
+	HANDLE hNewDib = GlobalAlloc(GHND, sizeof(BITMAPINFOHEADER) + (SIZE_T)uWidth * uHeight * 4);
+	LPBITMAPINFOHEADER lpbiNew = hNewDib != NULL ? (LPBITMAPINFOHEADER)GlobalLock(hNewDib) : NULL;
+
+	BOOL bSuccess = FALSE;
+	if (lpbiNew != NULL)
+	{
+		lpbiNew->biSize = sizeof(BITMAPINFOHEADER);
+		lpbiNew->biWidth = uWidth;
+		lpbiNew->biHeight = uHeight;
+		lpbiNew->biPlanes = 1;
+		lpbiNew->biBitCount = 32;
+		lpbiNew->biCompression = BI_RGB;
+
+		// The colors are filtered in linear light, and with alpha, weighted by alpha.
+		// The bottom-up destination is filled from the top row using a negative pitch.
+		LPBYTE lpBits = ((LPBYTE)lpbiNew) + sizeof(BITMAPINFOHEADER);
+		bSuccess = crn_resample_image(lpSrc, (crn_uint32)lWidth, (crn_uint32)lHeight, nSrcPitch,
+			lpBits + (SIZE_T)(uHeight-1) * uWidth * 4, uWidth, uHeight, -(crn_int32)(uWidth * 4),
+			(bIsTranslucent ? cCRNResampleFlagAlpha : 0) | (bUseThreads ? 0 : cCRNResampleFlagNoThreads), cCRNMipFilterLanczos4);
+
+		GlobalUnlock(hNewDib);
+	}
+
+	if (lpBGRA != NULL)
+		MyGlobalFreePtr(lpBGRA);
+	else
+		GlobalUnlock(hDib);
+
+	if (!bSuccess && hNewDib != NULL)
+	{
+		GlobalFree(hNewDib);
+		hNewDib = NULL;
+	}
+
+	return hNewDib;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 HANDLE CreateClipboardDib(HANDLE hDib, UINT *puFormat)
 {
 	if (hDib == NULL)
@@ -1731,3 +3793,157 @@ static BYTE GetColorValue(DWORD dwPixel, DWORD dwMask)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
+
+void InitDibBitfields(LPDIB_BITFIELDS lpBitfields, WORD wBitCount, DWORD dwRedMask, DWORD dwGreenMask, DWORD dwBlueMask, DWORD dwAlphaMask)
+{
+	ZeroMemory(lpBitfields, sizeof(DIB_BITFIELDS));
+	lpBitfields->adwMask[0] = dwBlueMask;
+	lpBitfields->adwMask[1] = dwGreenMask;
+	lpBitfields->adwMask[2] = dwRedMask;
+	lpBitfields->adwMask[3] = dwAlphaMask;
+	lpBitfields->wBitCount = wBitCount;
+
+	for (int i = 0; i < 4; i++)
+	{
+		DWORD dwMask = lpBitfields->adwMask[i];
+		if (dwMask == 0)
+			continue;
+
+		while ((dwMask & 0x80000000) == 0)
+		{
+			dwMask = dwMask << 1;
+			lpBitfields->anShift[i]++;
+		}
+	}
+
+#if defined(_M_IX86) || defined(_M_X64)
+	lpBitfields->bUseSse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static __inline BYTE GetBitfieldValue(DWORD dwPixel, LPDIB_BITFIELDS lpBitfields, int nIndex)
+{
+	return (BYTE)(((dwPixel & lpBitfields->adwMask[nIndex]) << lpBitfields->anShift[nIndex]) >> 24);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PremultiplyBitfieldsRow(LPDIB_BITFIELDS lpBitfields, LPBYTE lpSrc, LPBYTE lpDest, LONG lWidth, LPBYTE lpcAlphaOr, LPBYTE lpcAlphaAnd)
+{
+	BYTE cAlphaOr = *lpcAlphaOr;
+	BYTE cAlphaAnd = *lpcAlphaAnd;
+	LONG w = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	if (lpBitfields->bUseSse2)
+	{
+		__m128i aMask[4], aShift[4];
+		for (int i = 0; i < 4; i++)
+		{
+			aMask[i] = _mm_set1_epi32((int)lpBitfields->adwMask[i]);
+			aShift[i] = _mm_cvtsi32_si128(lpBitfields->anShift[i]);
+		}
+
+		__m128i zero = _mm_setzero_si128();
+		__m128i alpha_or = zero;
+		__m128i alpha_and = _mm_set1_epi32(-1);
+
+		if (lpBitfields->wBitCount == 16)
+		{ // Expand 8 pixels at once
+			for (; w + 8 <= lWidth; w += 8)
+			{
+				__m128i px = _mm_loadu_si128((const __m128i*)(lpSrc + w * 2));
+				__m128i lo = PremultiplyBitfieldsSse2(_mm_unpacklo_epi16(px, zero), aMask, aShift);
+				__m128i hi = PremultiplyBitfieldsSse2(_mm_unpackhi_epi16(px, zero), aMask, aShift);
+				_mm_storeu_si128((__m128i*)(lpDest + w * 4), lo);
+				_mm_storeu_si128((__m128i*)(lpDest + w * 4 + 16), hi);
+				alpha_or = _mm_or_si128(alpha_or, _mm_or_si128(lo, hi));
+				alpha_and = _mm_and_si128(alpha_and, _mm_and_si128(lo, hi));
+			}
+		}
+		else
+		{ // Expand 4 pixels at once
+			for (; w + 4 <= lWidth; w += 4)
+			{
+				__m128i px = PremultiplyBitfieldsSse2(_mm_loadu_si128((const __m128i*)(lpSrc + w * 4)), aMask, aShift);
+				_mm_storeu_si128((__m128i*)(lpDest + w * 4), px);
+				alpha_or = _mm_or_si128(alpha_or, px);
+				alpha_and = _mm_and_si128(alpha_and, px);
+			}
+		}
+
+		// The alpha values are in the most significant bytes of the pixels
+		alpha_or = _mm_or_si128(alpha_or, _mm_srli_si128(alpha_or, 8));
+		alpha_or = _mm_or_si128(alpha_or, _mm_srli_si128(alpha_or, 4));
+		alpha_and = _mm_and_si128(alpha_and, _mm_srli_si128(alpha_and, 8));
+		alpha_and = _mm_and_si128(alpha_and, _mm_srli_si128(alpha_and, 4));
+		cAlphaOr |= (BYTE)((DWORD)_mm_cvtsi128_si32(alpha_or) >> 24);
+		cAlphaAnd &= (BYTE)((DWORD)_mm_cvtsi128_si32(alpha_and) >> 24);
+	}
+#endif
+
+	lpDest += w * 4;
+	lpSrc += w * (lpBitfields->wBitCount >> 3);
+	for (; w < lWidth; w++)
+	{
+		DWORD dwColor;
+		if (lpBitfields->wBitCount == 16)
+		{
+			dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), 0);
+			lpSrc += 2;
+		}
+		else
+		{
+			dwColor = MAKELONG(MAKEWORD(lpSrc[0], lpSrc[1]), MAKEWORD(lpSrc[2], lpSrc[3]));
+			lpSrc += 4;
+		}
+
+		BYTE cAlpha = GetBitfieldValue(dwColor, lpBitfields, 3);
+		cAlphaOr |= cAlpha;
+		cAlphaAnd &= cAlpha;
+		*lpDest++ = Mul8Bit(GetBitfieldValue(dwColor, lpBitfields, 0), cAlpha);
+		*lpDest++ = Mul8Bit(GetBitfieldValue(dwColor, lpBitfields, 1), cAlpha);
+		*lpDest++ = Mul8Bit(GetBitfieldValue(dwColor, lpBitfields, 2), cAlpha);
+		*lpDest++ = cAlpha;
+	}
+
+	*lpcAlphaOr = cAlphaOr;
+	*lpcAlphaAnd = cAlphaAnd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(_M_IX86) || defined(_M_X64)
+__m128i PremultiplyBitfieldsSse2(__m128i px, const __m128i* aMask, const __m128i* aShift)
+{
+	// Move each component to the most significant bits and keep the upper 8 bits (see GetColorValue)
+	__m128i b = _mm_srli_epi32(_mm_sll_epi32(_mm_and_si128(px, aMask[0]), aShift[0]), 24);
+	__m128i g = _mm_srli_epi32(_mm_sll_epi32(_mm_and_si128(px, aMask[1]), aShift[1]), 24);
+	__m128i r = _mm_srli_epi32(_mm_sll_epi32(_mm_and_si128(px, aMask[2]), aShift[2]), 24);
+	__m128i a = _mm_srli_epi32(_mm_sll_epi32(_mm_and_si128(px, aMask[3]), aShift[3]), 24);
+	px = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(a, 24)));
+
+	// Multiply by alpha (and alpha by 255) in 16-bit lanes with the exact rounding of Mul8Bit:
+	// (t + (t >> 8)) >> 8 with t = c * a + 128 equals the upper 16 bits of t * 257
+	__m128i zero = _mm_setzero_si128();
+	__m128i colors = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	__m128i opaque = _mm_set_epi16(0xFF, 0, 0, 0, 0xFF, 0, 0, 0);
+	__m128i round = _mm_set1_epi16(128);
+	__m128i scale = _mm_set1_epi16(257);
+
+	__m128i lo = _mm_unpacklo_epi8(px, zero);
+	__m128i hi = _mm_unpackhi_epi8(px, zero);
+	__m128i alpha_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i alpha_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	alpha_lo = _mm_or_si128(_mm_and_si128(alpha_lo, colors), opaque);
+	alpha_hi = _mm_or_si128(_mm_and_si128(alpha_hi, colors), opaque);
+	lo = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(lo, alpha_lo), round), scale);
+	hi = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(hi, alpha_hi), round), scale);
+
+	return _mm_packus_epi16(lo, hi);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
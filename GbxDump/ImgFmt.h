@@ -35,20 +35,83 @@ BOOL GetFileName(HWND hDlg, LPTSTR lpszFileName, SIZE_T cchStringLen, LPDWORD lp
 BOOL SaveBmpFile(LPCTSTR lpszFileName, HANDLE hDib);
 
 // Saves a DIB as a PNG file using miniz. Creates images with 8-bit grayscale, 24-bit color,
-// and 32-bit color with alpha channel only. Color tables or color spaces are not supported.
+// and 32-bit color with alpha channel only. Color tables are expanded to gray or RGB values,
+// color spaces are not supported. The DIB is converted and filtered row by row, and strips
+// of rows are deflated in parallel and written to the file as they are finished.
 BOOL SavePngFile(LPCTSTR lpszFileName, HANDLE hDib);
 
+// Presets of the WebP encoder (values of WebPPreset)
+#define WEP_DEFAULT              0       // Default preset
+#define WEP_PICTURE              1       // Digital picture, like portrait or inner shot
+#define WEP_PHOTO                2       // Outdoor photograph with natural lighting
+#define WEP_DRAWING              3       // Hand or line drawing with high-contrast details
+#define WEP_ICON                 4       // Small-sized colorful image
+#define WEP_TEXT                 5       // Text-like image
+
+// Options of the WebP encoder
+#define WEO_USE_THREADS          0x0001  // Encode in worker threads (WebPConfig.thread_level)
+#define WEO_LOSSLESS             0x0002  // Encode the image losslessly
+#define WEO_EXACT                0x0004  // Keep the color values of transparent pixels
+#define WEO_DEFAULT              WEO_USE_THREADS
+
+// Saves a DIB as a WebP file using libwebpencoder. Translucent DIBs keep their alpha channel.
+// nQuality (0 to 100) sets the quality of lossy images and the compression effort of lossless
+// images. Callers that encode several images in parallel should omit WEO_USE_THREADS.
+BOOL SaveWebpFile(LPCTSTR lpszFileName, HANDLE hDib, UINT uPreset = WEP_PHOTO, int nQuality = 80, UINT uOptions = WEO_DEFAULT);
+
+// Saves JPEG data as a file without decoding the image. If bFlipImage is set, the image is
+// flipped vertically in the DCT domain using transupp of libjpeg. If the image height is not
+// a multiple of the MCU height, the partial MCU row at the bottom edge is trimmed. The flip
+// fails if libjpeg reports warnings for the source data, such as a truncated file.
+BOOL SaveJpegFile(LPCTSTR lpszFileName, LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage = FALSE);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Decoding Images
 
-// Converts a JPEG image into a DIB using libjpeg
-HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage = FALSE, INT nTraceLevel = 0);
+// Converts a JPEG image into a DIB using libjpeg. If a target size is specified, the image is
+// scaled down in the IDCT to the smallest size whose longer side is not below the target size.
+// A negative trace level suppresses all messages, which allows images to be decoded in worker threads.
+HANDLE JpegToDib(LPVOID lpJpegData, DWORD dwLenData, BOOL bFlipImage = FALSE, INT nTraceLevel = 0, UINT uTargetSize = 0);
+
+// Options of the WebP decoder
+#define WDO_USE_THREADS          0x0001  // Apply the loop filter of lossy images in a worker thread
+#define WDO_NO_FANCY_UPSAMPLING  0x0002  // Use fast point upsampling instead of fancy upsampling
+#define WDO_BYPASS_FILTERING     0x0004  // Skip the in-loop filtering of lossy images
+#define WDO_DEFAULT              WDO_USE_THREADS
+
+// Sets the options used by WebpToDib and WebpFileToDib (combination of WDO_* flags)
+void SetWebpDecoderOptions(UINT uOptions);
+
+// Returns the options of the WebP decoder
+UINT GetWebpDecoderOptions();
+
+// Replaces the worker interface of libwebp by a pool of worker threads, which are reused
+// across images instead of starting and terminating a thread for each decoded image.
+// Must be called before the first WebP image is decoded.
+BOOL InitWebpWorkerPool();
+
+// Terminates the idle worker threads. Threads that are still in use are terminated when
+// their decoder returns them. The worker interface remains installed, so decoders that are
+// still running at exit are not affected.
+void FreeWebpWorkerPool();
 
 // Decodes a WebP image into a DIB using libwebpdecoder
 HANDLE WebpToDib(LPVOID lpWebpData, DWORD dwLenData, BOOL bFlipImage = FALSE, BOOL bShowFeatures = FALSE);
 
-// Decodes a DDS image into a DIB using crunch/crnlib
-HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage = FALSE, BOOL bShowTextureDesc = FALSE);
+// Receives a partially decoded image for progressive display. nRows is the number of image rows,
+// counted from the top, decoded so far. The DIB is owned by the decoder and must not be freed.
+typedef void (CALLBACK* LPFNDECODEPROGRESS)(LPVOID lpParam, HANDLE hDib, int nRows);
+
+// Decodes a WebP image of dwLenData bytes at the current file position while it is being read.
+// The data is passed in chunks to the incremental decoder of libwebpdecoder. lpbReadError receives
+// TRUE if the file could not be read, as opposed to an image that could not be decoded.
+HANDLE WebpFileToDib(HANDLE hFile, DWORD dwLenData, BOOL bFlipImage = FALSE, BOOL bShowFeatures = FALSE,
+	LPFNDECODEPROGRESS lpfnProgress = NULL, LPVOID lpParam = NULL, LPBOOL lpbReadError = NULL);
+
+// Decodes the first face of a DDS image into a DIB using crunch/crnlib. If a target size is specified,
+// the smallest mipmap level whose longer side is not below the target size is decoded.
+// Floating point and BC6H textures are clamped to [0, 1] and converted to sRGB for display.
+HANDLE DdsToDib(LPVOID lpDdsData, DWORD dwLenData, BOOL bFlipImage = FALSE, BOOL bShowTextureDesc = FALSE, UINT uTargetSize = 0);
 
 // Frees the memory allocated for the DIB
 HANDLE FreeDib(HANDLE hDib);
@@ -75,6 +138,21 @@ HANDLE ChangeDibBitDepth(HANDLE hDib, WORD wBitCount = 0);
 // This function takes a DC instead of a logical palette (as support for ChangeDibBitDepth).
 HANDLE ConvertBitmapToDib(HBITMAP hBitmap, HDC hdc = NULL, WORD wBitCount = 0);
 
+// Resamples a DIB to a new size using the Lanczos filter of crnlib. The colors are filtered in linear
+// light on all processors, and the filter weights are reused for images of the same size, which makes
+// it suitable for batch thumbnail generation. Returns a 32-bit DIB, which is translucent only if the
+// source DIB is translucent. Callers that resample several images in parallel should pass FALSE for
+// bUseThreads, so that each image is resampled in the calling thread only.
+HANDLE ResampleDib(HANDLE hDib, UINT uWidth, UINT uHeight, BOOL bUseThreads = TRUE);
+
+// Creates the color conversion tables of the resampler.
+// Must be called before the first DIB is resampled.
+BOOL InitResampler();
+
+// Frees the color conversion tables and the cached filter weights.
+// Must not be called while a DIB is resampled.
+void FreeResampler();
+
 // Creates a memory object from a given DIB, which can be placed on the clipboard.
 // Depending on the source DIB, a CF_DIB or CF_DIBV5 is created. The system can then
 // create the other formats itself. puFormat returns the format for SetClipboardData.
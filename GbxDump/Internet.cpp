@@ -20,89 +20,958 @@
 #include "Internet.h"
 
 #define TIMEOUT 10000 // 10 seconds
+#define RECEIVE_BUFFER_SIZE 16384
+
+// Identifies a complete cache file. Differs between ANSI and Unicode builds,
+// because the URL is stored as TCHAR string.
+#define CACHE_MAGIC (0x30435847 + sizeof(TCHAR)) // "GXC1" or "GXC2"
+
+#define CACHE_MAX_AGE  (30 * 24 * 60 * 60) // Entries not validated for 30 days are removed
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)  // Largest total size of the cache entries in bytes
+#define CACHE_TEMP_AGE (60 * 60)           // Temporary files left behind for an hour are removed
+#define CACHE_NOT_FOUND_AGE (10 * 60)      // Longest time a "not found" response is served from the cache
+
+// Header of a cache file, followed by the URL and the response data
+typedef struct _CACHE_HEADER
+{
+	DWORD		dwMagic;			// CACHE_MAGIC, zero while the file is being written
+	DWORD		cchUrl;				// Length of the URL that follows the header
+	DWORD		cbData;				// Size of the response data that follows the URL
+	DWORD		dwStatusCode;		// HTTP status code of the cached response
+	FILETIME	ftValidated;		// Time of the last confirmation by the server
+	CHAR		szETag[128];		// Validators for conditional requests
+	CHAR		szLastModified[64];
+} CACHE_HEADER, *PCACHE_HEADER;
+
+// Stores the response data in a temporary cache file while passing it on to the actual receiver
+typedef struct _CACHE_WRITER
+{
+	HANDLE		hFile;
+	TCHAR		szTempFile[MAX_PATH];
+	DWORD		dwDataOffset;
+	DWORD		cbData;
+	BOOL		bFailed;
+	LPFNINTERNETRECEIVE lpfnReceive;
+	LPVOID		lpParam;
+} CACHE_WRITER, *PCACHE_WRITER;
+
+// Cache file found while pruning the cache
+typedef struct _CACHE_FILE
+{
+	FILETIME	ftLastWrite;		// Time of the last validation
+	DWORD		dwSize;
+	TCHAR		szName[24];			// Hash value and extension
+} CACHE_FILE, *PCACHE_FILE;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Forward declarations of functions included in this code module
 
 // Determines whether the system is globally offline
 BOOL IsGlobalOffline(HINTERNET hInternet = NULL);
-// Retrieves error messages from the WinINet module
-void LastInternetError(HWND hwndEdit, DWORD dwError);
+
+// Executes a request, offers to go online if necessary and outputs errors
+static BOOL RunInternetRequest(HWND hwndEdit, LPINTERNET_REQUEST lpRequest);
+
+// Sends a request using the shared WinINet session
+static BOOL CALLBACK WinInetTransport(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszHeaders, LPINTERNET_RESPONSE lpResponse);
+
+// Returns the shared WinINet session, which is opened on first use
+static HINTERNET GetInternetSession();
+
+// Stores received data in the buffer of an Internet request
+static BOOL CALLBACK ReceiveToBuffer(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+
+// Writes received data to a cache file and passes it on
+static BOOL CALLBACK ReceiveToCache(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+
+// Determines the cache directory and the name of the cache file of a URL
+static BOOL GetCacheFileName(LPCTSTR lpszUrl, LPTSTR lpszCacheDir, LPTSTR lpszCacheFile);
+
+// Opens a cache file and checks whether it belongs to the URL
+static HANDLE OpenCacheEntry(LPCTSTR lpszUrl, LPCTSTR lpszCacheFile, PCACHE_HEADER pHeader);
+
+// Returns the number of seconds since the last validation of a cache entry
+static DWORD GetCacheEntryAge(const PCACHE_HEADER pHeader);
+
+// Returns the number of seconds that have passed since a point in time
+static DWORD GetElapsedSeconds(const FILETIME* pftTime);
+
+// Thread function that prunes the cache directory in the background
+static unsigned __stdcall PruneThreadProc(LPVOID lpParameter);
+
+// Removes expired entries and left-behind temporary files, and limits the size of the cache
+static void PruneCache(LPCTSTR lpszCacheDir);
+
+// Compares the validation times of two cache files for qsort
+static int __cdecl CompareCacheFiles(const void* pElem1, const void* pElem2);
+
+// Passes the response data of an opened cache file to the receive function of a request
+static BOOL ReplayCacheEntry(HANDLE hFile, DWORD cbData, LPINTERNET_REQUEST lpRequest);
+
+// Updates the validation time of a cache entry after the server has confirmed it
+static void TouchCacheEntry(LPCTSTR lpszCacheFile, const LPINTERNET_RESPONSE lpResponse);
+
+// Creates a temporary cache file for a new response
+static BOOL BeginCacheEntry(PCACHE_WRITER pWriter, LPCTSTR lpszCacheDir, LPCTSTR lpszUrl);
+
+// Completes a temporary cache file and replaces the previous cache entry
+static void CommitCacheEntry(PCACHE_WRITER pWriter, LPCTSTR lpszCacheFile, const LPINTERNET_RESPONSE lpResponse);
+
+// Deletes a temporary cache file
+static void DiscardCacheEntry(PCACHE_WRITER pWriter);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+
+// WinINet keeps connections to a server alive per session. All requests share one
+// session, so that consecutive lookups reuse the connections of previous ones.
+static HINTERNET volatile g_hSession = NULL;
+
+// Set as soon as the cache directory has been pruned in this process
+static volatile LONG g_lCachePruned = 0;
+
+// The cache is pruned in a background thread, which is stopped and joined by CloseInternetSession
+static HANDLE volatile g_hPruneThread = NULL;
+static volatile LONG g_lStopPruning = 0;
+static TCHAR g_szPruneDir[MAX_PATH];
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-BOOL ReadInternetFile(HWND hwndEdit, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize)
+BOOL ReadInternetFile(HWND hwndEdit, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize, DWORD dwMaxAge)
 {
 	if (hwndEdit == NULL || lpszUrl == NULL || lpszData == NULL || dwSize == 0)
 		return FALSE;
 
-	HINTERNET hInternet = InternetOpen(g_szUserAgent, INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-	if (hInternet == NULL)
-	{
-		LastInternetError(hwndEdit, GetLastError());
+	INTERNET_REQUEST request;
+	if (!InitInternetRequest(&request, lpszUrl, lpszData, dwSize, dwMaxAge))
+		return FALSE;
+
+	return RunInternetRequest(hwndEdit, &request);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ReadInternetStream(HWND hwndEdit, LPCTSTR lpszUrl, LPFNINTERNETRECEIVE lpfnReceive, LPVOID lpParam, DWORD dwMaxAge)
+{
+	if (hwndEdit == NULL || lpszUrl == NULL || lpfnReceive == NULL)
 		return FALSE;
+
+	INTERNET_REQUEST request;
+	if (!InitInternetRequest(&request, lpszUrl, NULL, 0, dwMaxAge))
+		return FALSE;
+
+	request.lpfnReceive = lpfnReceive;
+	request.lpParam = lpParam;
+
+	return RunInternetRequest(hwndEdit, &request);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL RunInternetRequest(HWND hwndEdit, LPINTERNET_REQUEST lpRequest)
+{
+	BOOL bSuccess = ExecuteInternetRequest(lpRequest);
+	if (!bSuccess && IsGlobalOffline())
+	{ // Ask the user to go online and try again
+		if (!InternetGoOnline((LPTSTR)lpRequest->lpszUrl, GetParent(hwndEdit), INTERENT_GOONLINE_REFRESH))
+		{
+			DeleteInternetRequest(lpRequest);
+			return FALSE;
+		}
+
+		bSuccess = ExecuteInternetRequest(lpRequest);
 	}
 
+	if (!bSuccess)
+		LastInternetError(hwndEdit, lpRequest->dwError);
+
+	DeleteInternetRequest(lpRequest);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL InitInternetRequest(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize, DWORD dwMaxAge)
+{
+	if (lpRequest == NULL || lpszUrl == NULL || (lpszData == NULL) != (dwSize == 0))
+		return FALSE;
+
+	ZeroMemory(lpRequest, sizeof(INTERNET_REQUEST));
+	lpRequest->lpszUrl = lpszUrl;
+	lpRequest->lpszData = lpszData;
+	lpRequest->dwSize = dwSize;
+	lpRequest->dwMaxAge = dwMaxAge;
+	lpRequest->lpfnReceive = ReceiveToBuffer;
+	lpRequest->lpParam = lpRequest;
+	if (lpRequest->lpszData != NULL)
+		lpRequest->lpszData[0] = '\0';
+
+	InitializeCriticalSection(&lpRequest->cs);
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ExecuteInternetRequest(LPINTERNET_REQUEST lpRequest)
+{
+	if (lpRequest == NULL || lpRequest->lpszUrl == NULL || lpRequest->lpfnReceive == NULL)
+		return FALSE;
+
+	lpRequest->dwError = ERROR_SUCCESS;
+	lpRequest->dwStatusCode = 0;
+	lpRequest->lpfnReceive(lpRequest->lpParam, NULL, 0);
+
+	TCHAR szCacheDir[MAX_PATH];
+	TCHAR szCacheFile[MAX_PATH];
+	BOOL bUseCache = lpRequest->dwMaxAge > 0 && GetCacheFileName(lpRequest->lpszUrl, szCacheDir, szCacheFile);
+
+	// Serve fresh responses from the cache without contacting the server
+	CACHE_HEADER ch;
+	HANDLE hCache = INVALID_HANDLE_VALUE;
+	if (bUseCache)
+	{
+		// Maps may be uploaded at any time, so "not found" responses expire sooner
+		hCache = OpenCacheEntry(lpRequest->lpszUrl, szCacheFile, &ch);
+		if (hCache != INVALID_HANDLE_VALUE && GetCacheEntryAge(&ch) < (ch.dwStatusCode == HTTP_STATUS_NOT_FOUND ?
+			min(lpRequest->dwMaxAge, CACHE_NOT_FOUND_AGE) : lpRequest->dwMaxAge))
+		{
+			BOOL bSuccess = ReplayCacheEntry(hCache, ch.cbData, lpRequest);
+			CloseHandle(hCache);
+			if (bSuccess)
+				lpRequest->dwStatusCode = ch.dwStatusCode;
+			if (bSuccess || lpRequest->bCancelled)
+				return bSuccess;
+
+			// The cache file is unreadable, so ask the server instead
+			hCache = INVALID_HANDLE_VALUE;
+			lpRequest->dwError = ERROR_SUCCESS;
+		}
+	}
+
+	// Stale responses are revalidated using the validators of the cache entry
+	TCHAR szHeaders[256];
+	szHeaders[0] = '\0';
+	if (hCache != INVALID_HANDLE_VALUE)
+	{
+		int nLen = 0;
+		if (ch.szETag[0] != '\0')
+			nLen = _sntprintf(szHeaders, _countof(szHeaders), TEXT("If-None-Match: %hs\r\n"), ch.szETag);
+		if (nLen >= 0 && ch.szLastModified[0] != '\0')
+			nLen = _sntprintf(szHeaders + nLen, _countof(szHeaders) - nLen, TEXT("If-Modified-Since: %hs\r\n"), ch.szLastModified);
+		if (nLen < 0)
+			szHeaders[0] = '\0';
+		szHeaders[_countof(szHeaders)-1] = '\0';
+	}
+
+	// Store the response in a new cache file while receiving it
+	CACHE_WRITER writer;
+	ZeroMemory(&writer, sizeof(CACHE_WRITER));
+	writer.hFile = INVALID_HANDLE_VALUE;
+
+	LPFNINTERNETRECEIVE lpfnReceive = lpRequest->lpfnReceive;
+	LPVOID lpParam = lpRequest->lpParam;
+	if (bUseCache && BeginCacheEntry(&writer, szCacheDir, lpRequest->lpszUrl))
+	{
+		writer.lpfnReceive = lpfnReceive;
+		writer.lpParam = lpParam;
+		lpRequest->lpfnReceive = ReceiveToCache;
+		lpRequest->lpParam = &writer;
+	}
+
+	INTERNET_RESPONSE response;
+	ZeroMemory(&response, sizeof(INTERNET_RESPONSE));
+
+	LPFNINTERNETTRANSPORT lpfnTransport = (lpRequest->lpfnTransport != NULL) ? lpRequest->lpfnTransport : WinInetTransport;
+	BOOL bSuccess = lpfnTransport(lpRequest, szHeaders[0] != '\0' ? szHeaders : NULL, &response);
+
+	lpRequest->lpfnReceive = lpfnReceive;
+	lpRequest->lpParam = lpParam;
+	lpRequest->dwStatusCode = response.dwStatusCode;
+
+	// Server errors are failures, the response is neither cached nor passed on as data
+	if (bSuccess && response.dwStatusCode >= HTTP_STATUS_SERVER_ERROR)
+	{
+		lpRequest->dwError = ERROR_HTTP_INVALID_SERVER_RESPONSE;
+		bSuccess = FALSE;
+	}
+
+	if (bSuccess && response.dwStatusCode == HTTP_STATUS_NOT_MODIFIED && hCache != INVALID_HANDLE_VALUE)
+	{ // The cached response is still valid
+		DiscardCacheEntry(&writer);
+		bSuccess = ReplayCacheEntry(hCache, ch.cbData, lpRequest);
+		if (bSuccess)
+		{
+			lpRequest->dwStatusCode = ch.dwStatusCode;
+			TouchCacheEntry(szCacheFile, &response);
+		}
+	}
+	else if (bSuccess && (response.dwStatusCode == HTTP_STATUS_OK || response.dwStatusCode == HTTP_STATUS_NOT_FOUND))
+	{ // Unknown maps are cached as well, but only for a short time (CACHE_NOT_FOUND_AGE)
+		CommitCacheEntry(&writer, szCacheFile, &response);
+	}
+	else
+	{
+		DiscardCacheEntry(&writer);
+		if (!bSuccess && hCache != INVALID_HANDLE_VALUE && !lpRequest->bCancelled)
+		{ // Fall back to the stale response if the server cannot be reached
+			DWORD dwError = lpRequest->dwError;
+			bSuccess = ReplayCacheEntry(hCache, ch.cbData, lpRequest);
+			lpRequest->dwError = bSuccess ? ERROR_SUCCESS : dwError;
+			lpRequest->dwStatusCode = bSuccess ? ch.dwStatusCode : 0;
+		}
+	}
+
+	if (hCache != INVALID_HANDLE_VALUE)
+		CloseHandle(hCache);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CancelInternetRequest(LPINTERNET_REQUEST lpRequest)
+{
+	if (lpRequest == NULL)
+		return;
+
+	// Only the HTTP request handle is closed here. The connection handle remains owned by the
+	// executing thread, which closes it after the blocked call has returned.
+	EnterCriticalSection(&lpRequest->cs);
+	lpRequest->bCancelled = TRUE;
+	if (lpRequest->hInternet != NULL)
+	{ // Closing the handle unblocks the thread that is waiting for the server
+		InternetCloseHandle(lpRequest->hInternet);
+		lpRequest->hInternet = NULL;
+	}
+	LeaveCriticalSection(&lpRequest->cs);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void DeleteInternetRequest(LPINTERNET_REQUEST lpRequest)
+{
+	if (lpRequest != NULL)
+		DeleteCriticalSection(&lpRequest->cs);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+LPFNINTERNETTRANSPORT GetInternetTransport()
+{
+	return WinInetTransport;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CloseInternetSession()
+{
+	// Stop pruning the cache and wait for the thread
+	HANDLE hPruneThread = (HANDLE)InterlockedExchangePointer((PVOID volatile*)&g_hPruneThread, NULL);
+	if (hPruneThread != NULL)
+	{
+		InterlockedExchange(&g_lStopPruning, 1);
+		WaitForSingleObject(hPruneThread, INFINITE);
+		CloseHandle(hPruneThread);
+	}
+
+	HINTERNET hSession = (HINTERNET)InterlockedExchangePointer((PVOID volatile*)&g_hSession, NULL);
+	if (hSession != NULL)
+		InternetCloseHandle(hSession);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static HINTERNET GetInternetSession()
+{
+	HINTERNET hSession = g_hSession;
+	if (hSession != NULL)
+		return hSession;
+
+	hSession = InternetOpen(g_szUserAgent, INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+	if (hSession == NULL)
+		return NULL;
+
 	DWORD dwTimeout = TIMEOUT;
-	InternetSetOption(hInternet, INTERNET_OPTION_CONNECT_TIMEOUT, &dwTimeout, sizeof(dwTimeout));
-	InternetSetOption(hInternet, INTERNET_OPTION_RECEIVE_TIMEOUT, &dwTimeout, sizeof(dwTimeout));
+	InternetSetOption(hSession, INTERNET_OPTION_CONNECT_TIMEOUT, &dwTimeout, sizeof(dwTimeout));
+	InternetSetOption(hSession, INTERNET_OPTION_RECEIVE_TIMEOUT, &dwTimeout, sizeof(dwTimeout));
 
-	HINTERNET hInternetFile = InternetOpenUrl(hInternet, lpszUrl, NULL, 0, 0, 0);
-	if (hInternetFile == NULL)
+	// Another thread may have opened the session in the meantime
+	HINTERNET hPrevSession = (HINTERNET)InterlockedCompareExchangePointer((PVOID volatile*)&g_hSession, hSession, NULL);
+	if (hPrevSession != NULL)
 	{
-		DWORD dwError = GetLastError();
+		InternetCloseHandle(hSession);
+		hSession = hPrevSession;
+	}
+
+	return hSession;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK WinInetTransport(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszHeaders, LPINTERNET_RESPONSE lpResponse)
+{
+	if (lpRequest == NULL || lpResponse == NULL)
+		return FALSE;
+
+	HINTERNET hSession = GetInternetSession();
+	if (hSession == NULL)
+	{
+		lpRequest->dwError = GetLastError();
+		return FALSE;
+	}
+
+	// Split the URL into host name and object name
+	TCHAR szHostName[INTERNET_MAX_HOST_NAME_LENGTH];
+	TCHAR szUrlPath[INTERNET_MAX_PATH_LENGTH];
+	TCHAR szExtraInfo[INTERNET_MAX_PATH_LENGTH];
+
+	URL_COMPONENTS uc = {0};
+	uc.dwStructSize = sizeof(URL_COMPONENTS);
+	uc.lpszHostName = szHostName;
+	uc.dwHostNameLength = _countof(szHostName);
+	uc.lpszUrlPath = szUrlPath;
+	uc.dwUrlPathLength = _countof(szUrlPath);
+	uc.lpszExtraInfo = szExtraInfo;
+	uc.dwExtraInfoLength = _countof(szExtraInfo);
+
+	if (!InternetCrackUrl(lpRequest->lpszUrl, 0, 0, &uc))
+	{
+		lpRequest->dwError = GetLastError();
+		return FALSE;
+	}
 
-		if (!IsGlobalOffline(hInternet))
+	if (_tcslen(szUrlPath) + _tcslen(szExtraInfo) >= _countof(szUrlPath))
+	{
+		lpRequest->dwError = ERROR_INTERNET_INVALID_URL;
+		return FALSE;
+	}
+	_tcscat(szUrlPath, szExtraInfo);
+
+	HINTERNET hConnect = InternetConnect(hSession, szHostName, uc.nPort, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+	if (hConnect == NULL)
+	{
+		lpRequest->dwError = GetLastError();
+		return FALSE;
+	}
+
+	DWORD dwFlags = INTERNET_FLAG_KEEP_CONNECTION | INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE |
+		INTERNET_FLAG_NO_UI | INTERNET_FLAG_IGNORE_REDIRECT_TO_HTTPS;
+	if (uc.nScheme == INTERNET_SCHEME_HTTPS)
+		dwFlags |= INTERNET_FLAG_SECURE;
+
+	// The request handle is published to cancel the request from another thread. Whichever
+	// thread takes it out of the request data under the critical section closes it.
+	EnterCriticalSection(&lpRequest->cs);
+	HINTERNET hRequest = NULL;
+	if (!lpRequest->bCancelled)
+	{
+		hRequest = HttpOpenRequest(hConnect, NULL, szUrlPath, NULL, NULL, NULL, dwFlags, 0);
+		if (hRequest == NULL)
+			lpRequest->dwError = GetLastError();
+		lpRequest->hInternet = hRequest;
+	}
+	LeaveCriticalSection(&lpRequest->cs);
+
+	BOOL bSuccess = FALSE;
+	if (hRequest != NULL && !HttpSendRequest(hRequest, lpszHeaders, lpszHeaders != NULL ? (DWORD)-1L : 0, NULL, 0))
+		lpRequest->dwError = GetLastError();
+	else if (hRequest != NULL)
+	{
+		DWORD dwLen = sizeof(DWORD);
+		if (!HttpQueryInfo(hRequest, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &lpResponse->dwStatusCode, &dwLen, NULL))
+			lpResponse->dwStatusCode = HTTP_STATUS_OK;
+
+		dwLen = sizeof(lpResponse->szETag);
+		if (!HttpQueryInfoA(hRequest, HTTP_QUERY_ETAG, lpResponse->szETag, &dwLen, NULL))
+			lpResponse->szETag[0] = '\0';
+
+		dwLen = sizeof(lpResponse->szLastModified);
+		if (!HttpQueryInfoA(hRequest, HTTP_QUERY_LAST_MODIFIED, lpResponse->szLastModified, &dwLen, NULL))
+			lpResponse->szLastModified[0] = '\0';
+
+		CHAR achBuffer[RECEIVE_BUFFER_SIZE];
+		DWORD dwRead = 0;
+		bSuccess = TRUE;
+
+		do
 		{
-			LastInternetError(hwndEdit, dwError);
-			InternetCloseHandle(hInternet);
+			if (!InternetReadFile(hRequest, achBuffer, sizeof(achBuffer), &dwRead))
+			{
+				lpRequest->dwError = GetLastError();
+				bSuccess = FALSE;
+				break;
+			}
+
+			if (dwRead > 0 && !lpRequest->lpfnReceive(lpRequest->lpParam, achBuffer, dwRead))
+			{
+				lpRequest->dwError = ERROR_INTERNET_OPERATION_CANCELLED;
+				bSuccess = FALSE;
+				break;
+			}
+
+		} while (dwRead != 0);
+	}
+
+	// The request handle has already been closed if the request was cancelled
+	EnterCriticalSection(&lpRequest->cs);
+	if (lpRequest->bCancelled)
+	{
+		lpRequest->dwError = ERROR_INTERNET_OPERATION_CANCELLED;
+		bSuccess = FALSE;
+	}
+	if (lpRequest->hInternet != NULL)
+	{
+		InternetCloseHandle(lpRequest->hInternet);
+		lpRequest->hInternet = NULL;
+	}
+	LeaveCriticalSection(&lpRequest->cs);
+
+	InternetCloseHandle(hConnect);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ReceiveToBuffer(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	LPINTERNET_REQUEST lpRequest = (LPINTERNET_REQUEST)lpParam;
+	if (lpRequest == NULL || lpRequest->lpszData == NULL || lpRequest->dwSize == 0)
+		return FALSE;
+
+	if (lpData == NULL)
+		lpRequest->cbData = 0;
+	else
+	{ // Data that does not fit into the buffer is dropped
+		DWORD cbCopy = min(cbData, lpRequest->dwSize - lpRequest->cbData - 1);
+		CopyMemory(lpRequest->lpszData + lpRequest->cbData, lpData, cbCopy);
+		lpRequest->cbData += cbCopy;
+	}
+
+	lpRequest->lpszData[lpRequest->cbData] = '\0';
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ReceiveToCache(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PCACHE_WRITER pWriter = (PCACHE_WRITER)lpParam;
+	if (pWriter == NULL)
+		return FALSE;
+
+	if (!pWriter->bFailed)
+	{
+		DWORD dwWritten = 0;
+		if (lpData == NULL)
+		{ // Truncate the file behind the URL
+			pWriter->cbData = 0;
+			if (SetFilePointer(pWriter->hFile, pWriter->dwDataOffset, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER ||
+				!SetEndOfFile(pWriter->hFile))
+				pWriter->bFailed = TRUE;
+		}
+		else if (WriteFile(pWriter->hFile, lpData, cbData, &dwWritten, NULL) && dwWritten == cbData)
+			pWriter->cbData += cbData;
+		else
+			pWriter->bFailed = TRUE;
+	}
+
+	return pWriter->lpfnReceive(pWriter->lpParam, lpData, cbData);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL GetCacheFileName(LPCTSTR lpszUrl, LPTSTR lpszCacheDir, LPTSTR lpszCacheFile)
+{
+	if (lpszUrl == NULL || lpszCacheDir == NULL || lpszCacheFile == NULL)
+		return FALSE;
+
+	// %LOCALAPPDATA%\GbxDump\Cache, or the temp directory on systems without LOCALAPPDATA
+	DWORD dwLen = GetEnvironmentVariable(TEXT("LOCALAPPDATA"), lpszCacheDir, MAX_PATH);
+	if (dwLen == 0 || dwLen >= MAX_PATH)
+	{
+		dwLen = GetTempPath(MAX_PATH, lpszCacheDir);
+		if (dwLen == 0 || dwLen >= MAX_PATH)
 			return FALSE;
+	}
+
+	if (lpszCacheDir[dwLen-1] == TEXT('\\'))
+		lpszCacheDir[--dwLen] = TEXT('\0');
+
+	if (dwLen + 40 >= MAX_PATH)
+		return FALSE;
+
+	_tcscat(lpszCacheDir, TEXT("\\GbxDump"));
+	CreateDirectory(lpszCacheDir, NULL);
+	_tcscat(lpszCacheDir, TEXT("\\Cache"));
+	if (!CreateDirectory(lpszCacheDir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+		return FALSE;
+
+	// The first request of the process cleans up the cache without waiting for the directory scan
+	if (InterlockedCompareExchange(&g_lCachePruned, 1, 0) == 0)
+	{
+		MyStrNCpy(g_szPruneDir, lpszCacheDir, _countof(g_szPruneDir));
+		g_hPruneThread = (HANDLE)_beginthreadex(NULL, 0, PruneThreadProc, g_szPruneDir, 0, NULL);
+	}
+
+	// The file name is the 64-bit FNV-1a hash of the URL
+	ULONGLONG ullHash = 14695981039346656037ULL;
+	for (LPCTSTR lpsz = lpszUrl; *lpsz != TEXT('\0'); lpsz++)
+	{
+		ullHash ^= (ULONGLONG)(_TUCHAR)*lpsz;
+		ullHash *= 1099511628211ULL;
+	}
+
+	_sntprintf(lpszCacheFile, MAX_PATH, TEXT("%s\\%016I64x.cache"), lpszCacheDir, ullHash);
+	lpszCacheFile[MAX_PATH-1] = TEXT('\0');
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static HANDLE OpenCacheEntry(LPCTSTR lpszUrl, LPCTSTR lpszCacheFile, PCACHE_HEADER pHeader)
+{
+	if (lpszUrl == NULL || lpszCacheFile == NULL || pHeader == NULL)
+		return INVALID_HANDLE_VALUE;
+
+	SIZE_T cchUrl = _tcslen(lpszUrl);
+	if (cchUrl > INTERNET_MAX_URL_LENGTH)
+		return INVALID_HANDLE_VALUE;
+
+	HANDLE hFile = CreateFile(lpszCacheFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return INVALID_HANDLE_VALUE;
+
+	// Different URLs with the same hash value are treated as cache misses
+	TCHAR szUrl[INTERNET_MAX_URL_LENGTH+1];
+	DWORD dwRead = 0;
+	DWORD dwFileSize = GetFileSize(hFile, NULL);
+
+	if (!ReadFile(hFile, pHeader, sizeof(CACHE_HEADER), &dwRead, NULL) || dwRead != sizeof(CACHE_HEADER) ||
+		pHeader->dwMagic != CACHE_MAGIC || pHeader->cchUrl != cchUrl ||
+		!ReadFile(hFile, szUrl, (DWORD)(cchUrl * sizeof(TCHAR)), &dwRead, NULL) || dwRead != cchUrl * sizeof(TCHAR) ||
+		_tcsncmp(szUrl, lpszUrl, cchUrl) != 0 || dwFileSize == INVALID_FILE_SIZE ||
+		dwFileSize - sizeof(CACHE_HEADER) - cchUrl * sizeof(TCHAR) != pHeader->cbData)
+	{
+		CloseHandle(hFile);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	pHeader->szETag[_countof(pHeader->szETag)-1] = '\0';
+	pHeader->szLastModified[_countof(pHeader->szLastModified)-1] = '\0';
+
+	return hFile;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static DWORD GetCacheEntryAge(const PCACHE_HEADER pHeader)
+{
+	if (pHeader == NULL)
+		return MAXDWORD;
+
+	return GetElapsedSeconds(&pHeader->ftValidated);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static DWORD GetElapsedSeconds(const FILETIME* pftTime)
+{
+	FILETIME ftNow;
+	GetSystemTimeAsFileTime(&ftNow);
+
+	ULARGE_INTEGER uliNow, uliTime;
+	uliNow.LowPart = ftNow.dwLowDateTime;
+	uliNow.HighPart = ftNow.dwHighDateTime;
+	uliTime.LowPart = pftTime->dwLowDateTime;
+	uliTime.HighPart = pftTime->dwHighDateTime;
+
+	// Times in the future are considered stale
+	if (uliNow.QuadPart < uliTime.QuadPart)
+		return MAXDWORD;
+
+	ULONGLONG ullAge = (uliNow.QuadPart - uliTime.QuadPart) / 10000000; // 100 ns units
+	return ullAge < MAXDWORD ? (DWORD)ullAge : MAXDWORD;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static unsigned __stdcall PruneThreadProc(LPVOID lpParameter)
+{
+	// Requests of the user take precedence over the cleanup
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+	PruneCache((LPCTSTR)lpParameter);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Entries are only refreshed when their URL is requested again, and temporary files remain
+// when a request is abandoned or the process is terminated. The time of the last write
+// operation is the time of the last validation, as TouchCacheEntry rewrites the header.
+
+static void PruneCache(LPCTSTR lpszCacheDir)
+{
+	TCHAR szPath[MAX_PATH];
+	if (_sntprintf(szPath, _countof(szPath), TEXT("%s\\*"), lpszCacheDir) < 0)
+		return;
+	szPath[_countof(szPath)-1] = TEXT('\0');
+
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFile(szPath, &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+
+	PCACHE_FILE pFiles = NULL;
+	LONG lCount = 0;
+	LONG lCapacity = 0;
+	ULONGLONG ullTotalSize = 0;
+
+	do
+	{
+		if (g_lStopPruning)
+			break;
+
+		SIZE_T cchName = _tcslen(fd.cFileName);
+		if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || cchName >= _countof(pFiles->szName))
+			continue;
+
+		BOOL bTempFile = cchName > 7 && _tcsnicmp(fd.cFileName, TEXT("gxc"), 3) == 0 &&
+			_tcsicmp(fd.cFileName + cchName - 4, TEXT(".tmp")) == 0;
+		BOOL bCacheFile = cchName > 6 && _tcsicmp(fd.cFileName + cchName - 6, TEXT(".cache")) == 0;
+		if (!bTempFile && !bCacheFile)
+			continue;
+
+		// Files that are still being written by another request cannot be deleted
+		DWORD dwAge = GetElapsedSeconds(&fd.ftLastWriteTime);
+		if (dwAge > (bTempFile ? CACHE_TEMP_AGE : CACHE_MAX_AGE))
+		{
+			if (_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), lpszCacheDir, fd.cFileName) > 0)
+				DeleteFile(szPath);
+			continue;
 		}
 
-		if (!InternetGoOnline((LPTSTR)lpszUrl, GetParent(hwndEdit), INTERENT_GOONLINE_REFRESH))
+		if (bTempFile)
+			continue;
+
+		// Enlarge the list of the remaining entries
+		if (lCount >= lCapacity)
 		{
-			InternetCloseHandle(hInternet);
-			return FALSE;
+			LONG lNewCapacity = (lCapacity > 0) ? lCapacity * 2 : 256;
+			PCACHE_FILE pNewFiles = (PCACHE_FILE)MyGlobalAllocPtr(GHND, lNewCapacity * sizeof(CACHE_FILE));
+			if (pNewFiles == NULL)
+				break;
+
+			if (pFiles != NULL)
+			{
+				CopyMemory(pNewFiles, pFiles, lCount * sizeof(CACHE_FILE));
+				MyGlobalFreePtr((LPVOID)pFiles);
+			}
+
+			pFiles = pNewFiles;
+			lCapacity = lNewCapacity;
 		}
 
-		hInternetFile = InternetOpenUrl(hInternet, lpszUrl, NULL, 0, 0, INTERNET_NO_CALLBACK);
-		if (hInternetFile == NULL)
+		pFiles[lCount].ftLastWrite = fd.ftLastWriteTime;
+		pFiles[lCount].dwSize = fd.nFileSizeHigh != 0 ? MAXDWORD : fd.nFileSizeLow;
+		MyStrNCpy(pFiles[lCount].szName, fd.cFileName, _countof(pFiles[lCount].szName));
+		ullTotalSize += pFiles[lCount].dwSize;
+		lCount++;
+	}
+	while (FindNextFile(hFind, &fd));
+
+	FindClose(hFind);
+
+	// Remove the least recently validated entries until the cache fits into its size limit
+	if (pFiles != NULL && ullTotalSize > CACHE_MAX_SIZE && !g_lStopPruning)
+	{
+		qsort(pFiles, lCount, sizeof(CACHE_FILE), CompareCacheFiles);
+
+		for (LONG i = 0; i < lCount && ullTotalSize > CACHE_MAX_SIZE && !g_lStopPruning; i++)
 		{
-			LastInternetError(hwndEdit, GetLastError());
-			InternetCloseHandle(hInternet);
-			return FALSE;
+			if (_sntprintf(szPath, _countof(szPath), TEXT("%s\\%s"), lpszCacheDir, pFiles[i].szName) > 0 &&
+				DeleteFile(szPath))
+				ullTotalSize -= pFiles[i].dwSize;
 		}
 	}
 
-	DWORD dwRead = 0;
-	DWORD dwReadTotal = 0;
-	LPSTR lpsz = lpszData;
+	if (pFiles != NULL)
+		MyGlobalFreePtr((LPVOID)pFiles);
+}
 
-	do
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int __cdecl CompareCacheFiles(const void* pElem1, const void* pElem2)
+{
+	return CompareFileTime(&((const PCACHE_FILE)pElem1)->ftLastWrite, &((const PCACHE_FILE)pElem2)->ftLastWrite);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL ReplayCacheEntry(HANDLE hFile, DWORD cbData, LPINTERNET_REQUEST lpRequest)
+{
+	if (hFile == INVALID_HANDLE_VALUE || lpRequest == NULL)
+		return FALSE;
+
+	lpRequest->lpfnReceive(lpRequest->lpParam, NULL, 0);
+
+	CHAR achBuffer[RECEIVE_BUFFER_SIZE];
+	while (cbData > 0)
 	{
-		if (!InternetReadFile(hInternetFile, lpsz, dwSize-dwReadTotal-1, &dwRead))
+		if (lpRequest->bCancelled)
 		{
-			LastInternetError(hwndEdit, GetLastError());
-			InternetCloseHandle(hInternetFile);
-			InternetCloseHandle(hInternet);
+			lpRequest->dwError = ERROR_INTERNET_OPERATION_CANCELLED;
 			return FALSE;
 		}
 
-		lpsz += dwRead;
-		dwReadTotal += dwRead;
+		DWORD dwRead = 0;
+		if (!ReadFile(hFile, achBuffer, (DWORD)min(cbData, sizeof(achBuffer)), &dwRead, NULL) || dwRead == 0)
+		{
+			lpRequest->dwError = ERROR_READ_FAULT;
+			return FALSE;
+		}
+
+		if (!lpRequest->lpfnReceive(lpRequest->lpParam, achBuffer, dwRead))
+		{
+			lpRequest->dwError = ERROR_INTERNET_OPERATION_CANCELLED;
+			return FALSE;
+		}
+
+		cbData -= dwRead;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void TouchCacheEntry(LPCTSTR lpszCacheFile, const LPINTERNET_RESPONSE lpResponse)
+{
+	if (lpszCacheFile == NULL || lpResponse == NULL)
+		return;
+
+	HANDLE hFile = CreateFile(lpszCacheFile, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	CACHE_HEADER ch;
+	DWORD dwRead = 0;
+	if (ReadFile(hFile, &ch, sizeof(CACHE_HEADER), &dwRead, NULL) && dwRead == sizeof(CACHE_HEADER) &&
+		ch.dwMagic == CACHE_MAGIC)
+	{ // A 304 response may carry updated validators
+		GetSystemTimeAsFileTime(&ch.ftValidated);
+		if (lpResponse->szETag[0] != '\0')
+			MyStrNCpyA(ch.szETag, lpResponse->szETag, (int)_countof(ch.szETag));
+		if (lpResponse->szLastModified[0] != '\0')
+			MyStrNCpyA(ch.szLastModified, lpResponse->szLastModified, (int)_countof(ch.szLastModified));
+
+		DWORD dwWritten = 0;
+		if (SetFilePointer(hFile, 0, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER)
+			WriteFile(hFile, &ch, sizeof(CACHE_HEADER), &dwWritten, NULL);
+	}
+
+	CloseHandle(hFile);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL BeginCacheEntry(PCACHE_WRITER pWriter, LPCTSTR lpszCacheDir, LPCTSTR lpszUrl)
+{
+	if (pWriter == NULL || lpszCacheDir == NULL || lpszUrl == NULL)
+		return FALSE;
 
-	} while (dwRead != 0);
+	SIZE_T cchUrl = _tcslen(lpszUrl);
+	if (cchUrl > INTERNET_MAX_URL_LENGTH)
+		return FALSE;
 
-	lpszData[dwReadTotal] = '\0';
+	// Every request writes to its own file, so that concurrent requests do not interfere
+	if (GetTempFileName(lpszCacheDir, TEXT("gxc"), 0, pWriter->szTempFile) == 0)
+		return FALSE;
 
-	InternetCloseHandle(hInternetFile);
-	InternetCloseHandle(hInternet);
+	pWriter->hFile = CreateFile(pWriter->szTempFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+	if (pWriter->hFile == INVALID_HANDLE_VALUE)
+	{
+		DeleteFile(pWriter->szTempFile);
+		return FALSE;
+	}
+
+	// The header is written without magic number, so that incomplete files are never used
+	CACHE_HEADER ch;
+	ZeroMemory(&ch, sizeof(CACHE_HEADER));
+	ch.cchUrl = (DWORD)cchUrl;
+
+	DWORD dwWritten = 0;
+	DWORD cbUrl = (DWORD)(cchUrl * sizeof(TCHAR));
+	if (!WriteFile(pWriter->hFile, &ch, sizeof(CACHE_HEADER), &dwWritten, NULL) ||
+		!WriteFile(pWriter->hFile, lpszUrl, cbUrl, &dwWritten, NULL) || dwWritten != cbUrl)
+	{
+		DiscardCacheEntry(pWriter);
+		return FALSE;
+	}
+
+	pWriter->dwDataOffset = sizeof(CACHE_HEADER) + cbUrl;
+	pWriter->cbData = 0;
+	pWriter->bFailed = FALSE;
 
 	return TRUE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+static void CommitCacheEntry(PCACHE_WRITER pWriter, LPCTSTR lpszCacheFile, const LPINTERNET_RESPONSE lpResponse)
+{
+	if (pWriter == NULL || pWriter->hFile == INVALID_HANDLE_VALUE || lpszCacheFile == NULL || lpResponse == NULL)
+		return;
+
+	if (pWriter->bFailed)
+	{
+		DiscardCacheEntry(pWriter);
+		return;
+	}
+
+	CACHE_HEADER ch;
+	ZeroMemory(&ch, sizeof(CACHE_HEADER));
+	ch.dwMagic = CACHE_MAGIC;
+	ch.cchUrl = (pWriter->dwDataOffset - sizeof(CACHE_HEADER)) / sizeof(TCHAR);
+	ch.cbData = pWriter->cbData;
+	ch.dwStatusCode = lpResponse->dwStatusCode;
+	GetSystemTimeAsFileTime(&ch.ftValidated);
+	MyStrNCpyA(ch.szETag, lpResponse->szETag, (int)_countof(ch.szETag));
+	MyStrNCpyA(ch.szLastModified, lpResponse->szLastModified, (int)_countof(ch.szLastModified));
+
+	DWORD dwWritten = 0;
+	BOOL bSuccess = SetFilePointer(pWriter->hFile, 0, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER &&
+		WriteFile(pWriter->hFile, &ch, sizeof(CACHE_HEADER), &dwWritten, NULL) && dwWritten == sizeof(CACHE_HEADER);
+
+	CloseHandle(pWriter->hFile);
+	pWriter->hFile = INVALID_HANDLE_VALUE;
+
+	// Replace the previous entry in one step, readers keep their handle to the old file
+	if (!bSuccess || !MoveFileEx(pWriter->szTempFile, lpszCacheFile, MOVEFILE_REPLACE_EXISTING))
+		DeleteFile(pWriter->szTempFile);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void DiscardCacheEntry(PCACHE_WRITER pWriter)
+{
+	if (pWriter == NULL || pWriter->hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	CloseHandle(pWriter->hFile);
+	pWriter->hFile = INVALID_HANDLE_VALUE;
+	DeleteFile(pWriter->szTempFile);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL IsGlobalOffline(HINTERNET hInternet)
 { // NULL is a valid value for HINTERNET
 	BOOL bRet = FALSE;
@@ -125,8 +994,12 @@ void LastInternetError(HWND hwndEdit, DWORD dwError)
 
 	LPVOID lpMsgBuf = NULL;
 
-	DWORD dwLen = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_HMODULE |
-		FORMAT_MESSAGE_IGNORE_INSERTS, GetModuleHandle(TEXT("wininet.dll")), dwError,
+	// Error codes outside the WinINet range are system error codes
+	BOOL bWinInetError = (dwError >= INTERNET_ERROR_BASE && dwError <= INTERNET_ERROR_LAST);
+
+	DWORD dwLen = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_IGNORE_INSERTS |
+		(bWinInetError ? FORMAT_MESSAGE_FROM_HMODULE : FORMAT_MESSAGE_FROM_SYSTEM),
+		bWinInetError ? GetModuleHandle(TEXT("wininet.dll")) : NULL, dwError,
 		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPTSTR)&lpMsgBuf, 0, NULL);
 
 	if (lpMsgBuf == NULL)
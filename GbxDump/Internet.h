@@ -16,7 +16,72 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Retrieves data from an Internet address
-BOOL ReadInternetFile(HWND hwndEdit, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize);
+// Status code and cache validators of an HTTP response
+typedef struct _INTERNET_RESPONSE
+{
+    DWORD     dwStatusCode;         // HTTP status code (200, 304, 404, ...)
+    CHAR      szETag[128];          // Entity tag of the resource
+    CHAR      szLastModified[64];   // Date of the last modification of the resource
+} INTERNET_RESPONSE, FAR* LPINTERNET_RESPONSE, *PINTERNET_RESPONSE;
+
+// Receives the data of an Internet request in chunks. A call with lpData set to NULL discards the
+// data received so far, because the request is restarted. Returns FALSE to abort the request.
+typedef BOOL (CALLBACK* LPFNINTERNETRECEIVE)(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+
+// Sends an HTTP GET request with the additional headers (may be NULL) and passes the
+// response data to the receive function of the request
+typedef BOOL (CALLBACK* LPFNINTERNETTRANSPORT)(struct _INTERNET_REQUEST* lpRequest, LPCTSTR lpszHeaders, LPINTERNET_RESPONSE lpResponse);
+
+// Data of an Internet request that can be executed in a worker thread and cancelled from another thread
+typedef struct _INTERNET_REQUEST
+{
+    LPCTSTR   lpszUrl;      // Address of the requested resource
+    LPSTR     lpszData;     // Buffer that receives the null-terminated data, may be NULL
+    DWORD     dwSize;       // Size of the buffer in bytes
+    DWORD     cbData;       // Number of bytes stored in the buffer
+    DWORD     dwMaxAge;     // Maximum age of a cached response in seconds (0 = do not cache)
+    DWORD     dwStatusCode; // HTTP status code of the response
+    LPFNINTERNETRECEIVE lpfnReceive; // Receives the response data, by default stored in the buffer
+    LPVOID    lpParam;      // Parameter of the receive function
+    LPFNINTERNETTRANSPORT lpfnTransport; // Transport of this request, NULL for the WinINet transport
+    LPVOID    lpTransportParam; // Parameter of the transport of this request
+    DWORD     dwError;      // Error code of a failed request
+    BOOL      bCancelled;   // Set as soon as the request has been cancelled
+    HINTERNET hInternet;    // HTTP request handle of the running request, closed to cancel it
+    CRITICAL_SECTION cs;    // Synchronizes the access to the request handle
+} INTERNET_REQUEST, FAR* LPINTERNET_REQUEST, *PINTERNET_REQUEST;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Retrieves data from an Internet address. Responses younger than dwMaxAge seconds are served
+// from the local response cache, older ones are revalidated with the server.
+BOOL ReadInternetFile(HWND hwndEdit, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize, DWORD dwMaxAge = 0);
+
+// Retrieves data from an Internet address and passes it to the receive function as it arrives.
+// Unlike ReadInternetFile, the size of the response is not limited by a buffer.
+BOOL ReadInternetStream(HWND hwndEdit, LPCTSTR lpszUrl, LPFNINTERNETRECEIVE lpfnReceive, LPVOID lpParam, DWORD dwMaxAge = 0);
+
+// Initializes the data of an Internet request. Without a buffer (NULL, 0),
+// the caller has to set the receive function before executing the request.
+BOOL InitInternetRequest(LPINTERNET_REQUEST lpRequest, LPCTSTR lpszUrl, LPSTR lpszData, DWORD dwSize, DWORD dwMaxAge = 0);
+
+// Retrieves the data of an Internet request without any output. Can be called from any thread.
+BOOL ExecuteInternetRequest(LPINTERNET_REQUEST lpRequest);
+
+// Aborts a running Internet request. Is called from a thread other than the executing one.
+void CancelInternetRequest(LPINTERNET_REQUEST lpRequest);
+
+// Releases the resources of an Internet request
+void DeleteInternetRequest(LPINTERNET_REQUEST lpRequest);
+
+// Returns the WinINet transport, which a request-specific transport can pass the request on to
+LPFNINTERNETTRANSPORT GetInternetTransport();
+
+// Closes the shared WinINet session and thus all kept-alive connections. Stops and waits
+// for the cleanup of the response cache, so it is called once at exit.
+void CloseInternetSession();
+
+// Retrieves error messages from the WinINet module or, for other error codes, from the system
+void LastInternetError(HWND hwndEdit, DWORD dwError);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
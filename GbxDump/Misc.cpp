@@ -18,6 +18,12 @@
 
 #include "stdafx.h"
 #include "Archive.h"
+#include "NadeoFmt.h"
+
+#if defined(UNICODE) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -76,6 +82,52 @@ BOOL DisableButton(HWND hDlg, int nIDButton, int nIDFocus)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+void WaitForWorkerThreads(HANDLE hFinished, HANDLE hCancel, HANDLE* ahThreads, int nThreads,
+	DWORD dwInterval, LPFNWORKERPROGRESS lpfnProgress, LPVOID lpParam)
+{
+	BOOL bQuit = FALSE;
+	int nExitCode = 0;
+
+	for (;;)
+	{
+		DWORD dwWait = MsgWaitForMultipleObjects(1, &hFinished, FALSE, dwInterval, QS_ALLINPUT);
+
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+			{ // Remember the exit code for the message loop of the dialog box
+				bQuit = TRUE;
+				nExitCode = (int)msg.wParam;
+				SetEvent(hCancel);
+			}
+			else if (msg.message == WM_KEYDOWN && msg.wParam == VK_ESCAPE)
+				SetEvent(hCancel);
+			else if ((msg.message < WM_KEYFIRST || msg.message > WM_KEYLAST) &&
+				(msg.message < WM_MOUSEFIRST || msg.message > WM_MOUSELAST) &&
+				(msg.message < WM_NCMOUSEMOVE || msg.message > WM_NCXBUTTONDBLCLK))
+				DispatchMessage(&msg);
+		}
+
+		if (lpfnProgress != NULL)
+			lpfnProgress(lpParam);
+
+		if (dwWait == WAIT_OBJECT_0)
+			break;
+	}
+
+	if (nThreads > 0)
+		WaitForMultipleObjects(nThreads, ahThreads, TRUE, INFINITE);
+	for (int i = 0; i < nThreads; i++)
+		CloseHandle(ahThreads[i]);
+
+	// Pass the message on to the message loop of the dialog box
+	if (bQuit)
+		PostQuitMessage(nExitCode);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 HWND GetOutputWindow(HWND hDlg)
 {
 	HWND hwndDlg = NULL;
@@ -163,15 +215,16 @@ BOOL OutputTextCount(HWND hwndEdit, UINT uID, SIZE_T uCount)
 	_sntprintf(szFormat, _countof(szFormat), TEXT("%Iu"), uCount);
 	szFormat[FORMAT_LEN - 1] = TEXT('\0');
 
-	LPCTSTR lpszText = AllocReplaceString(szOutput, TEXT("{COUNT}"), szFormat);
-	if (lpszText == NULL)
+	LPCTSTR lpszPattern = TEXT("{COUNT}");
+	LPCTSTR lpszReplacement = szFormat;
+
+	TCHAR szText[OUTPUT_LEN + FORMAT_LEN];
+	if (ReplaceStrings(szOutput, &lpszPattern, &lpszReplacement, 1, szText, _countof(szText)) == (SIZE_T)-1)
 		return FALSE;
 
-	OutputText(hwndEdit, lpszText);
+	OutputText(hwndEdit, szText);
 	OutputText(hwndEdit, g_szSep1);
 
-	MyGlobalFreePtr((LPVOID)lpszText);
-
 	return TRUE;
 }
 
@@ -321,48 +374,27 @@ BOOL CleanupString(LPCTSTR lpszInput, LPTSTR lpszOutput, SIZE_T cchLenOutput)
 	if (_tcschr(lpszInput, TEXT('$')) == NULL)
 		return FALSE;
 
-	BOOL bRet = TRUE;
-	LPCTSTR lpszMem1 = NULL;
-	LPCTSTR lpszMem2 = NULL;
-	LPCTSTR lpszMem3 = NULL;
+	BOOL bRet = FALSE;
+	LPTSTR lpszText = NULL;
 
 	__try
 	{
-		// Replace dollar signs with alert escape characters
-		lpszMem1 = AllocReplaceString(lpszInput, TEXT("$$"), TEXT("\a"));
-		if (lpszMem1 == NULL)
-			return FALSE;
-
-		// Remove formatting characters
-		lpszMem2 = AllocCleanupString(lpszMem1);
-		if (lpszMem2 == NULL)
-		{
-			MyGlobalFreePtr((LPVOID)lpszMem1);
-			return FALSE;
-		}
-
-		// Replace alert escape characters back to dollar signs
-		lpszMem3 = AllocReplaceString(lpszMem2, TEXT("\a"), TEXT("$"));
-		if (lpszMem3 == NULL)
+		// The span list of a string is cached, so that names that appear
+		// again and again, such as those of Dedimania records, are parsed only once
+		lpszText = AllocRenderNadeoString(lpszInput, NTF_PLAIN);
+		if (lpszText != NULL)
 		{
-			MyGlobalFreePtr((LPVOID)lpszMem2);
-			MyGlobalFreePtr((LPVOID)lpszMem1);
-			return FALSE;
+			MyStrNCpy(lpszOutput, lpszText, (int)cchLenOutput);
+			bRet = TRUE;
 		}
-
-		MyStrNCpy(lpszOutput, lpszMem3, (int)cchLenOutput);
 	}
 	__except (EXCEPTION_EXECUTE_HANDLER)
 	{
 		bRet = FALSE;
 	}
 
-	if (lpszMem3 != NULL)
-		MyGlobalFreePtr((LPVOID)lpszMem3);
-	if (lpszMem2 != NULL)
-		MyGlobalFreePtr((LPVOID)lpszMem2);
-	if (lpszMem1 != NULL)
-		MyGlobalFreePtr((LPVOID)lpszMem1);
+	if (lpszText != NULL)
+		MyGlobalFreePtr((LPVOID)lpszText);
 
 	return bRet;
 }
@@ -371,48 +403,182 @@ BOOL CleanupString(LPCTSTR lpszInput, LPTSTR lpszOutput, SIZE_T cchLenOutput)
 
 LPTSTR AllocReplaceString(LPCTSTR lpszOriginal, LPCTSTR lpszPattern, LPCTSTR lpszReplacement)
 {
-	if (lpszOriginal == NULL || lpszPattern == NULL || lpszReplacement == NULL)
-		return NULL;
+	return AllocReplaceStrings(lpszOriginal, &lpszPattern, &lpszReplacement, 1);
+}
 
-	SIZE_T CONST cchRepLen = _tcslen(lpszReplacement);
-	SIZE_T CONST cchPatLen = _tcslen(lpszPattern);
-	SIZE_T CONST cchOriLen = _tcslen(lpszOriginal);
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-	UINT uPatCount = 0;
-	LPCTSTR lpszOrigPtr;
-	LPCTSTR lpszPatLoc;
+LPTSTR AllocReplaceStrings(LPCTSTR lpszOriginal, const LPCTSTR* lpPatterns, const LPCTSTR* lpReplacements, UINT uCount)
+{
+	if (lpszOriginal == NULL)
+		return NULL;
 
-	// Determine how often the pattern occurs in the original string
-	for (lpszOrigPtr = lpszOriginal; (lpszPatLoc = _tcsstr(lpszOrigPtr, lpszPattern));
-		lpszOrigPtr = lpszPatLoc + cchPatLen)
-		uPatCount++;
+	// Determine the exact length of the new string
+	SIZE_T cchRetLen = ReplaceStrings(lpszOriginal, lpPatterns, lpReplacements, uCount, NULL, 0);
+	if (cchRetLen == (SIZE_T)-1)
+		return NULL;
 
-	// Allocate memory for the new string
-	SIZE_T CONST cchRetLen = cchOriLen + uPatCount * (cchRepLen - cchPatLen);
+	// Allocate memory for the new string and replace all patterns
 	LPTSTR lpszReturn = (LPTSTR)MyGlobalAllocPtr(GHND, (cchRetLen + 1) * sizeof(TCHAR));
 	if (lpszReturn != NULL)
+		ReplaceStrings(lpszOriginal, lpPatterns, lpReplacements, uCount, lpszReturn, cchRetLen + 1);
+
+	return lpszReturn;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Copies characters to a position in a buffer as far as they fit into it
+static void AppendString(LPTSTR lpszOutput, SIZE_T cchLenOutput, SIZE_T cchOffset, LPCTSTR lpszString, SIZE_T cchString)
+{
+	if (cchLenOutput == 0 || cchOffset >= cchLenOutput - 1)
+		return;
+
+	if (cchString > cchLenOutput - 1 - cchOffset)
+		cchString = cchLenOutput - 1 - cchOffset;
+
+	memcpy(lpszOutput + cchOffset, lpszString, cchString * sizeof(TCHAR));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+SIZE_T ReplaceStrings(LPCTSTR lpszOriginal, const LPCTSTR* lpPatterns, const LPCTSTR* lpReplacements, UINT uCount,
+	LPTSTR lpszOutput, SIZE_T cchLenOutput)
+{
+	const UINT MAX_PATTERNS = 32;
+
+	if (lpszOriginal == NULL || lpPatterns == NULL || lpReplacements == NULL || uCount > MAX_PATTERNS)
+		return (SIZE_T)-1;
+
+	SIZE_T acchPatLen[MAX_PATTERNS];
+	SIZE_T acchRepLen[MAX_PATTERNS];
+	BYTE abFirstChar[256 / 8] = {0};
+	TCHAR achFirst[4] = {0};
+	UINT uFirstCount = 0;
+
+	// Set up a filter with the first characters of all patterns
+	for (UINT i = 0; i < uCount; i++)
 	{
-		// Copy the original string and replace each occurrence of the pattern
-		LPTSTR lpszRetPtr = lpszReturn;
-		for (lpszOrigPtr = lpszOriginal; (lpszPatLoc = _tcsstr(lpszOrigPtr, lpszPattern));
-			lpszOrigPtr = lpszPatLoc + cchPatLen)
+		if (lpPatterns[i] == NULL || lpReplacements[i] == NULL)
+			return (SIZE_T)-1;
+
+		acchPatLen[i] = _tcslen(lpPatterns[i]);
+		acchRepLen[i] = _tcslen(lpReplacements[i]);
+		if (acchPatLen[i] == 0)
+			continue;
+
+		TCHAR ch = lpPatterns[i][0];
+		BYTE bIndex = (BYTE)(ch & 0xFF);
+		if (!(abFirstChar[bIndex >> 3] & (1 << (bIndex & 7))))
 		{
-			SIZE_T CONST cchSkpLen = lpszPatLoc - lpszOrigPtr;
-			// Copy the substring up to the beginning of the pattern
-			_tcsncpy(lpszRetPtr, lpszOrigPtr, cchSkpLen);
-			lpszRetPtr += cchSkpLen;
-			// Copy the replacement string
-			_tcsncpy(lpszRetPtr, lpszReplacement, cchRepLen);
-			lpszRetPtr += cchRepLen;
+			abFirstChar[bIndex >> 3] |= (BYTE)(1 << (bIndex & 7));
+			if (uFirstCount < _countof(achFirst))
+				achFirst[uFirstCount] = ch;
+			uFirstCount++;
+		}
+		else if (uFirstCount <= _countof(achFirst))
+		{
+			BOOL bKnown = FALSE;
+			for (UINT j = 0; j < uFirstCount; j++)
+				bKnown = bKnown || (achFirst[j] == ch);
+			if (!bKnown)
+				uFirstCount = _countof(achFirst) + 1; // Same filter bit, but different character
 		}
-		// Copy the rest of the string
-		_tcscpy(lpszRetPtr, lpszOrigPtr);
 	}
 
-	return lpszReturn;
+	SIZE_T CONST cchOriLen = _tcslen(lpszOriginal);
+	SIZE_T cchRetLen = 0;
+	SIZE_T cchPos = 0;
+	SIZE_T cchCopied = 0;
+
+#if defined(UNICODE) && (defined(_M_IX86) || defined(_M_X64))
+	// Compare eight characters at once if there are only a few different first characters
+	BOOL bUseSse2 = uFirstCount > 0 && uFirstCount <= _countof(achFirst) &&
+		IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+	__m128i aFirst[_countof(achFirst)];
+	for (UINT j = 0; j < _countof(achFirst); j++)
+		aFirst[j] = _mm_set1_epi16((short)achFirst[j < uFirstCount ? j : 0]);
+#endif
+
+	while (cchPos < cchOriLen)
+	{
+#if defined(UNICODE) && (defined(_M_IX86) || defined(_M_X64))
+		if (bUseSse2)
+		{ // Skip blocks of characters that cannot start a pattern
+			while (cchPos + 8 <= cchOriLen)
+			{
+				__m128i chars = _mm_loadu_si128((const __m128i*)(lpszOriginal + cchPos));
+				__m128i match = _mm_cmpeq_epi16(chars, aFirst[0]);
+				for (UINT j = 1; j < uFirstCount; j++)
+					match = _mm_or_si128(match, _mm_cmpeq_epi16(chars, aFirst[j]));
+				int nMask = _mm_movemask_epi8(match);
+				if (nMask != 0)
+				{
+					unsigned long ulIndex;
+					_BitScanForward(&ulIndex, (unsigned long)nMask);
+					cchPos += ulIndex / sizeof(TCHAR);
+					break;
+				}
+				cchPos += 8;
+			}
+
+			if (cchPos >= cchOriLen)
+				break;
+		}
+#endif
+
+		TCHAR ch = lpszOriginal[cchPos];
+		BYTE bIndex = (BYTE)(ch & 0xFF);
+		if (!(abFirstChar[bIndex >> 3] & (1 << (bIndex & 7))))
+		{
+			cchPos++;
+			continue;
+		}
+
+		// Check the patterns in the order of the list
+		UINT uMatch = uCount;
+		for (UINT i = 0; i < uCount; i++)
+		{
+			if (acchPatLen[i] > 0 && lpPatterns[i][0] == ch && acchPatLen[i] <= cchOriLen - cchPos &&
+				memcmp(lpszOriginal + cchPos, lpPatterns[i], acchPatLen[i] * sizeof(TCHAR)) == 0)
+			{
+				uMatch = i;
+				break;
+			}
+		}
+
+		if (uMatch == uCount)
+		{
+			cchPos++;
+			continue;
+		}
+
+		// Copy the substring up to the beginning of the pattern and the replacement string
+		if (lpszOutput != NULL)
+		{
+			AppendString(lpszOutput, cchLenOutput, cchRetLen, lpszOriginal + cchCopied, cchPos - cchCopied);
+			AppendString(lpszOutput, cchLenOutput, cchRetLen + cchPos - cchCopied, lpReplacements[uMatch], acchRepLen[uMatch]);
+		}
+		cchRetLen += cchPos - cchCopied + acchRepLen[uMatch];
+
+		cchPos += acchPatLen[uMatch];
+		cchCopied = cchPos;
+	}
+
+	// Copy the rest of the string
+	if (lpszOutput != NULL)
+	{
+		AppendString(lpszOutput, cchLenOutput, cchRetLen, lpszOriginal + cchCopied, cchOriLen - cchCopied);
+		if (cchLenOutput > 0)
+			lpszOutput[min(cchRetLen + cchOriLen - cchCopied, cchLenOutput - 1)] = TEXT('\0');
+	}
+	cchRetLen += cchOriLen - cchCopied;
+
+	return cchRetLen;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////
 
 LPTSTR AllocCleanupString(LPCTSTR lpszOriginal)
 {
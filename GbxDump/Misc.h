@@ -49,6 +49,16 @@ BOOL IsKeyDown(int nVirtKey);
 // Disables a button control and sets the keyboard focus to the specified control if needed
 BOOL DisableButton(HWND hDlg, int nIDButton, int nIDFocus);
 
+// Callback function that updates the progress display while waiting for worker threads
+typedef void (CALLBACK* LPFNWORKERPROGRESS)(LPVOID lpParam);
+
+// Keeps the dialog box painted while waiting for hFinished to be signaled by a pool of worker
+// threads. User input is discarded, except for the Esc key, which sets hCancel. The progress
+// display is updated every dwInterval ms. The worker threads are then joined and their handles
+// are closed. A WM_QUIT message received meanwhile sets hCancel and is posted again at the end.
+void WaitForWorkerThreads(HANDLE hFinished, HANDLE hCancel, HANDLE* ahThreads, int nThreads,
+	DWORD dwInterval, LPFNWORKERPROGRESS lpfnProgress, LPVOID lpParam);
+
 // Determines the window handle of the output edit control
 HWND GetOutputWindow(HWND hDlg = NULL);
 
@@ -86,13 +96,23 @@ BOOL FormatTime(DWORD dwTime, LPTSTR lpszTime, SIZE_T cchStringLen, BOOL bFormat
 // Converts a Gbx string to Unicode and removes formatting characters
 BOOL ConvertGbxString(LPVOID lpData, SIZE_T cbLenData, LPTSTR lpszOutput, SIZE_T cchLenOutput, BOOL bCleanup = FALSE);
 
-// Removes the Nadeo formatting characters from a string
+// Removes the Nadeo formatting characters from a string. The parsed string is kept in the
+// span cache of NadeoFmt, so that repeated names are not parsed again.
 BOOL CleanupString(LPCTSTR lpszInput, LPTSTR lpszOutput, SIZE_T cchLenOutput);
 
 // Replaces each occurrence of a search pattern in a string with a different string.
 // The memory of the returned character string must be freed using MyGlobalFreePtr.
 LPTSTR AllocReplaceString(LPCTSTR lpszOriginal, LPCTSTR lpszPattern, LPCTSTR lpszReplacement);
 
+// Replaces each occurrence of several search patterns in a string in a single pass. If more
+// than one pattern matches at the same position, the first pattern in the list is used.
+// The memory of the returned character string must be freed using MyGlobalFreePtr.
+LPTSTR AllocReplaceStrings(LPCTSTR lpszOriginal, const LPCTSTR* lpPatterns, const LPCTSTR* lpReplacements, UINT uCount);
+
+// Like AllocReplaceStrings, but writes the result into a buffer provided by the caller. The result
+// is truncated if the buffer is too small. Returns the length of the complete result in characters.
+SIZE_T ReplaceStrings(LPCTSTR lpszOriginal, const LPCTSTR* lpPatterns, const LPCTSTR* lpReplacements, UINT uCount, LPTSTR lpszOutput, SIZE_T cchLenOutput);
+
 // Removes from a string all two- and four-digit Nadeo formatting characters that begin with a $.
 // The memory of the returned character string must be freed using MyGlobalFreePtr.
 LPTSTR AllocCleanupString(LPCTSTR lpszOriginal);
@@ -0,0 +1,610 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// NadeoFmt.cpp - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "NadeoFmt.h"
+
+#define NADEO_STACK_DEPTH    16
+#define NADEO_CACHE_BUCKETS  1024
+#define NADEO_CACHE_MAXSIZE  (4 * 1024 * 1024) // Memory limit of the span cache in bytes
+
+// Output buffer of the renderer. If lpszOutput is NULL, only the length is determined.
+typedef struct _RENDER_BUFFER
+{
+	LPTSTR lpszOutput;
+	SIZE_T cchOutput;
+} RENDER_BUFFER, *LPRENDER_BUFFER;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward declarations of functions included in this code module
+
+// Parses a formatted string into spans. If lpText is NULL, only the sizes are determined.
+static BOOL ParseNadeoText(LPCTSTR lpszSource, LPNADEO_TEXT lpText, LPUINT lpuSpans, PSIZE_T lpcchText, PSIZE_T lpcchLinks);
+// Writes the spans of a parsed string in the specified format to the render buffer
+static void RenderNadeoText(const LPNADEO_TEXT lpText, UINT uFormat, LPRENDER_BUFFER lpBuffer);
+// Appends characters to the render buffer
+static void AppendText(LPRENDER_BUFFER lpBuffer, LPCTSTR lpszText, SIZE_T cchText);
+// Appends characters to the render buffer and escapes them for the specified format
+static void AppendEscapedText(LPRENDER_BUFFER lpBuffer, LPCTSTR lpszText, SIZE_T cchText, UINT uFormat, BOOL bUpperCase);
+// Calculates the FNV-1a hash value of a string
+static UINT HashString(LPCTSTR lpszString, PSIZE_T lpcchString);
+// Initializes the lock of the span cache if necessary and enters it
+static void EnterCacheLock();
+// Leaves the lock of the span cache
+static void LeaveCacheLock();
+// Removes all entries from the span cache, must be called within the lock
+static void ClearCache();
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// String Constants
+
+const TCHAR g_szAnsiReset[]     = TEXT("\x1b[0m");
+const TCHAR g_szAnsiLinkOpen[]  = TEXT("\x1b]8;;");
+const TCHAR g_szAnsiLinkEnd[]   = TEXT("\x1b\\");
+const TCHAR g_szAnsiLinkClose[] = TEXT("\x1b]8;;\x1b\\");
+const TCHAR g_szHtmlSpanClose[] = TEXT("</span>");
+const TCHAR g_szHtmlLinkClose[] = TEXT("</a>");
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+
+static LPNADEO_TEXT g_aCache[NADEO_CACHE_BUCKETS];
+static SIZE_T g_cbCache = 0;
+static CRITICAL_SECTION g_csCache;
+static volatile LONG g_lCacheInit = 0;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+LPNADEO_TEXT AcquireNadeoText(LPCTSTR lpszSource)
+{
+	if (lpszSource == NULL)
+		return NULL;
+
+	SIZE_T cchSource = 0;
+	UINT uHash = HashString(lpszSource, &cchSource);
+	UINT uBucket = uHash % NADEO_CACHE_BUCKETS;
+
+	EnterCacheLock();
+
+	// Look for an already parsed copy of the string
+	for (LPNADEO_TEXT lpEntry = g_aCache[uBucket]; lpEntry != NULL; lpEntry = lpEntry->lpNext)
+	{
+		if (lpEntry->uHash == uHash && _tcscmp(lpEntry->lpszSource, lpszSource) == 0)
+		{
+			InterlockedIncrement(&lpEntry->lRefCount);
+			LeaveCacheLock();
+			return lpEntry;
+		}
+	}
+
+	LeaveCacheLock();
+
+	// Determine the size of the span list
+	UINT uSpans = 0;
+	SIZE_T cchText = 0;
+	SIZE_T cchLinks = 0;
+	if (!ParseNadeoText(lpszSource, NULL, &uSpans, &cchText, &cchLinks))
+		return NULL;
+
+	// Allocate the structure, the spans, the source string and the text buffer in one block
+	SIZE_T cbSize = sizeof(NADEO_TEXT) + uSpans * sizeof(NADEO_SPAN) +
+		(cchSource + 1 + cchText + 1 + cchLinks + 1) * sizeof(TCHAR);
+	LPNADEO_TEXT lpText = (LPNADEO_TEXT)MyGlobalAllocPtr(GHND, cbSize);
+	if (lpText == NULL)
+		return NULL;
+
+	lpText->lRefCount = 2;	// One reference for the cache and one for the caller
+	lpText->uHash = uHash;
+	lpText->lpSpans = (LPNADEO_SPAN)(lpText + 1);
+	lpText->lpszSource = (LPTSTR)(lpText->lpSpans + uSpans);
+	lpText->lpszText = lpText->lpszSource + cchSource + 1;
+	lpText->cchText = cchText;
+	lpText->uSpans = uSpans;
+
+	memcpy(lpText->lpszSource, lpszSource, (cchSource + 1) * sizeof(TCHAR));
+
+	if (!ParseNadeoText(lpszSource, lpText, &uSpans, &cchText, &cchLinks))
+	{
+		MyGlobalFreePtr((LPVOID)lpText);
+		return NULL;
+	}
+
+	// Strings that would take up a large part of the cache are only parsed for the caller
+	if (cbSize > NADEO_CACHE_MAXSIZE / 16)
+	{
+		lpText->lRefCount = 1;
+		return lpText;
+	}
+
+	EnterCacheLock();
+
+	// Another thread may have added the same string in the meantime
+	for (LPNADEO_TEXT lpEntry = g_aCache[uBucket]; lpEntry != NULL; lpEntry = lpEntry->lpNext)
+	{
+		if (lpEntry->uHash == uHash && _tcscmp(lpEntry->lpszSource, lpszSource) == 0)
+		{
+			InterlockedIncrement(&lpEntry->lRefCount);
+			LeaveCacheLock();
+			MyGlobalFreePtr((LPVOID)lpText);
+			return lpEntry;
+		}
+	}
+
+	// Limit the memory usage by discarding the whole cache if it is full
+	if (g_cbCache + cbSize > NADEO_CACHE_MAXSIZE)
+		ClearCache();
+
+	lpText->lpNext = g_aCache[uBucket];
+	g_aCache[uBucket] = lpText;
+	g_cbCache += cbSize;
+
+	LeaveCacheLock();
+
+	return lpText;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ReleaseNadeoText(LPNADEO_TEXT lpText)
+{
+	if (lpText != NULL && InterlockedDecrement(&lpText->lRefCount) == 0)
+		MyGlobalFreePtr((LPVOID)lpText);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+LPTSTR AllocRenderNadeoText(const LPNADEO_TEXT lpText, UINT uFormat)
+{
+	if (lpText == NULL)
+		return NULL;
+
+	// Determine the exact length of the output
+	RENDER_BUFFER rb = {0};
+	RenderNadeoText(lpText, uFormat, &rb);
+
+	LPTSTR lpszOutput = (LPTSTR)MyGlobalAllocPtr(GHND, (rb.cchOutput + 1) * sizeof(TCHAR));
+	if (lpszOutput == NULL)
+		return NULL;
+
+	rb.lpszOutput = lpszOutput;
+	rb.cchOutput = 0;
+	RenderNadeoText(lpText, uFormat, &rb);
+	lpszOutput[rb.cchOutput] = TEXT('\0');
+
+	return lpszOutput;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+LPTSTR AllocRenderNadeoString(LPCTSTR lpszSource, UINT uFormat)
+{
+	LPNADEO_TEXT lpText = AcquireNadeoText(lpszSource);
+	if (lpText == NULL)
+		return NULL;
+
+	LPTSTR lpszOutput = AllocRenderNadeoText(lpText, uFormat);
+
+	ReleaseNadeoText(lpText);
+
+	return lpszOutput;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void FreeNadeoTextCache()
+{
+	if (g_lCacheInit == 0)
+		return;
+
+	// The lock is not deleted, so that threads which are still running can continue to use the
+	// cache. Entries that are in use are freed when their last reference is released.
+	EnterCacheLock();
+	ClearCache();
+	LeaveCacheLock();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL ParseNadeoText(LPCTSTR lpszSource, LPNADEO_TEXT lpText, LPUINT lpuSpans, PSIZE_T lpcchText, PSIZE_T lpcchLinks)
+{
+	if (lpszSource == NULL || lpuSpans == NULL || lpcchText == NULL || lpcchLinks == NULL)
+		return FALSE;
+
+	WORD awStack[NADEO_STACK_DEPTH][2];
+	UINT uDepth = 0;
+
+	WORD wStyle = 0;
+	WORD wColor = 0;
+	DWORD dwLink = 0;
+	BOOL bLinkFromText = FALSE;
+	UINT uLinkSpan = 0;
+
+	UINT uSpans = 0;
+	SIZE_T cchText = 0;
+	SIZE_T cchLinks = 0;
+	BOOL bNewSpan = TRUE;
+
+	// The link targets are stored behind the terminated plain text
+	SIZE_T cchLinkBase = (lpText != NULL) ? lpText->cchText + 1 : 0;
+
+	LPCTSTR lpsz = lpszSource;
+	while (*lpsz != TEXT('\0'))
+	{
+		TCHAR ch = lpsz[0];
+		if (ch == TEXT('$'))
+		{
+			ch = lpsz[1];
+			if (ch == TEXT('\0'))
+				break;
+
+			if (ch != TEXT('$'))
+			{
+				lpsz += 2;
+
+				if (_istxdigit(ch))
+				{ // Color code with up to three hexadecimal digits
+					WORD wNewColor = 0;
+					TCHAR szDigit[2] = {ch, TEXT('\0')};
+					for (int i = 0; i < 3; i++)
+					{
+						wNewColor <<= 4;
+						if (i == 0 || _istxdigit(*lpsz))
+						{
+							if (i > 0)
+								szDigit[0] = *lpsz++;
+							wNewColor |= (WORD)_tcstoul(szDigit, NULL, 16);
+						}
+					}
+
+					if (!(wStyle & NTS_COLOR) || wColor != wNewColor)
+						bNewSpan = TRUE;
+					wStyle |= NTS_COLOR;
+					wColor = wNewColor;
+					continue;
+				}
+
+				WORD wOldStyle = wStyle;
+				switch (_totlower(ch))
+				{
+					case TEXT('o'): wStyle |= NTS_BOLD; break;
+					case TEXT('i'): wStyle |= NTS_ITALIC; break;
+					case TEXT('w'): wStyle = (wStyle & ~NTS_NARROW) | NTS_WIDE; break;
+					case TEXT('n'): wStyle = (wStyle & ~NTS_WIDE) | NTS_NARROW; break;
+					case TEXT('m'): wStyle &= ~(NTS_WIDE | NTS_NARROW); break;
+					case TEXT('t'): wStyle |= NTS_UPPERCASE; break;
+					case TEXT('s'): wStyle |= NTS_SHADOW; break;
+					case TEXT('g'): wStyle &= ~NTS_COLOR; break;
+					case TEXT('z'): wStyle &= NTS_ANYLINK; break;
+
+					case TEXT('<'): // Save the current style
+						if (uDepth < NADEO_STACK_DEPTH)
+						{
+							awStack[uDepth][0] = wStyle;
+							awStack[uDepth][1] = wColor;
+						}
+						uDepth++;
+						break;
+
+					case TEXT('>'): // Restore the last saved style
+						if (uDepth > 0 && --uDepth < NADEO_STACK_DEPTH)
+						{
+							wStyle = (wStyle & NTS_ANYLINK) | (awStack[uDepth][0] & ~NTS_ANYLINK);
+							wColor = awStack[uDepth][1];
+						}
+						break;
+
+					case TEXT('l'):
+					case TEXT('h'):
+					case TEXT('p'):
+						bNewSpan = TRUE;
+						if (wStyle & NTS_ANYLINK)
+						{ // Close the link. Without a target, the link text is the target.
+							if (bLinkFromText && lpText != NULL)
+								for (UINT i = uLinkSpan; i < uSpans; i++)
+									lpText->lpSpans[i].cchLink = (DWORD)(cchText - dwLink);
+							wStyle &= ~NTS_ANYLINK;
+							break;
+						}
+
+						wStyle |= (ch == TEXT('l') || ch == TEXT('L')) ? NTS_LINK :
+							(ch == TEXT('h') || ch == TEXT('H')) ? NTS_MANIALINK : NTS_PROFILE;
+
+						bLinkFromText = TRUE;
+						dwLink = (DWORD)cchText;
+						uLinkSpan = uSpans;
+
+						if (*lpsz == TEXT('['))
+						{ // Explicit link target in square brackets
+							LPCTSTR lpszEnd = _tcschr(lpsz, TEXT(']'));
+							if (lpszEnd != NULL)
+							{
+								SIZE_T cchLink = lpszEnd - lpsz - 1;
+								dwLink = (DWORD)(cchLinkBase + cchLinks);
+								if (lpText != NULL)
+									memcpy(lpText->lpszText + dwLink, lpsz + 1, cchLink * sizeof(TCHAR));
+								cchLinks += cchLink + 1;
+								bLinkFromText = FALSE;
+								lpsz = lpszEnd + 1;
+							}
+						}
+						break;
+				}
+
+				if (wStyle != wOldStyle)
+					bNewSpan = TRUE;
+				continue;
+			}
+		}
+
+		// Append a character to the current span or start a new one
+		if (bNewSpan)
+		{
+			if (lpText != NULL)
+			{
+				LPNADEO_SPAN lpSpan = &lpText->lpSpans[uSpans];
+				lpSpan->dwStart = (DWORD)cchText;
+				lpSpan->wStyle = wStyle;
+				lpSpan->wColor = (wStyle & NTS_COLOR) ? wColor : 0;
+				if (wStyle & NTS_ANYLINK)
+				{
+					lpSpan->dwLink = dwLink;
+					lpSpan->cchLink = bLinkFromText ? 0 : (DWORD)_tcslen(lpText->lpszText + dwLink);
+				}
+			}
+			uSpans++;
+			bNewSpan = FALSE;
+		}
+
+		if (lpText != NULL)
+		{
+			lpText->lpszText[cchText] = ch;
+			lpText->lpSpans[uSpans - 1].cchText++;
+		}
+
+		cchText++;
+		lpsz += (lpsz[0] == TEXT('$')) ? 2 : 1;
+	}
+
+	// Close a link that was not terminated
+	if ((wStyle & NTS_ANYLINK) && bLinkFromText && lpText != NULL)
+		for (UINT i = uLinkSpan; i < uSpans; i++)
+			lpText->lpSpans[i].cchLink = (DWORD)(cchText - dwLink);
+
+	*lpuSpans = uSpans;
+	*lpcchText = cchText;
+	*lpcchLinks = cchLinks;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void RenderNadeoText(const LPNADEO_TEXT lpText, UINT uFormat, LPRENDER_BUFFER lpBuffer)
+{
+	TCHAR szTag[128];
+	LPNADEO_SPAN lpPrev = NULL;
+
+	for (UINT i = 0; i < lpText->uSpans; i++)
+	{
+		LPNADEO_SPAN lpSpan = &lpText->lpSpans[i];
+		LPCTSTR lpszLink = lpText->lpszText + lpSpan->dwLink;
+
+		BOOL bLink = (lpSpan->wStyle & NTS_ANYLINK) != 0;
+		BOOL bPrevLink = lpPrev != NULL && (lpPrev->wStyle & NTS_ANYLINK) != 0;
+		BOOL bSameLink = bLink && bPrevLink && lpPrev->dwLink == lpSpan->dwLink;
+
+		if (uFormat == NTF_ANSI)
+		{
+			if (bPrevLink && !bSameLink && (lpPrev->wStyle & NTS_LINK))
+				AppendText(lpBuffer, g_szAnsiLinkClose, _countof(g_szAnsiLinkClose) - 1);
+
+			// Select graphic rendition: bold, italic and 24-bit foreground color
+			int nLen = _sntprintf(szTag, _countof(szTag), TEXT("\x1b[0%s%s"),
+				(lpSpan->wStyle & NTS_BOLD) ? TEXT(";1") : TEXT(""),
+				(lpSpan->wStyle & NTS_ITALIC) ? TEXT(";3") : TEXT(""));
+			if (lpSpan->wStyle & NTS_COLOR)
+				nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT(";38;2;%u;%u;%u"),
+					((lpSpan->wColor >> 8) & 0xF) * 17, ((lpSpan->wColor >> 4) & 0xF) * 17, (lpSpan->wColor & 0xF) * 17);
+			nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("m"));
+			AppendText(lpBuffer, szTag, nLen);
+
+			// Hyperlinks are supported by many terminals through OSC 8
+			if (bLink && !bSameLink && (lpSpan->wStyle & NTS_LINK))
+			{
+				AppendText(lpBuffer, g_szAnsiLinkOpen, _countof(g_szAnsiLinkOpen) - 1);
+				AppendEscapedText(lpBuffer, lpszLink, lpSpan->cchLink, uFormat, FALSE);
+				AppendText(lpBuffer, g_szAnsiLinkEnd, _countof(g_szAnsiLinkEnd) - 1);
+			}
+		}
+		else if (uFormat == NTF_HTML)
+		{
+			if (bPrevLink && !bSameLink)
+				AppendText(lpBuffer, g_szHtmlLinkClose, _countof(g_szHtmlLinkClose) - 1);
+
+			if (bLink && !bSameLink)
+			{
+				if (lpSpan->wStyle & NTS_LINK)
+				{
+					AppendText(lpBuffer, TEXT("<a href=\""), 9);
+					LPCTSTR lpszScheme = _tcsstr(lpszLink, TEXT("://"));
+					if (lpszScheme == NULL || lpszScheme >= lpszLink + lpSpan->cchLink)
+						AppendText(lpBuffer, TEXT("http://"), 7);
+				}
+				else if (lpSpan->wStyle & NTS_MANIALINK)
+					AppendText(lpBuffer, TEXT("<a class=\"manialink\" data-target=\""), 34);
+				else
+					AppendText(lpBuffer, TEXT("<a class=\"profile\" data-target=\""), 32);
+				AppendEscapedText(lpBuffer, lpszLink, lpSpan->cchLink, uFormat, FALSE);
+				AppendText(lpBuffer, TEXT("\">"), 2);
+			}
+
+			BOOL bStyled = (lpSpan->wStyle & ~(NTS_ANYLINK | NTS_UPPERCASE)) != 0;
+			if (bStyled)
+			{
+				int nLen = _sntprintf(szTag, _countof(szTag), TEXT("<span style=\""));
+				if (lpSpan->wStyle & NTS_COLOR)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("color:#%03x;"), lpSpan->wColor);
+				if (lpSpan->wStyle & NTS_BOLD)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("font-weight:bold;"));
+				if (lpSpan->wStyle & NTS_ITALIC)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("font-style:italic;"));
+				if (lpSpan->wStyle & NTS_WIDE)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("letter-spacing:.1em;"));
+				if (lpSpan->wStyle & NTS_NARROW)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("letter-spacing:-.1em;"));
+				if (lpSpan->wStyle & NTS_SHADOW)
+					nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("text-shadow:1px 1px 1px #000;"));
+				nLen += _sntprintf(szTag + nLen, _countof(szTag) - nLen, TEXT("\">"));
+				AppendText(lpBuffer, szTag, nLen);
+			}
+
+			AppendEscapedText(lpBuffer, lpText->lpszText + lpSpan->dwStart, lpSpan->cchText, uFormat,
+				(lpSpan->wStyle & NTS_UPPERCASE) != 0);
+
+			if (bStyled)
+				AppendText(lpBuffer, g_szHtmlSpanClose, _countof(g_szHtmlSpanClose) - 1);
+
+			lpPrev = lpSpan;
+			continue;
+		}
+
+		AppendEscapedText(lpBuffer, lpText->lpszText + lpSpan->dwStart, lpSpan->cchText, uFormat,
+			(lpSpan->wStyle & NTS_UPPERCASE) != 0);
+
+		lpPrev = lpSpan;
+	}
+
+	// Close any open link and reset the terminal attributes
+	if (lpPrev != NULL)
+	{
+		if (uFormat == NTF_ANSI)
+		{
+			if (lpPrev->wStyle & NTS_LINK)
+				AppendText(lpBuffer, g_szAnsiLinkClose, _countof(g_szAnsiLinkClose) - 1);
+			AppendText(lpBuffer, g_szAnsiReset, _countof(g_szAnsiReset) - 1);
+		}
+		else if (uFormat == NTF_HTML && (lpPrev->wStyle & NTS_ANYLINK))
+			AppendText(lpBuffer, g_szHtmlLinkClose, _countof(g_szHtmlLinkClose) - 1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void AppendText(LPRENDER_BUFFER lpBuffer, LPCTSTR lpszText, SIZE_T cchText)
+{
+	if (lpBuffer->lpszOutput != NULL)
+		memcpy(lpBuffer->lpszOutput + lpBuffer->cchOutput, lpszText, cchText * sizeof(TCHAR));
+	lpBuffer->cchOutput += cchText;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void AppendEscapedText(LPRENDER_BUFFER lpBuffer, LPCTSTR lpszText, SIZE_T cchText, UINT uFormat, BOOL bUpperCase)
+{
+	for (SIZE_T i = 0; i < cchText; i++)
+	{
+		TCHAR ch = lpszText[i];
+
+		// Control characters could be used to inject escape sequences.
+		// Plain text keeps them, so that the line breaks of comments are preserved.
+		if (uFormat != NTF_PLAIN && ((UINT)ch < 0x20 || ch == 0x7F))
+			continue;
+
+		if (bUpperCase)
+			ch = (TCHAR)(UINT_PTR)CharUpper((LPTSTR)(UINT_PTR)ch);
+
+		if (uFormat == NTF_HTML)
+		{
+			switch (ch)
+			{
+				case TEXT('&'):  AppendText(lpBuffer, TEXT("&amp;"), 5);  continue;
+				case TEXT('<'):  AppendText(lpBuffer, TEXT("&lt;"), 4);   continue;
+				case TEXT('>'):  AppendText(lpBuffer, TEXT("&gt;"), 4);   continue;
+				case TEXT('\"'): AppendText(lpBuffer, TEXT("&quot;"), 6); continue;
+				case TEXT('\''): AppendText(lpBuffer, TEXT("&#39;"), 5);  continue;
+			}
+		}
+
+		AppendText(lpBuffer, &ch, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static UINT HashString(LPCTSTR lpszString, PSIZE_T lpcchString)
+{
+	UINT uHash = 2166136261U;
+	LPCTSTR lpsz = lpszString;
+
+	while (*lpsz != TEXT('\0'))
+	{
+		uHash ^= (UINT)(_TUCHAR)*lpsz++;
+		uHash *= 16777619U;
+	}
+
+	if (lpcchString != NULL)
+		*lpcchString = lpsz - lpszString;
+
+	return uHash;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void EnterCacheLock()
+{
+	// The critical section is initialized by the first thread that uses the cache
+	if (InterlockedCompareExchange(&g_lCacheInit, 1, 0) == 0)
+	{
+		InitializeCriticalSection(&g_csCache);
+		InterlockedExchange(&g_lCacheInit, 2);
+	}
+	else
+	{
+		while (g_lCacheInit != 2)
+			Sleep(0);
+	}
+
+	EnterCriticalSection(&g_csCache);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void LeaveCacheLock()
+{
+	LeaveCriticalSection(&g_csCache);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void ClearCache()
+{
+	for (UINT i = 0; i < NADEO_CACHE_BUCKETS; i++)
+	{
+		LPNADEO_TEXT lpEntry = g_aCache[i];
+		while (lpEntry != NULL)
+		{
+			LPNADEO_TEXT lpNext = lpEntry->lpNext;
+			ReleaseNadeoText(lpEntry);
+			lpEntry = lpNext;
+		}
+		g_aCache[i] = NULL;
+	}
+	g_cbCache = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
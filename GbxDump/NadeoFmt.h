@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// NadeoFmt.h - Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Style flags of a formatted text span
+#define NTS_BOLD        0x0001  // $o
+#define NTS_ITALIC      0x0002  // $i
+#define NTS_WIDE        0x0004  // $w
+#define NTS_NARROW      0x0008  // $n
+#define NTS_UPPERCASE   0x0010  // $t
+#define NTS_SHADOW      0x0020  // $s
+#define NTS_COLOR       0x0040  // $rgb
+#define NTS_LINK        0x0100  // $l
+#define NTS_MANIALINK   0x0200  // $h
+#define NTS_PROFILE     0x0400  // $p
+
+#define NTS_ANYLINK     (NTS_LINK | NTS_MANIALINK | NTS_PROFILE)
+
+// Output formats of the formatted text renderer
+#define NTF_PLAIN       0
+#define NTF_ANSI        1
+#define NTF_HTML        2
+
+// A run of characters with identical formatting
+typedef struct _NADEO_SPAN
+{
+    DWORD  dwStart;     // Offset of the first character in the text buffer
+    DWORD  cchText;     // Number of characters in the span
+    DWORD  dwLink;      // Offset of the link target in the text buffer
+    DWORD  cchLink;     // Number of characters of the link target
+    WORD   wStyle;      // Combination of NTS_* flags
+    WORD   wColor;      // 12-bit RGB color value (0x0RGB), valid with NTS_COLOR
+} NADEO_SPAN, FAR* LPNADEO_SPAN, *PNADEO_SPAN;
+
+// Parsed representation of a formatted Nadeo string. The structure, the spans
+// and all strings are stored in a single memory block owned by the span cache.
+typedef struct _NADEO_TEXT
+{
+    struct _NADEO_TEXT* lpNext; // Next entry in the same hash bucket
+    LONG   lRefCount;   // Number of references held by the cache and its callers
+    UINT   uHash;       // Hash value of the source string
+    LPTSTR lpszSource;  // Interned copy of the source string
+    LPTSTR lpszText;    // Plain text followed by the link targets
+    SIZE_T cchText;     // Length of the plain text without link targets
+    UINT   uSpans;      // Number of spans
+    LPNADEO_SPAN lpSpans;
+} NADEO_TEXT, FAR* LPNADEO_TEXT, *PNADEO_TEXT;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Returns the parsed span list of a formatted string. The string is parsed only once and
+// the result is cached. The reference must be released using ReleaseNadeoText.
+LPNADEO_TEXT AcquireNadeoText(LPCTSTR lpszSource);
+
+// Releases a reference obtained with AcquireNadeoText
+void ReleaseNadeoText(LPNADEO_TEXT lpText);
+
+// Renders a parsed span list as plain text, ANSI escape sequences or HTML (NTF_*).
+// The memory of the returned character string must be freed using MyGlobalFreePtr.
+LPTSTR AllocRenderNadeoText(const LPNADEO_TEXT lpText, UINT uFormat);
+
+// Parses a formatted string using the span cache and renders it in the specified format.
+// The memory of the returned character string must be freed using MyGlobalFreePtr.
+LPTSTR AllocRenderNadeoString(LPCTSTR lpszSource, UINT uFormat);
+
+// Removes all entries from the span cache and frees the memory of unreferenced entries.
+// The cache remains usable, so other threads may still be running when it is called at exit.
+void FreeNadeoTextCache();
+
+////////////////////////////////////////////////////////////////////////////////////////////////
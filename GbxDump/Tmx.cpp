@@ -18,23 +18,14 @@
 
 #include "stdafx.h"
 #include "Internet.h"
+#include "XmlParser.h"
 #include "Tmx.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Constants
 
-#define GAME_TMNF   1
-#define GAME_TMU    2
-#define GAME_TMN    3
-#define GAME_TMS    4
-#define GAME_TMO    5
-#define GAME_TM2    6
-#define GAME_SM     7
-#define GAME_QM     8
-#define GAME_TM2020 9
-
 #define TMX_MAX_DATASIZE 32768
-#define MX_MAX_DATASIZE 524288
+#define TMX_CACHE_MAXAGE 86400 // Exchange data is cached for one day
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Data Types
@@ -49,21 +40,68 @@ typedef enum XmlArrayType
 	_XmlArrayType_Last = 4
 } 	XmlArrayType;
 
+// State of the output of an MX response that is parsed while it is being received
+typedef struct _MX_XML_OUTPUT
+{
+	HWND	hwndEdit;		// Output window
+	PINT	pnTrackId;		// Receives the MX track ID, may be NULL
+	int		nOutputStart;	// Length of the text of the output window before the response
+	BOOL	bOutput;		// Set as soon as the response has produced output
+	BOOL	bError;			// Set if the response is not well-formed
+	XML_PARSER parser;
+	XmlArrayType arrayType;
+	int		nReplayPos;
+	int		nReplayTime;
+	int		nObjectNumber;
+	WCHAR	wszElement[256];
+	WCHAR	wszUsername[256];
+	WCHAR	wszStuntScore[32];
+	WCHAR	wszObjectPath[260];
+	WCHAR	wszObjectAuthor[256];
+} MX_XML_OUTPUT, *PMX_XML_OUTPUT;
+
+// Lookup of a map UID on an exchange site that is executed in a worker thread
+typedef struct _EXCHANGE_LOOKUP
+{
+	int    nGame;       // Game whose exchange site is queried
+	BOOL   bDone;       // Set when the worker thread has finished
+	BOOL   bSuccess;    // Set if the request was successful
+	BOOL   bFound;      // Set if the exchange site knows the map
+	HANDLE hThread;     // Handle of the worker thread
+	TCHAR  szUrl[512];  // Address of the map information
+	INTERNET_REQUEST request;
+	XML_PARSER parser;  // Parses an MX response while it is being received
+	BOOL   bInTrackId;  // Set inside the element that holds the MX track ID
+	int    nTrackId;    // MX track ID found in the response
+} EXCHANGE_LOOKUP, *PEXCHANGE_LOOKUP;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 // Forward declarations of functions included in this code module
 
-// Retrieves and prints TMX information for a specific map
-BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound);
+// Queries several exchange sites concurrently and prints the
+// information of the first site in the list that knows the map
+BOOL ProcessExchanges(HWND hwndEdit, LPCSTR lpszUid, const int* pnGames, int nCount, PBOOL pbTrackFound);
+// Thread function that requests the map information from an exchange site
+static unsigned __stdcall LookupThreadProc(LPVOID lpParameter);
+// Receives a chunk of an MX lookup response and picks the track ID out of it
+static BOOL CALLBACK ReceiveMxLookup(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+// Reads the nodes passed to the parser of an MX lookup so far until the track ID is found
+static void FindMxTrackId(PEXCHANGE_LOOKUP pLookup);
+// Retrieves and prints TMX information for a specific map. Optionally, the response
+// to the map UID request can be passed if it has already been retrieved.
+BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound, LPCSTR lpszPrefetched = NULL);
 // Retrieves and prints MX information for a specific map
 BOOL ProcessMx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound);
 // Request, parse and output data from Mania Exchange
 BOOL RequestMxData(HWND hwndEdit, LPCTSTR lpszMxUrl, PINT pnTrackId = NULL);
-// Parse XML using Microsoft XmlLite.
+// Receives a chunk of an MX response and outputs the nodes that are complete
+static BOOL CALLBACK ReceiveMxXml(LPVOID lpParam, LPCSTR lpData, DWORD cbData);
+// Parses and outputs the XML data passed to the parser so far.
 // Supports the array types TrackInfo, TrackObject, Replay and Item.
-HRESULT ParseAndOutputXml(HWND hwndEdit, HGLOBAL hXml, PINT pnTrackId = NULL);
+static BOOL ParseAndOutputXml(PMX_XML_OUTPUT pOutput);
 // Converts a time value into a formatted string (tchar.h version)
 BOOL FormatTimeT(int nTime, TCHAR* pszTime, SIZE_T cchStringLen);
-// Converts a time value into a formatted string (wide-character version for XmlLite)
+// Converts a time value into a formatted string (wide-character version for XML data)
 BOOL FormatTimeW(int nTime, WCHAR* pwszTime, SIZE_T cchStringLen);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -92,6 +130,7 @@ const TCHAR g_szUrlMxMaps[]   = TEXT("%s://%s.exchange/api/maps/get_map_info/uid
 const TCHAR g_szUrlMxItems[]  = TEXT("%s://%s.exchange/api/maps/embeddedobjects/%d?format=xml");
 const TCHAR g_szUrlMxRepl[]   = TEXT("%s://%s.exchange/api/replays/get_replays/%d?format=xml");
 const TCHAR g_szErrOom[]      = TEXT("Out of memory.\r\n");
+const TCHAR g_szErrXml[]      = TEXT("The response of the exchange site is malformed.\r\n");
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -108,61 +147,258 @@ BOOL DumpTmx(HWND hwndEdit, LPCSTR lpszUid, LPCSTR lpszEnvi)
 	BOOL bTrackFound = FALSE;
 
 	// Selection of API endpoints based on the environment
-	if ((strcmp(lpszEnvi, "Canyon") == 0) || (strcmp(lpszEnvi, "Valley") == 0) ||
-		(strcmp(lpszEnvi, "Lagoon") == 0) || (strcmp(lpszEnvi, "Arena") == 0))
-		bSuccess = ProcessMx(hwndEdit, lpszUid, GAME_TM2, &bTrackFound);
-	else if ((strcmp(lpszEnvi, "Storm") == 0) || (strcmp(lpszEnvi, "Cryo") == 0) || (strcmp(lpszEnvi, "Meteor") == 0) ||
-		(strcmp(lpszEnvi, "Paris") == 0) || (strcmp(lpszEnvi, "Gothic") == 0))
-		bSuccess = ProcessMx(hwndEdit, lpszUid, GAME_SM, &bTrackFound);
-	else if ((strcmp(lpszEnvi, "Galaxy") == 0) || (strcmp(lpszEnvi, "History") == 0) ||
-		(strcmp(lpszEnvi, "Society") == 0) || (strcmp(lpszEnvi, "Future") == 0))
-		bSuccess = ProcessMx(hwndEdit, lpszUid, GAME_QM, &bTrackFound);
-	else if (strcmp(lpszEnvi, "Stadium") == 0)
+	int anGames[8];
+	int nGames = GetExchangeGames(lpszEnvi, anGames, _countof(anGames));
+	if (nGames == 1)
+		bSuccess = IS_MX_GAME(anGames[0]) ? ProcessMx(hwndEdit, lpszUid, anGames[0], &bTrackFound) :
+			ProcessTmx(hwndEdit, lpszUid, anGames[0], &bTrackFound);
+	else if (nGames > 1)
+		bSuccess = ProcessExchanges(hwndEdit, lpszUid, anGames, nGames, &bTrackFound);
+
+	if (bSuccess && !bTrackFound)
+	{ // Map not found
+		OutputTextErr(hwndEdit, g_bGerUI ? IDP_GER_ERR_TRACK : IDP_ENG_ERR_TRACK);
+	}
+
+	OutputText(hwndEdit, g_szSep2);
+	SetCursor(hOldCursor);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ProcessExchanges(HWND hwndEdit, LPCSTR lpszUid, const int* pnGames, int nCount, PBOOL pbTrackFound)
+{
+	if (hwndEdit == NULL || lpszUid == NULL || pnGames == NULL || pbTrackFound == NULL ||
+		nCount <= 0 || nCount > MAXIMUM_WAIT_OBJECTS)
+		return FALSE;
+
+	*pbTrackFound = FALSE;
+
+	PEXCHANGE_LOOKUP pLookups = (PEXCHANGE_LOOKUP)MyGlobalAllocPtr(GHND, nCount * sizeof(EXCHANGE_LOOKUP));
+	if (pLookups == NULL)
+	{
+		OutputText(hwndEdit, g_szSep1);
+		OutputText(hwndEdit, g_szErrOom);
+		return FALSE;
+	}
+
+	// Query all exchange sites at the same time
+	for (int i = 0; i < nCount; i++)
+	{
+		PEXCHANGE_LOOKUP pLookup = &pLookups[i];
+		pLookup->nGame = pnGames[i];
+
+		// MX responses are streamed into a parser that only looks for the track ID. The response
+		// is stored in the cache on the way, from where ProcessMx outputs it.
+		DWORD dwError = ERROR_SUCCESS;
+		DWORD dwSize = IS_MX_GAME(pLookup->nGame) ? 0 : TMX_MAX_DATASIZE;
+		LPSTR lpszData = dwSize > 0 ? (LPSTR)MyGlobalAllocPtr(GHND, dwSize) : NULL;
+		if (dwSize > 0 && lpszData == NULL)
+			dwError = ERROR_NOT_ENOUGH_MEMORY;
+		else if (!GetLookupUrl(pLookup->nGame, lpszUid, pLookup->szUrl, _countof(pLookup->szUrl)))
+			dwError = ERROR_NOT_SUPPORTED;
+		else if (!InitInternetRequest(&pLookup->request, pLookup->szUrl, lpszData, dwSize, TMX_CACHE_MAXAGE))
+			dwError = ERROR_INVALID_PARAMETER;
+		else if (dwSize == 0)
+		{
+			pLookup->request.lpfnReceive = ReceiveMxLookup;
+			pLookup->request.lpParam = pLookup;
+		}
+
+		if (dwError != ERROR_SUCCESS)
+		{
+			if (lpszData != NULL)
+				MyGlobalFreePtr((LPVOID)lpszData);
+			pLookup->request.dwError = dwError;
+			pLookup->bDone = TRUE;
+			continue;
+		}
+
+		pLookup->hThread = (HANDLE)_beginthreadex(NULL, 0, LookupThreadProc, pLookup, 0, NULL);
+		if (pLookup->hThread == NULL)
+		{ // Query the site in this thread instead
+			LookupThreadProc(pLookup);
+			pLookup->bDone = TRUE;
+		}
+	}
+
+	// Wait for the results in the order of priority. As soon as a site
+	// reports the map, the requests to the sites behind it are cancelled.
+	int nDecisive = 0;
+	for (;;)
 	{
-		bSuccess = ProcessMx(hwndEdit, lpszUid, GAME_TM2020, &bTrackFound);
-		if (bSuccess && bTrackFound == FALSE)
+		while (nDecisive < nCount && pLookups[nDecisive].bDone &&
+			pLookups[nDecisive].bSuccess && !pLookups[nDecisive].bFound)
+			nDecisive++;
+
+		if (nDecisive == nCount || pLookups[nDecisive].bDone)
+			break;
+
+		int anIndex[MAXIMUM_WAIT_OBJECTS];
+		HANDLE ahThreads[MAXIMUM_WAIT_OBJECTS];
+		DWORD dwThreads = 0;
+		for (int i = nDecisive; i < nCount; i++)
 		{
-			bSuccess = ProcessMx(hwndEdit, lpszUid, GAME_TM2, &bTrackFound);
-			if (bSuccess && bTrackFound == FALSE)
+			if (!pLookups[i].bDone)
 			{
-				bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMNF, &bTrackFound);
-				if (bSuccess && bTrackFound == FALSE)
-				{
-					bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMU, &bTrackFound);
-					if (bSuccess && bTrackFound == FALSE)
-						bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMN, &bTrackFound);
-				}
+				anIndex[dwThreads] = i;
+				ahThreads[dwThreads++] = pLookups[i].hThread;
 			}
 		}
+
+		DWORD dwWait = WaitForMultipleObjects(dwThreads, ahThreads, FALSE, INFINITE) - WAIT_OBJECT_0;
+		if (dwWait >= dwThreads)
+		{ // Fall back to waiting for the lookup with the highest priority
+			dwWait = 0;
+			WaitForSingleObject(ahThreads[0], INFINITE);
+		}
+
+		int nFinished = anIndex[dwWait];
+		pLookups[nFinished].bDone = TRUE;
+
+		if (pLookups[nFinished].bFound)
+			for (int i = nFinished + 1; i < nCount; i++)
+				if (!pLookups[i].bDone)
+					CancelInternetRequest(&pLookups[i].request);
 	}
-	else if ((strcmp(lpszEnvi, "Coast") == 0) || (strcmp(lpszEnvi, "Bay") == 0) || (strcmp(lpszEnvi, "Island") == 0))
+
+	// Cancel the remaining requests and wait for the threads to finish
+	for (int i = 0; i < nCount; i++)
 	{
-		bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMU, &bTrackFound);
-		if (bSuccess && bTrackFound == FALSE)
-			bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMS, &bTrackFound);
+		if (pLookups[i].hThread != NULL)
+		{
+			if (!pLookups[i].bDone)
+			{
+				CancelInternetRequest(&pLookups[i].request);
+				WaitForSingleObject(pLookups[i].hThread, INFINITE);
+			}
+			CloseHandle(pLookups[i].hThread);
+		}
 	}
-	else if ((strcmp(lpszEnvi, "Desert") == 0) || (strcmp(lpszEnvi, "Snow") == 0) || (strcmp(lpszEnvi, "Rally") == 0) ||
-		(strcmp(lpszEnvi, "Alpine") == 0) || (strcmp(lpszEnvi, "Speed") == 0))
+
+	BOOL bSuccess = TRUE;
+	if (nDecisive < nCount)
 	{
-		bSuccess = ProcessTmx(hwndEdit, lpszUid, GAME_TMU, &bTrackFound);
-		if (bSuccess && bTrackFound == FALSE)
-			ProcessTmx(hwndEdit, lpszUid, GAME_TMO, &bTrackFound);
+		PEXCHANGE_LOOKUP pLookup = &pLookups[nDecisive];
+		if (!pLookup->bSuccess)
+		{
+			if (pLookup->request.dwError == ERROR_NOT_ENOUGH_MEMORY)
+			{
+				OutputText(hwndEdit, g_szSep1);
+				OutputText(hwndEdit, g_szErrOom);
+			}
+			else
+				LastInternetError(hwndEdit, pLookup->request.dwError);
+			bSuccess = FALSE;
+		}
+		else if (IS_MX_GAME(pLookup->nGame))
+			bSuccess = ProcessMx(hwndEdit, lpszUid, pLookup->nGame, pbTrackFound);
+		else
+			bSuccess = ProcessTmx(hwndEdit, lpszUid, pLookup->nGame, pbTrackFound, pLookup->request.lpszData);
 	}
 
-	if (bSuccess && !bTrackFound)
-	{ // Map not found
-		OutputTextErr(hwndEdit, g_bGerUI ? IDP_GER_ERR_TRACK : IDP_ENG_ERR_TRACK);
+	for (int i = 0; i < nCount; i++)
+	{
+		if (pLookups[i].request.lpszUrl != NULL)
+			DeleteInternetRequest(&pLookups[i].request);
+		if (pLookups[i].request.lpszData != NULL)
+			MyGlobalFreePtr((LPVOID)pLookups[i].request.lpszData);
 	}
 
-	OutputText(hwndEdit, g_szSep2);
-	SetCursor(hOldCursor);
+	MyGlobalFreePtr((LPVOID)pLookups);
 
 	return bSuccess;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
+static unsigned __stdcall LookupThreadProc(LPVOID lpParameter)
+{
+	PEXCHANGE_LOOKUP pLookup = (PEXCHANGE_LOOKUP)lpParameter;
+	if (pLookup == NULL)
+		return 1;
+
+	if (IS_MX_GAME(pLookup->nGame))
+	{
+		XmlInitParser(&pLookup->parser);
+		pLookup->bSuccess = ExecuteInternetRequest(&pLookup->request);
+		if (pLookup->bSuccess)
+		{ // Parse the rest of the data
+			if (pLookup->nTrackId == 0)
+			{
+				XmlFeed(&pLookup->parser, NULL, 0);
+				FindMxTrackId(pLookup);
+			}
+			pLookup->bFound = (pLookup->nTrackId != 0);
+		}
+		XmlFreeParser(&pLookup->parser);
+	}
+	else
+	{
+		pLookup->bSuccess = ExecuteInternetRequest(&pLookup->request);
+		if (pLookup->bSuccess)
+		{
+			LPCSTR lpszData = pLookup->request.lpszData;
+			pLookup->bFound = (lpszData[0] != '\0' && strchr(lpszData, '\t') != NULL);
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ReceiveMxLookup(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PEXCHANGE_LOOKUP pLookup = (PEXCHANGE_LOOKUP)lpParam;
+	if (pLookup == NULL)
+		return FALSE;
+
+	if (lpData == NULL)
+	{ // The request is restarted
+		XmlFreeParser(&pLookup->parser);
+		XmlInitParser(&pLookup->parser);
+		pLookup->bInTrackId = FALSE;
+		pLookup->nTrackId = 0;
+		return TRUE;
+	}
+
+	// The rest of the response is received without parsing, so that it is cached completely
+	if (pLookup->nTrackId == 0 && !pLookup->parser.bError)
+	{
+		XmlFeed(&pLookup->parser, lpData, cbData);
+		FindMxTrackId(pLookup);
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void FindMxTrackId(PEXCHANGE_LOOKUP pLookup)
+{
+	XML_NODE node;
+	int nNodeType;
+
+	while (pLookup->nTrackId == 0 && (nNodeType = XmlRead(&pLookup->parser, &node)) != XML_NODE_NONE)
+	{
+		if (nNodeType == XML_NODE_ERROR)
+			break;
+		else if (nNodeType == XML_NODE_ELEMENT)
+			pLookup->bInTrackId = !node.bEmpty && (XmlIsName(node.lpszName, node.cchName, "TrackID") ||
+				XmlIsName(node.lpszName, node.cchName, "MapID"));
+		else if (nNodeType == XML_NODE_TEXT && pLookup->bInTrackId)
+			pLookup->nTrackId = XmlToInt(node.lpszValue, node.cchValue);
+		else
+			pLookup->bInTrackId = FALSE;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound, LPCSTR lpszPrefetched)
 {
 	if (hwndEdit == NULL || lpszUid == NULL || pbTrackFound == NULL)
 		return FALSE;
@@ -175,27 +411,9 @@ BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 	*pbTrackFound = FALSE;
 
 	// Subdomain
-	TCHAR szSubDomain[16];
-	switch (nGame)
-	{
-		case GAME_TMNF:
-			MyStrNCpy(szSubDomain, g_szForever, _countof(szSubDomain));
-			break;
-		case GAME_TMU:
-			MyStrNCpy(szSubDomain, g_szUnited, _countof(szSubDomain));
-			break;
-		case GAME_TMN:
-			MyStrNCpy(szSubDomain, g_szNations, _countof(szSubDomain));
-			break;
-		case GAME_TMS:
-			MyStrNCpy(szSubDomain, g_szSunrise, _countof(szSubDomain));
-			break;
-		case GAME_TMO:
-			MyStrNCpy(szSubDomain, g_szOriginal, _countof(szSubDomain));
-			break;
-		default:
-			return TRUE;
-	}
+	LPCTSTR lpszSubDomain = GetSubDomain(nGame);
+	if (lpszSubDomain == NULL || IS_MX_GAME(nGame))
+		return TRUE;
 
 	// Allocate memory for the TMX data
 	DWORD dwSize = TMX_MAX_DATASIZE;
@@ -209,9 +427,11 @@ BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 
 	// Create query URL and retrieve data via track UID
 	TCHAR szTmxUrl[512];
-	_sntprintf(szTmxUrl, _countof(szTmxUrl), g_szUrlTmx, g_szHttp, szSubDomain, g_szParamInfo, lpszUid);
+	GetLookupUrl(nGame, lpszUid, szTmxUrl, _countof(szTmxUrl));
 
-	if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize))
+	if (lpszPrefetched != NULL)
+		MyStrNCpyA(lpszData, lpszPrefetched, (int)dwSize);
+	else if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize, TMX_CACHE_MAXAGE))
 	{
 		MyGlobalFreePtr((LPVOID)lpszData);
 		return FALSE;
@@ -319,9 +539,9 @@ BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 	}
 
 	// Request additional TMX data by TMX track ID
-	_sntprintf(szTmxUrl, _countof(szTmxUrl), g_szUrlTmx, g_szHttp, szSubDomain, g_szParamSearch, szTrackId);
+	_sntprintf(szTmxUrl, _countof(szTmxUrl), g_szUrlTmx, g_szHttp, lpszSubDomain, g_szParamSearch, szTrackId);
 
-	if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize))
+	if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize, TMX_CACHE_MAXAGE))
 	{
 		MyGlobalFreePtr((LPVOID)lpszData);
 		return FALSE;
@@ -357,9 +577,9 @@ BOOL ProcessTmx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 	}
 
 	// Request additional TMX data (Replays) via TMX track ID
-	_sntprintf(szTmxUrl, _countof(szTmxUrl), g_szUrlTmx, g_szHttp, szSubDomain, g_szParamRecord, szTrackId);
+	_sntprintf(szTmxUrl, _countof(szTmxUrl), g_szUrlTmx, g_szHttp, lpszSubDomain, g_szParamRecord, szTrackId);
 
-	if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize))
+	if (!ReadInternetFile(hwndEdit, szTmxUrl, lpszData, dwSize, TMX_CACHE_MAXAGE))
 	{
 		MyGlobalFreePtr((LPVOID)lpszData);
 		return FALSE;
@@ -445,32 +665,16 @@ BOOL ProcessMx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 	*pbTrackFound = FALSE;
 
 	// Subdomain
-	TCHAR szSubDomain[16];
-	switch (nGame)
-	{
-		case GAME_TM2020:
-			MyStrNCpy(szSubDomain, g_szTrackMania, _countof(szSubDomain));
-			break;
-		case GAME_TM2:
-			MyStrNCpy(szSubDomain, g_szTM, _countof(szSubDomain));
-			break;
-		case GAME_SM:
-			MyStrNCpy(szSubDomain, g_szSM, _countof(szSubDomain));
-			break;
-		case GAME_QM:
-			MyStrNCpy(szSubDomain, g_szQM, _countof(szSubDomain));
-			break;
-		default:
-			return TRUE;
-	}
+	LPCTSTR lpszSubDomain = GetSubDomain(nGame);
+	if (lpszSubDomain == NULL || !IS_MX_GAME(nGame))
+		return TRUE;
 
 	int nTrackId = 0;
 
 	// Request, parse and output MX data (TrackInfo) via map UID
 	TCHAR szMxUrl[512];
-	_sntprintf(szMxUrl, _countof(szMxUrl),
-		nGame == GAME_TM2020 ? g_szUrlMxMaps : g_szUrlMpMaps, g_szHttps, szSubDomain, lpszUid);
-	
+	GetLookupUrl(nGame, lpszUid, szMxUrl, _countof(szMxUrl));
+
 	if (!RequestMxData(hwndEdit, szMxUrl, &nTrackId))
 		return FALSE;
 
@@ -482,7 +686,7 @@ BOOL ProcessMx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 
 	// Request, parse and output additional MX data (TrackObject) via MX track ID
 	_sntprintf(szMxUrl, _countof(szMxUrl),
-		nGame == GAME_TM2020 ? g_szUrlMxItems : g_szUrlMpItems, g_szHttps, szSubDomain, nTrackId);
+		nGame == GAME_TM2020 ? g_szUrlMxItems : g_szUrlMpItems, g_szHttps, lpszSubDomain, nTrackId);
 	
 	if (!RequestMxData(hwndEdit, szMxUrl))
 		return FALSE;
@@ -493,7 +697,7 @@ BOOL ProcessMx(HWND hwndEdit, LPCSTR lpszUid, int nGame, PBOOL pbTrackFound)
 
 	// Request, parse and output additional MX data (Replay) via MX track ID
 	_sntprintf(szMxUrl, _countof(szMxUrl),
-		nGame == GAME_TM2020 ? g_szUrlMxRepl : g_szUrlMpRepl, g_szHttps, szSubDomain, nTrackId);
+		nGame == GAME_TM2020 ? g_szUrlMxRepl : g_szUrlMpRepl, g_szHttps, lpszSubDomain, nTrackId);
 	
 	if (!RequestMxData(hwndEdit, szMxUrl, &nTrackId))
 		return FALSE;
@@ -508,224 +712,311 @@ BOOL RequestMxData(HWND hwndEdit, LPCTSTR lpszMxUrl, PINT pnTrackId)
 	if (hwndEdit == NULL || lpszMxUrl == NULL)
 		return FALSE;
 
-	DWORD dwSize = MX_MAX_DATASIZE;
-	HGLOBAL hXml = GlobalAlloc(GHND, dwSize);
-	if (hXml == NULL)
+	PMX_XML_OUTPUT pOutput = (PMX_XML_OUTPUT)MyGlobalAllocPtr(GHND, sizeof(MX_XML_OUTPUT));
+	if (pOutput == NULL)
 	{
 		OutputText(hwndEdit, g_szSep1);
 		OutputText(hwndEdit, g_szErrOom);
 		return FALSE;
 	}
 
-	LPSTR lpszData = (LPSTR)GlobalLock(hXml);
-	if (lpszData == NULL)
-	{
-		GlobalFree(hXml);
-		return FALSE;
+	pOutput->hwndEdit = hwndEdit;
+	pOutput->pnTrackId = pnTrackId;
+	XmlInitParser(&pOutput->parser);
+
+	// The response is output while it is being downloaded, so its size is not limited
+	BOOL bSuccess = ReadInternetStream(hwndEdit, lpszMxUrl, ReceiveMxXml, pOutput, TMX_CACHE_MAXAGE);
+
+	if (bSuccess)
+	{ // Output the rest of the data
+		XmlFeed(&pOutput->parser, NULL, 0);
+		ParseAndOutputXml(pOutput);
+
+		// Malformed data without any of the supported arrays, like an error page, is ignored
+		if (pOutput->bError && pOutput->bOutput)
+		{
+			OutputText(hwndEdit, g_szSep1);
+			OutputText(hwndEdit, g_szErrXml);
+			bSuccess = FALSE;
+		}
 	}
 
-	if (!ReadInternetFile(hwndEdit, lpszMxUrl, lpszData, dwSize))
-	{
-		GlobalUnlock(hXml);
-		GlobalFree(hXml);
+	XmlFreeParser(&pOutput->parser);
+	MyGlobalFreePtr((LPVOID)pOutput);
+
+	return bSuccess;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL CALLBACK ReceiveMxXml(LPVOID lpParam, LPCSTR lpData, DWORD cbData)
+{
+	PMX_XML_OUTPUT pOutput = (PMX_XML_OUTPUT)lpParam;
+	if (pOutput == NULL)
 		return FALSE;
-	}
 
-	GlobalUnlock(hXml);
+	if (lpData == NULL)
+	{ // The request is restarted: remove the output of the data received so far
+		if (pOutput->bOutput)
+		{
+			Edit_SetSel(pOutput->hwndEdit, pOutput->nOutputStart, Edit_GetTextLength(pOutput->hwndEdit));
+			Edit_ReplaceSel(pOutput->hwndEdit, TEXT(""));
+		}
 
-	// Perform a simple test for valid data before initializing XmlLite
-	if (lpszData[0] == '\0' ||
-		(strstr(lpszData, "<TrackInfo") == NULL && strstr(lpszData, "<SmMapInfo") == NULL &&
-		strstr(lpszData, "<QmMapInfo") == NULL && strstr(lpszData, "<TrackObject") == NULL &&
-		strstr(lpszData, "<Replay") == NULL && strstr(lpszData, "<Item") == NULL))
-	{
-		GlobalFree(hXml);
+		HWND hwndEdit = pOutput->hwndEdit;
+		PINT pnTrackId = pOutput->pnTrackId;
+		XmlFreeParser(&pOutput->parser);
+		ZeroMemory(pOutput, sizeof(MX_XML_OUTPUT));
+		pOutput->hwndEdit = hwndEdit;
+		pOutput->pnTrackId = pnTrackId;
+		XmlInitParser(&pOutput->parser);
 		return TRUE;
 	}
 
-	// Place the cursor at the end of the edit control
-	int nLen = Edit_GetTextLength(hwndEdit);
-	Edit_SetSel(hwndEdit, (WPARAM)nLen, (LPARAM)nLen);
-	OutputText(hwndEdit, g_szSep1);
-
-	HRESULT hr = S_FALSE;
-	if (FAILED(hr = ParseAndOutputXml(hwndEdit, hXml, pnTrackId)))
+	// Malformed data is skipped instead of aborting the request, which would report a network error
+	if (!pOutput->bError)
 	{
-		GlobalFree(hXml);
-		return FALSE;
+		XmlFeed(&pOutput->parser, lpData, cbData);
+		ParseAndOutputXml(pOutput);
 	}
 
-	GlobalFree(hXml);
 	return TRUE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
-HRESULT ParseAndOutputXml(HWND hwndEdit, HGLOBAL hXml, PINT pnTrackId)
+static BOOL ParseAndOutputXml(PMX_XML_OUTPUT pOutput)
 {
-	if (hwndEdit == NULL || hXml == NULL)
-		return E_INVALIDARG;
-
-	HRESULT hr = S_FALSE;
-	IStream* pStream = NULL;
-	IXmlReader* pReader = NULL;
-
-	XmlNodeType nodeType = XmlNodeType_None;
-	XmlArrayType arrayType = XmlArrayType_None;
-
-	const WCHAR* pwszElement = NULL;
-	const WCHAR* pwszValue = NULL;
+	if (pOutput == NULL)
+		return FALSE;
 
-	int nReplayPos = 0;
-	int nReplayTime = 0;
-	int nObjectNumber = 0;
+	HWND hwndEdit = pOutput->hwndEdit;
+	XML_NODE node;
+	int nNodeType = XML_NODE_NONE;
 
+	char szValue[OUTPUT_LEN];
+	WCHAR wszValue[OUTPUT_LEN];
 	WCHAR wszOutput[OUTPUT_LEN];
-	WCHAR wszElement[256];
-	WCHAR wszUsername[256];
 	WCHAR wszReplayTime[32];
-	WCHAR wszStuntScore[32];
-	WCHAR wszObjectPath[260];
-	WCHAR wszObjectAuthor[256];
-
-	wszOutput[0] = L'\0';
-	wszElement[0] = L'\0';
-	wszUsername[0] = L'\0';
-	wszReplayTime[0] = L'\0';
-	wszStuntScore[0] = L'\0';
-	wszObjectPath[0] = L'\0';
-	wszObjectAuthor[0] = L'\0';
-
-	if (FAILED(hr = CreateStreamOnHGlobal(hXml, FALSE, &pStream)))
-		goto CleanUp;
-	if (FAILED(hr = CreateXmlReader(IID_IXmlReader, (void**)&pReader, NULL)))
-		goto CleanUp;
-	if (FAILED(hr = pReader->SetProperty(XmlReaderProperty_DtdProcessing, DtdProcessing_Prohibit)))
-		goto CleanUp;
-	if (FAILED(hr = pReader->SetInput(pStream)))
-		goto CleanUp;
-
-	// Read until there are no more nodes
-	while ((hr = pReader->Read(&nodeType)) == S_OK)
+
+	// Read until all nodes received so far have been processed
+	while ((nNodeType = XmlRead(&pOutput->parser, &node)) != XML_NODE_NONE)
 	{
-		switch (nodeType)
+		switch (nNodeType)
 		{
-			case XmlNodeType_Element:
-				if (FAILED(hr = pReader->GetLocalName(&pwszElement, NULL)))
-					goto CleanUp;
-				if (pwszElement == NULL)
-					break;
-
-				if (_wcsicmp(pwszElement, L"TrackInfo") == 0)
-					arrayType = XmlArrayType_TrackInfo;
-				else if (_wcsicmp(pwszElement, L"TrackObject") == 0)
-					arrayType = XmlArrayType_TrackObject;
-				else if (_wcsicmp(pwszElement, L"Replay") == 0)
-					arrayType = XmlArrayType_Replay;
-				else if (_wcsicmp(pwszElement, L"Item") == 0)
-					arrayType = XmlArrayType_Item;
+			case XML_NODE_ERROR:
+				pOutput->bError = TRUE;
+				return FALSE;
+
+			case XML_NODE_ELEMENT:
+				if (XmlIsName(node.lpszName, node.cchName, "TrackInfo"))
+					pOutput->arrayType = XmlArrayType_TrackInfo;
+				else if (XmlIsName(node.lpszName, node.cchName, "TrackObject"))
+					pOutput->arrayType = XmlArrayType_TrackObject;
+				else if (XmlIsName(node.lpszName, node.cchName, "Replay"))
+					pOutput->arrayType = XmlArrayType_Replay;
+				else if (XmlIsName(node.lpszName, node.cchName, "Item"))
+					pOutput->arrayType = XmlArrayType_Item;
+
+				if (pOutput->arrayType != XmlArrayType_None)
+				{
+					if (!pOutput->bOutput)
+					{ // Place the cursor at the end of the edit control
+						pOutput->nOutputStart = Edit_GetTextLength(hwndEdit);
+						Edit_SetSel(hwndEdit, (WPARAM)pOutput->nOutputStart, (LPARAM)pOutput->nOutputStart);
+						OutputText(hwndEdit, g_szSep1);
+						pOutput->bOutput = TRUE;
+					}
 
-				if (arrayType != XmlArrayType_None)
-					MyStrNCpyW(wszElement, pwszElement, _countof(wszElement));
+					int cchElement = MultiByteToWideChar(CP_UTF8, 0, node.lpszName, (int)min(node.cchName, 255),
+						pOutput->wszElement, _countof(pOutput->wszElement) - 1);
+					pOutput->wszElement[cchElement] = L'\0';
+				}
 
 				break;
 
-			case XmlNodeType_Text:
-				if (FAILED(hr = pReader->GetValue(&pwszValue, NULL)))
-					goto CleanUp;
-				if (pwszValue == NULL)
+			case XML_NODE_TEXT:
+				if (pOutput->arrayType == XmlArrayType_None)
 					break;
 
-				if (arrayType == XmlArrayType_TrackInfo)
+				XmlDecodeText(node.lpszValue, node.cchValue, node.bCData, szValue, _countof(szValue));
+				if (MultiByteToWideChar(CP_UTF8, 0, szValue, -1, wszValue, _countof(wszValue)) == 0)
+					wszValue[0] = L'\0';
+				wszValue[_countof(wszValue)-1] = L'\0';
+
+				if (pOutput->arrayType == XmlArrayType_TrackInfo)
 				{
-					if (_wcsicmp(wszElement, L"Comments") == 0)
+					if (_wcsicmp(pOutput->wszElement, L"Comments") == 0)
 						break;
 
-					if (pnTrackId != NULL &&
-						(_wcsicmp(wszElement, L"TrackID") == 0 || _wcsicmp(wszElement, L"MapID") == 0))
-						*pnTrackId = _wtoi(pwszValue);
+					if (pOutput->pnTrackId != NULL &&
+						(_wcsicmp(pOutput->wszElement, L"TrackID") == 0 || _wcsicmp(pOutput->wszElement, L"MapID") == 0))
+						*pOutput->pnTrackId = _wtoi(wszValue);
 
-					wcsncat(wszElement, L":", _countof(wszElement) - wcslen(wszElement) - 1);
-					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%-23s %s\r\n", wszElement, pwszValue);
+					wcsncat(pOutput->wszElement, L":", _countof(pOutput->wszElement) - wcslen(pOutput->wszElement) - 1);
+					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%-23s %s\r\n", pOutput->wszElement, wszValue);
 				}
-				else if (arrayType == XmlArrayType_TrackObject)
+				else if (pOutput->arrayType == XmlArrayType_TrackObject)
 				{
-					if (_wcsicmp(wszElement, L"ObjectPath") == 0)
-						MyStrNCpyW(wszObjectPath, pwszValue, _countof(wszObjectPath));
-					if (_wcsicmp(wszElement, L"ObjectAuthor") == 0)
+					if (_wcsicmp(pOutput->wszElement, L"ObjectPath") == 0)
+						MyStrNCpyW(pOutput->wszObjectPath, wszValue, _countof(pOutput->wszObjectPath));
+					if (_wcsicmp(pOutput->wszElement, L"ObjectAuthor") == 0)
 					{
-						wszUsername[0] = L'\0';	// Username element can be empty or missing
-						MyStrNCpyW(wszObjectAuthor, pwszValue, _countof(wszObjectAuthor));
+						pOutput->wszUsername[0] = L'\0';	// Username element can be empty or missing
+						MyStrNCpyW(pOutput->wszObjectAuthor, wszValue, _countof(pOutput->wszObjectAuthor));
 					}
-					if (_wcsicmp(wszElement, L"Username") == 0)
-						MyStrNCpyW(wszUsername, pwszValue, _countof(wszUsername));
+					if (_wcsicmp(pOutput->wszElement, L"Username") == 0)
+						MyStrNCpyW(pOutput->wszUsername, wszValue, _countof(pOutput->wszUsername));
 				}
-				else if (arrayType == XmlArrayType_Replay)
+				else if (pOutput->arrayType == XmlArrayType_Replay)
 				{
-					if (_wcsicmp(wszElement, L"Username") == 0)
-						MyStrNCpyW(wszUsername, pwszValue, _countof(wszUsername));
-					if (_wcsicmp(wszElement, L"ReplayTime") == 0)
-						nReplayTime = _wtoi(pwszValue);
-					if (_wcsicmp(wszElement, L"StuntScore") == 0)
-						MyStrNCpyW(wszStuntScore, pwszValue, _countof(wszStuntScore));
-					if (_wcsicmp(wszElement, L"Position") == 0)
-						nReplayPos = _wtoi(pwszValue);
+					if (_wcsicmp(pOutput->wszElement, L"Username") == 0)
+						MyStrNCpyW(pOutput->wszUsername, wszValue, _countof(pOutput->wszUsername));
+					if (_wcsicmp(pOutput->wszElement, L"ReplayTime") == 0)
+						pOutput->nReplayTime = _wtoi(wszValue);
+					if (_wcsicmp(pOutput->wszElement, L"StuntScore") == 0)
+						MyStrNCpyW(pOutput->wszStuntScore, wszValue, _countof(pOutput->wszStuntScore));
+					if (_wcsicmp(pOutput->wszElement, L"Position") == 0)
+						pOutput->nReplayPos = _wtoi(wszValue);
 				}
-				else if (arrayType == XmlArrayType_Item)
+				else if (pOutput->arrayType == XmlArrayType_Item)
 				{
-					wcsncat(wszElement, L":", _countof(wszElement) - wcslen(wszElement) - 1);
-					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%-15s %s\r\n", wszElement, pwszValue);
+					wcsncat(pOutput->wszElement, L":", _countof(pOutput->wszElement) - wcslen(pOutput->wszElement) - 1);
+					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%-15s %s\r\n", pOutput->wszElement, wszValue);
 				}
 
 				break;
 
-			case XmlNodeType_EndElement:
-				if (FAILED(hr = pReader->GetLocalName(&pwszElement, NULL)))
-					goto CleanUp;
-				if (pwszElement == NULL)
-					break;
-
-				if (_wcsicmp(pwszElement, L"TrackInfo") == 0)
-					arrayType = XmlArrayType_None;
-				else if (_wcsicmp(pwszElement, L"TrackObject") == 0)
+			case XML_NODE_ENDELEMENT:
+				if (XmlIsName(node.lpszName, node.cchName, "TrackInfo"))
+					pOutput->arrayType = XmlArrayType_None;
+				else if (XmlIsName(node.lpszName, node.cchName, "TrackObject"))
 				{
 					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%02d. %s (%s",
-						++nObjectNumber, wszObjectPath, wszObjectAuthor);
-					if (wcsncmp(wszUsername, wszObjectAuthor, wcslen(wszUsername)) != 0)
-						OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"/%s", wszUsername);
+						++pOutput->nObjectNumber, pOutput->wszObjectPath, pOutput->wszObjectAuthor);
+					if (wcsncmp(pOutput->wszUsername, pOutput->wszObjectAuthor, wcslen(pOutput->wszUsername)) != 0)
+						OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"/%s", pOutput->wszUsername);
 					OutputText(hwndEdit, L")\r\n");
-					arrayType = XmlArrayType_None;
+					pOutput->arrayType = XmlArrayType_None;
 				}
-				else if (_wcsicmp(pwszElement, L"Replay") == 0)
+				else if (XmlIsName(node.lpszName, node.cchName, "Replay"))
 				{
-					FormatTimeW(nReplayTime, wszReplayTime, _countof(wszReplayTime));
+					FormatTimeW(pOutput->nReplayTime, wszReplayTime, _countof(wszReplayTime));
 					OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L"%02d. %s (%s)",
-						nReplayPos, wszUsername, wszReplayTime);
-					if (wcsncmp(wszStuntScore, L"0", wcslen(wszStuntScore)) != 0)
-						OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L" %s pt.", wszStuntScore);
+						pOutput->nReplayPos, pOutput->wszUsername, wszReplayTime);
+					if (wcsncmp(pOutput->wszStuntScore, L"0", wcslen(pOutput->wszStuntScore)) != 0)
+						OutputTextFmt(hwndEdit, wszOutput, _countof(wszOutput), L" %s pt.", pOutput->wszStuntScore);
 					OutputText(hwndEdit, L"\r\n");
-					arrayType = XmlArrayType_None;
+					pOutput->arrayType = XmlArrayType_None;
 				}
-				else if (_wcsicmp(pwszElement, L"Item") == 0)
-					arrayType = XmlArrayType_None;
+				else if (XmlIsName(node.lpszName, node.cchName, "Item"))
+					pOutput->arrayType = XmlArrayType_None;
 
 				break;
 		}
 	}
 
-	hr = S_OK;
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
 
-CleanUp:
-	if (pReader != NULL)
+LPCTSTR GetSubDomain(int nGame)
+{
+	switch (nGame)
 	{
-		pReader->SetInput(NULL);
-		pReader->Release();
+		case GAME_TMNF:   return g_szForever;
+		case GAME_TMU:    return g_szUnited;
+		case GAME_TMN:    return g_szNations;
+		case GAME_TMS:    return g_szSunrise;
+		case GAME_TMO:    return g_szOriginal;
+		case GAME_TM2:    return g_szTM;
+		case GAME_SM:     return g_szSM;
+		case GAME_QM:     return g_szQM;
+		case GAME_TM2020: return g_szTrackMania;
 	}
 
-	if (pStream != NULL)
-		pStream->Release();
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int GetExchangeGames(LPCSTR lpszEnvi, int* pnGames, int nMaxCount)
+{
+	if (lpszEnvi == NULL || pnGames == NULL)
+		return 0;
+
+	static const int anCanyon[]  = {GAME_TM2};
+	static const int anStorm[]   = {GAME_SM};
+	static const int anGalaxy[]  = {GAME_QM};
+	static const int anStadium[] = {GAME_TM2020, GAME_TM2, GAME_TMNF, GAME_TMU, GAME_TMN};
+	static const int anCoast[]   = {GAME_TMU, GAME_TMS};
+	static const int anDesert[]  = {GAME_TMU, GAME_TMO};
+
+	const int* pnList = NULL;
+	int nCount = 0;
+
+	if ((strcmp(lpszEnvi, "Canyon") == 0) || (strcmp(lpszEnvi, "Valley") == 0) ||
+		(strcmp(lpszEnvi, "Lagoon") == 0) || (strcmp(lpszEnvi, "Arena") == 0))
+		pnList = anCanyon, nCount = _countof(anCanyon);
+	else if ((strcmp(lpszEnvi, "Storm") == 0) || (strcmp(lpszEnvi, "Cryo") == 0) || (strcmp(lpszEnvi, "Meteor") == 0) ||
+		(strcmp(lpszEnvi, "Paris") == 0) || (strcmp(lpszEnvi, "Gothic") == 0))
+		pnList = anStorm, nCount = _countof(anStorm);
+	else if ((strcmp(lpszEnvi, "Galaxy") == 0) || (strcmp(lpszEnvi, "History") == 0) ||
+		(strcmp(lpszEnvi, "Society") == 0) || (strcmp(lpszEnvi, "Future") == 0))
+		pnList = anGalaxy, nCount = _countof(anGalaxy);
+	else if (strcmp(lpszEnvi, "Stadium") == 0)
+		pnList = anStadium, nCount = _countof(anStadium);
+	else if ((strcmp(lpszEnvi, "Coast") == 0) || (strcmp(lpszEnvi, "Bay") == 0) || (strcmp(lpszEnvi, "Island") == 0))
+		pnList = anCoast, nCount = _countof(anCoast);
+	else if ((strcmp(lpszEnvi, "Desert") == 0) || (strcmp(lpszEnvi, "Snow") == 0) || (strcmp(lpszEnvi, "Rally") == 0) ||
+		(strcmp(lpszEnvi, "Alpine") == 0) || (strcmp(lpszEnvi, "Speed") == 0))
+		pnList = anDesert, nCount = _countof(anDesert);
+
+	if (nCount > nMaxCount)
+		nCount = nMaxCount;
+	for (int i = 0; i < nCount; i++)
+		pnGames[i] = pnList[i];
+
+	return nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL GetLookupUrl(int nGame, LPCSTR lpszUid, LPTSTR lpszUrl, SIZE_T cchUrl)
+{
+	if (lpszUid == NULL || lpszUrl == NULL || cchUrl == 0)
+		return FALSE;
+
+	LPCTSTR lpszSubDomain = GetSubDomain(nGame);
+	if (lpszSubDomain == NULL)
+		return FALSE;
+
+	if (IS_MX_GAME(nGame))
+		_sntprintf(lpszUrl, cchUrl, nGame == GAME_TM2020 ? g_szUrlMxMaps : g_szUrlMpMaps, g_szHttps, lpszSubDomain, lpszUid);
+	else
+		_sntprintf(lpszUrl, cchUrl, g_szUrlTmx, g_szHttp, lpszSubDomain, g_szParamInfo, lpszUid);
+	lpszUrl[cchUrl - 1] = TEXT('\0');
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int GetMxTrackId(LPCSTR lpszXml)
+{
+	if (lpszXml == NULL)
+		return 0;
+
+	LPCSTR lpsz = strstr(lpszXml, "<TrackID>");
+	if (lpsz != NULL)
+		return atoi(lpsz + 9);
+
+	lpsz = strstr(lpszXml, "<MapID>");
+	if (lpsz != NULL)
+		return atoi(lpsz + 7);
 
-	return hr;
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -16,7 +16,46 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Games whose exchange sites are supported
+#define GAME_TMNF   1
+#define GAME_TMU    2
+#define GAME_TMN    3
+#define GAME_TMS    4
+#define GAME_TMO    5
+#define GAME_TM2    6
+#define GAME_SM     7
+#define GAME_QM     8
+#define GAME_TM2020 9
+
+// Mania Exchange game IDs follow the Track Exchange game IDs
+#define IS_MX_GAME(nGame) ((nGame) >= GAME_TM2)
+
+// URL templates of the exchange sites
+extern const TCHAR g_szHttp[];
+extern const TCHAR g_szHttps[];
+extern const TCHAR g_szParamSearch[];
+extern const TCHAR g_szParamRecord[];
+extern const TCHAR g_szUrlTmx[];
+extern const TCHAR g_szUrlMpMaps[];
+extern const TCHAR g_szUrlMpRepl[];
+extern const TCHAR g_szUrlMxMaps[];
+extern const TCHAR g_szUrlMxRepl[];
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
 // Retrieves and prints T/MX information for a specific map
 BOOL DumpTmx(HWND hwndEdit, LPCSTR lpszUid, LPCSTR lpszEnvi);
 
+// Returns the games whose exchange sites can know a map of the environment, in the order of priority
+int GetExchangeGames(LPCSTR lpszEnvi, int* pnGames, int nMaxCount);
+
+// Returns the subdomain of the exchange site of a game
+LPCTSTR GetSubDomain(int nGame);
+
+// Creates the URL to request the map information by map UID
+BOOL GetLookupUrl(int nGame, LPCSTR lpszUid, LPTSTR lpszUrl, SIZE_T cchUrl);
+
+// Extracts the MX track ID from a map information response
+int GetMxTrackId(LPCSTR lpszXml);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,572 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// XmlParser.cpp- Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "XmlParser.h"
+
+#define XML_MIN_CARRYSIZE 4096
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward declarations of functions included in this code module
+
+// Parses the node at the beginning of the data. Returns XML_NODE_NONE without consuming
+// any bytes if the node is incomplete, and with consumed bytes if the node is skipped.
+static int ParseNode(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData, LPXML_NODE lpNode, LPDWORD lpcbUsed);
+// Appends data to the carry buffer and removes the bytes already parsed
+static BOOL AppendCarry(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData);
+// Finds a null-terminated string in data that is not null-terminated
+static LPCSTR FindString(LPCSTR lpData, DWORD cbData, LPCSTR lpszFind);
+// Removes the namespace prefix of a qualified name
+static void StripPrefix(LPCSTR* lplpszName, LPDWORD lpcchName);
+// Checks whether a character is an XML whitespace character
+static BOOL IsXmlSpace(char ch);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void XmlInitParser(LPXML_PARSER lpParser)
+{
+	if (lpParser != NULL)
+		ZeroMemory(lpParser, sizeof(XML_PARSER));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void XmlFreeParser(LPXML_PARSER lpParser)
+{
+	if (lpParser == NULL)
+		return;
+
+	if (lpParser->lpCarry != NULL)
+		MyGlobalFreePtr((LPVOID)lpParser->lpCarry);
+
+	ZeroMemory(lpParser, sizeof(XML_PARSER));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+void XmlFeed(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData)
+{
+	if (lpParser == NULL || lpParser->bError)
+		return;
+
+	// Keep the rest of a chunk that has not been parsed completely
+	if (lpParser->dwChunkPos < lpParser->cbChunk &&
+		!AppendCarry(lpParser, lpParser->lpChunk + lpParser->dwChunkPos, lpParser->cbChunk - lpParser->dwChunkPos))
+		lpParser->bError = TRUE;
+
+	lpParser->lpChunk = lpData;
+	lpParser->cbChunk = (lpData != NULL) ? cbData : 0;
+	lpParser->dwChunkPos = 0;
+
+	if (lpData == NULL)
+		lpParser->bFinal = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int XmlRead(LPXML_PARSER lpParser, LPXML_NODE lpNode)
+{
+	if (lpParser == NULL || lpNode == NULL)
+		return XML_NODE_ERROR;
+
+	ZeroMemory(lpNode, sizeof(XML_NODE));
+
+	while (!lpParser->bError)
+	{
+		DWORD cbUsed = 0;
+		int nType = XML_NODE_NONE;
+		LPCSTR lpRest = lpParser->lpChunk + lpParser->dwChunkPos;
+		DWORD cbRest = lpParser->cbChunk - lpParser->dwChunkPos;
+
+		if (lpParser->dwCarryPos < lpParser->cbCarry)
+		{ // Parse the nodes of the carry buffer first
+			nType = ParseNode(lpParser, lpParser->lpCarry + lpParser->dwCarryPos,
+				lpParser->cbCarry - lpParser->dwCarryPos, lpNode, &cbUsed);
+			lpParser->dwCarryPos += cbUsed;
+			if (cbUsed > 0 || nType == XML_NODE_ERROR)
+			{
+				if (nType != XML_NODE_NONE)
+					break;
+				continue;
+			}
+
+			if (cbRest == 0)
+			{ // A node must not be truncated by the end of the data
+				if (lpParser->bFinal)
+					lpParser->bError = TRUE;
+				break;
+			}
+
+			// Complete the node with the next part of the chunk. A node ends with '>' or, for
+			// text, before '<', so the carried data never grows beyond the node it belongs to.
+			LPCSTR lpEnd = (LPCSTR)memchr(lpRest, '>', cbRest);
+			DWORD cbAppend = (lpEnd != NULL) ? (DWORD)(lpEnd - lpRest) + 1 : cbRest;
+			if (!AppendCarry(lpParser, lpRest, cbAppend))
+				lpParser->bError = TRUE;
+			lpParser->dwChunkPos += cbAppend;
+			continue;
+		}
+
+		lpParser->cbCarry = 0;
+		lpParser->dwCarryPos = 0;
+
+		if (cbRest == 0)
+			break;
+
+		// Parse the chunk in place
+		nType = ParseNode(lpParser, lpRest, cbRest, lpNode, &cbUsed);
+		lpParser->dwChunkPos += cbUsed;
+		if (cbUsed > 0 || nType == XML_NODE_ERROR)
+		{
+			if (nType != XML_NODE_NONE)
+				break;
+			continue;
+		}
+
+		// Carry the incomplete node over to the next chunk
+		if (lpParser->bFinal || !AppendCarry(lpParser, lpRest, cbRest))
+			lpParser->bError = TRUE;
+		lpParser->dwChunkPos = lpParser->cbChunk;
+		break;
+	}
+
+	if (lpParser->bError)
+	{
+		ZeroMemory(lpNode, sizeof(XML_NODE));
+		return XML_NODE_ERROR;
+	}
+
+	return lpNode->nType;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL XmlIsName(LPCSTR lpszName, DWORD cchName, LPCSTR lpszCompare)
+{
+	if (lpszName == NULL || lpszCompare == NULL)
+		return FALSE;
+
+	for (DWORD i = 0; i < cchName; i++)
+		if (lpszCompare[i] == '\0' || tolower((BYTE)lpszName[i]) != tolower((BYTE)lpszCompare[i]))
+			return FALSE;
+
+	return lpszCompare[cchName] == '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL XmlGetAttribute(const LPXML_NODE lpNode, LPCSTR lpszName, LPCSTR* lplpszValue, LPDWORD lpcchValue)
+{
+	if (lpNode == NULL || lpNode->nType != XML_NODE_ELEMENT || lpszName == NULL ||
+		lplpszValue == NULL || lpcchValue == NULL)
+		return FALSE;
+
+	LPCSTR lpsz = lpNode->lpszValue;
+	LPCSTR lpszEnd = lpsz + lpNode->cchValue;
+	while (lpsz < lpszEnd)
+	{
+		while (lpsz < lpszEnd && IsXmlSpace(*lpsz))
+			lpsz++;
+
+		// Name
+		LPCSTR lpszAttr = lpsz;
+		while (lpsz < lpszEnd && *lpsz != '=' && !IsXmlSpace(*lpsz))
+			lpsz++;
+		DWORD cchAttr = (DWORD)(lpsz - lpszAttr);
+
+		while (lpsz < lpszEnd && IsXmlSpace(*lpsz))
+			lpsz++;
+		if (lpsz == lpszEnd || *lpsz++ != '=')
+			return FALSE;
+		while (lpsz < lpszEnd && IsXmlSpace(*lpsz))
+			lpsz++;
+
+		// Quoted value
+		if (lpsz == lpszEnd || (*lpsz != '"' && *lpsz != '\''))
+			return FALSE;
+		char chQuote = *lpsz++;
+		LPCSTR lpszValue = lpsz;
+		while (lpsz < lpszEnd && *lpsz != chQuote)
+			lpsz++;
+		if (lpsz == lpszEnd)
+			return FALSE;
+
+		StripPrefix(&lpszAttr, &cchAttr);
+		if (XmlIsName(lpszAttr, cchAttr, lpszName))
+		{
+			*lplpszValue = lpszValue;
+			*lpcchValue = (DWORD)(lpsz - lpszValue);
+			return TRUE;
+		}
+
+		lpsz++;
+	}
+
+	return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD XmlDecodeText(LPCSTR lpszValue, DWORD cchValue, BOOL bCData, LPSTR lpszText, DWORD cchText)
+{
+	if (lpszText == NULL || cchText == 0)
+		return 0;
+
+	DWORD cchOut = 0;
+	LPCSTR lpsz = lpszValue;
+	LPCSTR lpszEnd = (lpszValue != NULL) ? lpszValue + cchValue : NULL;
+	while (lpsz < lpszEnd)
+	{
+		char achChar[4];
+		DWORD cchChar = 0;
+
+		LPCSTR lpszSemicolon = NULL;
+		if (*lpsz == '&' && !bCData)
+			lpszSemicolon = (LPCSTR)memchr(lpsz, ';', min((DWORD)(lpszEnd - lpsz), 12));
+
+		if (lpszSemicolon != NULL)
+		{
+			LPCSTR lpszRef = lpsz + 1;
+			DWORD cchRef = (DWORD)(lpszSemicolon - lpszRef);
+			UINT uCode = 0;
+
+			if (cchRef > 1 && lpszRef[0] == '#')
+			{ // Character reference
+				BOOL bHex = (lpszRef[1] == 'x' || lpszRef[1] == 'X');
+				for (DWORD i = bHex ? 2 : 1; i < cchRef && uCode <= 0x10FFFF; i++)
+				{
+					char ch = lpszRef[i];
+					if (ch >= '0' && ch <= '9')
+						uCode = uCode * (bHex ? 16 : 10) + (ch - '0');
+					else if (bHex && ch >= 'a' && ch <= 'f')
+						uCode = uCode * 16 + (ch - 'a' + 10);
+					else if (bHex && ch >= 'A' && ch <= 'F')
+						uCode = uCode * 16 + (ch - 'A' + 10);
+					else
+						uCode = 0x110000;
+				}
+			}
+			else if (cchRef == 2 && strncmp(lpszRef, "lt", 2) == 0)
+				uCode = '<';
+			else if (cchRef == 2 && strncmp(lpszRef, "gt", 2) == 0)
+				uCode = '>';
+			else if (cchRef == 3 && strncmp(lpszRef, "amp", 3) == 0)
+				uCode = '&';
+			else if (cchRef == 4 && strncmp(lpszRef, "quot", 4) == 0)
+				uCode = '"';
+			else if (cchRef == 4 && strncmp(lpszRef, "apos", 4) == 0)
+				uCode = '\'';
+
+			// Encode the character as UTF-8
+			if (uCode == 0 || uCode > 0x10FFFF || (uCode >= 0xD800 && uCode <= 0xDFFF))
+				cchChar = 0;
+			else if (uCode < 0x80)
+				achChar[cchChar++] = (char)uCode;
+			else if (uCode < 0x800)
+			{
+				achChar[cchChar++] = (char)(0xC0 | (uCode >> 6));
+				achChar[cchChar++] = (char)(0x80 | (uCode & 0x3F));
+			}
+			else if (uCode < 0x10000)
+			{
+				achChar[cchChar++] = (char)(0xE0 | (uCode >> 12));
+				achChar[cchChar++] = (char)(0x80 | ((uCode >> 6) & 0x3F));
+				achChar[cchChar++] = (char)(0x80 | (uCode & 0x3F));
+			}
+			else
+			{
+				achChar[cchChar++] = (char)(0xF0 | (uCode >> 18));
+				achChar[cchChar++] = (char)(0x80 | ((uCode >> 12) & 0x3F));
+				achChar[cchChar++] = (char)(0x80 | ((uCode >> 6) & 0x3F));
+				achChar[cchChar++] = (char)(0x80 | (uCode & 0x3F));
+			}
+
+			if (cchChar > 0)
+				lpsz = lpszSemicolon + 1;
+		}
+
+		// Unknown references are copied unchanged
+		if (cchChar == 0)
+			achChar[cchChar++] = *lpsz++;
+
+		if (cchOut + cchChar >= cchText)
+			break;
+
+		CopyMemory(lpszText + cchOut, achChar, cchChar);
+		cchOut += cchChar;
+	}
+
+	lpszText[cchOut] = '\0';
+
+	return cchOut;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+int XmlToInt(LPCSTR lpszValue, DWORD cchValue)
+{
+	if (lpszValue == NULL)
+		return 0;
+
+	LPCSTR lpsz = lpszValue;
+	LPCSTR lpszEnd = lpszValue + cchValue;
+	while (lpsz < lpszEnd && IsXmlSpace(*lpsz))
+		lpsz++;
+
+	BOOL bNegative = FALSE;
+	if (lpsz < lpszEnd && (*lpsz == '-' || *lpsz == '+'))
+		bNegative = (*lpsz++ == '-');
+
+	int nValue = 0;
+	while (lpsz < lpszEnd && *lpsz >= '0' && *lpsz <= '9')
+		nValue = nValue * 10 + (*lpsz++ - '0');
+
+	return bNegative ? -nValue : nValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int ParseNode(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData, LPXML_NODE lpNode, LPDWORD lpcbUsed)
+{
+	*lpcbUsed = 0;
+	if (cbData == 0)
+		return XML_NODE_NONE;
+
+	if (lpData[0] != '<')
+	{ // Text ends before the next tag or at the end of the data
+		LPCSTR lpEnd = (LPCSTR)memchr(lpData, '<', cbData);
+		if (lpEnd == NULL && !lpParser->bFinal)
+			return XML_NODE_NONE;
+
+		DWORD cchText = (lpEnd != NULL) ? (DWORD)(lpEnd - lpData) : cbData;
+		*lpcbUsed = cchText;
+
+		// Text outside the root element, like a byte order mark, is skipped as well
+		for (DWORD i = 0; i < cchText && lpParser->uDepth > 0; i++)
+		{
+			if (!IsXmlSpace(lpData[i]))
+			{
+				lpNode->nType = XML_NODE_TEXT;
+				lpNode->lpszValue = lpData;
+				lpNode->cchValue = cchText;
+				lpNode->uDepth = lpParser->uDepth;
+				return XML_NODE_TEXT;
+			}
+		}
+
+		return XML_NODE_NONE;
+	}
+
+	if (cbData < 2)
+		return XML_NODE_NONE;
+
+	if (lpData[1] == '?')
+	{ // Skip the XML declaration and processing instructions
+		LPCSTR lpEnd = FindString(lpData + 2, cbData - 2, "?>");
+		if (lpEnd != NULL)
+			*lpcbUsed = (DWORD)(lpEnd - lpData) + 2;
+		return XML_NODE_NONE;
+	}
+
+	if (lpData[1] == '!')
+	{
+		static const char szCData[] = "<![CDATA[";
+		const DWORD cchCData = _countof(szCData) - 1;
+
+		if (cbData < 4)
+			return XML_NODE_NONE;
+
+		if (lpData[2] == '-' && lpData[3] == '-')
+		{ // Skip comments
+			LPCSTR lpEnd = FindString(lpData + 4, cbData - 4, "-->");
+			if (lpEnd != NULL)
+				*lpcbUsed = (DWORD)(lpEnd - lpData) + 3;
+			return XML_NODE_NONE;
+		}
+
+		if (memcmp(lpData, szCData, min(cbData, cchCData)) != 0)
+		{ // Document type declarations are not supported
+			lpParser->bError = TRUE;
+			return XML_NODE_ERROR;
+		}
+
+		LPCSTR lpEnd = (cbData > cchCData) ? FindString(lpData + cchCData, cbData - cchCData, "]]>") : NULL;
+		if (lpEnd == NULL)
+			return XML_NODE_NONE;
+
+		*lpcbUsed = (DWORD)(lpEnd - lpData) + 3;
+		lpNode->nType = XML_NODE_TEXT;
+		lpNode->lpszValue = lpData + cchCData;
+		lpNode->cchValue = (DWORD)(lpEnd - lpNode->lpszValue);
+		lpNode->uDepth = lpParser->uDepth;
+		lpNode->bCData = TRUE;
+		return XML_NODE_TEXT;
+	}
+
+	// Find the end of the tag, skipping quoted attribute values
+	char chQuote = '\0';
+	DWORD dwEnd = 1;
+	for (; dwEnd < cbData; dwEnd++)
+	{
+		char ch = lpData[dwEnd];
+		if (chQuote != '\0')
+		{
+			if (ch == chQuote)
+				chQuote = '\0';
+		}
+		else if (ch == '"' || ch == '\'')
+			chQuote = ch;
+		else if (ch == '>')
+			break;
+	}
+
+	if (dwEnd == cbData)
+		return XML_NODE_NONE;
+
+	LPCSTR lpsz = lpData + 1;
+	LPCSTR lpszEnd = lpData + dwEnd;
+	BOOL bEndTag = (*lpsz == '/');
+	if (bEndTag)
+		lpsz++;
+	else if (lpszEnd > lpsz && lpszEnd[-1] == '/')
+	{
+		lpNode->bEmpty = TRUE;
+		lpszEnd--;
+	}
+
+	LPCSTR lpszName = lpsz;
+	while (lpsz < lpszEnd && !IsXmlSpace(*lpsz))
+		lpsz++;
+	DWORD cchName = (DWORD)(lpsz - lpszName);
+
+	if (cchName == 0 || (bEndTag && lpParser->uDepth == 0))
+	{
+		lpParser->bError = TRUE;
+		return XML_NODE_ERROR;
+	}
+
+	while (lpsz < lpszEnd && IsXmlSpace(*lpsz))
+		lpsz++;
+
+	StripPrefix(&lpszName, &cchName);
+
+	*lpcbUsed = dwEnd + 1;
+	lpNode->lpszName = lpszName;
+	lpNode->cchName = cchName;
+
+	if (bEndTag)
+	{
+		lpNode->nType = XML_NODE_ENDELEMENT;
+		lpNode->uDepth = --lpParser->uDepth;
+	}
+	else
+	{
+		lpNode->nType = XML_NODE_ELEMENT;
+		lpNode->lpszValue = lpsz;
+		lpNode->cchValue = (DWORD)(lpszEnd - lpsz);
+		lpNode->uDepth = lpParser->uDepth;
+		if (!lpNode->bEmpty)
+			lpParser->uDepth++;
+	}
+
+	return lpNode->nType;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL AppendCarry(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData)
+{
+	// Remove the parsed bytes, which are no longer referenced
+	if (lpParser->dwCarryPos > 0)
+	{
+		MoveMemory(lpParser->lpCarry, lpParser->lpCarry + lpParser->dwCarryPos,
+			lpParser->cbCarry - lpParser->dwCarryPos);
+		lpParser->cbCarry -= lpParser->dwCarryPos;
+		lpParser->dwCarryPos = 0;
+	}
+
+	if (cbData > XML_MAX_NODESIZE - lpParser->cbCarry)
+		return FALSE;
+
+	DWORD cbNeeded = lpParser->cbCarry + cbData;
+	if (cbNeeded > lpParser->cbAlloc)
+	{
+		DWORD cbAlloc = max(lpParser->cbAlloc, XML_MIN_CARRYSIZE);
+		while (cbAlloc < cbNeeded)
+			cbAlloc *= 2;
+
+		LPSTR lpCarry = (LPSTR)MyGlobalAllocPtr(GHND, cbAlloc);
+		if (lpCarry == NULL)
+			return FALSE;
+
+		if (lpParser->lpCarry != NULL)
+		{
+			CopyMemory(lpCarry, lpParser->lpCarry, lpParser->cbCarry);
+			MyGlobalFreePtr((LPVOID)lpParser->lpCarry);
+		}
+
+		lpParser->lpCarry = lpCarry;
+		lpParser->cbAlloc = cbAlloc;
+	}
+
+	CopyMemory(lpParser->lpCarry + lpParser->cbCarry, lpData, cbData);
+	lpParser->cbCarry += cbData;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static LPCSTR FindString(LPCSTR lpData, DWORD cbData, LPCSTR lpszFind)
+{
+	SIZE_T cchFind = strlen(lpszFind);
+	LPCSTR lpEnd = lpData + cbData;
+
+	while ((SIZE_T)(lpEnd - lpData) >= cchFind)
+	{
+		lpData = (LPCSTR)memchr(lpData, lpszFind[0], (SIZE_T)(lpEnd - lpData) - cchFind + 1);
+		if (lpData == NULL)
+			return NULL;
+		if (memcmp(lpData, lpszFind, cchFind) == 0)
+			return lpData;
+		lpData++;
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void StripPrefix(LPCSTR* lplpszName, LPDWORD lpcchName)
+{
+	LPCSTR lpszColon = (LPCSTR)memchr(*lplpszName, ':', *lpcchName);
+	if (lpszColon != NULL)
+	{
+		*lpcchName -= (DWORD)(lpszColon + 1 - *lplpszName);
+		*lplpszName = lpszColon + 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL IsXmlSpace(char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
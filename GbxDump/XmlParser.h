@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// XmlParser.h- Copyright (c) 2010-2024 by Electron.
+//
+// Licensed under the EUPL, Version 1.2 or - as soon they will be approved by
+// the European Commission - subsequent versions of the EUPL (the "Licence");
+// You may not use this work except in compliance with the Licence.
+// You may obtain a copy of the Licence at:
+//
+// https://joinup.ec.europa.eu/software/page/eupl
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the Licence is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the Licence for the specific language governing permissions and
+// limitations under the Licence.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Node types returned by XmlRead
+#define XML_NODE_ERROR      -1  // Malformed or unsupported data (e.g. a DTD)
+#define XML_NODE_NONE       0   // All data passed so far has been parsed
+#define XML_NODE_ELEMENT    1   // Start tag or empty element
+#define XML_NODE_ENDELEMENT 2   // End tag
+#define XML_NODE_TEXT       3   // Character data or CDATA section, whitespace is skipped
+
+// Upper limit for a single node that is split across several chunks
+#define XML_MAX_NODESIZE    16777216
+
+// State of the pull parser. Chunks of data are parsed in place; only a node that is
+// split across two chunks is copied to the carry buffer until it is complete.
+typedef struct _XML_PARSER
+{
+    LPCSTR lpChunk;     // Data passed with the last call of XmlFeed
+    DWORD  cbChunk;     // Size of the chunk in bytes
+    DWORD  dwChunkPos;  // Offset of the first unparsed byte of the chunk
+    LPSTR  lpCarry;     // Incomplete node carried over from previous chunks
+    DWORD  cbCarry;     // Number of bytes in the carry buffer
+    DWORD  dwCarryPos;  // Offset of the first unparsed byte of the carry buffer
+    DWORD  cbAlloc;     // Allocated size of the carry buffer
+    UINT   uDepth;      // Current nesting level
+    BOOL   bFinal;      // Set when the end of the data has been reached
+    BOOL   bError;      // Set if the data is malformed
+} XML_PARSER, FAR* LPXML_PARSER, *PXML_PARSER;
+
+// Node returned by XmlRead. The strings point into the parsed data, are not null-terminated
+// and remain valid until the next call of XmlRead or XmlFeed.
+typedef struct _XML_NODE
+{
+    int    nType;       // XML_NODE_* value
+    LPCSTR lpszName;    // Local name of the element, without namespace prefix
+    DWORD  cchName;     // Number of characters of the name
+    LPCSTR lpszValue;   // Undecoded text or attribute list of the element
+    DWORD  cchValue;    // Number of characters of the value
+    UINT   uDepth;      // Nesting level of the element or text
+    BOOL   bEmpty;      // Element without content (<Name/>), which has no end tag
+    BOOL   bCData;      // Text of a CDATA section, which contains no references
+} XML_NODE, FAR* LPXML_NODE, *PXML_NODE;
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Initializes the state of a parser
+void XmlInitParser(LPXML_PARSER lpParser);
+
+// Frees the carry buffer of a parser
+void XmlFreeParser(LPXML_PARSER lpParser);
+
+// Passes the next chunk of data to the parser. A NULL pointer marks the end of the data.
+// The chunk must remain valid until XmlRead returns XML_NODE_NONE.
+void XmlFeed(LPXML_PARSER lpParser, LPCSTR lpData, DWORD cbData);
+
+// Returns the next node of the data passed so far. XML_NODE_NONE requests the next chunk.
+int XmlRead(LPXML_PARSER lpParser, LPXML_NODE lpNode);
+
+// Compares a name of a node with a null-terminated string, ignoring the case
+BOOL XmlIsName(LPCSTR lpszName, DWORD cchName, LPCSTR lpszCompare);
+
+// Finds an attribute of an element node and returns its undecoded value
+BOOL XmlGetAttribute(const LPXML_NODE lpNode, LPCSTR lpszName, LPCSTR* lplpszValue, LPDWORD lpcchValue);
+
+// Decodes the entity and character references of a value into a null-terminated UTF-8 string.
+// Returns the length of the decoded string; longer strings are truncated.
+DWORD XmlDecodeText(LPCSTR lpszValue, DWORD cchValue, BOOL bCData, LPSTR lpszText, DWORD cchText);
+
+// Converts the leading digits of a value into an integer
+int XmlToInt(LPCSTR lpszValue, DWORD cchValue);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
@@ -26,6 +26,10 @@
 #define IDS_GER_UNSUPPORTED             415
 #define IDS_GER_FONTSIZEINFO            416
 #define IDS_GER_MSG_WRITE               417
+#define IDS_GER_FILTER_UID              418
+#define IDS_GER_SHEET_FOLDER            419
+#define IDS_GER_WEBP_FOLDER             420
+#define IDS_GER_JPEG_FOLDER             421
 #define IDD_ENG_GBXDUMP                 800
 #define IDS_ENG_FILTER_GBX              801
 #define IDS_ENG_FILTER_PNG              802
@@ -44,6 +48,10 @@
 #define IDS_ENG_UNSUPPORTED             815
 #define IDS_ENG_FONTSIZEINFO            816
 #define IDS_ENG_MSG_WRITE               817
+#define IDS_ENG_FILTER_UID              818
+#define IDS_ENG_SHEET_FOLDER            819
+#define IDS_ENG_WEBP_FOLDER             820
+#define IDS_ENG_JPEG_FOLDER             821
 #define IDC_OUTPUT                      1001
 #define IDC_OPEN                        1002
 #define IDC_COPY                        1003
@@ -54,6 +62,12 @@
 #define IDC_PASTE                       1008
 #define IDC_THUMB_COPY                  32771
 #define IDC_THUMB_SAVE                  32772
+#define IDC_BATCH                       32773
+#define IDC_CONTACT_SHEET               32774
+#define IDC_WEBP_EXPORT                 32775
+#define IDC_JPEG_EXPORT                 32776
+#define IDC_CONTACT_SHEET_WEBP          32777
+#define IDC_WEBP_EXPORT_LOSSLESS        32778
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
@@ -62,7 +76,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
 #define _APS_NEXT_RESOURCE_VALUE        107
-#define _APS_NEXT_COMMAND_VALUE         32773
+#define _APS_NEXT_COMMAND_VALUE         32779
 #define _APS_NEXT_CONTROL_VALUE         1009
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
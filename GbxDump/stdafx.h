@@ -46,7 +46,6 @@
 #include <shellapi.h>
 #include <vfw.h>
 #include <ole2.h>
-#include <xmllite.h>
 #include <Uxtheme.h>
 
 // C RunTime Header Files
@@ -58,6 +57,7 @@
 #include <tchar.h>
 #include <mbstring.h>
 #include <setjmp.h>
+#include <process.h>
 
 // TODO: reference additional headers your program requires here
 #include "GbxDump.h"
@@ -0,0 +1,638 @@
+// File: crn_bptc.cpp
+// This software is in the public domain. Please see license.txt.
+// BC6H and BC7 block decoding, as specified in the "BC6H Format" and "BC7 Format" sections of the Direct3D 11 documentation.
+#include "crn_core.h"
+#include "crn_bptc.h"
+#include "crn_hdr.h"
+#include "crn_threading.h"
+
+// SSE2 is part of the x64 baseline and is enabled by default for 32-bit x86 builds since VS2012 (/arch:SSE2).
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #define CRNLIB_BPTC_SSE2 1
+   #include <emmintrin.h>
+#else
+   #define CRNLIB_BPTC_SSE2 0
+#endif
+
+namespace crnlib
+{
+   // Subset of each pixel of the 2-subset partitions, one bit per pixel. BC6H uses the first 32 partitions.
+   static const uint16 g_bptc_partitions2[64] =
+   {
+      0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+      0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+      0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+      0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+      0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+      0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+      0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+      0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+   };
+
+   // Subset of each pixel of the 3-subset partitions, two bits per pixel
+   static const uint32 g_bc7_partitions3[64] =
+   {
+      0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+      0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+      0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+      0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+      0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+      0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+      0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+      0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+   };
+
+   // Anchor pixel of the second subset of the 2-subset partitions (the first subset is anchored at pixel 0)
+   static const uint8 g_bptc_anchors2[64] =
+   {
+      15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+      15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+      15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+       6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+   };
+
+   // Anchor pixels of the second and third subset of the 3-subset partitions
+   static const uint8 g_bc7_anchors3[2][64] =
+   {
+      {
+          3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+          3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+          8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+          3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+      },
+      {
+         15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+         15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+         15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+         15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+      }
+   };
+
+   // Interpolation weights of 2, 3 and 4-bit indices
+   static const uint8 g_bptc_weights2[4] = { 0, 21, 43, 64 };
+   static const uint8 g_bptc_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+   static const uint8 g_bptc_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+   static const uint8* const g_bptc_weights[5] = { NULL, NULL, g_bptc_weights2, g_bptc_weights3, g_bptc_weights4 };
+
+   struct bc7_mode_info
+   {
+      uint8 m_num_subsets;
+      uint8 m_partition_bits;
+      uint8 m_rotation_bits;
+      uint8 m_index_selection_bits;
+      uint8 m_color_bits;
+      uint8 m_alpha_bits;
+      uint8 m_endpoint_pbits;
+      uint8 m_shared_pbits;
+      uint8 m_index_bits;
+      uint8 m_index2_bits;
+   };
+
+   static const bc7_mode_info g_bc7_modes[8] =
+   {
+      { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+      { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+      { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+      { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+      { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+      { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+      { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+      { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+   };
+
+   // Endpoint fields of the BC6H block header: the base endpoint W and the endpoints (or deltas) X, Y and Z,
+   // each with a red, green and blue value, followed by the partition index.
+   enum bc6h_field
+   {
+      cBC6H_RW, cBC6H_GW, cBC6H_BW,
+      cBC6H_RX, cBC6H_GX, cBC6H_BX,
+      cBC6H_RY, cBC6H_GY, cBC6H_BY,
+      cBC6H_RZ, cBC6H_GZ, cBC6H_BZ,
+      cBC6H_D,
+
+      cBC6HNumFields
+   };
+
+   // A run of header bits, stored in ascending order at the given bit position of a field
+   struct bc6h_segment
+   {
+      uint8 m_field;
+      uint8 m_shift;
+      uint8 m_count;
+   };
+
+   const uint cBC6HMaxSegments = 24;
+
+   struct bc6h_mode_info
+   {
+      uint8 m_mode;
+      uint8 m_num_subsets;
+      uint8 m_transformed;
+      uint8 m_endpoint_bits;
+      uint8 m_delta_bits[3];
+      bc6h_segment m_segments[cBC6HMaxSegments];
+   };
+
+   #define BC6H_SEG(f, s, c) { cBC6H_##f, s, c }
+
+   static const bc6h_mode_info g_bc6h_modes[14] =
+   {
+      { 0x00, 2, 1, 10, { 5, 5, 5 }, {
+         BC6H_SEG(GY, 4, 1), BC6H_SEG(BY, 4, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10),
+         BC6H_SEG(RX, 0, 5), BC6H_SEG(GZ, 4, 1), BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 5), BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4),
+         BC6H_SEG(BX, 0, 5), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 5), BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 5),
+         BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x01, 2, 1, 7, { 6, 6, 6 }, {
+         BC6H_SEG(GY, 5, 1), BC6H_SEG(GZ, 4, 1), BC6H_SEG(GZ, 5, 1), BC6H_SEG(RW, 0, 7), BC6H_SEG(BZ, 0, 1), BC6H_SEG(BZ, 1, 1),
+         BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 7), BC6H_SEG(BY, 5, 1), BC6H_SEG(BZ, 2, 1), BC6H_SEG(GY, 4, 1), BC6H_SEG(BW, 0, 7),
+         BC6H_SEG(BZ, 3, 1), BC6H_SEG(BZ, 5, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RX, 0, 6), BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 6),
+         BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 6), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 6), BC6H_SEG(RZ, 0, 6), BC6H_SEG(D, 0, 5) } },
+      { 0x02, 2, 1, 11, { 5, 4, 4 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 5), BC6H_SEG(RW, 10, 1), BC6H_SEG(GY, 0, 4),
+         BC6H_SEG(GX, 0, 4), BC6H_SEG(GW, 10, 1), BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 4), BC6H_SEG(BW, 10, 1),
+         BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 5), BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 5), BC6H_SEG(BZ, 3, 1),
+         BC6H_SEG(D, 0, 5) } },
+      { 0x06, 2, 1, 11, { 4, 5, 4 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 4), BC6H_SEG(RW, 10, 1), BC6H_SEG(GZ, 4, 1),
+         BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 5), BC6H_SEG(GW, 10, 1), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 4), BC6H_SEG(BW, 10, 1),
+         BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 4), BC6H_SEG(BZ, 0, 1), BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 4),
+         BC6H_SEG(GY, 4, 1), BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x0A, 2, 1, 11, { 4, 4, 5 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 4), BC6H_SEG(RW, 10, 1), BC6H_SEG(BY, 4, 1),
+         BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 4), BC6H_SEG(GW, 10, 1), BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 5),
+         BC6H_SEG(BW, 10, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 4), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 4),
+         BC6H_SEG(BZ, 4, 1), BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x0E, 2, 1, 9, { 5, 5, 5 }, {
+         BC6H_SEG(RW, 0, 9), BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 9), BC6H_SEG(GY, 4, 1), BC6H_SEG(BW, 0, 9), BC6H_SEG(BZ, 4, 1),
+         BC6H_SEG(RX, 0, 5), BC6H_SEG(GZ, 4, 1), BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 5), BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4),
+         BC6H_SEG(BX, 0, 5), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 5), BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 5),
+         BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x12, 2, 1, 8, { 6, 5, 5 }, {
+         BC6H_SEG(RW, 0, 8), BC6H_SEG(GZ, 4, 1), BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 8), BC6H_SEG(BZ, 2, 1), BC6H_SEG(GY, 4, 1),
+         BC6H_SEG(BW, 0, 8), BC6H_SEG(BZ, 3, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RX, 0, 6), BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 5),
+         BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 5), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 6),
+         BC6H_SEG(RZ, 0, 6), BC6H_SEG(D, 0, 5) } },
+      { 0x16, 2, 1, 8, { 5, 6, 5 }, {
+         BC6H_SEG(RW, 0, 8), BC6H_SEG(BZ, 0, 1), BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 8), BC6H_SEG(GY, 5, 1), BC6H_SEG(GY, 4, 1),
+         BC6H_SEG(BW, 0, 8), BC6H_SEG(GZ, 5, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RX, 0, 5), BC6H_SEG(GZ, 4, 1), BC6H_SEG(GY, 0, 4),
+         BC6H_SEG(GX, 0, 6), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 5), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 5),
+         BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 5), BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x1A, 2, 1, 8, { 5, 5, 6 }, {
+         BC6H_SEG(RW, 0, 8), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 8), BC6H_SEG(BY, 5, 1), BC6H_SEG(GY, 4, 1),
+         BC6H_SEG(BW, 0, 8), BC6H_SEG(BZ, 5, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RX, 0, 5), BC6H_SEG(GZ, 4, 1), BC6H_SEG(GY, 0, 4),
+         BC6H_SEG(GX, 0, 5), BC6H_SEG(BZ, 0, 1), BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 6), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 5),
+         BC6H_SEG(BZ, 2, 1), BC6H_SEG(RZ, 0, 5), BC6H_SEG(BZ, 3, 1), BC6H_SEG(D, 0, 5) } },
+      { 0x1E, 2, 0, 6, { 6, 6, 6 }, {
+         BC6H_SEG(RW, 0, 6), BC6H_SEG(GZ, 4, 1), BC6H_SEG(BZ, 0, 1), BC6H_SEG(BZ, 1, 1), BC6H_SEG(BY, 4, 1), BC6H_SEG(GW, 0, 6),
+         BC6H_SEG(GY, 5, 1), BC6H_SEG(BY, 5, 1), BC6H_SEG(BZ, 2, 1), BC6H_SEG(GY, 4, 1), BC6H_SEG(BW, 0, 6), BC6H_SEG(GZ, 5, 1),
+         BC6H_SEG(BZ, 3, 1), BC6H_SEG(BZ, 5, 1), BC6H_SEG(BZ, 4, 1), BC6H_SEG(RX, 0, 6), BC6H_SEG(GY, 0, 4), BC6H_SEG(GX, 0, 6),
+         BC6H_SEG(GZ, 0, 4), BC6H_SEG(BX, 0, 6), BC6H_SEG(BY, 0, 4), BC6H_SEG(RY, 0, 6), BC6H_SEG(RZ, 0, 6), BC6H_SEG(D, 0, 5) } },
+      { 0x03, 1, 0, 10, { 10, 10, 10 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 10), BC6H_SEG(GX, 0, 10), BC6H_SEG(BX, 0, 10) } },
+      { 0x07, 1, 1, 11, { 9, 9, 9 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 9), BC6H_SEG(RW, 10, 1), BC6H_SEG(GX, 0, 9),
+         BC6H_SEG(GW, 10, 1), BC6H_SEG(BX, 0, 9), BC6H_SEG(BW, 10, 1) } },
+      { 0x0B, 1, 1, 12, { 8, 8, 8 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10), BC6H_SEG(RX, 0, 8), BC6H_SEG(RW, 11, 1), BC6H_SEG(RW, 10, 1),
+         BC6H_SEG(GX, 0, 8), BC6H_SEG(GW, 11, 1), BC6H_SEG(GW, 10, 1), BC6H_SEG(BX, 0, 8), BC6H_SEG(BW, 11, 1), BC6H_SEG(BW, 10, 1) } },
+      { 0x0F, 1, 1, 16, { 4, 4, 4 }, {
+         BC6H_SEG(RW, 0, 10), BC6H_SEG(GW, 0, 10), BC6H_SEG(BW, 0, 10),
+         BC6H_SEG(RX, 0, 4), BC6H_SEG(RW, 15, 1), BC6H_SEG(RW, 14, 1), BC6H_SEG(RW, 13, 1), BC6H_SEG(RW, 12, 1), BC6H_SEG(RW, 11, 1), BC6H_SEG(RW, 10, 1),
+         BC6H_SEG(GX, 0, 4), BC6H_SEG(GW, 15, 1), BC6H_SEG(GW, 14, 1), BC6H_SEG(GW, 13, 1), BC6H_SEG(GW, 12, 1), BC6H_SEG(GW, 11, 1), BC6H_SEG(GW, 10, 1),
+         BC6H_SEG(BX, 0, 4), BC6H_SEG(BW, 15, 1), BC6H_SEG(BW, 14, 1), BC6H_SEG(BW, 13, 1), BC6H_SEG(BW, 12, 1), BC6H_SEG(BW, 11, 1), BC6H_SEG(BW, 10, 1) } }
+   };
+
+   #undef BC6H_SEG
+
+   // Reads the bits of a 128-bit block from the least significant bit upwards.
+   class bptc_bit_reader
+   {
+   public:
+      explicit bptc_bit_reader(const void* pBlock) :
+         m_lo(0),
+         m_hi(0),
+         m_bit_ofs(0)
+      {
+         const uint8* pBytes = static_cast<const uint8*>(pBlock);
+         for (uint i = 0; i < 8; i++)
+         {
+            m_lo |= static_cast<uint64>(pBytes[i]) << (i * 8U);
+            m_hi |= static_cast<uint64>(pBytes[i + 8]) << (i * 8U);
+         }
+      }
+
+      inline uint get_bits(uint num_bits)
+      {
+         CRNLIB_ASSERT((num_bits <= 16) && ((m_bit_ofs + num_bits) <= 128));
+
+         uint64 v;
+         if (m_bit_ofs >= 64)
+            v = m_hi >> (m_bit_ofs - 64);
+         else if (m_bit_ofs)
+            v = (m_lo >> m_bit_ofs) | (m_hi << (64 - m_bit_ofs));
+         else
+            v = m_lo;
+
+         m_bit_ofs += num_bits;
+         return static_cast<uint>(v) & ((1U << num_bits) - 1U);
+      }
+
+   private:
+      uint64 m_lo;
+      uint64 m_hi;
+      uint m_bit_ofs;
+   };
+
+   // Interpolates the palette of 4, 8 or 16 colors between two RGBA endpoints.
+   static inline void bc7_interpolate(const color_quad_u8& e0, const color_quad_u8& e1, uint index_bits, color_quad_u8* pPalette)
+   {
+      const uint8* pWeights = g_bptc_weights[index_bits];
+      const uint num_colors = 1U << index_bits;
+
+#if CRNLIB_BPTC_SSE2
+      // Two palette entries per iteration, each channel as a 16-bit lane. The sums do not exceed 255 * 64 + 32.
+      const __m128i zero = _mm_setzero_si128();
+      __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(e0.m_u32)), zero);
+      __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(e1.m_u32)), zero);
+      a = _mm_unpacklo_epi64(a, a);
+      b = _mm_unpacklo_epi64(b, b);
+
+      const __m128i total = _mm_set1_epi16(64);
+      const __m128i round = _mm_set1_epi16(32);
+
+      for (uint i = 0; i < num_colors; i += 2)
+      {
+         const __m128i w = _mm_unpacklo_epi64(_mm_set1_epi16(pWeights[i]), _mm_set1_epi16(pWeights[i + 1]));
+         __m128i c = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(total, w)), _mm_mullo_epi16(b, w));
+         c = _mm_srli_epi16(_mm_add_epi16(c, round), 6);
+         _mm_storel_epi64(reinterpret_cast<__m128i*>(pPalette + i), _mm_packus_epi16(c, c));
+      }
+#else
+      for (uint i = 0; i < num_colors; i++)
+      {
+         const uint w = pWeights[i];
+         for (uint c = 0; c < 4; c++)
+            pPalette[i].c[c] = static_cast<uint8>(((64U - w) * e0.c[c] + w * e1.c[c] + 32U) >> 6);
+      }
+#endif
+   }
+
+   void unpack_bc7_block(const void* pBlock, color_quad_u8* pPixels)
+   {
+      const uint first_byte = static_cast<const uint8*>(pBlock)[0];
+      if (!first_byte)
+      {
+         for (uint i = 0; i < 16; i++)
+            pPixels[i].clear();
+         return;
+      }
+
+      uint mode = 0;
+      while (!(first_byte & (1U << mode)))
+         mode++;
+
+      const bc7_mode_info& info = g_bc7_modes[mode];
+
+      bptc_bit_reader reader(pBlock);
+      reader.get_bits(mode + 1);
+
+      const uint partition = reader.get_bits(info.m_partition_bits);
+      const uint rotation = reader.get_bits(info.m_rotation_bits);
+      const uint index_selection = reader.get_bits(info.m_index_selection_bits);
+
+      const uint num_endpoints = info.m_num_subsets * 2;
+      color_quad_u8 endpoints[6];
+
+      for (uint c = 0; c < 4; c++)
+      {
+         const uint bits = (c < 3) ? info.m_color_bits : info.m_alpha_bits;
+         for (uint i = 0; i < num_endpoints; i++)
+            endpoints[i].c[c] = static_cast<uint8>(bits ? reader.get_bits(bits) : 255U);
+      }
+
+      uint pbits[6] = { 0, 0, 0, 0, 0, 0 };
+      const uint num_pbits = (info.m_endpoint_pbits || info.m_shared_pbits) ? 1 : 0;
+      if (info.m_endpoint_pbits)
+      {
+         for (uint i = 0; i < num_endpoints; i++)
+            pbits[i] = reader.get_bits(1);
+      }
+      else if (info.m_shared_pbits)
+      {
+         for (uint s = 0; s < info.m_num_subsets; s++)
+            pbits[s * 2] = pbits[s * 2 + 1] = reader.get_bits(1);
+      }
+
+      // Appends the p-bit and replicates the high bits into the low bits of each 8-bit component
+      for (uint c = 0; c < 4; c++)
+      {
+         const uint bits = ((c < 3) ? info.m_color_bits : info.m_alpha_bits);
+         if (!bits)
+            continue;
+
+         const uint total_bits = bits + num_pbits;
+         for (uint i = 0; i < num_endpoints; i++)
+         {
+            uint v = (endpoints[i].c[c] << num_pbits) | pbits[i];
+            v <<= (8 - total_bits);
+            endpoints[i].c[c] = static_cast<uint8>(v | (v >> total_bits));
+         }
+      }
+
+      uint anchor1 = 16, anchor2 = 16;
+      if (info.m_num_subsets == 2)
+         anchor1 = g_bptc_anchors2[partition];
+      else if (info.m_num_subsets == 3)
+      {
+         anchor1 = g_bc7_anchors3[0][partition];
+         anchor2 = g_bc7_anchors3[1][partition];
+      }
+
+      uint8 indices[16];
+      for (uint i = 0; i < 16; i++)
+      {
+         const uint is_anchor = ((!i) || (i == anchor1) || (i == anchor2)) ? 1 : 0;
+         indices[i] = static_cast<uint8>(reader.get_bits(info.m_index_bits - is_anchor));
+      }
+
+      uint8 indices2[16];
+      if (info.m_index2_bits)
+      {
+         for (uint i = 0; i < 16; i++)
+            indices2[i] = static_cast<uint8>(reader.get_bits(info.m_index2_bits - (i ? 0 : 1)));
+      }
+
+      color_quad_u8 palettes[3][16];
+      color_quad_u8 alpha_palette[16];
+
+      if (info.m_index2_bits)
+      {
+         // Separate color and alpha indices of a single subset, index_selection swaps their roles
+         const uint8* pColor_indices = index_selection ? indices2 : indices;
+         const uint8* pAlpha_indices = index_selection ? indices : indices2;
+
+         bc7_interpolate(endpoints[0], endpoints[1], index_selection ? info.m_index2_bits : info.m_index_bits, palettes[0]);
+         bc7_interpolate(endpoints[0], endpoints[1], index_selection ? info.m_index_bits : info.m_index2_bits, alpha_palette);
+
+         for (uint i = 0; i < 16; i++)
+         {
+            pPixels[i] = palettes[0][pColor_indices[i]];
+            pPixels[i].a = alpha_palette[pAlpha_indices[i]].a;
+         }
+      }
+      else
+      {
+         for (uint s = 0; s < info.m_num_subsets; s++)
+            bc7_interpolate(endpoints[s * 2], endpoints[s * 2 + 1], info.m_index_bits, palettes[s]);
+
+         if (info.m_num_subsets == 1)
+         {
+            for (uint i = 0; i < 16; i++)
+               pPixels[i] = palettes[0][indices[i]];
+         }
+         else if (info.m_num_subsets == 2)
+         {
+            const uint subsets = g_bptc_partitions2[partition];
+            for (uint i = 0; i < 16; i++)
+               pPixels[i] = palettes[(subsets >> i) & 1][indices[i]];
+         }
+         else
+         {
+            const uint32 subsets = g_bc7_partitions3[partition];
+            for (uint i = 0; i < 16; i++)
+               pPixels[i] = palettes[(subsets >> (i * 2)) & 3][indices[i]];
+         }
+      }
+
+      if (rotation)
+      {
+         for (uint i = 0; i < 16; i++)
+            utils::swap(pPixels[i].a, pPixels[i].c[rotation - 1]);
+      }
+   }
+
+   static inline int bc6h_sign_extend(int v, uint bits)
+   {
+      const int sign = 1 << (bits - 1);
+      return (v & (sign - 1)) - (v & sign);
+   }
+
+   // Expands an endpoint to 16 bits (17 bits with sign)
+   static inline int bc6h_unquantize(int v, uint bits, bool is_signed)
+   {
+      if (!is_signed)
+      {
+         if (bits >= 15)
+            return v;
+         if (!v)
+            return 0;
+         if (v == ((1 << bits) - 1))
+            return 0xFFFF;
+         return ((v << 16) + 0x8000) >> bits;
+      }
+
+      if (bits >= 16)
+         return v;
+
+      const bool negative = v < 0;
+      if (negative)
+         v = -v;
+
+      int q;
+      if (!v)
+         q = 0;
+      else if (v >= ((1 << (bits - 1)) - 1))
+         q = 0x7FFF;
+      else
+         q = ((v << 15) + 0x4000) >> (bits - 1);
+
+      return negative ? -q : q;
+   }
+
+   // Scales an interpolated value to the bit pattern of a half float
+   static inline uint16 bc6h_finish_unquantize(int v, bool is_signed)
+   {
+      if (!is_signed)
+         return static_cast<uint16>((v * 31) >> 6);
+
+      if (v < 0)
+         return static_cast<uint16>(0x8000 | (((-v) * 31) >> 5));
+
+      return static_cast<uint16>((v * 31) >> 5);
+   }
+
+   void unpack_bc6h_block(const void* pBlock, uint16* pHalfs, bool is_signed)
+   {
+      bptc_bit_reader reader(pBlock);
+
+      uint mode = reader.get_bits(2);
+      if (mode > 1)
+         mode |= reader.get_bits(3) << 2;
+
+      const bc6h_mode_info* pInfo = NULL;
+      for (uint i = 0; i < CRNLIB_ARRAY_SIZE(g_bc6h_modes); i++)
+      {
+         if (g_bc6h_modes[i].m_mode == mode)
+         {
+            pInfo = &g_bc6h_modes[i];
+            break;
+         }
+      }
+
+      if (!pInfo)
+      {
+         memset(pHalfs, 0, sizeof(uint16) * 16 * 3);
+         return;
+      }
+
+      int fields[cBC6HNumFields];
+      memset(fields, 0, sizeof(fields));
+
+      for (uint i = 0; (i < cBC6HMaxSegments) && (pInfo->m_segments[i].m_count); i++)
+      {
+         const bc6h_segment& seg = pInfo->m_segments[i];
+         fields[seg.m_field] |= static_cast<int>(reader.get_bits(seg.m_count) << seg.m_shift);
+      }
+
+      const uint num_endpoints = pInfo->m_num_subsets * 2;
+      const uint bits = pInfo->m_endpoint_bits;
+      const int mask = (1 << bits) - 1;
+
+      int endpoints[4][3];
+      for (uint c = 0; c < 3; c++)
+      {
+         endpoints[0][c] = is_signed ? bc6h_sign_extend(fields[c], bits) : fields[c];
+
+         // The other endpoints are either stored as deltas to the base endpoint or directly
+         for (uint i = 1; i < num_endpoints; i++)
+         {
+            int v = fields[i * 3 + c];
+            if (pInfo->m_transformed)
+               v = (endpoints[0][c] + bc6h_sign_extend(v, pInfo->m_delta_bits[c])) & mask;
+            endpoints[i][c] = is_signed ? bc6h_sign_extend(v, bits) : v;
+         }
+
+         for (uint i = 0; i < num_endpoints; i++)
+            endpoints[i][c] = bc6h_unquantize(endpoints[i][c], bits, is_signed);
+      }
+
+      const uint partition = static_cast<uint>(fields[cBC6H_D]);
+      const uint subsets = (pInfo->m_num_subsets == 2) ? g_bptc_partitions2[partition] : 0;
+      const uint anchor = (pInfo->m_num_subsets == 2) ? g_bptc_anchors2[partition] : 0;
+      const uint index_bits = (pInfo->m_num_subsets == 2) ? 3 : 4;
+      const uint8* pWeights = g_bptc_weights[index_bits];
+
+      for (uint i = 0; i < 16; i++)
+      {
+         const uint is_anchor = ((!i) || (i == anchor)) ? 1 : 0;
+         const uint w = pWeights[reader.get_bits(index_bits - is_anchor)];
+         const int* pE0 = endpoints[((subsets >> i) & 1) * 2];
+         const int* pE1 = endpoints[((subsets >> i) & 1) * 2 + 1];
+
+         for (uint c = 0; c < 3; c++)
+            pHalfs[i * 3 + c] = bc6h_finish_unquantize((pE0[c] * static_cast<int>(64 - w) + pE1[c] * static_cast<int>(w) + 32) >> 6, is_signed);
+      }
+   }
+
+   // Minimum number of pixels before the rows of blocks are distributed across threads
+   const uint cBPTCMinPixelsForThreads = 256 * 256;
+
+   struct bptc_unpack_params
+   {
+      image_u8*               m_pImage;
+      const uint8*            m_pBlocks;
+      bptc_format             m_format;
+      const hdr_tone_mapper*  m_pTone_mapper;
+      uint                    m_blocks_x;
+      uint                    m_blocks_y;
+      uint                    m_rows_per_task;
+   };
+
+   static void unpack_bptc_block_rows(const bptc_unpack_params& params, uint first_block_y, uint num_block_rows)
+   {
+      image_u8& img = *params.m_pImage;
+      const bool is_signed = (params.m_format == cBPTC_BC6H_SF16);
+
+      color_quad_u8 pixels[16];
+      uint16 halfs[16 * 3];
+      float colors[16 * 3];
+
+      for (uint block_y = first_block_y; block_y < (first_block_y + num_block_rows); block_y++)
+      {
+         const uint8* pBlock = params.m_pBlocks + (block_y * params.m_blocks_x) * cBPTCBytesPerBlock;
+         const uint limit_y = math::minimum<uint>(4, img.get_height() - block_y * 4);
+
+         for (uint block_x = 0; block_x < params.m_blocks_x; block_x++, pBlock += cBPTCBytesPerBlock)
+         {
+            if (params.m_format == cBPTC_BC7)
+               unpack_bc7_block(pBlock, pixels);
+            else
+            {
+               unpack_bc6h_block(pBlock, halfs, is_signed);
+               half_to_float(colors, halfs, 16 * 3);
+               params.m_pTone_mapper->map_row(pixels, colors, 16, 3);
+            }
+
+            const uint limit_x = math::minimum<uint>(4, img.get_width() - block_x * 4);
+            for (uint y = 0; y < limit_y; y++)
+            {
+               color_quad_u8* pDst = img.get_scanline(block_y * 4 + y) + block_x * 4;
+               for (uint x = 0; x < limit_x; x++)
+                  pDst[x] = pixels[y * 4 + x];
+            }
+         }
+      }
+   }
+
+   static void unpack_bptc_task(uint64 data, void* pData_ptr)
+   {
+      const bptc_unpack_params* pParams = static_cast<const bptc_unpack_params*>(pData_ptr);
+
+      const uint first_block_y = static_cast<uint>(data) * pParams->m_rows_per_task;
+      const uint num_block_rows = math::minimum<uint>(pParams->m_rows_per_task, pParams->m_blocks_y - first_block_y);
+
+      unpack_bptc_block_rows(*pParams, first_block_y, num_block_rows);
+   }
+
+   bool unpack_bptc_image(image_u8& img, const uint8* pBlocks, bptc_format fmt, task_pool* pTask_pool)
+   {
+      if ((!pBlocks) || (fmt == cBPTCInvalid) || (!img.get_width()) || (!img.get_height()))
+         return false;
+
+      // BC6H is tone mapped with the same table as floating point textures
+      hdr_tone_mapper tone_mapper;
+      if (fmt != cBPTC_BC7)
+         tone_mapper.init();
+
+      bptc_unpack_params params;
+      params.m_pImage = &img;
+      params.m_pBlocks = pBlocks;
+      params.m_format = fmt;
+      params.m_pTone_mapper = &tone_mapper;
+      params.m_blocks_x = (img.get_width() + 3) >> 2;
+      params.m_blocks_y = (img.get_height() + 3) >> 2;
+      params.m_rows_per_task = params.m_blocks_y;
+
+      const uint num_threads = pTask_pool ? (pTask_pool->get_num_threads() + 1) : 1;
+      if ((num_threads == 1) || (params.m_blocks_y < 2) || ((img.get_width() * img.get_height()) < cBPTCMinPixelsForThreads))
+      {
+         unpack_bptc_block_rows(params, 0, params.m_blocks_y);
+         return true;
+      }
+
+      // Several tasks per thread even out rows of different complexity
+      params.m_rows_per_task = math::maximum<uint>(1U, (params.m_blocks_y + num_threads * 4 - 1) / (num_threads * 4));
+
+      const uint num_tasks = (params.m_blocks_y + params.m_rows_per_task - 1) / params.m_rows_per_task;
+      for (uint i = 0; i < num_tasks; i++)
+      {
+         if (!pTask_pool->queue_task(unpack_bptc_task, i, &params))
+            unpack_bptc_task(i, &params);
+      }
+
+      pTask_pool->join();
+
+      return true;
+   }
+
+} // namespace crnlib
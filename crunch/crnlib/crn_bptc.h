@@ -0,0 +1,33 @@
+// File: crn_bptc.h
+// This software is in the public domain. Please see license.txt.
+#pragma once
+#include "crn_image.h"
+
+namespace crnlib
+{
+   class task_pool;
+
+   enum bptc_format
+   {
+      cBPTCInvalid = -1,
+
+      cBPTC_BC6H_UF16,
+      cBPTC_BC6H_SF16,
+      cBPTC_BC7
+   };
+
+   const uint cBPTCBytesPerBlock = 16U;
+
+   // Decodes a BC7 block into 16 RGBA pixels. Reserved modes decode to transparent black.
+   void unpack_bc7_block(const void* pBlock, color_quad_u8* pPixels);
+
+   // Decodes a BC6H block into 16 RGB pixels of 3 half floats each. Reserved modes decode to black.
+   void unpack_bc6h_block(const void* pBlock, uint16* pHalfs, bool is_signed);
+
+   // Decodes the blocks of a BC6H or BC7 image into img, which must already have the size of the image.
+   // BC6H is tone mapped for display: negative values are dropped, values above 1.0 are clamped and
+   // the result is gamma corrected to sRGB. With a task pool, the rows of blocks of large images are
+   // decoded in parallel.
+   bool unpack_bptc_image(image_u8& img, const uint8* pBlocks, bptc_format fmt, task_pool* pTask_pool = NULL);
+
+} // namespace crnlib
@@ -23,6 +23,14 @@
 #include "crn_etc.h"
 #define CRNLIB_USE_RG_ETC1 1
 
+// SSE2 is part of the x64 baseline and is enabled by default for 32-bit x86 builds since VS2012 (/arch:SSE2).
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #define CRNLIB_DXT_UNPACK_SSE2 1
+   #include <emmintrin.h>
+#else
+   #define CRNLIB_DXT_UNPACK_SSE2 0
+#endif
+
 namespace crnlib
 {
    dxt_image::dxt_image() :
@@ -493,6 +501,244 @@ namespace crnlib
       return true;
    }
 
+   // Minimum number of pixels before unpack() distributes the rows of blocks across threads.
+   const uint cUnpackMinPixelsForThreads = 512 * 512;
+
+   struct dxt_image::unpack_task_params
+   {
+      const dxt_image*  m_pImage;
+      uint8*            m_pDst;
+      int               m_pitch;
+      bool              m_bgra;
+      uint              m_rows_per_task;
+      atomic32_t        m_failed;
+   };
+
+   // Returns the bit position of a color component in a 32-bit pixel read from memory.
+   static inline uint get_unpack_component_shift(uint comp_index, bool bgra)
+   {
+      static const uint8 s_bgra_ofs[4] = { 2, 1, 0, 3 };
+      const uint ofs = bgra ? s_bgra_ofs[comp_index] : comp_index;
+      return c_crnlib_little_endian_platform ? (ofs * 8U) : (24U - ofs * 8U);
+   }
+
+   // Expands the selectors of a DXT1 block. Only the bits of the pixels in color_mask are replaced.
+   static inline void unpack_dxt1_pixels(uint32* pPixels, const dxt1_block* pBlock, const uint32* pColors, uint32 color_mask)
+   {
+#if CRNLIB_DXT_UNPACK_SSE2
+      const __m128i mask = _mm_set1_epi32(static_cast<int>(color_mask));
+      const __m128i c0 = _mm_set1_epi32(static_cast<int>(pColors[0]));
+      const __m128i c1 = _mm_set1_epi32(static_cast<int>(pColors[1]));
+      const __m128i c2 = _mm_set1_epi32(static_cast<int>(pColors[2]));
+      const __m128i c3 = _mm_set1_epi32(static_cast<int>(pColors[3]));
+      // Multiplying moves the selector of pixel x to bits 6-7 of 32-bit lane x, after the shift they are the low bits
+      const __m128i shift_mul = _mm_setr_epi16(64, 64, 16, 16, 4, 4, 1, 1);
+      const __m128i sel_mask = _mm_set1_epi32(3);
+
+      for (uint y = 0; y < cDXTBlockSize; y++)
+      {
+         __m128i sel = _mm_set1_epi16(pBlock->m_selectors[y]);
+         sel = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(sel, shift_mul), 6), sel_mask);
+
+         __m128i c = _mm_and_si128(_mm_cmpeq_epi32(sel, _mm_setzero_si128()), c0);
+         c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(sel, _mm_set1_epi32(1)), c1));
+         c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(sel, _mm_set1_epi32(2)), c2));
+         c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(sel, sel_mask), c3));
+
+         __m128i* pRow = reinterpret_cast<__m128i*>(pPixels + y * cDXTBlockSize);
+         _mm_storeu_si128(pRow, _mm_or_si128(_mm_andnot_si128(mask, _mm_loadu_si128(pRow)), _mm_and_si128(mask, c)));
+      }
+#else
+      for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++)
+      {
+         const uint s = (pBlock->m_selectors[i >> 2] >> ((i & 3) * cDXT1SelectorBits)) & cDXT1SelectorMask;
+         pPixels[i] = (pPixels[i] & ~color_mask) | (pColors[s] & color_mask);
+      }
+#endif
+   }
+
+   // Stores 16 component values at the given bit position of the pixels.
+   static inline void unpack_component_values(uint32* pPixels, const uint* pValues, uint shift)
+   {
+#if CRNLIB_DXT_UNPACK_SSE2
+      const __m128i mask = _mm_set1_epi32(static_cast<int>(0xFFU << shift));
+      const __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+
+      for (uint y = 0; y < cDXTBlockSize; y++)
+      {
+         const uint* p = pValues + y * cDXTBlockSize;
+         const __m128i v = _mm_sll_epi32(_mm_setr_epi32(p[0], p[1], p[2], p[3]), count);
+
+         __m128i* pRow = reinterpret_cast<__m128i*>(pPixels + y * cDXTBlockSize);
+         _mm_storeu_si128(pRow, _mm_or_si128(_mm_andnot_si128(mask, _mm_loadu_si128(pRow)), v));
+      }
+#else
+      const uint32 mask = 0xFFU << shift;
+      for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++)
+         pPixels[i] = (pPixels[i] & ~mask) | (pValues[i] << shift);
+#endif
+   }
+
+   bool dxt_image::unpack(uint8* pDst, int pitch, bool bgra, task_pool* pTask_pool) const
+   {
+      if ((!m_total_elements) || (!pDst))
+         return false;
+
+      const uint num_threads = pTask_pool ? (pTask_pool->get_num_threads() + 1) : 1;
+      if ((num_threads == 1) || (m_blocks_y < 2) || ((m_width * m_height) < cUnpackMinPixelsForThreads))
+         return unpack_block_rows(0, m_blocks_y, pDst, pitch, bgra);
+
+      // Several tasks per thread even out rows of different complexity
+      unpack_task_params params;
+      params.m_pImage = this;
+      params.m_pDst = pDst;
+      params.m_pitch = pitch;
+      params.m_bgra = bgra;
+      params.m_rows_per_task = math::maximum<uint>(1U, (m_blocks_y + num_threads * 4 - 1) / (num_threads * 4));
+      params.m_failed = 0;
+
+      const uint num_tasks = (m_blocks_y + params.m_rows_per_task - 1) / params.m_rows_per_task;
+      for (uint i = 0; i < num_tasks; i++)
+      {
+         if (!pTask_pool->queue_task(unpack_task, i, &params))
+            unpack_task(i, &params);
+      }
+
+      pTask_pool->join();
+
+      return !params.m_failed;
+   }
+
+   void dxt_image::unpack_task(uint64 data, void* pData_ptr)
+   {
+      unpack_task_params* pParams = static_cast<unpack_task_params*>(pData_ptr);
+      const dxt_image* pImage = pParams->m_pImage;
+
+      const uint first_block_y = static_cast<uint>(data) * pParams->m_rows_per_task;
+      const uint num_block_rows = math::minimum<uint>(pParams->m_rows_per_task, pImage->m_blocks_y - first_block_y);
+
+      if (!pImage->unpack_block_rows(first_block_y, num_block_rows, pParams->m_pDst, pParams->m_pitch, pParams->m_bgra))
+         atomic_exchange32(&pParams->m_failed, 1);
+   }
+
+   bool dxt_image::unpack_block_rows(uint first_block_y, uint num_block_rows, uint8* pDst, int pitch, bool bgra) const
+   {
+      const uint red_shift = get_unpack_component_shift(0, bgra);
+      const uint green_shift = get_unpack_component_shift(1, bgra);
+      const uint blue_shift = get_unpack_component_shift(2, bgra);
+      const uint alpha_shift = get_unpack_component_shift(3, bgra);
+      const uint32 default_pixel = 0xFFU << alpha_shift;
+      const uint32 color_mask = (m_format <= cDXT1A) ? 0xFFFFFFFFU : ~default_pixel;
+
+      uint comp_shift[2] = { 0, 0 };
+      bool generic = false;
+      for (uint element_index = 0; element_index < m_num_elements_per_block; element_index++)
+      {
+         if (m_element_component_index[element_index] >= 0)
+            comp_shift[element_index] = get_unpack_component_shift(m_element_component_index[element_index], bgra);
+         if ((m_element_type[element_index] != cColorDXT1) && (m_element_type[element_index] != cAlphaDXT3) && (m_element_type[element_index] != cAlphaDXT5))
+            generic = true;
+      }
+
+      bool success = true;
+      uint32 pixels[cDXTBlockSize * cDXTBlockSize];
+      color_quad_u8 colors[cDXT1SelectorValues];
+      uint32 packed_colors[cDXT1SelectorValues];
+      uint values[cDXTBlockSize * cDXTBlockSize];
+      uint block_values[cDXT5SelectorValues];
+
+      for (uint block_y = first_block_y; block_y < first_block_y + num_block_rows; block_y++)
+      {
+         const uint pixel_ofs_y = block_y * cDXTBlockSize;
+         const uint limit_y = math::minimum<uint>(cDXTBlockSize, m_height - pixel_ofs_y);
+
+         for (uint block_x = 0; block_x < m_blocks_x; block_x++)
+         {
+            for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++)
+               pixels[i] = default_pixel;
+
+            if (generic)
+            {
+               // Formats without a dedicated kernel (ETC1)
+               color_quad_u8 block_pixels[cDXTBlockSize * cDXTBlockSize];
+               for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++)
+                  block_pixels[i].set(0, 0, 0, 255);
+
+               if (!get_block_pixels(block_x, block_y, block_pixels))
+                  success = false;
+
+               for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++)
+               {
+                  const color_quad_u8& c = block_pixels[i];
+                  pixels[i] = (c.r << red_shift) | (c.g << green_shift) | (c.b << blue_shift) | (c.a << alpha_shift);
+               }
+            }
+            else
+            {
+               const element* pElement = &get_element(block_x, block_y, 0);
+
+               for (uint element_index = 0; element_index < m_num_elements_per_block; element_index++, pElement++)
+               {
+                  switch (m_element_type[element_index])
+                  {
+                     case cColorDXT1:
+                     {
+                        const dxt1_block* pDXT1_block = reinterpret_cast<const dxt1_block*>(pElement);
+                        dxt1_block::get_block_colors(colors, static_cast<uint16>(pDXT1_block->get_low_color()), static_cast<uint16>(pDXT1_block->get_high_color()));
+
+                        for (uint i = 0; i < cDXT1SelectorValues; i++)
+                        {
+                           packed_colors[i] = (colors[i].r << red_shift) | (colors[i].g << green_shift) | (colors[i].b << blue_shift) | (colors[i].a << alpha_shift);
+                        }
+
+                        unpack_dxt1_pixels(pixels, pDXT1_block, packed_colors, color_mask);
+                        break;
+                     }
+                     case cAlphaDXT5:
+                     {
+                        const dxt5_block* pDXT5_block = reinterpret_cast<const dxt5_block*>(pElement);
+                        dxt5_block::get_block_values(block_values, pDXT5_block->get_low_alpha(), pDXT5_block->get_high_alpha());
+
+                        uint64 sel = 0;
+                        for (uint i = 0; i < dxt5_block::cNumSelectorBytes; i++)
+                           sel |= static_cast<uint64>(pDXT5_block->m_selectors[i]) << (i * 8U);
+
+                        for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i++, sel >>= cDXT5SelectorBits)
+                           values[i] = block_values[static_cast<uint>(sel) & cDXT5SelectorMask];
+
+                        unpack_component_values(pixels, values, comp_shift[element_index]);
+                        break;
+                     }
+                     case cAlphaDXT3:
+                     {
+                        const dxt3_block* pDXT3_block = reinterpret_cast<const dxt3_block*>(pElement);
+
+                        for (uint i = 0; i < cDXTBlockSize * cDXTBlockSize; i += 2)
+                        {
+                           const uint a = pDXT3_block->m_alpha[i >> 1];
+                           values[i] = (a & 0xF) * 17;
+                           values[i + 1] = (a >> 4) * 17;
+                        }
+
+                        unpack_component_values(pixels, values, comp_shift[element_index]);
+                        break;
+                     }
+                     default: break;
+                  }
+               }
+            }
+
+            const uint pixel_ofs_x = block_x * cDXTBlockSize;
+            const uint limit_x = math::minimum<uint>(cDXTBlockSize, m_width - pixel_ofs_x);
+
+            for (uint y = 0; y < limit_y; y++)
+               memcpy(pDst + (ptrdiff_t)pitch * (pixel_ofs_y + y) + pixel_ofs_x * 4, &pixels[y * cDXTBlockSize], limit_x * 4);
+         }
+      }
+
+      return success;
+   }
+
    void dxt_image::endian_swap()
    {
       utils::endian_switch_words(reinterpret_cast<uint16*>(m_elements.get_ptr()), m_elements.size_in_bytes() / sizeof(uint16));
@@ -153,6 +153,11 @@ namespace crnlib
       bool init(dxt_format fmt, const image_u8& img, const pack_params& p = dxt_image::pack_params());
       
       bool unpack(image_u8& img) const;
+
+      // Unpacks the image straight into 32-bit pixels supplied by the caller. pitch is the distance in bytes between two
+      // pixel rows and may be negative. Components not stored in the image are set to 0 (alpha to 255). If bgra is true,
+      // the pixels are stored in BGRA instead of RGBA order. The rows of blocks are split across the threads of pTask_pool.
+      bool unpack(uint8* pDst, int pitch, bool bgra, task_pool* pTask_pool = NULL) const;
       
       void endian_swap();
       
@@ -237,6 +242,11 @@ namespace crnlib
       bool init_internal(dxt_format fmt, uint width, uint height);
       void init_task(uint64 data, void* pData_ptr);
 
+      struct unpack_task_params;
+
+      bool unpack_block_rows(uint first_block_y, uint num_block_rows, uint8* pDst, int pitch, bool bgra) const;
+      static void unpack_task(uint64 data, void* pData_ptr);
+
 #if CRNLIB_SUPPORT_ATI_COMPRESS   
       bool init_ati_compress(dxt_format fmt, const image_u8& img, const pack_params& p);
 #endif      
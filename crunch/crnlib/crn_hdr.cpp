@@ -0,0 +1,321 @@
+// File: crn_hdr.cpp
+// This software is in the public domain. Please see license.txt.
+// Conversion of floating point (half and single precision) textures to 8-bit RGBA for display.
+#include "crn_core.h"
+#include "crn_hdr.h"
+#include "crn_threading.h"
+
+// SSE2 is part of the x64 baseline and is enabled by default for 32-bit x86 builds since VS2012 (/arch:SSE2).
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #define CRNLIB_HDR_SSE2 1
+   #include <emmintrin.h>
+#else
+   #define CRNLIB_HDR_SSE2 0
+#endif
+
+namespace crnlib
+{
+   // Minimum number of pixels before the rows are distributed across threads
+   const uint cHDRMinPixelsForThreads = 256 * 256;
+
+   // Number of channel values tone mapped at once, a multiple of 1, 2, 3 and 4 channels per pixel
+   const uint cHDRChunkSize = 240;
+
+   static inline float bits_to_float(uint32 bits)
+   {
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      return f;
+   }
+
+   static inline uint32 float_to_bits(float f)
+   {
+      uint32 bits;
+      memcpy(&bits, &f, sizeof(bits));
+      return bits;
+   }
+
+   uint get_hdr_num_channels(hdr_format fmt)
+   {
+      switch (fmt)
+      {
+         case cHDR_R16F:    return 1;
+         case cHDR_RG16F:   return 2;
+         case cHDR_RGBA16F: return 4;
+         case cHDR_R32F:    return 1;
+         case cHDR_RG32F:   return 2;
+         case cHDR_RGB32F:  return 3;
+         case cHDR_RGBA32F: return 4;
+         default: break;
+      }
+      CRNLIB_ASSERT(false);
+      return 0;
+   }
+
+   uint get_hdr_bytes_per_pixel(hdr_format fmt)
+   {
+      switch (fmt)
+      {
+         case cHDR_R16F:    return 2;
+         case cHDR_RG16F:   return 4;
+         case cHDR_RGBA16F: return 8;
+         case cHDR_R32F:    return 4;
+         case cHDR_RG32F:   return 8;
+         case cHDR_RGB32F:  return 12;
+         case cHDR_RGBA32F: return 16;
+         default: break;
+      }
+      CRNLIB_ASSERT(false);
+      return 0;
+   }
+
+   static inline float half_to_float(uint16 h)
+   {
+      const uint32 sign = static_cast<uint32>(h & 0x8000U) << 16;
+      const uint exp = (h >> 10) & 0x1F;
+      uint mantissa = h & 0x3FF;
+
+      if (exp == 0x1F)
+         return bits_to_float(sign | 0x7F800000U | (mantissa << 13));
+      if (exp)
+         return bits_to_float(sign | ((exp + 127 - 15) << 23) | (mantissa << 13));
+      if (!mantissa)
+         return bits_to_float(sign);
+
+      // Denormals are normalized, each shift halves the value
+      uint e = 127 - 14;
+      while (!(mantissa & 0x400))
+      {
+         mantissa <<= 1;
+         e--;
+      }
+      return bits_to_float(sign | (e << 23) | ((mantissa & 0x3FF) << 13));
+   }
+
+#if CRNLIB_HDR_SSE2
+   // Converts four half floats in the lower 16 bits of each lane. Exponent and mantissa are shifted into
+   // place and rebiased by a multiplication with 2^112, which also normalizes denormals. Infinities and
+   // NaNs get the maximum exponent.
+   static inline __m128 half_to_float_sse2(__m128i h)
+   {
+      const __m128i exp_mantissa = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+      const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, exp_mantissa), 16);
+
+      const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exp_mantissa, 13)), _mm_castsi128_ps(_mm_set1_epi32((127 + 112) << 23)));
+      const __m128i inf_nan = _mm_and_si128(_mm_cmpgt_epi32(exp_mantissa, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(0x7F800000));
+
+      return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, inf_nan)));
+   }
+#endif
+
+   void half_to_float(float* pDst, const uint16* pSrc, uint n)
+   {
+      uint i = 0;
+
+#if CRNLIB_HDR_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      for ( ; (i + 8) <= n; i += 8)
+      {
+         const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+         _mm_storeu_ps(pDst + i, half_to_float_sse2(_mm_unpacklo_epi16(h, zero)));
+         _mm_storeu_ps(pDst + i + 4, half_to_float_sse2(_mm_unpackhi_epi16(h, zero)));
+      }
+#endif
+
+      for ( ; i < n; i++)
+         pDst[i] = half_to_float(pSrc[i]);
+   }
+
+   void hdr_tone_mapper::init()
+   {
+      for (uint h = 0; h <= cHalfOne; h++)
+      {
+         const float f = half_to_float(static_cast<uint16>(h));
+         const float s = (f <= 0.0031308f) ? (f * 12.92f) : (1.055f * powf(f, 1.0f / 2.4f) - 0.055f);
+         m_srgb[h] = static_cast<uint8>(math::clamp<int>(static_cast<int>(s * 255.0f + 0.5f), 0, 255));
+      }
+   }
+
+   // The table is indexed by the bit pattern of the largest half float not above the clamped value. Values
+   // below the smallest normalized half float (6.1e-5) map to 0, as do all denormals in the table.
+   void hdr_tone_mapper::map_values(uint8* pDst, const float* pSrc, uint n) const
+   {
+      uint i = 0;
+
+#if CRNLIB_HDR_SSE2
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128i rebias = _mm_set1_epi32((127 - 15) << 10);
+
+      for ( ; (i + 4) <= n; i += 4)
+      {
+         // The maximum returns its second operand for NaNs
+         const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pSrc + i), zero), one);
+
+         __m128i index = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(v), 13), rebias);
+         index = _mm_and_si128(index, _mm_cmpgt_epi32(index, _mm_castps_si128(zero)));
+
+         uint32 indices[4];
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), index);
+
+         pDst[i + 0] = m_srgb[indices[0]];
+         pDst[i + 1] = m_srgb[indices[1]];
+         pDst[i + 2] = m_srgb[indices[2]];
+         pDst[i + 3] = m_srgb[indices[3]];
+      }
+#endif
+
+      // Negative values and NaNs have bit patterns above infinity
+      for ( ; i < n; i++)
+      {
+         const uint32 bits = float_to_bits(pSrc[i]);
+         if (bits > 0x7F800000U)
+            pDst[i] = 0;
+         else if (bits >= 0x3F800000U)
+            pDst[i] = m_srgb[cHalfOne];
+         else
+            pDst[i] = m_srgb[math::maximum(static_cast<int>(bits >> 13) - ((127 - 15) << 10), 0)];
+      }
+   }
+
+   static inline uint8 float_to_alpha(float f)
+   {
+      const uint32 bits = float_to_bits(f);
+      if (bits > 0x7F800000U)
+         return 0;
+      if (bits >= 0x3F800000U)
+         return 255;
+      return static_cast<uint8>(static_cast<int>(f * 255.0f + 0.5f));
+   }
+
+   void hdr_tone_mapper::map_row(color_quad_u8* pDst, const float* pSrc, uint width, uint num_chans) const
+   {
+      CRNLIB_ASSERT((num_chans >= 1) && (num_chans <= 4));
+
+      // The alpha channel is mapped with the colors and replaced afterwards
+      uint8 values[cHDRChunkSize];
+      const uint pixels_per_chunk = cHDRChunkSize / num_chans;
+
+      for (uint x = 0; x < width; x += pixels_per_chunk)
+      {
+         const uint num_pixels = math::minimum(pixels_per_chunk, width - x);
+         const float* pChunk = pSrc + x * num_chans;
+         color_quad_u8* pPixels = pDst + x;
+
+         map_values(values, pChunk, num_pixels * num_chans);
+
+         switch (num_chans)
+         {
+            case 1:
+            {
+               for (uint i = 0; i < num_pixels; i++)
+                  pPixels[i].set_noclamp_rgba(values[i], 0, 0, 255);
+               break;
+            }
+            case 2:
+            {
+               for (uint i = 0; i < num_pixels; i++)
+                  pPixels[i].set_noclamp_rgba(values[i * 2], values[i * 2 + 1], 0, 255);
+               break;
+            }
+            case 3:
+            {
+               for (uint i = 0; i < num_pixels; i++)
+                  pPixels[i].set_noclamp_rgba(values[i * 3], values[i * 3 + 1], values[i * 3 + 2], 255);
+               break;
+            }
+            default:
+            {
+               for (uint i = 0; i < num_pixels; i++)
+                  pPixels[i].set_noclamp_rgba(values[i * 4], values[i * 4 + 1], values[i * 4 + 2], float_to_alpha(pChunk[i * 4 + 3]));
+               break;
+            }
+         }
+      }
+   }
+
+   struct hdr_unpack_params
+   {
+      image_u8*               m_pImage;
+      const uint8*            m_pPixels;
+      hdr_format              m_format;
+      const hdr_tone_mapper*  m_pTone_mapper;
+      uint                    m_rows_per_task;
+   };
+
+   static void unpack_hdr_rows(const hdr_unpack_params& params, uint first_row, uint num_rows)
+   {
+      image_u8& img = *params.m_pImage;
+      const uint width = img.get_width();
+      const uint num_chans = get_hdr_num_channels(params.m_format);
+      const uint row_size = width * get_hdr_bytes_per_pixel(params.m_format);
+      const bool is_half = (params.m_format <= cHDR_RGBA16F);
+
+      // Half float rows are converted into a row of floats first
+      crnlib::vector<float> row;
+      if (is_half)
+         row.resize(width * num_chans);
+
+      for (uint y = first_row; y < (first_row + num_rows); y++)
+      {
+         const uint8* pSrc = params.m_pPixels + y * row_size;
+
+         if (is_half)
+         {
+            half_to_float(row.get_ptr(), reinterpret_cast<const uint16*>(pSrc), width * num_chans);
+            params.m_pTone_mapper->map_row(img.get_scanline(y), row.get_ptr(), width, num_chans);
+         }
+         else
+            params.m_pTone_mapper->map_row(img.get_scanline(y), reinterpret_cast<const float*>(pSrc), width, num_chans);
+      }
+   }
+
+   static void unpack_hdr_task(uint64 data, void* pData_ptr)
+   {
+      const hdr_unpack_params* pParams = static_cast<const hdr_unpack_params*>(pData_ptr);
+
+      const uint first_row = static_cast<uint>(data) * pParams->m_rows_per_task;
+      const uint num_rows = math::minimum<uint>(pParams->m_rows_per_task, pParams->m_pImage->get_height() - first_row);
+
+      unpack_hdr_rows(*pParams, first_row, num_rows);
+   }
+
+   bool unpack_hdr_image(image_u8& img, const uint8* pPixels, hdr_format fmt, task_pool* pTask_pool)
+   {
+      if ((!pPixels) || (fmt == cHDRInvalid) || (!img.get_width()) || (!img.get_height()))
+         return false;
+
+      hdr_tone_mapper tone_mapper;
+      tone_mapper.init();
+
+      const uint height = img.get_height();
+
+      hdr_unpack_params params;
+      params.m_pImage = &img;
+      params.m_pPixels = pPixels;
+      params.m_format = fmt;
+      params.m_pTone_mapper = &tone_mapper;
+      params.m_rows_per_task = height;
+
+      const uint num_threads = pTask_pool ? (pTask_pool->get_num_threads() + 1) : 1;
+      if ((num_threads == 1) || (height < 2) || ((img.get_width() * height) < cHDRMinPixelsForThreads))
+      {
+         unpack_hdr_rows(params, 0, height);
+         return true;
+      }
+
+      params.m_rows_per_task = math::maximum<uint>(1U, (height + num_threads * 4 - 1) / (num_threads * 4));
+
+      const uint num_tasks = (height + params.m_rows_per_task - 1) / params.m_rows_per_task;
+      for (uint i = 0; i < num_tasks; i++)
+      {
+         if (!pTask_pool->queue_task(unpack_hdr_task, i, &params))
+            unpack_hdr_task(i, &params);
+      }
+
+      pTask_pool->join();
+
+      return true;
+   }
+
+} // namespace crnlib
@@ -0,0 +1,58 @@
+// File: crn_hdr.h
+// This software is in the public domain. Please see license.txt.
+#pragma once
+#include "crn_image.h"
+
+namespace crnlib
+{
+   class task_pool;
+
+   enum hdr_format
+   {
+      cHDRInvalid = -1,
+
+      cHDR_R16F,
+      cHDR_RG16F,
+      cHDR_RGBA16F,
+      cHDR_R32F,
+      cHDR_RG32F,
+      cHDR_RGB32F,
+      cHDR_RGBA32F
+   };
+
+   // Returns the number of channels (1 to 4) of a floating point format
+   uint get_hdr_num_channels(hdr_format fmt);
+
+   // Returns the size of a pixel of a floating point format in bytes
+   uint get_hdr_bytes_per_pixel(hdr_format fmt);
+
+   // Converts n half floats to floats, eight at a time with SSE2 where available.
+   // Denormals, infinities and NaNs are converted exactly.
+   void half_to_float(float* pDst, const uint16* pSrc, uint n);
+
+   // Tone maps linear floating point colors for display: negative values and NaNs become 0, values
+   // above 1.0 are clamped and the colors are gamma corrected to sRGB. Alpha is only clamped.
+   class hdr_tone_mapper
+   {
+   public:
+      // Fills the sRGB table, which must be done before the first row is mapped
+      void init();
+
+      // Maps a row of pixels with num_chans interleaved channels in R, G, B, A order.
+      // Missing color channels are black, a missing alpha channel is opaque.
+      void map_row(color_quad_u8* pDst, const float* pSrc, uint width, uint num_chans) const;
+
+   private:
+      enum { cHalfOne = 0x3C00 };
+
+      // sRGB values of the half float bit patterns from 0 to 1.0
+      uint8 m_srgb[cHalfOne + 1];
+
+      void map_values(uint8* pDst, const float* pSrc, uint n) const;
+   };
+
+   // Converts a level of a floating point image with tightly packed rows into img, which must already
+   // have the size of the level. With a task pool, the rows of large images are converted in parallel.
+   bool unpack_hdr_image(image_u8& img, const uint8* pPixels, hdr_format fmt, task_pool* pTask_pool = NULL);
+
+} // namespace crnlib
@@ -978,6 +978,121 @@ namespace crnlib
          return static_cast<uint8>(math::clamp(ib, 0, 255));
       }
 
+      void convert_pixel(color_quad_u8& dst, const color_quad_u8& src, image_utils::conversion_type conv_type)
+      {
+         switch (conv_type)
+         {
+            case image_utils::cConversion_To_CCxY:
+            {
+               color::RGB_to_YCC(dst, src);
+               break;
+            }
+            case image_utils::cConversion_From_CCxY:
+            {
+               color::YCC_to_RGB(dst, src);
+               break;
+            }
+            case image_utils::cConversion_To_xGxR:
+            {
+               dst.r = 0;
+               dst.g = src.g;
+               dst.b = 0;
+               dst.a = src.r;
+               break;
+            }
+            case image_utils::cConversion_From_xGxR:
+            {
+               dst.r = src.a;
+               dst.g = src.g;
+               // This is kinda iffy, we're assuming the image is a normal map here.
+               dst.b = regen_z(src.a, src.g);
+               dst.a = 255;
+               break;
+            }
+            case image_utils::cConversion_To_xGBR:
+            {
+               dst.r = 0;
+               dst.g = src.g;
+               dst.b = src.b;
+               dst.a = src.r;
+               break;
+            }
+            case image_utils::cConversion_To_AGBR:
+            {
+               dst.r = src.a;
+               dst.g = src.g;
+               dst.b = src.b;
+               dst.a = src.r;
+               break;
+            }
+            case image_utils::cConversion_From_xGBR:
+            {
+               dst.r = src.a;
+               dst.g = src.g;
+               dst.b = src.b;
+               dst.a = 255;
+               break;
+            }
+            case image_utils::cConversion_From_AGBR:
+            {
+               dst.r = src.a;
+               dst.g = src.g;
+               dst.b = src.b;
+               dst.a = src.r;
+               break;
+            }
+            case image_utils::cConversion_XY_to_XYZ:
+            {
+               dst.r = src.r;
+               dst.g = src.g;
+               // This is kinda iffy, we're assuming the image is a normal map here.
+               dst.b = regen_z(src.r, src.g);
+               dst.a = 255;
+               break;
+            }
+            case image_utils::cConversion_Y_To_A:
+            {
+               dst.r = src.r;
+               dst.g = src.g;
+               dst.b = src.b;
+               dst.a = static_cast<uint8>(src.get_luma());
+               break;
+            }
+            case image_utils::cConversion_Y_To_RGB:
+            {
+               uint8 y = static_cast<uint8>(src.get_luma());
+               dst.r = y;
+               dst.g = y;
+               dst.b = y;
+               dst.a = src.a;
+               break;
+            }
+            case image_utils::cConversion_A_To_RGBA:
+            {
+               dst.r = src.a;
+               dst.g = src.a;
+               dst.b = src.a;
+               dst.a = src.a;
+               break;
+            }
+            case image_utils::cConversion_To_Y:
+            {
+               uint8 y = static_cast<uint8>(src.get_luma());
+               dst.r = y;
+               dst.g = y;
+               dst.b = y;
+               dst.a = src.a;
+               break;
+            }
+            default:
+            {
+               CRNLIB_ASSERT(false);
+               dst = src;
+               break;
+            }
+         }
+      }
+
       void convert_image(image_u8& img, image_utils::conversion_type conv_type)
       {
          switch (conv_type)
@@ -1058,121 +1173,8 @@ namespace crnlib
          {
             for (uint x = 0; x < img.get_width(); x++)
             {
-               color_quad_u8 src(img(x, y));
                color_quad_u8 dst;
-
-               switch (conv_type)
-               {
-                  case image_utils::cConversion_To_CCxY:
-                  {
-                     color::RGB_to_YCC(dst, src);
-                     break;
-                  }
-                  case image_utils::cConversion_From_CCxY:
-                  {
-                     color::YCC_to_RGB(dst, src);
-                     break;
-                  }
-                  case image_utils::cConversion_To_xGxR:
-                  {
-                     dst.r = 0;
-                     dst.g = src.g;
-                     dst.b = 0;
-                     dst.a = src.r;
-                     break;
-                  }
-                  case image_utils::cConversion_From_xGxR:
-                  {
-                     dst.r = src.a;
-                     dst.g = src.g;
-                     // This is kinda iffy, we're assuming the image is a normal map here.
-                     dst.b = regen_z(src.a, src.g);
-                     dst.a = 255;
-                     break;
-                  }
-                  case image_utils::cConversion_To_xGBR:
-                  {
-                     dst.r = 0;
-                     dst.g = src.g;
-                     dst.b = src.b;
-                     dst.a = src.r;
-                     break;
-                  }
-                  case image_utils::cConversion_To_AGBR:
-                  {
-                     dst.r = src.a;
-                     dst.g = src.g;
-                     dst.b = src.b;
-                     dst.a = src.r;
-                     break;
-                  }
-                  case image_utils::cConversion_From_xGBR:
-                  {
-                     dst.r = src.a;
-                     dst.g = src.g;
-                     dst.b = src.b;
-                     dst.a = 255;
-                     break;
-                  }
-                  case image_utils::cConversion_From_AGBR:
-                  {
-                     dst.r = src.a;
-                     dst.g = src.g;
-                     dst.b = src.b;
-                     dst.a = src.r;
-                     break;
-                  }
-                  case image_utils::cConversion_XY_to_XYZ:
-                  {
-                     dst.r = src.r;
-                     dst.g = src.g;
-                     // This is kinda iffy, we're assuming the image is a normal map here.
-                     dst.b = regen_z(src.r, src.g);
-                     dst.a = 255;
-                     break;
-                  }
-                  case image_utils::cConversion_Y_To_A:
-                  {
-                     dst.r = src.r;
-                     dst.g = src.g;
-                     dst.b = src.b;
-                     dst.a = static_cast<uint8>(src.get_luma());
-                     break;
-                  }
-                  case image_utils::cConversion_Y_To_RGB:
-                  {
-                     uint8 y = static_cast<uint8>(src.get_luma());
-                     dst.r = y;
-                     dst.g = y;
-                     dst.b = y;
-                     dst.a = src.a;
-                     break;
-                  }
-                  case image_utils::cConversion_A_To_RGBA:
-                  {
-                     dst.r = src.a;
-                     dst.g = src.a;
-                     dst.b = src.a;
-                     dst.a = src.a;
-                     break;
-                  }
-                  case image_utils::cConversion_To_Y:
-                  {
-                     uint8 y = static_cast<uint8>(src.get_luma());
-                     dst.r = y;
-                     dst.g = y;
-                     dst.b = y;
-                     dst.a = src.a;
-                     break;
-                  }
-                  default:
-                  {
-                     CRNLIB_ASSERT(false);
-                     dst = src;
-                     break;
-                  }
-               }
-
+               convert_pixel(dst, img(x, y), conv_type);
                img(x, y) = dst;
             }
          }
@@ -152,6 +152,7 @@ namespace crnlib
       };
 
       void convert_image(image_u8& img, conversion_type conv_type);
+      void convert_pixel(color_quad_u8& dst, const color_quad_u8& src, conversion_type conv_type);
 
       template<typename image_type>
       inline uint8* pack_image(const image_type& img, const pixel_packer& packer, uint& n)
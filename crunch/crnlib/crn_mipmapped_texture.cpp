@@ -7,6 +7,9 @@
 #include "crn_console.h"
 #include "crn_texture_comp.h"
 #include "crn_ktx_texture.h"
+#include "crn_bptc.h"
+#include "crn_hdr.h"
+#include "crn_threading.h"
 
 #define CRND_HEADER_FILE_ONLY
 #include "../inc/crn_decomp.h"
@@ -513,9 +516,9 @@ namespace crnlib
       return *this;
    }
    
-   bool mipmapped_texture::read_dds(data_stream_serializer& serializer)
+   bool mipmapped_texture::read_dds(data_stream_serializer& serializer, dds_level_selection* pSelection)
    {
-      if (!read_dds_internal(serializer))
+      if (!read_dds_internal(serializer, pSelection))
       {
          clear();
          return false;
@@ -524,7 +527,7 @@ namespace crnlib
       return true;
    }
 
-   bool mipmapped_texture::read_dds_internal(data_stream_serializer& serializer)
+   bool mipmapped_texture::read_dds_internal(data_stream_serializer& serializer, dds_level_selection* pSelection)
    {
       CRNLIB_ASSERT(serializer.get_little_endian());
 
@@ -597,6 +600,8 @@ namespace crnlib
       }
 
       dxt_format dxt_fmt = cDXTInvalid;
+      bptc_format bptc_fmt = cBPTCInvalid;
+      hdr_format hdr_fmt = cHDRInvalid;
 
       if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
       {
@@ -680,6 +685,18 @@ namespace crnlib
                dxt_fmt = cETC1;
                break;
             }
+            case 111: // D3DFMT_R16F
+            case 112: // D3DFMT_G16R16F
+            case 113: // D3DFMT_A16B16G16R16F
+            case 114: // D3DFMT_R32F
+            case 115: // D3DFMT_G32R32F
+            case 116: // D3DFMT_A32B32G32R32F
+            {
+               static const hdr_format s_d3d_hdr_formats[6] = { cHDR_R16F, cHDR_RG16F, cHDR_RGBA16F, cHDR_R32F, cHDR_RG32F, cHDR_RGBA32F };
+               hdr_fmt = s_d3d_hdr_formats[desc.ddpfPixelFormat.dwFourCC - 111];
+               m_format = (hdr_fmt <= cHDR_RGBA16F) ? PIXEL_FMT_FLOAT16 : PIXEL_FMT_FLOAT32;
+               break;
+            }
             case CRNLIB_PIXEL_FMT_FOURCC('D', 'X', '1', '0'):
             {
                DDSURFACEDX10 dx10;
@@ -691,6 +708,48 @@ namespace crnlib
 
                switch (dx10.dxgiFormat)
                {
+                  case 2:  // DXGI_FORMAT_R32G32B32A32_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT32;
+                     hdr_fmt = cHDR_RGBA32F;
+                     break;
+                  }
+                  case 6:  // DXGI_FORMAT_R32G32B32_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT32;
+                     hdr_fmt = cHDR_RGB32F;
+                     break;
+                  }
+                  case 10: // DXGI_FORMAT_R16G16B16A16_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT16;
+                     hdr_fmt = cHDR_RGBA16F;
+                     break;
+                  }
+                  case 16: // DXGI_FORMAT_R32G32_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT32;
+                     hdr_fmt = cHDR_RG32F;
+                     break;
+                  }
+                  case 34: // DXGI_FORMAT_R16G16_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT16;
+                     hdr_fmt = cHDR_RG16F;
+                     break;
+                  }
+                  case 41: // DXGI_FORMAT_R32_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT32;
+                     hdr_fmt = cHDR_R32F;
+                     break;
+                  }
+                  case 54: // DXGI_FORMAT_R16_FLOAT
+                  {
+                     m_format = PIXEL_FMT_FLOAT16;
+                     hdr_fmt = cHDR_R16F;
+                     break;
+                  }
                   case 71: // DXGI_FORMAT_BC1_UNORM
                   {
                      m_format = PIXEL_FMT_DXT1;
@@ -721,6 +780,22 @@ namespace crnlib
                      dxt_fmt = cDXN_YX;
                      break;
                   }
+                  case 94: // DXGI_FORMAT_BC6H_TYPELESS
+                  case 95: // DXGI_FORMAT_BC6H_UF16
+                  case 96: // DXGI_FORMAT_BC6H_SF16
+                  {
+                     m_format = PIXEL_FMT_BC6H;
+                     bptc_fmt = (dx10.dxgiFormat == 96) ? cBPTC_BC6H_SF16 : cBPTC_BC6H_UF16;
+                     break;
+                  }
+                  case 97: // DXGI_FORMAT_BC7_TYPELESS
+                  case 98: // DXGI_FORMAT_BC7_UNORM
+                  case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+                  {
+                     m_format = PIXEL_FMT_BC7;
+                     bptc_fmt = cBPTC_BC7;
+                     break;
+                  }
                   default:
                   {
                      dynamic_string err_msg(cVarArg, "Unsupported DX10 DXGI format: %u", dx10.dxgiFormat);
@@ -782,13 +857,29 @@ namespace crnlib
 
       uint bits_per_pixel = desc.ddpfPixelFormat.dwRGBBitCount;
 
-      if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
+      // Floating point formats are stored as uncompressed rows, their channels depend on the D3D or DXGI format
+      if (hdr_fmt != cHDRInvalid)
+      {
+         static const uint s_hdr_comp_flags[4] =
+         {
+            pixel_format_helpers::cCompFlagRValid,
+            pixel_format_helpers::cCompFlagRValid | pixel_format_helpers::cCompFlagGValid,
+            pixel_format_helpers::cCompFlagRValid | pixel_format_helpers::cCompFlagGValid | pixel_format_helpers::cCompFlagBValid,
+            pixel_format_helpers::cDefaultCompFlags
+         };
+         m_comp_flags = static_cast<pixel_format_helpers::component_flags>(s_hdr_comp_flags[get_hdr_num_channels(hdr_fmt) - 1]);
+
+         bits_per_pixel = get_hdr_bytes_per_pixel(hdr_fmt) << 3;
+      }
+      else if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
          bits_per_pixel = pixel_format_helpers::get_bpp(m_format);
 
       set_last_error("Load failed");
 
+      const bool is_block_format = (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC) && (hdr_fmt == cHDRInvalid);
+
       uint default_pitch;
-      if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
+      if (is_block_format)
          default_pitch = (((desc.dwWidth + 3) & ~3) * ((desc.dwHeight + 3) & ~3) * bits_per_pixel) >> 3;
       else
          default_pitch = (desc.dwWidth * bits_per_pixel) >> 3;
@@ -838,23 +929,145 @@ namespace crnlib
             mask_size[0] /= 2;
       }
 
-      m_faces.resize(num_faces);
+      // When a single face and level is selected, the levels stored in front of it are skipped and the
+      // texture is loaded as a texture with one face and one level.
+      uint sel_face = 0;
+      uint sel_level = 0;
+      if (pSelection)
+      {
+         pSelection->m_width = desc.dwWidth;
+         pSelection->m_height = desc.dwHeight;
+         pSelection->m_faces = num_faces;
+         pSelection->m_levels = num_mip_levels;
+
+         sel_face = pSelection->m_face;
+         sel_level = pSelection->m_level;
+         if (pSelection->m_target_size)
+         {
+            sel_level = 0;
+            while (((sel_level + 1) < num_mip_levels) &&
+               (math::maximum<uint>(desc.dwWidth >> (sel_level + 1), desc.dwHeight >> (sel_level + 1)) >= pSelection->m_target_size))
+               sel_level++;
+            pSelection->m_level = sel_level;
+         }
+
+         if ((sel_face >= num_faces) || (sel_level >= num_mip_levels))
+         {
+            set_last_error("Invalid face or mipmap level");
+            return false;
+         }
+
+         m_width = math::maximum<uint>(desc.dwWidth >> sel_level, 1U);
+         m_height = math::maximum<uint>(desc.dwHeight >> sel_level, 1U);
+      }
+
+      m_faces.resize(pSelection ? 1 : num_faces);
+      for (uint face_index = 0; face_index < m_faces.size(); face_index++)
+         m_faces[face_index].resize(pSelection ? 1 : num_mip_levels);
 
       bool dxt1_alpha = false;
 
-      for (uint face_index = 0; face_index < num_faces; face_index++)
-      {
-         m_faces[face_index].resize(num_mip_levels);
+      // There is no packed representation of BC6H, BC7 and floating point formats, their levels are decoded when they are loaded
+      task_pool tp;
+      task_pool* pTask_pool = NULL;
+      if (((bptc_fmt != cBPTCInvalid) || (hdr_fmt != cHDRInvalid)) && (g_number_of_processors > 1) && tp.init(math::minimum<uint>(g_number_of_processors, task_pool::cMaxThreads) - 1))
+         pTask_pool = &tp;
 
-         for (uint level_index = 0; level_index < num_mip_levels; level_index++)
+      const uint last_face = pSelection ? sel_face : (num_faces - 1);
+      for (uint face_index = 0; face_index <= last_face; face_index++)
+      {
+         const uint end_level = (pSelection && (face_index == sel_face)) ? (sel_level + 1) : num_mip_levels;
+         for (uint level_index = 0; level_index < end_level; level_index++)
          {
             const uint width = math::maximum<uint>(desc.dwWidth >> level_index, 1U);
             const uint height = math::maximum<uint>(desc.dwHeight >> level_index, 1U);
 
+            if (pSelection && ((face_index != sel_face) || (level_index != sel_level)))
+            {
+               // Skip as many bytes as the level would consume when it is read. The pitch of the first level of a
+               // block format may be the size of a row of blocks, in which case the whole level is read.
+               uint level_size;
+               if (is_block_format)
+               {
+                  const uint actual_level_pitch = ((width + 3) >> 2) * ((height + 3) >> 2) * pixel_format_helpers::get_dxt_bytes_per_block(m_format);
+                  level_size = level_index ? actual_level_pitch : math::maximum(pitch, actual_level_pitch);
+               }
+               else
+               {
+                  const uint actual_line_pitch = width * (bits_per_pixel >> 3);
+                  uint line_pitch = actual_line_pitch;
+                  if (!level_index)
+                     line_pitch = (hdr_fmt != cHDRInvalid) ? math::maximum(pitch, actual_line_pitch) : pitch;
+                  level_size = line_pitch * height;
+               }
+
+               if (!serializer.skip(level_size))
+                  return false;
+
+               continue;
+            }
+
             mip_level* pMip = crnlib_new<mip_level>();
-            m_faces[face_index][level_index] = pMip;
+            if (pSelection)
+               m_faces[0][0] = pMip;
+            else
+               m_faces[face_index][level_index] = pMip;
+
+            if (bptc_fmt != cBPTCInvalid)
+            {
+               const uint actual_level_pitch = ((width + 3) >> 2) * ((height + 3) >> 2) * cBPTCBytesPerBlock;
+               const uint level_pitch = level_index ? actual_level_pitch : pitch;
 
-            if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
+               if (load_buf.size() < actual_level_pitch)
+                  load_buf.resize(actual_level_pitch);
+
+               if (!serializer.read(&load_buf[0], actual_level_pitch))
+                  return false;
+
+               if ((level_pitch > actual_level_pitch) && (!serializer.skip(level_pitch - actual_level_pitch)))
+                  return false;
+
+               image_u8* pImage = crnlib_new<image_u8>(width, height);
+               pImage->set_comp_flags(m_comp_flags);
+
+               unpack_bptc_image(*pImage, &load_buf[0], bptc_fmt, pTask_pool);
+
+               pMip->assign(pImage, m_format);
+            }
+            else if (hdr_fmt != cHDRInvalid)
+            {
+               const uint actual_line_pitch = width * (bits_per_pixel >> 3);
+               const uint line_pitch = level_index ? actual_line_pitch : pitch;
+
+               if (load_buf.size() < (actual_line_pitch * height))
+                  load_buf.resize(actual_line_pitch * height);
+
+               // The rows are packed tightly, padding at the end of the rows of the first level is skipped
+               if (line_pitch == actual_line_pitch)
+               {
+                  if (!serializer.read(&load_buf[0], actual_line_pitch * height))
+                     return false;
+               }
+               else
+               {
+                  for (uint y = 0; y < height; y++)
+                  {
+                     if (!serializer.read(&load_buf[y * actual_line_pitch], actual_line_pitch))
+                        return false;
+
+                     if ((line_pitch > actual_line_pitch) && (!serializer.skip(line_pitch - actual_line_pitch)))
+                        return false;
+                  }
+               }
+
+               image_u8* pImage = crnlib_new<image_u8>(width, height);
+               pImage->set_comp_flags(m_comp_flags);
+
+               unpack_hdr_image(*pImage, &load_buf[0], hdr_fmt, pTask_pool);
+
+               pMip->assign(pImage, m_format);
+            }
+            else if (desc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
             {
                const uint bytes_per_block = pixel_format_helpers::get_dxt_bytes_per_block(m_format);
 
@@ -30,6 +30,20 @@ namespace crnlib
       cUnpackFlagUnflip = 2
    };
 
+   // Selects a single face and mipmap level to be read by mipmapped_texture::read_dds().
+   struct dds_level_selection
+   {
+      uint m_face;
+      uint m_level;           // Receives the selected level if m_target_size is not 0
+      uint m_target_size;     // If not 0, selects the smallest level whose longer side is at least m_target_size
+
+      // Receive the description of the whole DDS texture
+      uint m_width;
+      uint m_height;
+      uint m_faces;
+      uint m_levels;
+   };
+
    class mip_level
    {
       friend class mipmapped_texture;
@@ -178,7 +192,7 @@ namespace crnlib
       void clear_last_error() { m_last_error.clear(); }
 
       // Reading/writing
-      bool read_dds(data_stream_serializer& serializer);
+      bool read_dds(data_stream_serializer& serializer, dds_level_selection* pSelection = NULL);
       bool write_dds(data_stream_serializer& serializer) const;
 
       bool read_ktx(data_stream_serializer& serializer);
@@ -324,7 +338,7 @@ namespace crnlib
       void free_all_mips();
       bool read_regular_image(data_stream_serializer &serializer, texture_file_types::format file_format);
       bool write_regular_image(const char* pFilename, uint32 image_write_flags);
-      bool read_dds_internal(data_stream_serializer& serializer);
+      bool read_dds_internal(data_stream_serializer& serializer, dds_level_selection* pSelection);
       void print_crn_comp_params(const crn_comp_params& p);
       bool write_comp_texture(const char* pFilename, const crn_comp_params &comp_params, uint32 *pActual_quality_level, float *pActual_bitrate);
       void change_dxt1_to_dxt1a();
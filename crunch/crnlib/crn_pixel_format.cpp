@@ -61,6 +61,10 @@ namespace crnlib
             case PIXEL_FMT_DXT5_xGBR: return "DXT5_xGBR";
             case PIXEL_FMT_DXT5_AGBR: return "DXT5_AGBR";
             case PIXEL_FMT_ETC1:      return "ETC1";
+            case PIXEL_FMT_BC6H:      return "BC6H";
+            case PIXEL_FMT_BC7:       return "BC7";
+            case PIXEL_FMT_FLOAT16:   return "FLOAT16";
+            case PIXEL_FMT_FLOAT32:   return "FLOAT32";
             case PIXEL_FMT_R8G8B8:    return "R8G8B8";
             case PIXEL_FMT_A8R8G8B8:  return "A8R8G8B8";
             case PIXEL_FMT_A8:        return "A8";
@@ -102,11 +106,15 @@ namespace crnlib
          {
             case PIXEL_FMT_DXT1:
             case PIXEL_FMT_ETC1:
+            case PIXEL_FMT_BC6H:
             {
                flags = cCompFlagRValid | cCompFlagGValid | cCompFlagBValid;
                break;
             }
             case PIXEL_FMT_DXT1A:
+            case PIXEL_FMT_BC7:
+            case PIXEL_FMT_FLOAT16:
+            case PIXEL_FMT_FLOAT32:
             {
                flags = cCompFlagRValid | cCompFlagGValid | cCompFlagBValid | cCompFlagAValid;
                break;
@@ -218,11 +226,15 @@ namespace crnlib
                break;
             case PIXEL_FMT_R8G8B8:
             case PIXEL_FMT_L8:
+            case PIXEL_FMT_BC6H:
                fmt = cCRNFmtDXT1;
                break;
             case PIXEL_FMT_A8R8G8B8:
             case PIXEL_FMT_A8:
             case PIXEL_FMT_A8L8:
+            case PIXEL_FMT_BC7:
+            case PIXEL_FMT_FLOAT16:
+            case PIXEL_FMT_FLOAT32:
                fmt = cCRNFmtDXT5;
                break;
             case PIXEL_FMT_DXT5_CCxY:
@@ -49,6 +49,7 @@ namespace crnlib
             case PIXEL_FMT_A8:
             case PIXEL_FMT_A8L8:
             case PIXEL_FMT_DXT5_AGBR:
+            case PIXEL_FMT_BC7:
                return true;
             default: break;
          }
@@ -228,6 +229,10 @@ namespace crnlib
             case PIXEL_FMT_DXT5_xGxR: return 8;
             case PIXEL_FMT_DXT5_xGBR: return 8;
             case PIXEL_FMT_DXT5_AGBR: return 8;
+            case PIXEL_FMT_BC6H:      return 8;
+            case PIXEL_FMT_BC7:       return 8;
+            case PIXEL_FMT_FLOAT16:   return 64;
+            case PIXEL_FMT_FLOAT32:   return 128;
             default: break;
          }
          CRNLIB_ASSERT(false);
@@ -252,6 +257,8 @@ namespace crnlib
             case PIXEL_FMT_DXT5_xGxR: return 16;
             case PIXEL_FMT_DXT5_xGBR: return 16;
             case PIXEL_FMT_DXT5_AGBR: return 16;
+            case PIXEL_FMT_BC6H:      return 16;
+            case PIXEL_FMT_BC7:       return 16;
             default: break;
          }
          CRNLIB_ASSERT(false);
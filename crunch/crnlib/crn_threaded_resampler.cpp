@@ -7,6 +7,147 @@
 
 namespace crnlib
 {
+   // A filter weight table of one axis, shared by all resamplers. Thumbnails and mipmaps often have the same
+   // sizes, and the table of each combination of lengths and filter parameters is only computed once.
+   struct contrib_cache_entry
+   {
+      Resampler::Contrib_List*   m_pContribs;
+      uint                       m_src_len;
+      uint                       m_dst_len;
+      int                        m_filter_index;
+      Resampler::Boundary_Op     m_boundary_op;
+      float                      m_filter_scale;
+      uint                       m_ref_count;
+      uint                       m_last_use;
+   };
+
+   // Number of cached tables. Tables in use are never replaced.
+   const uint cContribCacheSize = 16;
+
+   static contrib_cache_entry g_contrib_cache[cContribCacheSize];
+   static uint g_contrib_cache_clock;
+   static mutex g_contrib_cache_mutex;
+
+   static void free_contribs(Resampler::Contrib_List* pContribs)
+   {
+      // The contributors of all destination pixels are allocated in one block
+      crnlib_free(pContribs->p);
+      pContribs->p = NULL;
+
+      crnlib_free(pContribs);
+   }
+
+   static contrib_cache_entry* find_cached_contribs(uint src_len, uint dst_len, Resampler::Boundary_Op boundary_op, int filter_index, float filter_scale)
+   {
+      for (uint i = 0; i < cContribCacheSize; i++)
+      {
+         contrib_cache_entry& entry = g_contrib_cache[i];
+         if ((entry.m_pContribs) && (entry.m_src_len == src_len) && (entry.m_dst_len == dst_len) &&
+             (entry.m_boundary_op == boundary_op) && (entry.m_filter_index == filter_index) && (entry.m_filter_scale == filter_scale))
+            return &entry;
+      }
+      return NULL;
+   }
+
+   // Returns the table of an axis from the cache or computes it. The table must be returned with release_contribs().
+   static Resampler::Contrib_List* acquire_contribs(uint src_len, uint dst_len, Resampler::Boundary_Op boundary_op, int filter_index, float filter_scale)
+   {
+      {
+         scoped_mutex lock(g_contrib_cache_mutex);
+
+         contrib_cache_entry* pEntry = find_cached_contribs(src_len, dst_len, boundary_op, filter_index, filter_scale);
+         if (pEntry)
+         {
+            pEntry->m_ref_count++;
+            pEntry->m_last_use = ++g_contrib_cache_clock;
+            return pEntry->m_pContribs;
+         }
+      }
+
+      const resample_filter& filter = g_resample_filters[filter_index];
+
+      Resampler::Contrib_List* pContribs = Resampler::make_clist(src_len, dst_len, boundary_op, filter.func, filter.support, filter_scale, 0.0f);
+      if (!pContribs)
+         return NULL;
+
+      scoped_mutex lock(g_contrib_cache_mutex);
+
+      // Another resampler may have computed the same table in the meantime
+      contrib_cache_entry* pEntry = find_cached_contribs(src_len, dst_len, boundary_op, filter_index, filter_scale);
+      if (pEntry)
+      {
+         free_contribs(pContribs);
+
+         pEntry->m_ref_count++;
+         pEntry->m_last_use = ++g_contrib_cache_clock;
+         return pEntry->m_pContribs;
+      }
+
+      // Take an empty entry or replace the least recently used table. If all tables are in use, the new one isn't cached.
+      contrib_cache_entry* pVictim = NULL;
+      for (uint i = 0; i < cContribCacheSize; i++)
+      {
+         contrib_cache_entry& entry = g_contrib_cache[i];
+         if (entry.m_ref_count)
+            continue;
+
+         if ((!pVictim) || (!entry.m_pContribs) || ((pVictim->m_pContribs) && (entry.m_last_use < pVictim->m_last_use)))
+            pVictim = &entry;
+      }
+
+      if (pVictim)
+      {
+         if (pVictim->m_pContribs)
+            free_contribs(pVictim->m_pContribs);
+
+         pVictim->m_pContribs = pContribs;
+         pVictim->m_src_len = src_len;
+         pVictim->m_dst_len = dst_len;
+         pVictim->m_filter_index = filter_index;
+         pVictim->m_boundary_op = boundary_op;
+         pVictim->m_filter_scale = filter_scale;
+         pVictim->m_ref_count = 1;
+         pVictim->m_last_use = ++g_contrib_cache_clock;
+      }
+
+      return pContribs;
+   }
+
+   static void release_contribs(Resampler::Contrib_List* pContribs)
+   {
+      scoped_mutex lock(g_contrib_cache_mutex);
+
+      for (uint i = 0; i < cContribCacheSize; i++)
+      {
+         if (g_contrib_cache[i].m_pContribs == pContribs)
+         {
+            CRNLIB_ASSERT(g_contrib_cache[i].m_ref_count);
+            g_contrib_cache[i].m_ref_count--;
+            return;
+         }
+      }
+
+      free_contribs(pContribs);
+   }
+
+   void free_contrib_cache()
+   {
+      scoped_mutex lock(g_contrib_cache_mutex);
+
+      for (uint i = 0; i < cContribCacheSize; i++)
+      {
+         contrib_cache_entry& entry = g_contrib_cache[i];
+         CRNLIB_ASSERT(!entry.m_ref_count);
+
+         if (entry.m_pContribs)
+            free_contribs(entry.m_pContribs);
+
+         utils::zero_object(entry);
+      }
+
+      g_contrib_cache_clock = 0;
+   }
+
    threaded_resampler::threaded_resampler(task_pool& tp) :
       m_pTask_pool(&tp),
       m_pParams(NULL),
@@ -25,28 +166,43 @@ namespace crnlib
    {
       if (m_pX_contribs)
       {
-         crnlib_free(m_pX_contribs->p);
-         m_pX_contribs->p = NULL;
-
-         crnlib_free(m_pX_contribs);
+         release_contribs(m_pX_contribs);
          m_pX_contribs = NULL;
       }
 
       if (m_pY_contribs)
       {
-         crnlib_free(m_pY_contribs->p);
-         m_pY_contribs->p = NULL;
-
-         crnlib_free(m_pY_contribs);
+         release_contribs(m_pY_contribs);
          m_pY_contribs = NULL;
       }
    }
 
+   void threaded_resampler::convert_u8_row(vec4F* pDst, const uint8* pSrc) const
+   {
+      const float* pTable = m_pParams->m_pSrc_color_table;
+      const bool premultiply = (m_pParams->m_fmt == cPF_RGBA_U8) && (m_pParams->m_premultiply_alpha);
+
+      for (uint x = 0; x < m_pParams->m_src_width; x++, pSrc += 4)
+      {
+         const float a = pSrc[3] * (1.0f / 255.0f);
+
+         if (premultiply)
+            pDst[x].set(pTable[pSrc[0]] * a, pTable[pSrc[1]] * a, pTable[pSrc[2]] * a, a);
+         else
+            pDst[x].set(pTable[pSrc[0]], pTable[pSrc[1]], pTable[pSrc[2]], a);
+      }
+   }
+
    void threaded_resampler::resample_x_task(uint64 data, void* pData_ptr)
    {
       pData_ptr;
       const uint thread_index = (uint)data;
 
+      // 8-bit source rows are converted to floats before they are filtered
+      crnlib::vector<vec4F> row;
+      if ((m_pParams->m_fmt == cPF_RGBX_U8) || (m_pParams->m_fmt == cPF_RGBA_U8))
+         row.resize(m_pParams->m_src_width);
+
       for (uint src_y = 0; src_y < m_pParams->m_src_height; src_y++)
       {
          if (m_pTask_pool->get_num_threads())
@@ -62,7 +218,7 @@ namespace crnlib
          {
             case cPF_Y_F32:
             {
-               const float* pSrc = reinterpret_cast<const float*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
+               const float* pSrc = reinterpret_cast<const float*>(get_src_row(src_y));
                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
 
                do
@@ -90,7 +246,7 @@ namespace crnlib
             }
             case cPF_RGBX_F32:
             {
-               const vec4F* pSrc = reinterpret_cast<const vec4F*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
+               const vec4F* pSrc = reinterpret_cast<const vec4F*>(get_src_row(src_y));
                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
 
                do
@@ -121,7 +277,7 @@ namespace crnlib
             }
             case cPF_RGBA_F32:
             {
-               const vec4F* pSrc = reinterpret_cast<const vec4F*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
+               const vec4F* pSrc = reinterpret_cast<const vec4F*>(get_src_row(src_y));
                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
 
                do
@@ -151,6 +307,41 @@ namespace crnlib
 
                break;
             }
+            case cPF_RGBX_U8:
+            case cPF_RGBA_U8:
+            {
+               convert_u8_row(row.get_ptr(), get_src_row(src_y));
+
+               const vec4F* pSrc = row.get_ptr();
+               vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
+
+               do
+               {
+                  const Resampler::Contrib* p = pContribs->p;
+                  const Resampler::Contrib* p_end = pContribs->p + pContribs->n;
+
+                  vec4F s(0.0f);
+
+                  while (p != p_end)
+                  {
+                     const float src_weight = p->weight;
+
+                     const vec4F& src_pixel = pSrc[p->pixel];
+
+                     s[0] += src_pixel[0] * src_weight;
+                     s[1] += src_pixel[1] * src_weight;
+                     s[2] += src_pixel[2] * src_weight;
+                     s[3] += src_pixel[3] * src_weight;
+
+                     p++;
+                  }
+
+                  *pDst++ = s;
+                  pContribs++;
+               } while (pContribs != pContribs_end);
+
+               break;
+            }
             default: break;
          }
       }
@@ -211,7 +402,7 @@ namespace crnlib
          {
             case cPF_Y_F32:
             {
-               float* pDst = reinterpret_cast<float*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
+               float* pDst = reinterpret_cast<float*>(get_dst_row(dst_y));
 
                do
                {
@@ -224,8 +415,9 @@ namespace crnlib
                break;
             }
             case cPF_RGBX_F32:
+            case cPF_RGBX_U8:
             {
-               vec4F* pDst = reinterpret_cast<vec4F*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
+               vec4F* pDst = reinterpret_cast<vec4F*>(get_dst_row(dst_y));
 
                do
                {
@@ -242,8 +434,29 @@ namespace crnlib
                break;
             }
             case cPF_RGBA_F32:
+            case cPF_RGBA_U8:
             {
-               vec4F* pDst = reinterpret_cast<vec4F*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
+               vec4F* pDst = reinterpret_cast<vec4F*>(get_dst_row(dst_y));
+
+               if ((m_pParams->m_fmt == cPF_RGBA_U8) && (m_pParams->m_premultiply_alpha))
+               {
+                  do
+                  {
+                     const float a = math::clamp((*pSrc)[3], l, h);
+                     const float s = (a > 0.0f) ? (1.0f / a) : 0.0f;
+
+                     (*pDst)[0] = math::clamp((*pSrc)[0] * s, l, h);
+                     (*pDst)[1] = math::clamp((*pSrc)[1] * s, l, h);
+                     (*pDst)[2] = math::clamp((*pSrc)[2] * s, l, h);
+                     (*pDst)[3] = a;
+
+                     pSrc++;
+                     pDst++;
+
+                  } while (pSrc != pSrc_end);
+
+                  break;
+               }
 
                do
                {
@@ -282,6 +495,12 @@ namespace crnlib
          case cPF_RGBA_F32:
             m_bytes_per_pixel = 16;
             break;
+         case cPF_RGBX_U8:
+         case cPF_RGBA_U8:
+            if (!p.m_pSrc_color_table)
+               return false;
+            m_bytes_per_pixel = 4;
+            break;
          default:
             CRNLIB_ASSERT(false);
             return false;
@@ -291,13 +510,11 @@ namespace crnlib
       if (filter_index < 0)
          return false;
 
-      const resample_filter& filter = g_resample_filters[filter_index];
-
-      m_pX_contribs = Resampler::make_clist(m_pParams->m_src_width, m_pParams->m_dst_width, m_pParams->m_boundary_op, filter.func, filter.support, p.m_filter_x_scale, 0.0f);
+      m_pX_contribs = acquire_contribs(m_pParams->m_src_width, m_pParams->m_dst_width, m_pParams->m_boundary_op, filter_index, p.m_filter_x_scale);
       if (!m_pX_contribs)
          return false;
 
-      m_pY_contribs = Resampler::make_clist(m_pParams->m_src_height, m_pParams->m_dst_height, m_pParams->m_boundary_op, filter.func, filter.support, p.m_filter_y_scale, 0.0f);
+      m_pY_contribs = acquire_contribs(m_pParams->m_src_height, m_pParams->m_dst_height, m_pParams->m_boundary_op, filter_index, p.m_filter_y_scale);
       if (!m_pY_contribs)
          return false;
 
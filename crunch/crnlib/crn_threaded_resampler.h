@@ -21,6 +21,10 @@ namespace crnlib
          cPF_RGBX_F32,
          cPF_RGBA_F32,
 
+         // 32-bit source pixels, converted to floats row by row while they are filtered. The destination is RGBX_F32 or RGBA_F32.
+         cPF_RGBX_U8,
+         cPF_RGBA_U8,
+
          cPF_Total
       };
 
@@ -45,15 +49,16 @@ namespace crnlib
 
          pixel_format            m_fmt;
 
+         // Negative pitches step through bottom-up images.
          const void*             m_pSrc_pixels;
          uint                    m_src_width;
          uint                    m_src_height;
-         uint                    m_src_pitch;
+         int                     m_src_pitch;
 
          void*                   m_pDst_pixels;
          uint                    m_dst_width;
          uint                    m_dst_height;
-         uint                    m_dst_pitch;
+         int                     m_dst_pitch;
 
          Resampler::Boundary_Op  m_boundary_op;
 
@@ -63,8 +68,16 @@ namespace crnlib
          const char*             m_Pfilter_name;
          float                   m_filter_x_scale;
          float                   m_filter_y_scale;
+
+         // 8-bit formats only: converts the color channels of the source pixels to floats (256 entries). Alpha is divided by 255.
+         const float*            m_pSrc_color_table;
+
+         // cPF_RGBA_U8 only: the colors are multiplied by alpha before they are filtered and divided by it afterwards,
+         // so that the colors of transparent pixels don't bleed into their neighbors.
+         bool                    m_premultiply_alpha;
       };
 
+      // The filter weight tables are taken from a cache of recently used sizes, which is shared by all resamplers.
       bool resample(const params& p);
 
    private:
@@ -80,8 +93,16 @@ namespace crnlib
 
       void free_contrib_lists();
 
+      void convert_u8_row(vec4F* pDst, const uint8* pSrc) const;
+
+      inline const uint8* get_src_row(uint y) const { return static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + static_cast<ptrdiff_t>(m_pParams->m_src_pitch) * y; }
+      inline uint8* get_dst_row(uint y) const { return static_cast<uint8*>(m_pParams->m_pDst_pixels) + static_cast<ptrdiff_t>(m_pParams->m_dst_pitch) * y; }
+
       void resample_x_task(uint64 data, void* pData_ptr);
       void resample_y_task(uint64 data, void* pData_ptr);
    };
 
+   // Frees the cached filter weight tables. Must not be called while images are resampled.
+   void free_contrib_cache();
+
 } // namespace crnlib
@@ -8,6 +8,7 @@
 #include "crn_buffer_stream.h"
 #include "crn_ryg_dxt.hpp"
 #include "crn_etc.h"
+#include "crn_threaded_resampler.h"
 
 #define CRND_HEADER_FILE_ONLY
 #include "../inc/crn_decomp.h"
@@ -266,6 +267,237 @@ void crn_free_all_images(crn_uint32 **ppImages, const crn_texture_desc &desc)
          crn_free_block(ppImages[l + desc.m_levels * f]);
 }
 
+static inline void store_decompressed_pixel(uint8 *pDst, const color_quad_u8 &c, bool bgra)
+{
+   pDst[0] = bgra ? c.b : c.r;
+   pDst[1] = c.g;
+   pDst[2] = bgra ? c.r : c.b;
+   pDst[3] = c.a;
+}
+
+bool crn_decompress_dds_to_buffer(const void *pDDS_file_data, crn_uint32 dds_file_size, crn_uint32 flags, crn_decomp_level *pLevel,
+   crn_get_dst_buffer_func pGet_dst_buffer, void *pUser_data, crn_texture_desc &tex_desc)
+{
+   memset(&tex_desc, 0, sizeof(tex_desc));
+
+   if (!pGet_dst_buffer)
+      return false;
+
+   crn_decomp_level level;
+   memset(&level, 0, sizeof(level));
+   if (pLevel)
+      level = *pLevel;
+
+   // Only the selected level is read from the file
+   dds_level_selection selection;
+   memset(&selection, 0, sizeof(selection));
+   selection.m_face = level.m_face;
+   selection.m_level = level.m_level;
+   selection.m_target_size = level.m_target_size;
+
+   mipmapped_texture tex;
+   buffer_stream in_stream(pDDS_file_data, dds_file_size);
+   data_stream_serializer in_serializer(in_stream);
+   if (!tex.read_dds(in_serializer, &selection))
+      return false;
+
+   tex_desc.m_faces = selection.m_faces;
+   tex_desc.m_width = selection.m_width;
+   tex_desc.m_height = selection.m_height;
+   tex_desc.m_levels = selection.m_levels;
+   tex_desc.m_fmt_fourcc = (crn_uint32)tex.get_format();
+
+   level.m_level = selection.m_level;
+   level.m_width = tex.get_width();
+   level.m_height = tex.get_height();
+   if (pLevel)
+      *pLevel = level;
+
+   const mip_level *pMip = tex.get_level(0, 0);
+   if ((!pMip) || (!pMip->is_valid()))
+      return false;
+
+   crn_int32 pitch = 0;
+   uint8 *pDst = static_cast<uint8*>(pGet_dst_buffer(tex_desc, level, pitch, pUser_data));
+   if (!pDst)
+      return false;
+
+   const uint width = pMip->get_width();
+   const uint height = pMip->get_height();
+   const bool bgra = (flags & cCRNDecompFlagBGRA) != 0;
+
+   if (pMip->is_packed())
+   {
+      // Same result as crn_decompress_dds_to_images(), which unpacks and uncooks each level into a temporary image.
+      // The blocks are unpacked straight into the destination, large levels using all processors.
+      const dxt_image *pDXT_image = pMip->get_dxt_image();
+
+      task_pool tp;
+      task_pool *pTask_pool = NULL;
+      if ((g_number_of_processors > 1) && tp.init(math::minimum<uint>(g_number_of_processors, task_pool::cMaxThreads) - 1))
+         pTask_pool = &tp;
+
+      if (!pDXT_image->unpack(pDst, pitch, bgra, pTask_pool))
+         return false;
+
+      const image_utils::conversion_type conv_type = image_utils::get_conversion_type(false, pMip->get_format());
+      if (conv_type != image_utils::cConversion_Invalid)
+      {
+         for (uint y = 0; y < height; y++)
+         {
+            uint8 *pRow = pDst + (ptrdiff_t)pitch * y;
+
+            for (uint x = 0; x < width; x++, pRow += 4)
+            {
+               color_quad_u8 src(bgra ? pRow[2] : pRow[0], pRow[1], bgra ? pRow[0] : pRow[2], pRow[3]);
+               color_quad_u8 dst;
+               image_utils::convert_pixel(dst, src, conv_type);
+               store_decompressed_pixel(pRow, dst, bgra);
+            }
+         }
+      }
+   }
+   else
+   {
+      const image_u8 *pImg = pMip->get_image();
+
+      for (uint y = 0; y < height; y++)
+      {
+         const color_quad_u8 *pSrc = pImg->get_scanline(y);
+         uint8 *pRow = pDst + (ptrdiff_t)pitch * y;
+
+         for (uint x = 0; x < width; x++)
+            store_decompressed_pixel(pRow + x * 4, pSrc[x], bgra);
+      }
+   }
+
+   return true;
+}
+
+namespace crnlib
+{
+   // Conversion tables of crn_resample_image()
+   class resample_color_tables
+   {
+   public:
+      enum { cLinearToSRGBTableSize = 8192 };
+
+      float m_srgb_to_linear[256];
+      float m_unorm_to_float[256];
+      uint8 m_linear_to_srgb[cLinearToSRGBTableSize];
+
+      resample_color_tables()
+      {
+         for (uint i = 0; i < 256; i++)
+         {
+            const float c = i / 255.0f;
+            m_srgb_to_linear[i] = (c <= .04045f) ? (c / 12.92f) : powf((c + .055f) / 1.055f, 2.4f);
+            m_unorm_to_float[i] = c;
+         }
+
+         for (uint i = 0; i < cLinearToSRGBTableSize; i++)
+         {
+            const float c = i / float(cLinearToSRGBTableSize - 1);
+            const float s = (c <= .0031308f) ? (c * 12.92f) : (1.055f * powf(c, 1.0f / 2.4f) - .055f);
+            m_linear_to_srgb[i] = static_cast<uint8>(math::clamp<int>(static_cast<int>(s * 255.0f + .5f), 0, 255));
+         }
+      }
+
+      inline uint8 linear_to_srgb(float c) const
+      {
+         return m_linear_to_srgb[static_cast<int>(c * (cLinearToSRGBTableSize - 1) + .5f)];
+      }
+   };
+
+   // Created by crn_init_resampler(), before any thread resamples images
+   static resample_color_tables* g_pResample_color_tables;
+
+} // namespace crnlib
+
+bool crn_init_resampler()
+{
+   if (!g_pResample_color_tables)
+      g_pResample_color_tables = crnlib_new<resample_color_tables>();
+
+   return g_pResample_color_tables != NULL;
+}
+
+void crn_free_resampler()
+{
+   crnlib_delete(g_pResample_color_tables);
+   g_pResample_color_tables = NULL;
+
+   free_contrib_cache();
+}
+
+bool crn_resample_image(const void *pSrc_pixels, crn_uint32 src_width, crn_uint32 src_height, crn_int32 src_pitch,
+   void *pDst_pixels, crn_uint32 dst_width, crn_uint32 dst_height, crn_int32 dst_pitch,
+   crn_uint32 flags, crn_mip_filter filter)
+{
+   if ((!pSrc_pixels) || (!pDst_pixels) || (filter >= cCRNMipFilterTotal))
+      return false;
+
+   if ((!src_width) || (!src_height) || (!dst_width) || (!dst_height))
+      return false;
+
+   if ((math::maximum(src_width, src_height) > CRNLIB_RESAMPLER_MAX_DIMENSION) || (math::maximum(dst_width, dst_height) > CRNLIB_RESAMPLER_MAX_DIMENSION))
+      return false;
+
+   if (!g_pResample_color_tables)
+      return false;
+
+   const resample_color_tables& tables = *g_pResample_color_tables;
+
+   const bool alpha = (flags & cCRNResampleFlagAlpha) != 0;
+   const bool linear = (flags & cCRNResampleFlagLinear) != 0;
+
+   crnlib::vector<vec4F> dst_image;
+   if (!dst_image.try_resize(dst_width * dst_height))
+      return false;
+
+   // Without worker threads, the rows are resampled by the calling thread
+   task_pool tp;
+   if ((g_number_of_processors > 1) && ((flags & cCRNResampleFlagNoThreads) == 0))
+      tp.init(math::minimum<uint>(g_number_of_processors, task_pool::cMaxThreads) - 1);
+
+   // The 8-bit pixels are converted to linear floats by the resampler, one source row at a time
+   threaded_resampler resampler(tp);
+   threaded_resampler::params params;
+   params.m_fmt = alpha ? threaded_resampler::cPF_RGBA_U8 : threaded_resampler::cPF_RGBX_U8;
+   params.m_pSrc_pixels = pSrc_pixels;
+   params.m_src_width = src_width;
+   params.m_src_height = src_height;
+   params.m_src_pitch = src_pitch;
+   params.m_pDst_pixels = dst_image.get_ptr();
+   params.m_dst_width = dst_width;
+   params.m_dst_height = dst_height;
+   params.m_dst_pitch = dst_width * sizeof(vec4F);
+   params.m_sample_low = 0.0f;
+   params.m_sample_high = 1.0f;
+   params.m_Pfilter_name = crn_get_mip_filter_name(filter);
+   params.m_pSrc_color_table = linear ? tables.m_unorm_to_float : tables.m_srgb_to_linear;
+   params.m_premultiply_alpha = alpha;
+
+   if (!resampler.resample(params))
+      return false;
+
+   for (uint y = 0; y < dst_height; y++)
+   {
+      const vec4F *pSrc = &dst_image[dst_width * y];
+      uint8 *pDst = static_cast<uint8*>(pDst_pixels) + (ptrdiff_t)dst_pitch * y;
+
+      for (uint x = 0; x < dst_width; x++, pSrc++, pDst += 4)
+      {
+         for (uint c = 0; c < 3; c++)
+            pDst[c] = linear ? static_cast<uint8>((*pSrc)[c] * 255.0f + .5f) : tables.linear_to_srgb((*pSrc)[c]);
+
+         pDst[3] = alpha ? static_cast<uint8>((*pSrc)[3] * 255.0f + .5f) : 255;
+      }
+   }
+
+   return true;
+}
+
 // Simple low-level DXTn 4x4 block compressor API.
 // Basically just a basic wrapper over the crnlib::dxt_image class.
 
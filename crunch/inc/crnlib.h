@@ -558,6 +558,68 @@ bool crn_decompress_dds_to_images(const void *pDDS_file_data, crn_uint32 dds_fil
 // Frees all images allocated by crn_decompress_dds_to_images().
 void crn_free_all_images(crn_uint32 **ppImages, const crn_texture_desc &desc);
 
+// Flags for crn_decompress_dds_to_buffer().
+enum crn_decomp_flags
+{
+   // Store the pixels as BGRA bytes in memory (the layout of a 32-bit Windows DIB) instead of RGBA.
+   cCRNDecompFlagBGRA = 1,
+
+   cCRNDecompFlagForceDWORD = 0xFFFFFFFF
+};
+
+// Selects the face and mipmap level decompressed by crn_decompress_dds_to_buffer().
+struct crn_decomp_level
+{
+   crn_uint32 m_face;
+   crn_uint32 m_level;        // Receives the selected level if m_target_size is not 0
+   crn_uint32 m_target_size;  // If not 0, selects the smallest level whose longer side is at least m_target_size
+   crn_uint32 m_width;        // Receive the dimensions of the decompressed level
+   crn_uint32 m_height;
+};
+
+// Called by crn_decompress_dds_to_buffer() once the DDS header has been read. Returns the address of the top scanline of the
+// destination buffer, which must hold level.m_height scanlines of level.m_width 32-bit pixels, or NULL to cancel the decompression.
+// pitch must be set to the distance in bytes between two consecutive scanlines. A negative pitch stores the image bottom-up.
+typedef void* (*crn_get_dst_buffer_func)(const crn_texture_desc &desc, const crn_decomp_level &level, crn_int32 &pitch, void *pUser_data);
+
+// Decompresses a single mipmap level of a single face of a DDS file directly into a buffer supplied by the caller.
+// pLevel selects the face and level, or the first level of the first face if NULL. Unlike crn_decompress_dds_to_images(),
+// the other levels and faces are skipped without being read or unpacked, and DXTn blocks are unpacked straight into the
+// destination. tex_desc describes the whole texture. flags is a combination of crn_decomp_flags.
+bool crn_decompress_dds_to_buffer(const void *pDDS_file_data, crn_uint32 dds_file_size, crn_uint32 flags, crn_decomp_level *pLevel,
+   crn_get_dst_buffer_func pGet_dst_buffer, void *pUser_data, crn_texture_desc &tex_desc);
+
+// Flags for crn_resample_image().
+enum crn_resample_flags
+{
+   // The fourth byte of each pixel is alpha. The colors are weighted by alpha while they are filtered, so transparent
+   // pixels don't darken their neighbors. Otherwise the fourth byte is ignored and set to 255 in the destination.
+   cCRNResampleFlagAlpha = 1,
+
+   // The color bytes are linear. Otherwise they are sRGB and are filtered in linear light.
+   cCRNResampleFlagLinear = 2,
+
+   // Resample the image in the calling thread only, for callers that process several images in parallel.
+   cCRNResampleFlagNoThreads = 4,
+
+   cCRNResampleFlagForceDWORD = 0xFFFFFFFF
+};
+
+// Creates the color conversion tables of crn_resample_image(). Must be called once before any thread resamples images.
+bool crn_init_resampler();
+
+// Frees the color conversion tables and the cached filter weights. Must not be called while images are resampled.
+void crn_free_resampler();
+
+// Resamples an image of 32-bit pixels to a new size using all processors, for example to create thumbnails. The byte order
+// of the color channels doesn't matter (RGBA or BGRA), but the fourth byte must be alpha. Negative pitches process bottom-up
+// images. The filter weights are cached for recently used sizes, so a batch of images with the same size is resampled faster.
+// flags is a combination of crn_resample_flags. Width and height must be between 1 and 16384. Fails unless
+// crn_init_resampler() has been called.
+bool crn_resample_image(const void *pSrc_pixels, crn_uint32 src_width, crn_uint32 src_height, crn_int32 src_pitch,
+   void *pDst_pixels, crn_uint32 dst_width, crn_uint32 dst_height, crn_int32 dst_pitch,
+   crn_uint32 flags = 0, crn_mip_filter filter = cCRNMipFilterLanczos4);
+
 // -------- crn_format related helpers functions.
 
 // Returns the FOURCC format equivalent to the specified crn_format.
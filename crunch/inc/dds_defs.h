@@ -33,6 +33,10 @@ namespace crnlib
 
       PIXEL_FMT_DXT1A                 = CRNLIB_PIXEL_FMT_FOURCC('D', 'X', '1', 'A'),
       PIXEL_FMT_ETC1                  = CRNLIB_PIXEL_FMT_FOURCC('E', 'T', 'C', '1'),
+      PIXEL_FMT_BC6H                  = CRNLIB_PIXEL_FMT_FOURCC('B', 'C', '6', 'H'), // DX10 only, decoded when loaded
+      PIXEL_FMT_BC7                   = CRNLIB_PIXEL_FMT_FOURCC('B', 'C', '7', 'U'), // DX10 only, decoded when loaded
+      PIXEL_FMT_FLOAT16               = CRNLIB_PIXEL_FMT_FOURCC('F', 'P', '1', '6'), // 1, 2 or 4 half floats, decoded when loaded
+      PIXEL_FMT_FLOAT32               = CRNLIB_PIXEL_FMT_FOURCC('F', 'P', '3', '2'), // 1 to 4 floats, decoded when loaded
 
       PIXEL_FMT_R8G8B8                = CRNLIB_PIXEL_FMT_FOURCC('R', 'G', 'B', 'x'),
       PIXEL_FMT_L8                    = CRNLIB_PIXEL_FMT_FOURCC('L', 'x', 'x', 'x'),
@@ -12,6 +12,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jsimd.h"
 
 
 #if RANGE_BITS < 2
@@ -695,7 +696,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       cconvert->pub.color_convert = gray_rgb_convert;
       break;
     case JCS_YCbCr:
-      cconvert->pub.color_convert = ycc_rgb_convert;
+      if (jsimd_can_ycc_rgb())
+	cconvert->pub.color_convert = jsimd_ycc_rgb_convert;
+      else
+	cconvert->pub.color_convert = ycc_rgb_convert;
       build_ycc_rgb_table(cinfo);
       break;
     case JCS_BG_YCC:
@@ -23,7 +23,7 @@
 
 /* Derived data constructed for each Huffman table */
 
-#define HUFF_LOOKAHEAD	8	/* # of bits of lookahead */
+#define HUFF_LOOKAHEAD	9	/* # of bits of lookahead */
 
 typedef struct {
   /* Basic tables: (element [0] of each array is unused) */
@@ -45,6 +45,14 @@ typedef struct {
    */
   int look_nbits[1<<HUFF_LOOKAHEAD]; /* # bits, or 0 if too long */
   UINT8 look_sym[1<<HUFF_LOOKAHEAD]; /* symbol, or unused */
+
+  /* Combined lookahead tables for AC tables: if the next Huffman code
+   * and its additional bits together are no more than HUFF_LOOKAHEAD
+   * bits long, we can obtain the run length, the total number of bits
+   * and the sign-extended coefficient value with a single lookup.
+   */
+  UINT8 look_ac_nbits[1<<HUFF_LOOKAHEAD]; /* run << 4 | # bits, or 0 */
+  INT16 look_ac_coef[1<<HUFF_LOOKAHEAD]; /* coefficient value, or unused */
 } d_derived_tbl;
 
 
@@ -66,14 +74,21 @@ typedef struct {
  * necessary.
  */
 
+#ifdef _WIN64
+typedef unsigned __int64 bit_buf_type;	/* type of bit-extraction buffer */
+#define BIT_BUF_SIZE  64		/* size of buffer in bits */
+#else
 typedef INT32 bit_buf_type;	/* type of bit-extraction buffer */
 #define BIT_BUF_SIZE  32	/* size of buffer in bits */
+#endif
 
 /* If long is > 32 bits on your machine, and shifting/masking longs is
  * reasonably fast, making bit_buf_type be long and setting BIT_BUF_SIZE
  * appropriately should be a win.  Unfortunately we can't define the size
  * with something like  #define BIT_BUF_SIZE (sizeof(bit_buf_type)*8)
  * because not all machines measure sizeof in 8-bit bytes.
+ * On 64-bit Windows we use a 64-bit buffer, which holds enough bits
+ * for a Huffman code and its additional bits after a single refill.
  */
 
 typedef struct {		/* Bitreading state saved across MCUs */
@@ -423,6 +438,32 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
     }
   }
 
+  /* Compute combined lookahead tables for AC coefficients.
+   * An entry is usable if the code is followed by all of its additional
+   * bits within the lookahead; EOB and ZRL codes are left to the normal
+   * lookahead tables.
+   */
+
+  MEMZERO(dtbl->look_ac_nbits, SIZEOF(dtbl->look_ac_nbits));
+
+  if (! isDC) {
+    for (lookbits = 0; lookbits < (1<<HUFF_LOOKAHEAD); lookbits++) {
+      int r, s, v;
+
+      l = dtbl->look_nbits[lookbits];
+      r = dtbl->look_sym[lookbits] >> 4;
+      s = dtbl->look_sym[lookbits] & 15;
+      if (l == 0 || s == 0 || l + s > HUFF_LOOKAHEAD)
+	continue;
+      /* Extract the additional bits and extend the sign (Figure F.12) */
+      v = (lookbits >> (HUFF_LOOKAHEAD - l - s)) & ((1 << s) - 1);
+      if (v < (1 << (s - 1)))
+	v -= (1 << s) - 1;
+      dtbl->look_ac_nbits[lookbits] = (UINT8) ((r << 4) | (l + s));
+      dtbl->look_ac_coef[lookbits] = (INT16) v;
+    }
+  }
+
   /* Validate symbols as being reasonable.
    * For AC tables, we make no check, but accept all byte values 0..255.
    * For DC tables, we require the symbols to be in range 0..15.
@@ -476,6 +517,23 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
   /* We fail to do so only if we hit a marker or are forced to suspend. */
 
   if (cinfo->unread_marker == 0) {	/* cannot advance past a marker */
+    /* Fast path: if the source buffer holds enough bytes for a complete
+     * refill, load bytes without checking for the end of the buffer until
+     * a 0xFF byte shows up, which is then handled by the loop below.
+     */
+    if (bytes_in_buffer >= BIT_BUF_SIZE / 8) {
+      while (bits_left < MIN_GET_BITS) {
+	register int c = GETJOCTET(*next_input_byte);
+
+	if (c == 0xFF)
+	  break;
+	next_input_byte++;
+	bytes_in_buffer--;
+	get_buffer = (get_buffer << 8) | c;
+	bits_left += 8;
+      }
+    }
+
     while (bits_left < MIN_GET_BITS) {
       register int c;
 
@@ -1195,6 +1253,188 @@ decode_mcu_sub (j_decompress_ptr cinfo, JBLOCKARRAY MCU_data)
 }
 
 
+/*
+ * Fast path for decode_mcu.
+ *
+ * If the source buffer is known to hold enough data for the worst case
+ * of a complete MCU, we need neither check for the end of the buffer nor
+ * prepare for suspension.  The bit buffer is then refilled in-line, and
+ * most AC coefficients are decoded together with their additional bits
+ * in a single table lookup.
+ *
+ * Markers and corrupt Huffman codes are not handled here.  If we hit one,
+ * we return FALSE without updating the permanent state, and decode_mcu
+ * decodes the MCU once more with the normal code.  Note that a marker
+ * is never consumed: the bytes in front of it are simply padded with
+ * zero bits, and the decoding results of this MCU are discarded anyway.
+ */
+
+/* Worst case of compressed data in a block: 64 Huffman codes of up to
+ * 16 bits plus up to 15 additional bits each, all bytes stuffed.
+ */
+#define DECODE_FAST_BYTES  (DCTSIZE2 * 8)
+
+#define FILL_BIT_BUFFER_FAST(nbits) \
+	{ if (bits_left < (nbits)) { \
+	    do { \
+	      register int c = GETJOCTET(*next_input_byte++); \
+	      if (c == 0xFF) { \
+		if (GETJOCTET(*next_input_byte) == 0) \
+		  next_input_byte++;	/* FF/00 represents an FF data byte */ \
+		else { \
+		  next_input_byte--;	/* leave the marker in the buffer */ \
+		  c = 0; \
+		  hit_marker = TRUE; \
+		} \
+	      } \
+	      get_buffer = (get_buffer << 8) | c; \
+	      bits_left += 8; \
+	    } while (bits_left < MIN_GET_BITS); } }
+
+/* Up to 17 bits are needed to detect a corrupt Huffman code. */
+
+#define HUFF_DECODE_FAST(result,htbl) \
+{ register int nb, look; \
+  FILL_BIT_BUFFER_FAST(17); \
+  look = PEEK_BITS(HUFF_LOOKAHEAD); \
+  if ((nb = htbl->look_nbits[look]) != 0) { \
+    DROP_BITS(nb); \
+    result = htbl->look_sym[look]; \
+  } else { \
+    register INT32 code; \
+    nb = HUFF_LOOKAHEAD+1; \
+    code = GET_BITS(nb); \
+    while (code > htbl->maxcode[nb]) { \
+      code <<= 1; \
+      code |= GET_BITS(1); \
+      nb++; \
+    } \
+    if (nb > 16) \
+      goto Fail; \
+    result = htbl->pub->huffval[ (int) (code + htbl->valoffset[nb]) ]; \
+  } \
+}
+
+
+LOCAL(boolean)
+decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKARRAY MCU_data)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  register bit_buf_type get_buffer = entropy->bitstate.get_buffer;
+  register int bits_left = entropy->bitstate.bits_left;
+  const JOCTET * next_input_byte = cinfo->src->next_input_byte;
+  boolean hit_marker = FALSE;
+  savable_state state;
+  int blkn;
+
+  ASSIGN_STATE(state, entropy->saved);
+
+  /* Outer loop handles each block in the MCU */
+
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+    JBLOCKROW block = MCU_data[blkn];
+    d_derived_tbl * htbl;
+    register int s, k, r;
+    int coef_limit, ci, look;
+
+    /* Section F.2.2.1: decode the DC coefficient difference */
+    htbl = entropy->dc_cur_tbls[blkn];
+    HUFF_DECODE_FAST(s, htbl);
+
+    htbl = entropy->ac_cur_tbls[blkn];
+    k = 1;
+    coef_limit = entropy->coef_limit[blkn];
+    if (coef_limit) {
+      /* Convert DC difference to actual value, update last_dc_val */
+      if (s) {
+	FILL_BIT_BUFFER_FAST(s);
+	r = GET_BITS(s);
+	s = HUFF_EXTEND(r, s);
+      }
+      ci = cinfo->MCU_membership[blkn];
+      s += state.last_dc_val[ci];
+      state.last_dc_val[ci] = s;
+      /* Output the DC coefficient */
+      (*block)[0] = (JCOEF) s;
+
+      /* Section F.2.2.2: decode the AC coefficients */
+      for (; k < coef_limit; k++) {
+	FILL_BIT_BUFFER_FAST(17);
+	look = PEEK_BITS(HUFF_LOOKAHEAD);
+	if ((r = htbl->look_ac_nbits[look]) != 0) {
+	  /* Code and additional bits in one lookup */
+	  k += r >> 4;
+	  DROP_BITS(r & 15);
+	  (*block)[jpeg_natural_order[k]] = (JCOEF) htbl->look_ac_coef[look];
+	  continue;
+	}
+
+	HUFF_DECODE_FAST(s, htbl);
+
+	r = s >> 4;
+	s &= 15;
+
+	if (s) {
+	  k += r;
+	  FILL_BIT_BUFFER_FAST(s);
+	  r = GET_BITS(s);
+	  s = HUFF_EXTEND(r, s);
+	  (*block)[jpeg_natural_order[k]] = (JCOEF) s;
+	} else {
+	  if (r != 15)
+	    goto EndOfBlock;
+	  k += 15;
+	}
+      }
+    } else {
+      if (s) {
+	FILL_BIT_BUFFER_FAST(s);
+	DROP_BITS(s);
+      }
+    }
+
+    /* In this path we just discard the values */
+    for (; k < DCTSIZE2; k++) {
+      HUFF_DECODE_FAST(s, htbl);
+
+      r = s >> 4;
+      s &= 15;
+
+      if (s) {
+	k += r;
+	FILL_BIT_BUFFER_FAST(s);
+	DROP_BITS(s);
+      } else {
+	if (r != 15)
+	  break;
+	k += 15;
+      }
+    }
+
+    EndOfBlock: ;
+  }
+
+  if (hit_marker)
+    goto Fail;
+
+  /* Completed MCU, so update state */
+  cinfo->src->bytes_in_buffer -= next_input_byte - cinfo->src->next_input_byte;
+  cinfo->src->next_input_byte = next_input_byte;
+  entropy->bitstate.get_buffer = get_buffer;
+  entropy->bitstate.bits_left = bits_left;
+  ASSIGN_STATE(entropy->saved, state);
+
+  return TRUE;
+
+Fail:
+  /* Clear the output area again for the normal code */
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+    MEMZERO(MCU_data[blkn], SIZEOF(JBLOCK));
+
+  return FALSE;
+}
+
+
 /*
  * Decode one MCU's worth of Huffman-compressed coefficients,
  * full-size blocks.
@@ -1217,8 +1457,14 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKARRAY MCU_data)
 
   /* If we've run out of data, just leave the MCU set to zeroes.
    * This way, we return uniform gray for the remainder of the segment.
+   * Otherwise use the fast path if the source buffer holds enough data,
+   * and fall back to the normal code if the fast path cannot finish.
    */
-  if (! entropy->insufficient_data) {
+  if (! entropy->insufficient_data &&
+      ! (cinfo->unread_marker == 0 &&
+	 cinfo->src->bytes_in_buffer >= (size_t) cinfo->blocks_in_MCU *
+					DECODE_FAST_BYTES + BIT_BUF_SIZE / 8 &&
+	 decode_mcu_fast(cinfo, MCU_data))) {
 
     /* Load up working state */
     BITREAD_LOAD_STATE(cinfo, entropy->bitstate);
@@ -0,0 +1,656 @@
+/*
+ * jsimd.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 versions of the decompression inner loops that
+ * dominate the decoding time of typical baseline images:
+ *	the accurate integer IDCT (jidctint.c, 8x8 only),
+ *	YCbCr => RGB color conversion (jdcolor.c, sYCC only),
+ *	2h2v upsampling by replication (jdsample.c),
+ *	merged 2h2v upsampling and color conversion (jdmerge.c).
+ * Each routine is selected at runtime by the corresponding module if the
+ * jsimd_can_xxx function returns TRUE, otherwise the C code is used.
+ *
+ * The SIMD routines perform exactly the same integer arithmetic as the
+ * C code, including the wraparound of 32-bit products, and therefore give
+ * bit-exact the same output.  SSE2 has no 32-bit multiply, so products of
+ * 32-bit values and 16-bit constants are assembled from the low and high
+ * halves of 16-bit multiplications (see MULTIPLY_SSE2).
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define JSIMD_SSE2_SUPPORTED
+#endif
+
+/* The SIMD code is written for the default 8-bit configuration only. */
+
+#if BITS_IN_JSAMPLE != 8 || DCTSIZE != 8
+#undef JSIMD_SSE2_SUPPORTED
+#endif
+
+#if RGB_RED != 2 || RGB_GREEN != 1 || RGB_BLUE != 0 || RGB_PIXELSIZE != 3
+#define JSIMD_NO_COLOR		/* the color routines store BGR triplets */
+#endif
+
+#ifdef JSIMD_SSE2_SUPPORTED
+
+#include <intrin.h>
+#include <emmintrin.h>
+
+
+/*
+ * Check once whether the CPU supports SSE2.
+ */
+
+LOCAL(boolean)
+jsimd_has_sse2 (void)
+{
+#ifdef _M_X64
+  return TRUE;			/* SSE2 is part of the x64 architecture */
+#else
+  static int sse2_state = -1;	/* -1 = not yet checked */
+  int cpu_info[4];
+
+  if (sse2_state < 0) {
+    __cpuid(cpu_info, 1);
+    sse2_state = (cpu_info[3] & (1 << 26)) ? 1 : 0;
+  }
+  return sse2_state ? TRUE : FALSE;
+#endif
+}
+
+
+/*
+ * Multiply each 32-bit element of x by a 16-bit unsigned value which is
+ * replicated into both halves of the corresponding element of c.
+ * The result equals the low 32 bits of the full product, just like the
+ * 32-bit int multiplication of the C code.
+ */
+
+#define MULTIPLY_SSE2(x,c) \
+  _mm_add_epi32(_mm_mullo_epi16(x, c), \
+		_mm_slli_epi32(_mm_mulhi_epu16(x, c), 16))
+
+#define CONST_SSE2(k)  _mm_set1_epi16((short) (k))
+
+/* Transpose a 4x4 matrix of 32-bit elements held in four registers. */
+
+#define TRANSPOSE4_SSE2(a,b,c,d) { \
+  __m128i t0 = _mm_unpacklo_epi32(a, b); \
+  __m128i t1 = _mm_unpacklo_epi32(c, d); \
+  __m128i t2 = _mm_unpackhi_epi32(a, b); \
+  __m128i t3 = _mm_unpackhi_epi32(c, d); \
+  a = _mm_unpacklo_epi64(t0, t1); \
+  b = _mm_unpackhi_epi64(t0, t1); \
+  c = _mm_unpacklo_epi64(t2, t3); \
+  d = _mm_unpackhi_epi64(t2, t3); }
+
+
+/**************** Accurate integer IDCT (see jidctint.c) ****************/
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+
+/*
+ * One-dimensional 8-point IDCT on four columns (or rows) at a time.
+ * On entry, d[0] and d[4] must already be scaled up by CONST_BITS
+ * (including any fudge factor); d[1..3] and d[5..7] are unscaled.
+ * On exit, d[0..7] hold the outputs before the final descaling.
+ */
+
+LOCAL(void)
+idct_1d_sse2 (__m128i * d)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z1, z2, z3;
+
+  /* Even part */
+
+  tmp0 = _mm_add_epi32(d[0], d[4]);
+  tmp1 = _mm_sub_epi32(d[0], d[4]);
+
+  z2 = d[2];
+  z3 = d[6];
+
+  z1 = MULTIPLY_SSE2(_mm_add_epi32(z2, z3), CONST_SSE2(FIX_0_541196100));
+  tmp2 = _mm_add_epi32(z1, MULTIPLY_SSE2(z2, CONST_SSE2(FIX_0_765366865)));
+  tmp3 = _mm_sub_epi32(z1, MULTIPLY_SSE2(z3, CONST_SSE2(FIX_1_847759065)));
+
+  tmp10 = _mm_add_epi32(tmp0, tmp2);
+  tmp13 = _mm_sub_epi32(tmp0, tmp2);
+  tmp11 = _mm_add_epi32(tmp1, tmp3);
+  tmp12 = _mm_sub_epi32(tmp1, tmp3);
+
+  /* Odd part */
+
+  tmp0 = d[7];
+  tmp1 = d[5];
+  tmp2 = d[3];
+  tmp3 = d[1];
+
+  z2 = _mm_add_epi32(tmp0, tmp2);
+  z3 = _mm_add_epi32(tmp1, tmp3);
+
+  z1 = MULTIPLY_SSE2(_mm_add_epi32(z2, z3), CONST_SSE2(FIX_1_175875602));
+  z2 = _mm_sub_epi32(z1, MULTIPLY_SSE2(z2, CONST_SSE2(FIX_1_961570560)));
+  z3 = _mm_sub_epi32(z1, MULTIPLY_SSE2(z3, CONST_SSE2(FIX_0_390180644)));
+
+  z1 = MULTIPLY_SSE2(_mm_add_epi32(tmp0, tmp3), CONST_SSE2(FIX_0_899976223));
+  tmp0 = MULTIPLY_SSE2(tmp0, CONST_SSE2(FIX_0_298631336));
+  tmp3 = MULTIPLY_SSE2(tmp3, CONST_SSE2(FIX_1_501321110));
+  tmp0 = _mm_add_epi32(_mm_sub_epi32(tmp0, z1), z2);
+  tmp3 = _mm_add_epi32(_mm_sub_epi32(tmp3, z1), z3);
+
+  z1 = MULTIPLY_SSE2(_mm_add_epi32(tmp1, tmp2), CONST_SSE2(FIX_2_562915447));
+  tmp1 = MULTIPLY_SSE2(tmp1, CONST_SSE2(FIX_2_053119869));
+  tmp2 = MULTIPLY_SSE2(tmp2, CONST_SSE2(FIX_3_072711026));
+  tmp1 = _mm_add_epi32(_mm_sub_epi32(tmp1, z1), z3);
+  tmp2 = _mm_add_epi32(_mm_sub_epi32(tmp2, z1), z2);
+
+  /* Final output stage */
+
+  d[0] = _mm_add_epi32(tmp10, tmp3);
+  d[7] = _mm_sub_epi32(tmp10, tmp3);
+  d[1] = _mm_add_epi32(tmp11, tmp2);
+  d[6] = _mm_sub_epi32(tmp11, tmp2);
+  d[2] = _mm_add_epi32(tmp12, tmp1);
+  d[5] = _mm_sub_epi32(tmp12, tmp1);
+  d[3] = _mm_add_epi32(tmp13, tmp0);
+  d[4] = _mm_sub_epi32(tmp13, tmp0);
+}
+
+
+/*
+ * Pass 2 and output for four rows of the work array, given in transposed
+ * form (ws[k] holds column k of the four rows).  Rows whose AC terms are
+ * all zero take the DC shortcut of the C code, which gives the same result
+ * unless the full calculation would overflow.
+ */
+
+LOCAL(void)
+idct_rows_sse2 (__m128i * ws, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i d[8];
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask = _mm_set1_epi32(RANGE_MASK);
+  __m128i subset = _mm_set1_epi32(RANGE_SUBSET);
+  __m128i z2, ac, dcval;
+  int k;
+
+  /* Add range center and fudge factor for final descale and range-limit. */
+  z2 = _mm_add_epi32(ws[0],
+    _mm_set1_epi32((RANGE_CENTER << (PASS1_BITS+3)) + (1 << (PASS1_BITS+2))));
+
+  ac = _mm_or_si128(_mm_or_si128(ws[1], ws[2]), _mm_or_si128(ws[3], ws[4]));
+  ac = _mm_or_si128(ac, _mm_or_si128(_mm_or_si128(ws[5], ws[6]), ws[7]));
+  ac = _mm_cmpeq_epi32(ac, zero);	/* all ones for rows without AC terms */
+  dcval = _mm_and_si128(_mm_srai_epi32(z2, PASS1_BITS+3), mask);
+
+  d[0] = _mm_slli_epi32(z2, CONST_BITS);
+  d[4] = _mm_slli_epi32(ws[4], CONST_BITS);
+  d[1] = ws[1];
+  d[2] = ws[2];
+  d[3] = ws[3];
+  d[5] = ws[5];
+  d[6] = ws[6];
+  d[7] = ws[7];
+  idct_1d_sse2(d);
+
+  /* The range_limit table maps the masked value x to x - RANGE_SUBSET,
+   * clamped to 0..MAXJSAMPLE; the clamping is done by the packing below.
+   */
+  for (k = 0; k < DCTSIZE; k++) {
+    d[k] = _mm_and_si128(_mm_srai_epi32(d[k], CONST_BITS+PASS1_BITS+3), mask);
+    d[k] = _mm_or_si128(_mm_and_si128(ac, dcval), _mm_andnot_si128(ac, d[k]));
+    d[k] = _mm_sub_epi32(d[k], subset);
+  }
+
+  /* Transpose back to rows and store 8 samples per row */
+  TRANSPOSE4_SSE2(d[0], d[1], d[2], d[3]);
+  TRANSPOSE4_SSE2(d[4], d[5], d[6], d[7]);
+  for (k = 0; k < 4; k++) {
+    __m128i row = _mm_packs_epi32(d[k], d[k+4]);
+    _mm_storel_epi64((__m128i *) (output_buf[k] + output_col),
+		     _mm_packus_epi16(row, row));
+  }
+}
+
+
+GLOBAL(void)
+jsimd_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		  JCOEFPTR coef_block,
+		  JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m128i coef[DCTSIZE], ws[2][DCTSIZE], d[DCTSIZE];
+  __m128i zero = _mm_setzero_si128();
+  __m128i ac, acmask, dcval;
+  int half, k;
+
+  for (k = 0; k < DCTSIZE; k++)
+    coef[k] = _mm_loadu_si128((__m128i *) (coef_block + k * DCTSIZE));
+
+  /* Columns whose AC terms are all zero take the DC shortcut. */
+  ac = _mm_or_si128(_mm_or_si128(coef[1], coef[2]),
+		    _mm_or_si128(coef[3], coef[4]));
+  ac = _mm_or_si128(ac, _mm_or_si128(_mm_or_si128(coef[5], coef[6]), coef[7]));
+  ac = _mm_cmpeq_epi16(ac, zero);
+
+  /* Pass 1: process columns 0..3 and 4..7 from input, store into work array.
+   * Each register holds one row of four columns, so no transposition is
+   * needed for this pass.
+   */
+
+  for (half = 0; half < 2; half++) {
+    for (k = 0; k < DCTSIZE; k++) {
+      __m128i q, c;
+
+      /* Sign-extend the coefficients to 32 bits */
+      c = half ? _mm_unpackhi_epi16(coef[k], coef[k])
+	       : _mm_unpacklo_epi16(coef[k], coef[k]);
+      c = _mm_srai_epi32(c, 16);
+      /* Replicate the quantization values into both 16-bit halves */
+      q = _mm_loadu_si128((__m128i *) (quantptr + k * DCTSIZE + half * 4));
+      q = _mm_or_si128(q, _mm_slli_epi32(q, 16));
+      d[k] = MULTIPLY_SSE2(c, q);	/* DEQUANTIZE */
+    }
+
+    acmask = half ? _mm_unpackhi_epi16(ac, ac) : _mm_unpacklo_epi16(ac, ac);
+    dcval = _mm_slli_epi32(d[0], PASS1_BITS);
+
+    /* Add fudge factor here for final descale. */
+    d[0] = _mm_add_epi32(_mm_slli_epi32(d[0], CONST_BITS),
+			 _mm_set1_epi32(1 << (CONST_BITS-PASS1_BITS-1)));
+    d[4] = _mm_slli_epi32(d[4], CONST_BITS);
+    idct_1d_sse2(d);
+
+    for (k = 0; k < DCTSIZE; k++) {
+      d[k] = _mm_srai_epi32(d[k], CONST_BITS-PASS1_BITS);
+      ws[half][k] = _mm_or_si128(_mm_and_si128(acmask, dcval),
+				 _mm_andnot_si128(acmask, d[k]));
+    }
+  }
+
+  /* Pass 2: process rows 0..3 and 4..7 from work array, store into output
+   * array.  The four 4x4 quarters of the work array are transposed so that
+   * each register holds one column of four rows.
+   */
+
+  for (half = 0; half < 2; half++) {
+    __m128i * w0 = ws[0] + half * 4;	/* columns 0..3 of rows */
+    __m128i * w1 = ws[1] + half * 4;	/* columns 4..7 of rows */
+
+    d[0] = w0[0]; d[1] = w0[1]; d[2] = w0[2]; d[3] = w0[3];
+    d[4] = w1[0]; d[5] = w1[1]; d[6] = w1[2]; d[7] = w1[3];
+    TRANSPOSE4_SSE2(d[0], d[1], d[2], d[3]);
+    TRANSPOSE4_SSE2(d[4], d[5], d[6], d[7]);
+    idct_rows_sse2(d, output_buf + half * 4, output_col);
+  }
+}
+
+
+/**************** YCbCr => RGB conversion (see jdcolor.c) ****************/
+
+#define SCALEBITS	16
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+#undef  FIX		/* jdct.h defines FIX with CONST_SCALE for the IDCT */
+#define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
+
+/*
+ * The constants FIX(1.402) = 91881, FIX(1.772) = 116130 and
+ * FIX(0.714136286) = 46802 do not fit into 16 bits.  They are split into
+ * a multiple of 2^16, which is added as a multiple of the input after the
+ * descaling, and a 16-bit remainder for _mm_madd_epi16:
+ *	Cr=>R:  91881 * x =  26345 * x + 1 * 65536 * x
+ *	Cb=>B: 116130 * x = -14942 * x + 2 * 65536 * x
+ *	Cr=>G: -46802 * x =  18734 * x - 1 * 65536 * x
+ * The rounding constant ONE_HALF is formed by pairing the input with the
+ * value 2 and multiplying it by 16384.
+ */
+
+LOCAL(void)
+ycc_rgb_chroma_sse2 (__m128i cb, __m128i cr,
+		     __m128i * cred, __m128i * cgreen, __m128i * cblue)
+/* Compute the chroma terms for eight Cb/Cr pairs given as 16-bit values */
+{
+  __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+  __m128i two = _mm_set1_epi16(2);
+  __m128i k_r = _mm_set_epi16(16384, 26345, 16384, 26345,
+			      16384, 26345, 16384, 26345);
+  __m128i k_b = _mm_set_epi16(16384, -14942, 16384, -14942,
+			      16384, -14942, 16384, -14942);
+  __m128i k_g = _mm_set_epi16(18734, -22553, 18734, -22553,
+			      18734, -22553, 18734, -22553);
+  __m128i half = _mm_set1_epi32(ONE_HALF);
+  __m128i lo, hi;
+
+  cb = _mm_sub_epi16(cb, center);
+  cr = _mm_sub_epi16(cr, center);
+
+  lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cr, two), k_r), SCALEBITS);
+  hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cr, two), k_r), SCALEBITS);
+  *cred = _mm_add_epi16(_mm_packs_epi32(lo, hi), cr);
+
+  lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb, two), k_b), SCALEBITS);
+  hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb, two), k_b), SCALEBITS);
+  *cblue = _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_add_epi16(cb, cb));
+
+  lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), k_g), half);
+  hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), k_g), half);
+  lo = _mm_srai_epi32(lo, SCALEBITS);
+  hi = _mm_srai_epi32(hi, SCALEBITS);
+  *cgreen = _mm_sub_epi16(_mm_packs_epi32(lo, hi), cr);
+}
+
+
+LOCAL(void)
+store_bgr_sse2 (JSAMPROW outptr, __m128i b, __m128i g, __m128i r)
+/* Store 16 pixels as 48 bytes of BGR triplets */
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask_px = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+  __m128i mask_px2 = _mm_set_epi32(0x00FFFFFF, 0, 0x00FFFFFF, 0);
+  __m128i mask_lo = _mm_set_epi32(0, 0, 0x0000FFFF, 0xFFFFFFFF);
+  __m128i bg, r0, p[4];
+  int i;
+
+  bg = _mm_unpacklo_epi8(b, g);
+  r0 = _mm_unpacklo_epi8(r, zero);
+  p[0] = _mm_unpacklo_epi16(bg, r0);
+  p[1] = _mm_unpackhi_epi16(bg, r0);
+  bg = _mm_unpackhi_epi8(b, g);
+  r0 = _mm_unpackhi_epi8(r, zero);
+  p[2] = _mm_unpacklo_epi16(bg, r0);
+  p[3] = _mm_unpackhi_epi16(bg, r0);
+
+  /* Squeeze each group of four BGR0 pixels into 12 bytes */
+  for (i = 0; i < 4; i++) {
+    __m128i v = _mm_or_si128(_mm_and_si128(p[i], mask_px),
+			     _mm_srli_epi64(_mm_and_si128(p[i], mask_px2), 8));
+    p[i] = _mm_or_si128(_mm_and_si128(v, mask_lo),
+			_mm_srli_si128(_mm_andnot_si128(mask_lo, v), 2));
+  }
+
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_or_si128(p[0], _mm_slli_si128(p[1], 12)));
+  _mm_storeu_si128((__m128i *) (outptr + 16),
+		   _mm_or_si128(_mm_srli_si128(p[1], 4), _mm_slli_si128(p[2], 8)));
+  _mm_storeu_si128((__m128i *) (outptr + 32),
+		   _mm_or_si128(_mm_srli_si128(p[2], 8), _mm_slli_si128(p[3], 4)));
+}
+
+
+LOCAL(void)
+ycc_rgb_pixel (JSAMPROW outptr, JSAMPLE * range_limit, int y, int cb, int cr)
+/* Convert a single pixel exactly like the table-driven C code */
+{
+  SHIFT_TEMPS
+
+  cb -= CENTERJSAMPLE;
+  cr -= CENTERJSAMPLE;
+  outptr[RGB_RED]   = range_limit[y + (int) DESCALE(FIX(1.402) * cr, SCALEBITS)];
+  outptr[RGB_GREEN] = range_limit[y + (int) RIGHT_SHIFT((- FIX(0.344136286)) *
+    cb + ONE_HALF + (- FIX(0.714136286)) * cr, SCALEBITS)];
+  outptr[RGB_BLUE]  = range_limit[y + (int) DESCALE(FIX(1.772) * cb, SCALEBITS)];
+}
+
+
+GLOBAL(void)
+jsimd_ycc_rgb_convert (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+{
+  JSAMPROW outptr;
+  JSAMPROW inptr0, inptr1, inptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+  JSAMPLE * range_limit = cinfo->sample_range_limit;
+  __m128i zero = _mm_setzero_si128();
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      __m128i y  = _mm_loadu_si128((__m128i *) (inptr0 + col));
+      __m128i cb = _mm_loadu_si128((__m128i *) (inptr1 + col));
+      __m128i cr = _mm_loadu_si128((__m128i *) (inptr2 + col));
+      __m128i ylo = _mm_unpacklo_epi8(y, zero);
+      __m128i yhi = _mm_unpackhi_epi8(y, zero);
+      __m128i rlo, glo, blo, rhi, ghi, bhi;
+
+      ycc_rgb_chroma_sse2(_mm_unpacklo_epi8(cb, zero),
+			  _mm_unpacklo_epi8(cr, zero), &rlo, &glo, &blo);
+      ycc_rgb_chroma_sse2(_mm_unpackhi_epi8(cb, zero),
+			  _mm_unpackhi_epi8(cr, zero), &rhi, &ghi, &bhi);
+      /* Saturation does the range-limiting */
+      store_bgr_sse2(outptr,
+	_mm_packus_epi16(_mm_add_epi16(ylo, blo), _mm_add_epi16(yhi, bhi)),
+	_mm_packus_epi16(_mm_add_epi16(ylo, glo), _mm_add_epi16(yhi, ghi)),
+	_mm_packus_epi16(_mm_add_epi16(ylo, rlo), _mm_add_epi16(yhi, rhi)));
+      outptr += 16 * RGB_PIXELSIZE;
+    }
+    for (; col < num_cols; col++) {
+      ycc_rgb_pixel(outptr, range_limit, GETJSAMPLE(inptr0[col]),
+		    GETJSAMPLE(inptr1[col]), GETJSAMPLE(inptr2[col]));
+      outptr += RGB_PIXELSIZE;
+    }
+  }
+}
+
+
+/**************** 2h2v upsampling (see jdsample.c) ****************/
+
+GLOBAL(void)
+jsimd_h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPIMAGE output_data_ptr)
+{
+  JSAMPARRAY output_data, output_end;
+  JSAMPROW inptr, outptr;
+  JSAMPLE invalue;
+  JSAMPROW outend;
+
+  output_data = *output_data_ptr;
+  output_end = output_data + cinfo->max_v_samp_factor;
+  for (; output_data < output_end; output_data += 2) {
+    inptr = *input_data++;
+    outptr = *output_data;
+    outend = outptr + cinfo->output_width;
+    while (outend - outptr >= 32) {
+      __m128i v = _mm_loadu_si128((__m128i *) inptr);
+      _mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi8(v, v));
+      _mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi8(v, v));
+      inptr += 16;
+      outptr += 32;
+    }
+    while (outptr < outend) {
+      invalue = *inptr++;
+      *outptr++ = invalue;
+      *outptr++ = invalue;
+    }
+    jcopy_sample_rows(output_data, output_data + 1,
+		      1, cinfo->output_width);
+  }
+}
+
+
+/**************** Merged 2h2v upsampling (see jdmerge.c) ****************/
+
+GLOBAL(void)
+jsimd_h2v2_merged_upsample (j_decompress_ptr cinfo,
+			    JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			    JSAMPARRAY output_buf)
+{
+  JSAMPROW outptr0, outptr1;
+  JSAMPROW inptr00, inptr01, inptr1, inptr2;
+  JDIMENSION col;
+  JSAMPLE * range_limit = cinfo->sample_range_limit;
+  __m128i zero = _mm_setzero_si128();
+
+  inptr00 = input_buf[0][in_row_group_ctr*2];
+  inptr01 = input_buf[0][in_row_group_ctr*2 + 1];
+  inptr1 = input_buf[1][in_row_group_ctr];
+  inptr2 = input_buf[2][in_row_group_ctr];
+  outptr0 = output_buf[0];
+  outptr1 = output_buf[1];
+  /* Each group of 8 chroma samples yields 16 pixels in each of two rows */
+  for (col = 0; col + 16 <= cinfo->output_width; col += 16) {
+    __m128i cb = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) inptr1), zero);
+    __m128i cr = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) inptr2), zero);
+    __m128i cred, cgreen, cblue;
+    __m128i rlo, glo, blo, rhi, ghi, bhi;
+    __m128i y, ylo, yhi;
+
+    ycc_rgb_chroma_sse2(cb, cr, &cred, &cgreen, &cblue);
+    rlo = _mm_unpacklo_epi16(cred, cred);
+    rhi = _mm_unpackhi_epi16(cred, cred);
+    glo = _mm_unpacklo_epi16(cgreen, cgreen);
+    ghi = _mm_unpackhi_epi16(cgreen, cgreen);
+    blo = _mm_unpacklo_epi16(cblue, cblue);
+    bhi = _mm_unpackhi_epi16(cblue, cblue);
+
+    y = _mm_loadu_si128((__m128i *) inptr00);
+    ylo = _mm_unpacklo_epi8(y, zero);
+    yhi = _mm_unpackhi_epi8(y, zero);
+    store_bgr_sse2(outptr0,
+      _mm_packus_epi16(_mm_add_epi16(ylo, blo), _mm_add_epi16(yhi, bhi)),
+      _mm_packus_epi16(_mm_add_epi16(ylo, glo), _mm_add_epi16(yhi, ghi)),
+      _mm_packus_epi16(_mm_add_epi16(ylo, rlo), _mm_add_epi16(yhi, rhi)));
+
+    y = _mm_loadu_si128((__m128i *) inptr01);
+    ylo = _mm_unpacklo_epi8(y, zero);
+    yhi = _mm_unpackhi_epi8(y, zero);
+    store_bgr_sse2(outptr1,
+      _mm_packus_epi16(_mm_add_epi16(ylo, blo), _mm_add_epi16(yhi, bhi)),
+      _mm_packus_epi16(_mm_add_epi16(ylo, glo), _mm_add_epi16(yhi, ghi)),
+      _mm_packus_epi16(_mm_add_epi16(ylo, rlo), _mm_add_epi16(yhi, rhi)));
+
+    inptr00 += 16;
+    inptr01 += 16;
+    inptr1 += 8;
+    inptr2 += 8;
+    outptr0 += 16 * RGB_PIXELSIZE;
+    outptr1 += 16 * RGB_PIXELSIZE;
+  }
+  /* Remaining pixels, including an odd last column */
+  for (; col < cinfo->output_width; col++) {
+    int cb = GETJSAMPLE(*inptr1);
+    int cr = GETJSAMPLE(*inptr2);
+
+    ycc_rgb_pixel(outptr0, range_limit, GETJSAMPLE(*inptr00++), cb, cr);
+    ycc_rgb_pixel(outptr1, range_limit, GETJSAMPLE(*inptr01++), cb, cr);
+    outptr0 += RGB_PIXELSIZE;
+    outptr1 += RGB_PIXELSIZE;
+    if (col & 1) {
+      inptr1++;
+      inptr2++;
+    }
+  }
+}
+
+#else /* ! JSIMD_SSE2_SUPPORTED */
+
+/* Never called, because the jsimd_can_xxx functions return FALSE. */
+
+GLOBAL(void)
+jsimd_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		  JCOEFPTR coef_block,
+		  JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+}
+
+GLOBAL(void)
+jsimd_ycc_rgb_convert (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPIMAGE output_data_ptr)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v2_merged_upsample (j_decompress_ptr cinfo,
+			    JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			    JSAMPARRAY output_buf)
+{
+}
+
+#endif /* JSIMD_SSE2_SUPPORTED */
+
+
+/*
+ * Runtime selection.  The modules must not call the jsimd_xxx routines
+ * unless the corresponding jsimd_can_xxx function returned TRUE.
+ */
+
+GLOBAL(boolean)
+jsimd_can_idct_islow (void)
+{
+#ifdef JSIMD_SSE2_SUPPORTED
+  if (SIZEOF(JCOEF) == 2 && SIZEOF(ISLOW_MULT_TYPE) == 4)
+    return jsimd_has_sse2();
+#endif
+  return FALSE;
+}
+
+
+GLOBAL(boolean)
+jsimd_can_ycc_rgb (void)
+{
+#if defined(JSIMD_SSE2_SUPPORTED) && !defined(JSIMD_NO_COLOR)
+  return jsimd_has_sse2();
+#else
+  return FALSE;
+#endif
+}
+
+
+GLOBAL(boolean)
+jsimd_can_h2v2_upsample (void)
+{
+#ifdef JSIMD_SSE2_SUPPORTED
+  return jsimd_has_sse2();
+#else
+  return FALSE;
+#endif
+}
+
+
+GLOBAL(boolean)
+jsimd_can_h2v2_merged_upsample (void)
+{
+#if defined(JSIMD_SSE2_SUPPORTED) && !defined(JSIMD_NO_COLOR)
+  return jsimd_has_sse2();
+#else
+  return FALSE;
+#endif
+}
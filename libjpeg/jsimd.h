@@ -0,0 +1,45 @@
+/*
+ * jsimd.h
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This include file contains declarations for the SIMD versions of the
+ * decompression inner loops in jsimd.c.  The jsimd_can_xxx functions check
+ * at runtime whether the CPU and the build configuration allow the use of
+ * the corresponding SIMD routine; otherwise the portable C code is used.
+ * The SIMD routines produce bit-exact the same results as the C code.
+ */
+
+
+/* Short forms of external names for systems with brain-damaged linkers. */
+
+#ifdef NEED_SHORT_EXTERNAL_NAMES
+#define jsimd_can_idct_islow		jSCislow
+#define jsimd_can_ycc_rgb		jSCycc
+#define jsimd_can_h2v2_upsample		jSCh2v2
+#define jsimd_can_h2v2_merged_upsample	jSCmh2v2
+#define jsimd_idct_islow		jSislow
+#define jsimd_ycc_rgb_convert		jSycc
+#define jsimd_h2v2_upsample		jSh2v2
+#define jsimd_h2v2_merged_upsample	jSmh2v2
+#endif /* NEED_SHORT_EXTERNAL_NAMES */
+
+
+EXTERN(boolean) jsimd_can_idct_islow JPP((void));
+EXTERN(boolean) jsimd_can_ycc_rgb JPP((void));
+EXTERN(boolean) jsimd_can_h2v2_upsample JPP((void));
+EXTERN(boolean) jsimd_can_h2v2_merged_upsample JPP((void));
+
+EXTERN(void) jsimd_idct_islow
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jsimd_ycc_rgb_convert
+    JPP((j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+	 JSAMPARRAY output_buf, int num_rows));
+EXTERN(void) jsimd_h2v2_upsample
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JSAMPARRAY input_data, JSAMPIMAGE output_data_ptr));
+EXTERN(void) jsimd_h2v2_merged_upsample
+    JPP((j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+	 JDIMENSION in_row_group_ctr, JSAMPARRAY output_buf));